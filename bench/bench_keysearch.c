@@ -0,0 +1,85 @@
+// Compares the node key search kernels across node sizes.
+// Build with -DBUILD_BENCHMARKS=ON and run ./bench_keysearch [lookups]
+#include "keysearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_KEYS 8192
+
+static const uint32_t node_sizes[] = { 8, 16, 30, 64, 128, 203, 256, 512, 1024, 2048, 4096, 8192 };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*state >> 32);
+}
+
+// Sorted, distinct keys spread over the whole uint32 range
+static void make_keys(uint32_t *keys, uint32_t count, uint64_t *state) {
+    uint32_t step = UINT32_MAX / count;
+    for (uint32_t i = 0; i < count; i++) {
+        keys[i] = i * step + next_random(state) % step;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t lookups = argc > 1 ? (uint32_t)atoi(argv[1]) : 2000000;
+    uint64_t state = 42;
+
+    uint32_t *keys = malloc(MAX_KEYS * sizeof(uint32_t));
+    uint32_t *probes = malloc(lookups * sizeof(uint32_t));
+    if (!keys || !probes) return 1;
+    for (uint32_t i = 0; i < lookups; i++) {
+        probes[i] = next_random(&state);
+    }
+
+    KeySearchKernel kernels[] = { KEYSEARCH_SCALAR, KEYSEARCH_SSE42, KEYSEARCH_AVX2 };
+    int num_kernels = sizeof(kernels) / sizeof(kernels[0]);
+
+    printf("Active kernel: %s\n", keysearch_kernel_name(keysearch_active_kernel()));
+    printf("%8s", "keys");
+    for (int k = 0; k < num_kernels; k++) {
+        printf("%12s", keysearch_kernel_name(kernels[k]));
+    }
+    printf("   (ns per lookup)\n");
+
+    for (size_t s = 0; s < sizeof(node_sizes) / sizeof(node_sizes[0]); s++) {
+        uint32_t count = node_sizes[s];
+        make_keys(keys, count, &state);
+
+        printf("%8u", count);
+        uint64_t reference = 0;
+        for (int k = 0; k < num_kernels; k++) {
+            KeySearchFn search = keysearch_kernel(kernels[k]);
+            if (!search) {
+                printf("%12s", "n/a");
+                continue;
+            }
+
+            uint64_t checksum = 0;
+            double start = now_ns();
+            for (uint32_t i = 0; i < lookups; i++) {
+                checksum += search(keys, count, probes[i]);
+            }
+            double elapsed = now_ns() - start;
+
+            if (k == 0) reference = checksum;
+            if (checksum != reference) {
+                printf("\nKernel %s disagrees with scalar search\n", keysearch_kernel_name(kernels[k]));
+                return 1;
+            }
+            printf("%12.2f", elapsed / lookups);
+        }
+        printf("\n");
+    }
+
+    free(keys);
+    free(probes);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Measures point-read throughput of one shared handle as threads are added.
+// Build with -DBUILD_BENCHMARKS=ON and run
+//   ./bench_readers [keys] [seconds per step] [database path]
+#include "stark.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VALUE_SIZE 100
+
+static const int thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+
+typedef struct {
+    stark_db_t *db;
+    uint32_t num_keys;
+    uint64_t seed;
+    volatile int *stop;
+    uint64_t reads;
+    uint64_t misses;
+} Reader;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t next_random(uint64_t *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(*state >> 32);
+}
+
+// Counts in locals and stores them once at the end: the Readers sit side
+// by side, and counters updated in place would share cache lines
+static void *reader_main(void *arg) {
+    Reader *reader = arg;
+    char value[VALUE_SIZE + 1];
+    uint64_t seed = reader->seed;
+    uint64_t reads = 0;
+    uint64_t misses = 0;
+
+    while (!__atomic_load_n(reader->stop, __ATOMIC_RELAXED)) {
+        // Check the stop flag once per batch of reads
+        for (int i = 0; i < 256; i++) {
+            uint32_t key = next_random(&seed) % reader->num_keys;
+            size_t size = sizeof(value);
+            if (stark_get(reader->db, key, value, &size) != STARK_OK) misses++;
+            reads++;
+        }
+    }
+    reader->reads = reads;
+    reader->misses = misses;
+    return NULL;
+}
+
+// Feeds the bulk loader keys 0..num_keys-1 in order
+typedef struct {
+    uint32_t next;
+    uint32_t num_keys;
+    char value[VALUE_SIZE];
+} Loader;
+
+static int load_source(void *context, uint32_t *key, const void **data, size_t *size) {
+    Loader *loader = context;
+    if (loader->next == loader->num_keys) return 0;
+    *key = loader->next++;
+    snprintf(loader->value, sizeof(loader->value), "value-%u", *key);
+    *data = loader->value;
+    *size = sizeof(loader->value);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    uint32_t num_keys = argc > 1 ? (uint32_t)atoi(argv[1]) : 200000;
+    double seconds = argc > 2 ? atof(argv[2]) : 2.0;
+    const char *path = argc > 3 ? argv[3] : "bench_readers_db";
+    if (num_keys == 0 || seconds <= 0) return 1;
+
+    char filename[512];
+    const char *extensions[] = { ".idx", ".dat", ".wal", ".wal2" };
+    for (int i = 0; i < 4; i++) {
+        snprintf(filename, sizeof(filename), "%s%s", path, extensions[i]);
+        unlink(filename);
+    }
+
+    // A pool large enough for the whole database: this measures CPU
+    // scaling, not the disk
+    stark_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.cache_pages = num_keys / 16 + 1024;
+    stark_db_t *db = stark_open_ex(path, 0, &options);
+    if (!db) {
+        fprintf(stderr, "Cannot create %s\n", path);
+        return 1;
+    }
+
+    Loader loader = { 0, num_keys, { 0 } };
+    stark_bulk_options_t bulk;
+    memset(&bulk, 0, sizeof(bulk));
+    bulk.presorted = 1;
+    if (stark_bulk_load(db, load_source, &loader, &bulk) != STARK_OK) {
+        fprintf(stderr, "Bulk load failed\n");
+        stark_close(db);
+        return 1;
+    }
+
+    // Warm the pool so every step reads from memory
+    char value[VALUE_SIZE + 1];
+    for (uint32_t key = 0; key < num_keys; key++) {
+        size_t size = sizeof(value);
+        stark_get(db, key, value, &size);
+    }
+
+    printf("%u keys, %d-byte values, %.1f s per step, %ld CPUs online\n",
+           num_keys, VALUE_SIZE, seconds, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %14s %14s %10s\n", "threads", "reads/s", "per thread", "speedup");
+    fflush(stdout);
+
+    double single = 0;
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int count = thread_counts[t];
+        Reader *readers = calloc(count, sizeof(Reader));
+        pthread_t *threads = calloc(count, sizeof(pthread_t));
+        volatile int stop = 0;
+        if (!readers || !threads) return 1;
+
+        double start = now_seconds();
+        for (int i = 0; i < count; i++) {
+            readers[i].db = db;
+            readers[i].num_keys = num_keys;
+            readers[i].seed = 42 + i;
+            readers[i].stop = &stop;
+            pthread_create(&threads[i], NULL, reader_main, &readers[i]);
+        }
+        usleep((useconds_t)(seconds * 1e6));
+        __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+
+        uint64_t reads = 0;
+        uint64_t misses = 0;
+        for (int i = 0; i < count; i++) {
+            pthread_join(threads[i], NULL);
+            reads += readers[i].reads;
+            misses += readers[i].misses;
+        }
+        double elapsed = now_seconds() - start;
+
+        double rate = reads / elapsed;
+        if (count == 1) single = rate;
+        printf("%8d %14.0f %14.0f %9.2fx", count, rate, rate / count, rate / single);
+        if (misses > 0) printf("   (%llu failed reads)", (unsigned long long)misses);
+        printf("\n");
+        fflush(stdout);
+
+        free(readers);
+        free(threads);
+    }
+
+    stark_close(db);
+    return 0;
+}
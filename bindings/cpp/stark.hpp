@@ -6,6 +6,14 @@
 #include <stdexcept>
 #include <cstring>
 #include <iostream>
+#include <type_traits>
+#include <utility>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#if __cplusplus >= 202002L
+#include <span>
+#endif
 
 extern "C" {
     #include <stark.h>
@@ -31,12 +39,139 @@ struct Stats {
     uint32_t height;
     uint64_t data_size;
     uint32_t pages;
+    uint32_t key_bits;
     
-    Stats() : keys(0), height(0), data_size(0), pages(0) {}
+    Stats() : keys(0), height(0), data_size(0), pages(0), key_bits(0) {}
     
     explicit Stats(const stark_stats_t& s) 
         : keys(s.keys_count), height(s.btree_height), 
-          data_size(s.data_size), pages(s.page_count) {}
+          data_size(s.data_size), pages(s.page_count), key_bits(s.key_bits) {}
+};
+
+// ==================== Key Types ====================
+// Numeric keys of up to 32 bits go through stark_add and friends, wider
+// ones through the *64 calls, which need a database opened with
+// key_bits = 64 when it was created
+template <typename Key, bool Wide = (sizeof(Key) > sizeof(uint32_t))>
+struct KeyOps {
+    typedef uint32_t Wire;
+    typedef stark_kv_t Pair;
+    
+    static stark_result_t add(stark_db_t* db, Key key, const void* value, size_t size) {
+        return stark_add(db, static_cast<uint32_t>(key), value, size);
+    }
+    static stark_result_t remove(stark_db_t* db, Key key) {
+        return stark_delete(db, static_cast<uint32_t>(key));
+    }
+    static int exists(stark_db_t* db, Key key) {
+        return stark_exists(db, static_cast<uint32_t>(key));
+    }
+    static stark_result_t view(stark_db_t* db, Key key, const void** value, size_t* size,
+                               stark_pin_t* pin) {
+        return stark_get_view(db, static_cast<uint32_t>(key), value, size, pin);
+    }
+    static stark_result_t put_batch(stark_db_t* db, const Pair* items, size_t count) {
+        return stark_put_batch(db, items, count);
+    }
+    static stark_result_t get_batch(stark_db_t* db, const Wire* keys, size_t count,
+                                    void* buffer, size_t size, stark_get_result_t* results) {
+        return stark_get_batch(db, keys, count, buffer, size, results);
+    }
+};
+
+template <typename Key>
+struct KeyOps<Key, true> {
+    typedef uint64_t Wire;
+    typedef stark_kv64_t Pair;
+    
+    static stark_result_t add(stark_db_t* db, Key key, const void* value, size_t size) {
+        return stark_add64(db, static_cast<uint64_t>(key), value, size);
+    }
+    static stark_result_t remove(stark_db_t* db, Key key) {
+        return stark_delete64(db, static_cast<uint64_t>(key));
+    }
+    static int exists(stark_db_t* db, Key key) {
+        return stark_exists64(db, static_cast<uint64_t>(key));
+    }
+    static stark_result_t view(stark_db_t* db, Key key, const void** value, size_t* size,
+                               stark_pin_t* pin) {
+        return stark_get_view64(db, static_cast<uint64_t>(key), value, size, pin);
+    }
+    static stark_result_t put_batch(stark_db_t* db, const Pair* items, size_t count) {
+        return stark_put_batch64(db, items, count);
+    }
+    static stark_result_t get_batch(stark_db_t* db, const Wire* keys, size_t count,
+                                    void* buffer, size_t size, stark_get_result_t* results) {
+        return stark_get_batch64(db, keys, count, buffer, size, results);
+    }
+};
+
+// Keys already of the width the C API takes are passed through as they are;
+// others are copied into `copy`
+template <typename Wire>
+const Wire* wire_keys(const Wire* keys, size_t, std::vector<Wire>&) {
+    return keys;
+}
+
+template <typename Wire, typename Key>
+const Wire* wire_keys(const Key* keys, size_t count, std::vector<Wire>& copy) {
+    copy.assign(keys, keys + count);
+    return copy.data();
+}
+
+// ==================== Value View ====================
+// A value read in place from the cached page (stark_get_view). The page is
+// released when the view is destroyed, and writes wait until then, so keep
+// views short-lived. A view may be moved to and destroyed on another
+// thread, but until then writes from the thread that made it fail.
+// A default-constructed view, or one for a missing key, is false.
+class ValueView {
+private:
+    stark_pin_t pin;
+    const char* ptr;
+    size_t len;
+    
+    friend class Database;
+
+public:
+    ValueView() noexcept : ptr(nullptr), len(0) {
+        pin.db = nullptr;
+    }
+    
+    ~ValueView() {
+        stark_release(&pin);
+    }
+    
+    ValueView(const ValueView&) = delete;
+    ValueView& operator=(const ValueView&) = delete;
+    
+    ValueView(ValueView&& other) noexcept : pin(other.pin), ptr(other.ptr), len(other.len) {
+        other.pin.db = nullptr;
+        other.ptr = nullptr;
+        other.len = 0;
+    }
+    
+    ValueView& operator=(ValueView&& other) noexcept {
+        if (this != &other) {
+            stark_release(&pin);
+            pin = other.pin;
+            ptr = other.ptr;
+            len = other.len;
+            other.pin.db = nullptr;
+            other.ptr = nullptr;
+            other.len = 0;
+        }
+        return *this;
+    }
+    
+    explicit operator bool() const noexcept { return pin.db != nullptr; }
+    const char* data() const noexcept { return ptr; }
+    size_t size() const noexcept { return len; }
+    std::string str() const { return std::string(ptr ? ptr : "", len); }
+    
+#if __cplusplus >= 201703L
+    operator std::string_view() const noexcept { return std::string_view(ptr, len); }
+#endif
 };
 
 // ==================== Field Definition ====================
@@ -72,8 +207,17 @@ private:
 public:
     // ========== Constructor / Destructor ==========
     
-    explicit Database(const std::string& path) {
-        db = stark_open(path.c_str(), 0);
+    // flags: STARK_OPEN_READONLY, STARK_OPEN_MMAP, STARK_OPEN_SHADOW
+    explicit Database(const std::string& path, unsigned flags = 0) {
+        db = stark_open(path.c_str(), flags);
+        if (!db) {
+            throw Error("Failed to open database: " + path);
+        }
+    }
+    
+    // options.key_bits = 64 creates a database for 64-bit keys
+    Database(const std::string& path, unsigned flags, const stark_options_t& options) {
+        db = stark_open_ex(path.c_str(), flags, &options);
         if (!db) {
             throw Error("Failed to open database: " + path);
         }
@@ -106,51 +250,145 @@ public:
     }
     
     // ========== Numeric Key Operations ==========
-    // Uses: stark_add, stark_get, stark_delete, stark_exists
+    // Uses: stark_add, stark_get_view, stark_delete, stark_exists and their
+    //       *64 variants for key types wider than 32 bits (see KeyOps)
     
-    void add(uint32_t key, const std::string& value) {
+    template <typename Key>
+    void add(Key key, const std::string& value) {
+        static_assert(std::is_integral<Key>::value, "keys are integers");
         check_db();
-        stark_result_t r = stark_add(db, key, value.c_str(), value.size() + 1);
+        stark_result_t r = KeyOps<Key>::add(db, key, value.c_str(), value.size() + 1);
         if (r != STARK_OK) {
             throw Error("Failed to add key " + std::to_string(key));
         }
     }
     
-    std::string get(uint32_t key) {
+    // The value in place; see ValueView. False if the key is missing.
+    template <typename Key>
+    ValueView view(Key key) {
+        static_assert(std::is_integral<Key>::value, "keys are integers");
         check_db();
-        char buffer[4096];
-        size_t size = sizeof(buffer);
-        stark_result_t r = stark_get(db, key, buffer, &size);
-        
+        ValueView v;
+        const void* value;
+        stark_result_t r = KeyOps<Key>::view(db, key, &value, &v.len, &v.pin);
         if (r == STARK_OK) {
-            return std::string(buffer, size);
-        } else if (r == STARK_NOT_FOUND) {
-            return "";
-        } else {
+            v.ptr = static_cast<const char*>(value);
+        } else if (r != STARK_NOT_FOUND) {
             throw Error("Failed to get key " + std::to_string(key));
         }
+        return v;
     }
     
-    std::string get(uint32_t key, const std::string& default_value) {
+    template <typename Key>
+    std::string get(Key key) {
+        // One lookup, copied straight out of the page
+        return view(key).str();
+    }
+    
+    template <typename Key>
+    std::string get(Key key, const std::string& default_value) {
         std::string result = get(key);
         return result.empty() ? default_value : result;
     }
     
-    bool remove(uint32_t key) {
+    template <typename Key>
+    bool remove(Key key) {
+        static_assert(std::is_integral<Key>::value, "keys are integers");
         check_db();
-        stark_result_t r = stark_delete(db, key);
+        stark_result_t r = KeyOps<Key>::remove(db, key);
         if (r == STARK_OK) return true;
         if (r == STARK_NOT_FOUND) return false;
         throw Error("Failed to remove key " + std::to_string(key));
     }
     
-    bool exists(uint32_t key) {
+    template <typename Key>
+    bool exists(Key key) {
+        static_assert(std::is_integral<Key>::value, "keys are integers");
+        check_db();
+        return KeyOps<Key>::exists(db, key) != 0;
+    }
+    
+    // ========== Batch Operations ==========
+    // Uses: stark_put_batch, stark_get_batch and their *64 variants for key
+    //       types wider than 32 bits (see KeyOps)
+    
+    template <typename Key>
+    void put_many(const std::pair<Key, std::string>* items, size_t count) {
+        static_assert(std::is_integral<Key>::value, "keys are integers");
         check_db();
-        return stark_exists(db, key) != 0;
+        std::vector<typename KeyOps<Key>::Pair> batch(count);
+        for (size_t i = 0; i < count; i++) {
+            batch[i].key = static_cast<typename KeyOps<Key>::Wire>(items[i].first);
+            batch[i].value = items[i].second.c_str();
+            batch[i].value_size = items[i].second.size() + 1;
+        }
+        stark_result_t r = KeyOps<Key>::put_batch(db, batch.data(), batch.size());
+        if (r != STARK_OK) {
+            throw Error("Failed to put batch of " + std::to_string(count) + " keys");
+        }
+    }
+    
+    // Key defaults to uint32_t for a braced list, as in put_many({{1, "one"}})
+    template <typename Key = uint32_t>
+    void put_many(const std::vector<std::pair<Key, std::string>>& items) {
+        put_many(items.data(), items.size());
+    }
+    
+    // Missing keys come back as empty strings, like get()
+    template <typename Key>
+    std::vector<std::string> get_many(const Key* keys, size_t count) {
+        static_assert(std::is_integral<Key>::value, "keys are integers");
+        check_db();
+        typedef typename KeyOps<Key>::Wire Wire;
+        std::vector<Wire> copy;
+        const Wire* wire = wire_keys<Wire>(keys, count, copy);
+        std::vector<stark_get_result_t> results(count);
+        
+        // Sizes come from the index alone; then one pass reads every value
+        stark_result_t r = KeyOps<Key>::get_batch(db, wire, count, nullptr, 0, results.data());
+        size_t total = 0;
+        for (size_t i = 0; r == STARK_OK && i < count; i++) {
+            total += results[i].value_size;
+        }
+        std::string buffer(total, '\0');
+        if (r == STARK_OK) {
+            r = KeyOps<Key>::get_batch(db, wire, count, &buffer[0], buffer.size(), results.data());
+        }
+        if (r != STARK_OK) {
+            throw Error("Failed to get batch of " + std::to_string(count) + " keys");
+        }
+        
+        std::vector<std::string> values(count);
+        for (size_t i = 0; i < count; i++) {
+            if (results[i].status == STARK_OK) {
+                values[i].assign(buffer, results[i].value_offset, results[i].value_size);
+            } else if (results[i].status != STARK_NOT_FOUND) {
+                throw Error("Failed to get key " + std::to_string(keys[i]));
+            }
+        }
+        return values;
+    }
+    
+    template <typename Key = uint32_t>
+    std::vector<std::string> get_many(const std::vector<Key>& keys) {
+        return get_many(keys.data(), keys.size());
+    }
+    
+#if __cplusplus >= 202002L
+    template <typename Key = uint32_t>
+    void put_many(std::span<const std::pair<Key, std::string>> items) {
+        put_many(items.data(), items.size());
+    }
+    
+    template <typename Key = uint32_t>
+    std::vector<std::string> get_many(std::span<const Key> keys) {
+        return get_many(keys.data(), keys.size());
     }
+#endif
     
     // ========== String Key Operations ==========
-    // Uses: stark_put_str, stark_get_str, stark_del_str, stark_exists_str
+    // Uses: stark_put_str, stark_get_str_view, stark_del_str, stark_exists_str,
+    //       stark_str_cursor_*
     
     void put_str(const std::string& key, const std::string& value) {
         check_db();
@@ -160,19 +398,21 @@ public:
         }
     }
     
-    std::string get_str(const std::string& key) {
+    ValueView view_str(const std::string& key) {
         check_db();
-        char buffer[4096];
-        size_t size = sizeof(buffer);
-        stark_result_t r = stark_get_str(db, key.c_str(), buffer, &size);
-        
+        ValueView v;
+        const void* value;
+        stark_result_t r = stark_get_str_view(db, key.c_str(), &value, &v.len, &v.pin);
         if (r == STARK_OK) {
-            return std::string(buffer, size);
-        } else if (r == STARK_NOT_FOUND) {
-            return "";
-        } else {
+            v.ptr = static_cast<const char*>(value);
+        } else if (r != STARK_NOT_FOUND) {
             throw Error("Failed to get string key: " + key);
         }
+        return v;
+    }
+    
+    std::string get_str(const std::string& key) {
+        return view_str(key).str();
     }
     
     bool remove_str(const std::string& key) {
@@ -188,6 +428,29 @@ public:
         return stark_exists_str(db, key.c_str()) != 0;
     }
     
+    // String keys starting with prefix, in byte order ("" for all)
+    std::vector<std::string> keys_str(const std::string& prefix = "") {
+        check_db();
+        stark_str_cursor_t* cursor = stark_str_cursor_create(db);
+        if (!cursor) throw Error("Failed to create string cursor");
+    
+        std::vector<std::string> keys;
+        char key[STARK_MAX_STR_KEY + 1];
+        stark_result_t r = stark_str_cursor_seek(cursor, prefix.c_str());
+        while (r == STARK_OK) {
+            r = stark_str_cursor_get(cursor, key, sizeof(key), nullptr, nullptr);
+            if (r != STARK_OK || std::strncmp(key, prefix.c_str(), prefix.size()) != 0) break;
+            keys.emplace_back(key);
+            r = stark_str_cursor_next(cursor);
+        }
+        stark_str_cursor_destroy(cursor);
+    
+        if (r != STARK_OK && r != STARK_NOT_FOUND) {
+            throw Error("Failed to scan string keys from: " + prefix);
+        }
+        return keys;
+    }
+    
     // ========== Type System ==========
     // Uses: stark_define_type, stark_undefine_type, stark_get_type,
     //       stark_add_typed, stark_get_typed
@@ -3,6 +3,53 @@
 #include <stdlib.h>
 #include "stark.h"
 
+// Longest line accepted by import
+#define IMPORT_LINE_MAX 65536
+
+// Reads "<key> <value>" lines for stark_bulk_load; values are stored with
+// their terminating NUL, like addn
+typedef struct {
+    FILE* file;
+    char* line;
+    unsigned long line_number;
+    unsigned long records;
+    unsigned long skipped;
+} import_source_t;
+
+static int import_next(void* context, uint32_t* key, const void** value, size_t* value_size) {
+    import_source_t* source = (import_source_t*)context;
+    
+    while (fgets(source->line, IMPORT_LINE_MAX, source->file)) {
+        source->line_number++;
+        
+        // A line that does not fit is skipped whole, not split into records
+        if (!strchr(source->line, '\n') && !feof(source->file)) {
+            int c;
+            while ((c = fgetc(source->file)) != EOF && c != '\n') {}
+            printf("Skipping line %lu: longer than %d bytes\n", source->line_number, IMPORT_LINE_MAX - 2);
+            source->skipped++;
+            continue;
+        }
+        source->line[strcspn(source->line, "\r\n")] = 0;
+        if (source->line[0] == 0) continue;
+        
+        char* end;
+        unsigned long parsed = strtoul(source->line, &end, 10);
+        if (end == source->line || *end != ' ' || parsed > UINT32_MAX) {
+            printf("Skipping line %lu: expected <key> <value>\n", source->line_number);
+            source->skipped++;
+            continue;
+        }
+        
+        *key = (uint32_t)parsed;
+        *value = end + 1;
+        *value_size = strlen(end + 1) + 1;
+        source->records++;
+        return 1;
+    }
+    return ferror(source->file) ? -1 : 0;
+}
+
 void print_help() {
 // Colors
 const char *PURPLE  = "\033[38;5;135m";
@@ -57,6 +104,7 @@ printf("╚═══════════════════════
     printf("└───────────────────────────────────────────────────────────┘\n");
 
     printf("\n%s┌──────────────── 📊 GENERAL COMMANDS ─────────────────────┐%s\n", CYAN, RESET);
+    printf("│  import <file> [sorted]       - Bulk load key value lines│\n");
     printf("│  stats                        - Show database stats      │\n");
     printf("│  sync                         - Flush to disk            │\n");
     printf("│  help                         - Show this help menu      │\n");
@@ -65,12 +113,32 @@ printf("╚═══════════════════════
 }
 
 int main(int argc, char* argv[]) {
-    const char* db_path = argc > 1 ? argv[1] : "mydb";
+    const char* db_path = "mydb";
+    unsigned open_flags = 0;
+    stark_options_t options = {0};
+    
+    // Usage: stark_cli [path] [--readonly] [--mmap] [--shadow] [--page-size N] [--log-level N]
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--readonly") == 0) {
+            open_flags |= STARK_OPEN_READONLY;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            open_flags |= STARK_OPEN_READONLY | STARK_OPEN_MMAP;
+        } else if (strcmp(argv[i], "--shadow") == 0) {
+            open_flags |= STARK_OPEN_SHADOW;
+        } else if (strcmp(argv[i], "--page-size") == 0 && i + 1 < argc) {
+            options.page_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            stark_set_log_level(atoi(argv[++i]));
+        } else {
+            db_path = argv[i];
+        }
+    }
     
-    printf("Opening database: %s\n", db_path);
+    printf("Opening database: %s%s\n", db_path,
+           (open_flags & STARK_OPEN_READONLY) ? " (read-only)" : "");
     
     
-    stark_db_t* db = stark_open(db_path, 0);
+    stark_db_t* db = stark_open_ex(db_path, open_flags, &options);
     if (!db) {
         printf("Failed to open database!\n");
         return 1;
@@ -256,6 +324,8 @@ if (strcmp(cmd, "define") == 0) {
                 stark_result_t r = stark_add(db, key, value, strlen(value) + 1);
                 if (r == STARK_OK)
                     printf("OK: %u -> %s\n", key, value);
+                else if (r == STARK_READONLY)
+                    printf("Database is open read-only\n");
                 else
                     printf("Error: %d\n", r);
             } else {
@@ -384,6 +454,34 @@ else if (strcmp(cmd, "exists_str") == 0) {
     }
         
         // ===== GENERAL COMMANDS =====
+        else if (strcmp(cmd, "import") == 0) {
+            char path[256];
+            char mode[16] = "";
+            if (sscanf(line, "%*s %255s %15s", path, mode) >= 1) {
+                import_source_t source = {0};
+                source.file = fopen(path, "r");
+                source.line = malloc(IMPORT_LINE_MAX);
+                if (!source.file || !source.line) {
+                    printf("Cannot open %s\n", path);
+                } else {
+                    stark_bulk_options_t bulk = {0};
+                    bulk.presorted = strcmp(mode, "sorted") == 0;
+                    stark_result_t r = stark_bulk_load(db, import_next, &source, &bulk);
+                    if (r == STARK_OK)
+                        printf("✅ Imported %lu records (%lu lines skipped)\n",
+                               source.records, source.skipped);
+                    else if (r == STARK_READONLY)
+                        printf("Database is open read-only\n");
+                    else
+                        printf("❌ Import failed (error %d). The database must be empty"
+                               "%s\n", r, bulk.presorted ? " and keys ascending" : "");
+                }
+                if (source.file) fclose(source.file);
+                free(source.line);
+            } else {
+                printf("Usage: import <file> [sorted]\n");
+            }
+        }
         else if (strcmp(cmd, "stats") == 0) {
             stark_stats_t stats;
             if (stark_stats(db, &stats) == STARK_OK) {
@@ -19,7 +19,8 @@
 extern "C" {
 #endif
 
-// Opaque handle - users never see inside
+// Opaque handle - users never see inside. One handle may be shared by many
+// threads: reads run in parallel, writes run one at a time.
 typedef struct stark_db stark_db_t;
 
 // Result codes
@@ -31,21 +32,58 @@ typedef enum {
     STARK_IO_ERROR = -4,
     STARK_INVALID_ARG = -5,
     STARK_CLOSED = -6,
-    STARK_MEMORY_ERROR = -7
+    STARK_MEMORY_ERROR = -7,
+    STARK_READONLY = -8
 } stark_result_t;
 
+// Flags for stark_open / stark_open_ex
+#define STARK_OPEN_READONLY 0x1u   // Reject writes; the database must already exist
+#define STARK_OPEN_MMAP     0x2u   // Map .idx/.dat read-only instead of caching pages (implies READONLY)
+// Shadow paging instead of the write-ahead log: changed pages are written to
+// free space in .idx/.dat and each commit flips a double-buffered meta page,
+// so opening after a crash has nothing to replay. Every commit is fsynced
+// (async_commit and the checkpoint options do not apply) and snapshots are
+// not available. A database stays in the mode it was created in; with MMAP
+// pages are cached as usual, read-only.
+#define STARK_OPEN_SHADOW   0x4u
+
 // ==================== LIFECYCLE ====================
 
+// Tuning knobs for stark_open_ex; zero-initialize and set what you need
+typedef struct {
+    uint32_t cache_pages;      // Buffer pool size per file, in pages (0 = default)
+    uint32_t page_size;        // Page size for new databases: a power of two from
+                               // 4096 to 65536 (0 = 4096). Existing files keep theirs.
+    int async_commit;          // Nonzero: commits return before the log is fsynced. A crash
+                               // may lose the latest commits but never leaves a partial one.
+    uint64_t checkpoint_bytes; // A background checkpoint copies logged pages into .idx/.dat once
+                               // this much log is waiting (0 = 8 MB)
+    uint32_t checkpoint_interval_ms; // ...or at least this often while commits wait (0 = 1000)
+    uint32_t key_bits;         // Integer key width for new databases: 32 or 64 (0 = 32).
+                               // Existing files keep theirs. 32-bit keys pack more per page.
+} stark_options_t;
+
 /**
  * Open a database connection
  * @param path Database file path (without extension)
- * @param flags Reserved for future use
+ * @param flags STARK_OPEN_* flags, or 0 for read-write
  * @return Database handle or NULL on error
  */
 STARK_API stark_db_t* stark_open(const char* path, unsigned flags);
 
+/**
+ * Open a database connection with tuning options
+ * @param path Database file path (without extension)
+ * @param flags STARK_OPEN_* flags, or 0 for read-write
+ * @param options Tuning options (NULL for defaults)
+ * @return Database handle or NULL on error
+ */
+STARK_API stark_db_t* stark_open_ex(const char* path, unsigned flags,
+                                    const stark_options_t* options);
+
 /**
  * Close database and flush all changes
+ * No other thread may still be using the handle.
  * @param db Database handle
  */
 STARK_API void stark_close(stark_db_t* db);
@@ -71,7 +109,8 @@ STARK_API stark_result_t stark_add(stark_db_t* db, uint32_t key,
  * @param key Key to find
  * @param buffer Output buffer
  * @param buffer_size Size of buffer (will be set to actual size)
- * @return STARK_OK if found, STARK_NOT_FOUND if not
+ * @return STARK_OK if found, STARK_NOT_FOUND if not. If the buffer is too
+ *         small, returns STARK_ERROR with buffer_size set to the value size.
  */
 STARK_API stark_result_t stark_get(stark_db_t* db, uint32_t key,
                                    void* buffer, size_t* buffer_size);
@@ -92,13 +131,207 @@ STARK_API stark_result_t stark_delete(stark_db_t* db, uint32_t key);
  */
 STARK_API int stark_exists(stark_db_t* db, uint32_t key);
 
+// ==================== 64-BIT KEYS ====================
+
+// A database created with key_bits = 64 takes integer keys up to
+// UINT64_MAX, in the same keyspace and order as the 32-bit calls above:
+// stark_get(db, 7, ...) and stark_get64(db, 7, ...) read the same record.
+// A 32-bit database rejects wider keys with STARK_INVALID_ARG and never
+// finds them.
+
+/**
+ * Insert or update a key-value pair with a 64-bit key
+ * @param db Database handle
+ * @param key 64-bit integer key
+ * @param value Data to store
+ * @param value_size Size of value in bytes
+ * @return STARK_OK on success, STARK_INVALID_ARG if the key is too wide for the database
+ */
+STARK_API stark_result_t stark_add64(stark_db_t* db, uint64_t key,
+                                     const void* value, size_t value_size);
+
+/**
+ * Get value by 64-bit key
+ * @param db Database handle
+ * @param key Key to find
+ * @param buffer Output buffer
+ * @param buffer_size Size of buffer (will be set to actual size)
+ * @return STARK_OK if found, STARK_NOT_FOUND if not. If the buffer is too
+ *         small, returns STARK_ERROR with buffer_size set to the value size.
+ */
+STARK_API stark_result_t stark_get64(stark_db_t* db, uint64_t key,
+                                     void* buffer, size_t* buffer_size);
+
+/**
+ * Delete a key-value pair by 64-bit key
+ * @param db Database handle
+ * @param key Key to delete
+ * @return STARK_OK if deleted, STARK_NOT_FOUND if not
+ */
+STARK_API stark_result_t stark_delete64(stark_db_t* db, uint64_t key);
+
+/**
+ * Check if a 64-bit key exists
+ * @param db Database handle
+ * @param key Key to check
+ * @return 1 if exists, 0 if not
+ */
+STARK_API int stark_exists64(stark_db_t* db, uint64_t key);
+
+// ==================== ZERO-COPY READS ====================
+
+// A view points straight into the cached page that holds a value instead
+// of copying it out, so no buffer has to be sized first. The page stays
+// pinned and unchanged until the view is released: writes wait for every
+// open view, so release views promptly, and before closing the database.
+// A view may be released on any thread, but it counts against the thread
+// that took it: until then that thread's writes, stark_begin, stark_commit
+// and stark_rollback fail with STARK_ERROR rather than wait for it.
+// Values too large for a page are copied once into memory owned by the pin.
+
+// Filled in by stark_get_view; the fields are internal
+typedef struct {
+    void* db;
+    uint64_t page;
+    void* copy;
+    void* holder;
+} stark_pin_t;
+
+/**
+ * Get a read-only view of a value
+ * @param db Database handle
+ * @param key Key to find
+ * @param value Output, pointer to the value bytes
+ * @param value_size Output, size of the value
+ * @param pin Output, passed to stark_release when done with the value
+ * @return STARK_OK if found, STARK_NOT_FOUND if not; pin needs releasing
+ *         only on STARK_OK
+ */
+STARK_API stark_result_t stark_get_view(stark_db_t* db, uint32_t key,
+                                        const void** value, size_t* value_size,
+                                        stark_pin_t* pin);
+
+/**
+ * Get a read-only view of a value by 64-bit key
+ * @param db Database handle
+ * @param key Key to find
+ * @param value Output, pointer to the value bytes
+ * @param value_size Output, size of the value
+ * @param pin Output, passed to stark_release when done with the value
+ * @return STARK_OK if found, STARK_NOT_FOUND if not
+ */
+STARK_API stark_result_t stark_get_view64(stark_db_t* db, uint64_t key,
+                                          const void** value, size_t* value_size,
+                                          stark_pin_t* pin);
+
+/**
+ * Release a view; the value pointer is invalid afterwards. Releasing a pin
+ * twice, or one no view was returned for, does nothing.
+ * @param pin Pin from stark_get_view, stark_get_view64 or stark_get_str_view
+ */
+STARK_API void stark_release(stark_pin_t* pin);
+
+// ==================== BATCH OPERATIONS ====================
+
+// Batches, fetches, snapshot reads and bulk loads take 32-bit keys in
+// databases of either width; the *64 variants take the full key width.
+
+// One key/value pair for stark_put_batch
+typedef struct {
+    uint32_t key;
+    const void* value;
+    size_t value_size;
+} stark_kv_t;
+
+// One key/value pair for stark_put_batch64
+typedef struct {
+    uint64_t key;
+    const void* value;
+    size_t value_size;
+} stark_kv64_t;
+
+// Per-key outcome of stark_get_batch
+typedef struct {
+    stark_result_t status;     // STARK_OK, STARK_NOT_FOUND, or STARK_ERROR if the value did not fit
+    size_t value_offset;       // Offset of the value in the batch buffer
+    size_t value_size;
+} stark_get_result_t;
+
+/**
+ * Insert or update many key-value pairs in one call. Pairs are applied in
+ * key order with one tree descent per leaf touched; if a key repeats, its
+ * last pair wins.
+ * @param db Database handle
+ * @param items Pairs to store, in any order
+ * @param count Number of pairs
+ * @return STARK_OK on success, STARK_FULL if the data does not fit (nothing is written)
+ */
+STARK_API stark_result_t stark_put_batch(stark_db_t* db, const stark_kv_t* items, size_t count);
+
+/**
+ * Look up many keys in one call. Values are copied back to back into
+ * buffer in the order of keys; a value that does not fit is skipped with
+ * status STARK_ERROR and its size reported.
+ * @param db Database handle
+ * @param keys Keys to find, in any order
+ * @param count Number of keys
+ * @param buffer Output buffer, or NULL to fetch only statuses and sizes
+ * @param buffer_size Size of buffer
+ * @param results Output, one per key
+ * @return STARK_OK if the lookups ran; see results for each key
+ */
+STARK_API stark_result_t stark_get_batch(stark_db_t* db, const uint32_t* keys, size_t count,
+                                        void* buffer, size_t buffer_size,
+                                        stark_get_result_t* results);
+
+/**
+ * Insert or update many key-value pairs with 64-bit keys (see stark_put_batch)
+ * @param db Database handle
+ * @param items Pairs to store, in any order
+ * @param count Number of pairs
+ * @return STARK_OK on success, STARK_FULL if the data does not fit, or
+ *         STARK_INVALID_ARG if a key is wider than the database (nothing is written)
+ */
+STARK_API stark_result_t stark_put_batch64(stark_db_t* db, const stark_kv64_t* items, size_t count);
+
+/**
+ * Look up many 64-bit keys in one call (see stark_get_batch)
+ * @param db Database handle
+ * @param keys Keys to find, in any order
+ * @param count Number of keys
+ * @param buffer Output buffer, or NULL to fetch only statuses and sizes
+ * @param buffer_size Size of buffer
+ * @param results Output, one per key
+ * @return STARK_OK if the lookups ran; see results for each key
+ */
+STARK_API stark_result_t stark_get_batch64(stark_db_t* db, const uint64_t* keys, size_t count,
+                                          void* buffer, size_t buffer_size,
+                                          stark_get_result_t* results);
+
 // ==================== ITERATION ====================
 
-// Opaque cursor handle
+// Opaque cursor handle. Cursors walk keys in ascending order along the
+// linked leaves; a cursor stays usable across writes and resumes from the
+// nearest key still present.
 typedef struct stark_cursor stark_cursor_t;
 
+// One entry returned by stark_cursor_fetch
+typedef struct {
+    uint32_t key;
+    size_t value_offset;        // Offset of the value in the fetch buffer
+    size_t value_size;
+} stark_entry_t;
+
+// One entry returned by stark_cursor_fetch64
+typedef struct {
+    uint64_t key;
+    size_t value_offset;        // Offset of the value in the fetch buffer
+    size_t value_size;
+} stark_entry64_t;
+
 /**
  * Create a cursor for iterating over database
+ * A cursor belongs to one thread at a time; threads can each have their own.
  * @param db Database handle
  * @return Cursor handle or NULL on error
  */
@@ -118,6 +351,14 @@ STARK_API stark_result_t stark_cursor_first(stark_cursor_t* cursor);
  */
 STARK_API stark_result_t stark_cursor_last(stark_cursor_t* cursor);
 
+/**
+ * Move cursor to the first key >= key
+ * @param cursor Cursor handle
+ * @param key Key to seek to
+ * @return STARK_OK if positioned, STARK_NOT_FOUND if every key is smaller
+ */
+STARK_API stark_result_t stark_cursor_seek(stark_cursor_t* cursor, uint32_t key);
+
 /**
  * Move cursor to next key
  * @param cursor Cursor handle
@@ -132,35 +373,199 @@ STARK_API stark_result_t stark_cursor_next(stark_cursor_t* cursor);
  */
 STARK_API stark_result_t stark_cursor_prev(stark_cursor_t* cursor);
 
+/**
+ * Move cursor to the first key >= a 64-bit key
+ * @param cursor Cursor handle
+ * @param key Key to seek to
+ * @return STARK_OK if positioned, STARK_NOT_FOUND if every key is smaller
+ */
+STARK_API stark_result_t stark_cursor_seek64(stark_cursor_t* cursor, uint64_t key);
+
 /**
  * Get current key and value at cursor
  * @param cursor Cursor handle
  * @param key Output key
  * @param buffer Output buffer
  * @param buffer_size Size of buffer (will be set to actual size)
- * @return STARK_OK on success
+ * @return STARK_OK on success, STARK_ERROR if the key is wider than 32 bits
+ *         (see stark_cursor_get64)
  */
 STARK_API stark_result_t stark_cursor_get(stark_cursor_t* cursor,
                                          uint32_t* key,
                                          void* buffer, size_t* buffer_size);
 
+/**
+ * Get current 64-bit key and value at cursor
+ * @param cursor Cursor handle
+ * @param key Output key
+ * @param buffer Output buffer
+ * @param buffer_size Size of buffer (will be set to actual size)
+ * @return STARK_OK on success
+ */
+STARK_API stark_result_t stark_cursor_get64(stark_cursor_t* cursor,
+                                           uint64_t* key,
+                                           void* buffer, size_t* buffer_size);
+
+/**
+ * Read up to max_entries entries starting at the cursor and move past them.
+ * Values are copied back to back into buffer; the batch stops early at the
+ * first value that does not fit, or at a key wider than 32 bits.
+ * @param cursor Cursor handle
+ * @param entries Output entries
+ * @param max_entries Capacity of entries
+ * @param buffer Output buffer for values, or NULL to fetch keys and sizes only
+ * @param buffer_size Size of buffer
+ * @param count Number of entries returned
+ * @return STARK_OK if any entries were returned, STARK_NOT_FOUND at the end,
+ *         STARK_ERROR if the first entry cannot be returned (a value that does
+ *         not fit has its size in entries[0])
+ */
+STARK_API stark_result_t stark_cursor_fetch(stark_cursor_t* cursor,
+                                           stark_entry_t* entries, size_t max_entries,
+                                           void* buffer, size_t buffer_size,
+                                           size_t* count);
+
+/**
+ * Read up to max_entries entries with 64-bit keys (see stark_cursor_fetch).
+ * Every key fits, so only a value that does not fit ends the batch early.
+ * @param cursor Cursor handle
+ * @param entries Output entries
+ * @param max_entries Capacity of entries
+ * @param buffer Output buffer for values, or NULL to fetch keys and sizes only
+ * @param buffer_size Size of buffer
+ * @param count Number of entries returned
+ * @return As stark_cursor_fetch
+ */
+STARK_API stark_result_t stark_cursor_fetch64(stark_cursor_t* cursor,
+                                             stark_entry64_t* entries, size_t max_entries,
+                                             void* buffer, size_t buffer_size,
+                                             size_t* count);
+
 /**
  * Destroy cursor
  * @param cursor Cursor handle
  */
 STARK_API void stark_cursor_destroy(stark_cursor_t* cursor);
 
+// ==================== SNAPSHOTS ====================
+
+// Opaque snapshot handle: a read-only view of the database as of the last
+// commit before it was opened. Reads through a snapshot take no locks, so
+// long scans neither wait for writers nor hold them up, and they never see
+// later commits or a transaction in progress. One snapshot may be shared by
+// many threads. The write-ahead log cannot be checkpointed past an open
+// snapshot and keeps growing meanwhile, so close snapshots when done.
+typedef struct stark_snapshot stark_snapshot_t;
 
+/**
+ * Open a snapshot of the last committed state
+ * @param db Database handle
+ * @return Snapshot handle, or NULL on error or with STARK_OPEN_SHADOW
+ */
+STARK_API stark_snapshot_t* stark_snapshot_open(stark_db_t* db);
+
+/**
+ * Get value by key as of the snapshot
+ * @param snapshot Snapshot handle
+ * @param key Key to find
+ * @param buffer Output buffer
+ * @param buffer_size Size of buffer (will be set to actual size)
+ * @return STARK_OK if found, STARK_NOT_FOUND if not. If the buffer is too
+ *         small, returns STARK_ERROR with buffer_size set to the value size.
+ */
+STARK_API stark_result_t stark_snapshot_get(stark_snapshot_t* snapshot, uint32_t key,
+                                            void* buffer, size_t* buffer_size);
+
+/**
+ * Get value by 64-bit key as of the snapshot
+ * @param snapshot Snapshot handle
+ * @param key Key to find
+ * @param buffer Output buffer
+ * @param buffer_size Size of buffer (will be set to actual size)
+ * @return As stark_snapshot_get
+ */
+STARK_API stark_result_t stark_snapshot_get64(stark_snapshot_t* snapshot, uint64_t key,
+                                              void* buffer, size_t* buffer_size);
+
+/**
+ * Create a cursor over the snapshot. It works with every stark_cursor_*
+ * function and must be destroyed before the snapshot is closed.
+ * @param snapshot Snapshot handle
+ * @return Cursor handle or NULL on error
+ */
+STARK_API stark_cursor_t* stark_snapshot_cursor(stark_snapshot_t* snapshot);
+
+/**
+ * Close snapshot. Every snapshot must be closed before stark_close.
+ * @param snapshot Snapshot handle
+ */
+STARK_API void stark_snapshot_close(stark_snapshot_t* snapshot);
+
+// ==================== BULK LOAD ====================
+
+/**
+ * Record source for stark_bulk_load
+ * @param context Caller context passed to stark_bulk_load
+ * @param key Output key
+ * @param value Output value; must stay valid until the next call
+ * @param value_size Output value size
+ * @return 1 for a record, 0 at the end of input, negative on error
+ */
+typedef int (*stark_record_source_t)(void* context, uint32_t* key,
+                                     const void** value, size_t* value_size);
+
+// Record source for stark_bulk_load64; as stark_record_source_t with 64-bit keys
+typedef int (*stark_record_source64_t)(void* context, uint64_t* key,
+                                       const void** value, size_t* value_size);
+
+// Options for stark_bulk_load; zero-initialize for defaults
+typedef struct {
+    uint32_t fill_percent;     // How full index nodes are packed, 50-100 (0 = 90)
+    int presorted;             // Keys arrive in ascending order; skips the sort
+    size_t sort_memory;        // Bytes sorted in memory before spilling a run (0 = 64 MB)
+} stark_bulk_options_t;
+
+/**
+ * Load records into an empty database in one pass. Unsorted input is
+ * external-sorted first; the index is then built bottom-up. When a key
+ * repeats, the last record wins.
+ * @param db Database handle
+ * @param source Record source
+ * @param context Passed to source
+ * @param options Load options (NULL for defaults)
+ * @return STARK_OK on success, STARK_ERROR if the database is not empty,
+ *         the input fails or presorted input is out of order
+ */
+STARK_API stark_result_t stark_bulk_load(stark_db_t* db, stark_record_source_t source,
+                                        void* context, const stark_bulk_options_t* options);
+
+/**
+ * Load records with 64-bit keys into an empty database (see stark_bulk_load)
+ * @param db Database handle
+ * @param source Record source
+ * @param context Passed to source
+ * @param options Load options (NULL for defaults)
+ * @return As stark_bulk_load; a key wider than the database fails the load
+ *         with STARK_ERROR
+ */
+STARK_API stark_result_t stark_bulk_load64(stark_db_t* db, stark_record_source64_t source,
+                                          void* context, const stark_bulk_options_t* options);
 
 // ==================== STRING KEY OPERATIONS ====================
 
+// String keys are stored as the bytes before the terminating NUL, in a
+// keyspace of their own: "42" and the integer key 42 are different keys.
+// They are kept in byte order (memcmp), so keys sharing a prefix sit
+// together and can be scanned with a string cursor.
+#define STARK_MAX_STR_KEY 512   // Longest string key in bytes
+
 /**
  * Insert or update a key-value pair with string key
  * @param db Database handle
- * @param key String key (will be hashed internally)
+ * @param key String key, at most STARK_MAX_STR_KEY bytes
  * @param value Data to store
  * @param value_size Size of value in bytes
- * @return STARK_OK on success
+ * @return STARK_OK on success, STARK_INVALID_ARG if the key is too long
  */
 STARK_API stark_result_t stark_put_str(stark_db_t* db, const char* key,
                                        const void* value, size_t value_size);
@@ -176,6 +581,19 @@ STARK_API stark_result_t stark_put_str(stark_db_t* db, const char* key,
 STARK_API stark_result_t stark_get_str(stark_db_t* db, const char* key,
                                        void* buffer, size_t* buffer_size);
 
+/**
+ * Get a read-only view of a value by string key (see stark_get_view)
+ * @param db Database handle
+ * @param key String key
+ * @param value Output, pointer to the value bytes
+ * @param value_size Output, size of the value
+ * @param pin Output, passed to stark_release when done with the value
+ * @return STARK_OK if found, STARK_NOT_FOUND if not
+ */
+STARK_API stark_result_t stark_get_str_view(stark_db_t* db, const char* key,
+                                            const void** value, size_t* value_size,
+                                            stark_pin_t* pin);
+
 /**
  * Delete a key-value pair with string key
  * @param db Database handle
@@ -192,13 +610,60 @@ STARK_API stark_result_t stark_del_str(stark_db_t* db, const char* key);
  */
 STARK_API int stark_exists_str(stark_db_t* db, const char* key);
 
+// Opaque cursor over the string keys, in byte order. Like stark_cursor_t it
+// belongs to one thread at a time and stays usable across writes.
+typedef struct stark_str_cursor stark_str_cursor_t;
+
+/**
+ * Create a cursor over the string keys
+ * @param db Database handle
+ * @return Cursor handle or NULL on error
+ */
+STARK_API stark_str_cursor_t* stark_str_cursor_create(stark_db_t* db);
+
+/**
+ * Move cursor to the first key >= key. Seeking to a prefix puts the cursor
+ * on the first key that starts with it, if any.
+ * @param cursor Cursor handle
+ * @param key Key to seek to ("" for the first key)
+ * @return STARK_OK if positioned, STARK_NOT_FOUND if every key is smaller
+ */
+STARK_API stark_result_t stark_str_cursor_seek(stark_str_cursor_t* cursor, const char* key);
+
+/**
+ * Move cursor to next key
+ * @param cursor Cursor handle
+ * @return STARK_OK if exists, STARK_NOT_FOUND if at end
+ */
+STARK_API stark_result_t stark_str_cursor_next(stark_str_cursor_t* cursor);
+
+/**
+ * Get current key and value at cursor
+ * @param cursor Cursor handle
+ * @param key Output buffer for the NUL-terminated key (STARK_MAX_STR_KEY + 1 bytes always fit)
+ * @param key_size Size of key buffer
+ * @param buffer Output buffer for the value, or NULL to read only the key
+ * @param buffer_size Size of buffer (will be set to actual size); may be NULL without buffer
+ * @return STARK_OK on success, STARK_ERROR if either buffer is too small
+ */
+STARK_API stark_result_t stark_str_cursor_get(stark_str_cursor_t* cursor,
+                                             char* key, size_t key_size,
+                                             void* buffer, size_t* buffer_size);
+
+/**
+ * Destroy string cursor
+ * @param cursor Cursor handle
+ */
+STARK_API void stark_str_cursor_destroy(stark_str_cursor_t* cursor);
+
 // ==================== STATISTICS ====================
 
 typedef struct {
-    uint64_t keys_count;      // Number of keys
+    uint64_t keys_count;      // Number of keys, integer and string
     uint32_t btree_height;     // B-tree height
     uint64_t data_size;        // Total data size in bytes
     uint32_t page_count;       // Number of pages used
+    uint32_t key_bits;         // Integer key width, 32 or 64
 } stark_stats_t;
 
 /**
@@ -219,12 +684,51 @@ STARK_API stark_result_t stark_stats(stark_db_t* db, stark_stats_t* stats);
 STARK_API const char* stark_error(stark_db_t* db);
 
 /**
- * Flush all changes to disk
+ * Checkpoint now: copy committed changes from the write-ahead log into
+ * the data files. Commits are durable without this, and a background
+ * thread checkpoints on its own (see stark_options_t). Does nothing with
+ * STARK_OPEN_SHADOW.
  * @param db Database handle
  * @return STARK_OK on success
  */
 STARK_API stark_result_t stark_sync(stark_db_t* db);
 
+// ==================== LOGGING ====================
+
+// Log levels, most severe first; a level enables every level before it.
+// The library also has a compile-time ceiling, STARK_LOG_LEVEL (a CMake
+// cache variable, default STARK_LOG_DEBUG): messages above it are not
+// compiled in at all, so they cost nothing at run time.
+#define STARK_LOG_NONE  0
+#define STARK_LOG_ERROR 1   // I/O failures and damaged files
+#define STARK_LOG_WARN  2   // Recoverable trouble, such as a failed background checkpoint
+#define STARK_LOG_INFO  3   // Opens, recoveries, syncs, transactions
+#define STARK_LOG_DEBUG 4   // Structural changes: splits, merges, checkpoints
+#define STARK_LOG_TRACE 5   // Every page and record access
+
+// Receives each message that passes the level, without a trailing newline.
+// It may be called from any thread, several at once.
+typedef void (*stark_log_sink_t)(int level, const char* message, void* context);
+
+/**
+ * Set which messages are logged (process-wide)
+ * @param level STARK_LOG_* level; the default is STARK_LOG_WARN
+ */
+STARK_API void stark_set_log_level(int level);
+
+/**
+ * Get the runtime log level
+ * @return STARK_LOG_* level
+ */
+STARK_API int stark_get_log_level(void);
+
+/**
+ * Send log messages somewhere other than stderr (process-wide)
+ * @param sink Callback, or NULL to restore the stderr sink
+ * @param context Passed to every call of sink
+ */
+STARK_API void stark_set_log_sink(stark_log_sink_t sink, void* context);
+
 // ==================== TYPE SYSTEM ====================
 
 /**
@@ -288,14 +792,14 @@ STARK_API stark_result_t stark_get_typed(stark_db_t* db, const char* type_name,
 
                                          
 
-#ifdef __cplusplus
-}
-
 // ==================== TRANSACTIONS ====================
 
 /**
  * Begin a transaction
- * All subsequent operations will be atomic
+ * All subsequent operations will be atomic. Outside a transaction each
+ * write commits on its own. Reads and writes from other threads wait until
+ * the transaction ends, so they never see its changes before the commit;
+ * snapshots read the last commit meanwhile.
  * @param db Database handle
  * @return STARK_OK on success
  */
@@ -303,7 +807,8 @@ STARK_API stark_result_t stark_begin(stark_db_t* db);
 
 /**
  * Commit current transaction
- * Makes all changes permanent
+ * Makes all changes permanent: the changed pages are appended to the
+ * write-ahead log (<path>.wal), which is fsynced before this returns
  * @param db Database handle
  * @return STARK_OK on success
  */
@@ -324,6 +829,8 @@ STARK_API stark_result_t stark_rollback(stark_db_t* db);
  */
 STARK_API int stark_in_transaction(stark_db_t* db);
 
+#ifdef __cplusplus
+}
 #endif
 
 #endif // STARK_H
\ No newline at end of file
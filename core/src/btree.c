@@ -1,8 +1,64 @@
 #include "btree.h"
+#include "keysearch.h"
+#include "log.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+static LeafValue *leaf_values(BTree *tree, LeafNode *node) {
+    return (LeafValue *)((char *)node + tree->leaf_values_offset);
+}
+
+static page_num_t *node_children(BTree *tree, InternalNode *node) {
+    return (page_num_t *)((char *)node + tree->internal_children_offset);
+}
+
+// Keys are key_size bytes wide. Everything outside these helpers and the
+// searches below moves them as opaque runs of bytes.
+static uint64_t key_at(const BTree *tree, const uint8_t *keys, uint32_t index) {
+    if (tree->key_size == sizeof(uint64_t)) return ((const uint64_t *)keys)[index];
+    return ((const uint32_t *)keys)[index];
+}
+
+static void set_key(const BTree *tree, uint8_t *keys, uint32_t index, uint64_t key) {
+    if (tree->key_size == sizeof(uint64_t)) {
+        ((uint64_t *)keys)[index] = key;
+    } else {
+        ((uint32_t *)keys)[index] = (uint32_t)key;
+    }
+}
+
+static uint8_t *key_slot(const BTree *tree, uint8_t *keys, uint32_t index) {
+    return keys + (size_t)index * tree->key_size;
+}
+
+// Copies count keys, which may overlap
+static void move_keys(const BTree *tree, uint8_t *dest, const uint8_t *src, uint32_t count) {
+    memmove(dest, src, (size_t)count * tree->key_size);
+}
+
+// A key above max_key sorts after every key the node can hold
+static uint32_t search_upper(const BTree *tree, const uint8_t *keys, uint32_t count, uint64_t key) {
+    if (tree->key_size == sizeof(uint64_t)) return keys64_upper_bound((const uint64_t *)keys, count, key);
+    if (key > tree->max_key) return count;
+    return keys_upper_bound((const uint32_t *)keys, count, (uint32_t)key);
+}
+
+static uint32_t search_lower(const BTree *tree, const uint8_t *keys, uint32_t count, uint64_t key) {
+    if (tree->key_size == sizeof(uint64_t)) return keys64_lower_bound((const uint64_t *)keys, count, key);
+    if (key > tree->max_key) return count;
+    return keys_lower_bound((const uint32_t *)keys, count, (uint32_t)key);
+}
+
+// Scratch layout: the keys of two nodes, then their values or children
+static uint8_t *scratch_keys(BTree *tree) {
+    return tree->scratch;
+}
+
+static void *scratch_payload(BTree *tree) {
+    return (char *)tree->scratch + tree->scratch_payload_offset;
+}
+
 static LeafNode *get_leaf_node(Pager *pager, page_num_t page_num) {
     return (LeafNode *)pager_get_page(pager, page_num);
 }
@@ -13,235 +69,504 @@ static InternalNode *get_internal_node(Pager *pager, page_num_t page_num) {
 
 static void initialize_leaf_node(void *page) {
     LeafNode *node = (LeafNode *)page;
+    node->header.format = BTREE_FORMAT_VERSION;
     node->header.type = NODE_LEAF;
     node->header.is_root = 0;
-    node->header.parent = INVALID_PAGE;
     node->num_cells = 0;
+    node->prev_leaf = INVALID_PAGE;
+    node->next_leaf = INVALID_PAGE;
 }
 
 static void initialize_internal_node(void *page) {
     InternalNode *node = (InternalNode *)page;
+    node->header.format = BTREE_FORMAT_VERSION;
     node->header.type = NODE_INTERNAL;
     node->header.is_root = 0;
-    node->header.parent = INVALID_PAGE;
     node->num_keys = 0;
 }
 
-BTree *btree_create(Pager *pager) {
-    BTree *tree = malloc(sizeof(BTree));
-    if (!tree) return NULL;
+// Writes the cached root, height and key count back to the meta page
+static DB_Result write_meta(BTree *tree) {
+    BTreeMeta *meta = pager_get_page(tree->pager, BTREE_META_PAGE);
+    if (!meta) return DB_ERROR;
+    pager_mark_dirty(tree->pager, BTREE_META_PAGE);
+    meta->root_page = tree->root_page_num;
+    meta->height = tree->height;
+    meta->num_keys = tree->num_keys;
+    pager_unpin_page(tree->pager, BTREE_META_PAGE);
+    return DB_SUCCESS;
+}
+
+static BTree *create_index(BTree *tree) {
+    Pager *pager = tree->pager;
     
-    tree->pager = pager;
+    page_num_t meta_page = pager_allocate_page(pager);
+    BTreeMeta *meta = pager_get_page(pager, BTREE_META_PAGE);
+    if (meta_page != BTREE_META_PAGE || !meta) return NULL;
+    pager_mark_dirty(pager, BTREE_META_PAGE);
+    meta->magic = BTREE_MAGIC;
+    meta->format = BTREE_FORMAT_VERSION;
+    meta->key_size = tree->key_size;
+    pager_unpin_page(pager, BTREE_META_PAGE);
     
-    // Check if database already has a root
-    if (pager->num_pages > 0) {
-        // Existing database - root is page 0
-        tree->root_page_num = 0;
+    tree->root_page_num = pager_allocate_page(pager);
+    void *root_node = pager_get_page(pager, tree->root_page_num);
+    if (!root_node) return NULL;
+    pager_mark_dirty(pager, tree->root_page_num);
+    initialize_leaf_node(root_node);
+    ((LeafNode *)root_node)->header.is_root = 1;
+    pager_unpin_page(pager, tree->root_page_num);
+    
+    tree->height = 1;
+    tree->num_keys = 0;
+    return write_meta(tree) == DB_SUCCESS ? tree : NULL;
+}
+
+static BTree *load_index(BTree *tree) {
+    BTreeMeta *meta = pager_get_page(tree->pager, BTREE_META_PAGE);
+    if (!meta) return NULL;
+    
+    uint32_t key_size = meta->key_size == 0 ? sizeof(uint32_t) : meta->key_size;
+    bool valid = meta->magic == BTREE_MAGIC && meta->format == BTREE_FORMAT_VERSION &&
+                 meta->root_page < tree->pager->num_pages &&
+                 (key_size == sizeof(uint32_t) || key_size == sizeof(uint64_t));
+    if (valid) {
+        tree->root_page_num = meta->root_page;
+        tree->height = meta->height;
+        tree->num_keys = meta->num_keys;
+        tree->key_size = key_size;
     } else {
-        // New database - create root
-        tree->root_page_num = pager_allocate_page(pager);
-        void *root_node = pager_get_page(pager, tree->root_page_num);
-        initialize_leaf_node(root_node);
-        ((LeafNode *)root_node)->header.is_root = 1;
+        LOG_ERROR("Index has no valid meta page (format %u, expected %u, key size %u)",
+                  meta->format, BTREE_FORMAT_VERSION, meta->key_size);
     }
+    pager_unpin_page(tree->pager, BTREE_META_PAGE);
+    
+    return valid ? tree : NULL;
+}
+
+// Sizes the key and value arrays to fill a page
+static void compute_layout(BTree *tree, uint32_t page_size) {
+    uint32_t key_size = tree->key_size;
+    tree->max_key = key_size == sizeof(uint64_t) ? UINT64_MAX : UINT32_MAX;
+    
+    uint32_t leaf_prefix = sizeof(LeafNode);
+    uint32_t cells = (page_size - leaf_prefix - sizeof(uint32_t)) /
+                     (key_size + sizeof(LeafValue));
+    tree->leaf_max_cells = cells;
+    tree->leaf_min_cells = cells / 2;
+    // Values are 8-byte aligned; the word reserved above covers the padding
+    tree->leaf_values_offset = (leaf_prefix + cells * key_size + 7) & ~7u;
+    
+    uint32_t internal_prefix = sizeof(InternalNode);
+    uint32_t keys = (page_size - internal_prefix - sizeof(page_num_t)) /
+                    (key_size + sizeof(page_num_t));
+    tree->internal_max_keys = keys;
+    tree->internal_min_keys = keys / 2;
+    tree->internal_children_offset = internal_prefix + keys * key_size;
+    
+    // Two nodes' keys, or an overfull internal node's plus the separator
+    uint32_t scratch_keys = 2 * (cells > keys + 1 ? cells : keys + 1);
+    tree->scratch_payload_offset = (scratch_keys * key_size + 7) & ~7u;
+}
+
+BTree *btree_create(Pager *pager, uint32_t key_size) {
+    BTree *tree = calloc(1, sizeof(BTree));
+    if (!tree) return NULL;
     
-    return tree;
+    tree->pager = pager;
+    tree->key_size = key_size == sizeof(uint64_t) ? sizeof(uint64_t) : sizeof(uint32_t);
+    
+    // Existing index: the meta page says where the root is and how wide
+    // its keys are
+    BTree *result = (pager->num_pages > 0) ? load_index(tree) : create_index(tree);
+    if (result) {
+        compute_layout(tree, pager->page_size);
+        // Two nodes' values take at most two pages
+        tree->scratch = malloc(tree->scratch_payload_offset + 2 * (size_t)pager->page_size);
+        if (!tree->scratch) result = NULL;
+    }
+    if (!result) btree_destroy(tree);
+    return result;
 }
 
-static DB_Result leaf_node_insert(LeafNode *node, uint32_t key, page_num_t value) {
-    if (node->num_cells >= LEAF_NODE_MAX_CELLS) {
+DB_Result btree_reload(BTree *tree) {
+    tree->mod_count++;
+    return load_index(tree) ? DB_SUCCESS : DB_ERROR;
+}
+
+void btree_destroy(BTree *tree) {
+    if (!tree) return;
+    free(tree->scratch);
+    free(tree);
+}
+
+static DB_Result leaf_node_insert(BTree *tree, LeafNode *node, uint64_t key, LeafValue value) {
+    if (node->num_cells >= tree->leaf_max_cells) {
         return DB_FULL;
     }
     
     // Find insertion point
-    int insertion_point = 0;
-    while (insertion_point < node->num_cells && node->keys[insertion_point] < key) {
-        insertion_point++;
-    }
+    uint32_t insertion_point = search_lower(tree, node->keys, node->num_cells, key);
     
     // Shift cells
-    for (int i = node->num_cells; i > insertion_point; i--) {
-        node->keys[i] = node->keys[i - 1];
-        node->values[i] = node->values[i - 1];
-    }
+    uint32_t moved = node->num_cells - insertion_point;
+    move_keys(tree, key_slot(tree, node->keys, insertion_point + 1),
+              key_slot(tree, node->keys, insertion_point), moved);
+    memmove(&leaf_values(tree, node)[insertion_point + 1], &leaf_values(tree, node)[insertion_point],
+            moved * sizeof(LeafValue));
     
     // Insert
-    node->keys[insertion_point] = key;
-    node->values[insertion_point] = value;
+    set_key(tree, node->keys, insertion_point, key);
+    leaf_values(tree, node)[insertion_point] = value;
     node->num_cells++;
     
     return DB_SUCCESS;
 }
 
-static DB_Result leaf_node_find(LeafNode *node, uint32_t key, page_num_t *value) {
-    // Binary search
-    int left = 0;
-    int right = node->num_cells - 1;
+// Cell index holding `key`, or -1
+static int leaf_node_find_cell(BTree *tree, LeafNode *node, uint64_t key) {
+    uint32_t index = search_lower(tree, node->keys, node->num_cells, key);
+    return (index < node->num_cells && key_at(tree, node->keys, index) == key) ? (int)index : -1;
+}
+
+// Child covering `key`: separators equal to a key route it to the right
+static int internal_node_child_index(BTree *tree, InternalNode *node, uint64_t key) {
+    return search_upper(tree, node->keys, node->num_keys, key);
+}
+
+// Drops keys[key_index] and the child to its right
+static void internal_node_remove(BTree *tree, InternalNode *node, int key_index) {
+    uint32_t moved = node->num_keys - key_index - 1;
+    move_keys(tree, key_slot(tree, node->keys, key_index),
+              key_slot(tree, node->keys, key_index + 1), moved);
+    memmove(&node_children(tree, node)[key_index + 1], &node_children(tree, node)[key_index + 2],
+            moved * sizeof(page_num_t));
+    node->num_keys--;
+}
+
+// Replaces a full root: the old root becomes the left child of a new one
+static DB_Result grow_root(BTree *tree, page_num_t left_page, uint64_t key, page_num_t right_page) {
+    page_num_t root_page_num = pager_allocate_page(tree->pager);
+    if (root_page_num == INVALID_PAGE) return DB_FULL;
     
-    while (left <= right) {
-        int mid = (left + right) / 2;
-        if (node->keys[mid] == key) {
-            *value = node->values[mid];
-            return DB_SUCCESS;
-        } else if (node->keys[mid] < key) {
-            left = mid + 1;
-        } else {
-            right = mid - 1;
-        }
+    InternalNode *root = get_internal_node(tree->pager, root_page_num);
+    if (!root) return DB_ERROR;
+    pager_mark_dirty(tree->pager, root_page_num);
+    initialize_internal_node(root);
+    root->header.is_root = 1;
+    node_children(tree, root)[0] = left_page;
+    set_key(tree, root->keys, 0, key);
+    node_children(tree, root)[1] = right_page;
+    root->num_keys = 1;
+    pager_unpin_page(tree->pager, root_page_num);
+    
+    NodeHeader *old_root = pager_get_page(tree->pager, left_page);
+    if (!old_root) return DB_ERROR;
+    pager_mark_dirty(tree->pager, left_page);
+    old_root->is_root = 0;
+    pager_unpin_page(tree->pager, left_page);
+    
+    tree->root_page_num = root_page_num;
+    tree->height++;
+    LOG_DEBUG("New root page %u, height %u", root_page_num, tree->height);
+    return write_meta(tree);
+}
+
+// Adds separator `key` and its right child to the parent of `left_page`,
+// splitting full internal nodes up to the root. path[0..depth) holds the
+// internal pages on the way down to `left_page`.
+static DB_Result insert_into_parent(BTree *tree, page_num_t *path, int depth,
+                                    page_num_t left_page, uint64_t key, page_num_t right_page) {
+    if (depth == 0) {
+        return grow_root(tree, left_page, key, right_page);
     }
     
-    return DB_NOT_FOUND;
+    page_num_t parent_page_num = path[depth - 1];
+    InternalNode *parent = get_internal_node(tree->pager, parent_page_num);
+    if (!parent) return DB_ERROR;
+    pager_mark_dirty(tree->pager, parent_page_num);
+    
+    // Find insertion point in parent
+    uint32_t insert_index = 0;
+    while (insert_index <= parent->num_keys &&
+           node_children(tree, parent)[insert_index] != left_page) {
+        insert_index++;
+    }
+    if (insert_index > parent->num_keys) {
+        pager_unpin_page(tree->pager, parent_page_num);
+        return DB_ERROR;
+    }
+    
+    if (parent->num_keys < tree->internal_max_keys) {
+        // Shift keys and children
+        uint32_t moved = parent->num_keys - insert_index;
+        move_keys(tree, key_slot(tree, parent->keys, insert_index + 1),
+                  key_slot(tree, parent->keys, insert_index), moved);
+        memmove(&node_children(tree, parent)[insert_index + 2],
+                &node_children(tree, parent)[insert_index + 1], moved * sizeof(page_num_t));
+        
+        // Insert new key and child
+        set_key(tree, parent->keys, insert_index, key);
+        node_children(tree, parent)[insert_index + 1] = right_page;
+        parent->num_keys++;
+        pager_unpin_page(tree->pager, parent_page_num);
+        return DB_SUCCESS;
+    }
+    
+    // Full parent: merge the new entry into a scratch copy, then split it
+    uint8_t *keys = scratch_keys(tree);
+    page_num_t *children = scratch_payload(tree);
+    uint32_t total_keys = tree->internal_max_keys + 1;
+    for (uint32_t i = 0, j = 0; i < total_keys; i++) {
+        set_key(tree, keys, i, (i == insert_index) ? key : key_at(tree, parent->keys, j++));
+    }
+    for (uint32_t i = 0, j = 0; i <= total_keys; i++) {
+        children[i] = (i == insert_index + 1) ? right_page : node_children(tree, parent)[j++];
+    }
+    
+    page_num_t sibling_page_num = pager_allocate_page(tree->pager);
+    if (sibling_page_num == INVALID_PAGE) {
+        pager_unpin_page(tree->pager, parent_page_num);
+        return DB_FULL;
+    }
+    InternalNode *sibling = get_internal_node(tree->pager, sibling_page_num);
+    if (!sibling) {
+        pager_unpin_page(tree->pager, parent_page_num);
+        return DB_ERROR;
+    }
+    pager_mark_dirty(tree->pager, sibling_page_num);
+    initialize_internal_node(sibling);
+    
+    // The middle key moves up; it stays in neither half
+    uint32_t split_point = total_keys / 2;
+    parent->num_keys = split_point;
+    move_keys(tree, parent->keys, keys, split_point);
+    memcpy(node_children(tree, parent), children, (split_point + 1) * sizeof(page_num_t));
+    
+    sibling->num_keys = total_keys - split_point - 1;
+    move_keys(tree, sibling->keys, key_slot(tree, keys, split_point + 1), sibling->num_keys);
+    memcpy(node_children(tree, sibling), children + split_point + 1,
+           (sibling->num_keys + 1) * sizeof(page_num_t));
+    
+    uint64_t promoted_key = key_at(tree, keys, split_point);
+    pager_unpin_page(tree->pager, sibling_page_num);
+    pager_unpin_page(tree->pager, parent_page_num);
+    
+    LOG_DEBUG("Split internal page %u, new sibling %u", parent_page_num, sibling_page_num);
+    return insert_into_parent(tree, path, depth - 1, parent_page_num, promoted_key, sibling_page_num);
 }
 
-static DB_Result split_leaf_node(BTree *tree, LeafNode *old_node, page_num_t old_page_num) {
+// Splits a full leaf around the new cell and links the new leaf into the parent
+static DB_Result split_leaf_node(BTree *tree, page_num_t *path, int depth,
+                                 LeafNode *old_node, page_num_t old_page_num,
+                                 uint64_t key, LeafValue value) {
     // Create new node
     page_num_t new_page_num = pager_allocate_page(tree->pager);
     if (new_page_num == INVALID_PAGE) return DB_FULL;
     
     LeafNode *new_node = get_leaf_node(tree->pager, new_page_num);
+    if (!new_node) return DB_ERROR;
+    pager_mark_dirty(tree->pager, new_page_num);
+    pager_mark_dirty(tree->pager, old_page_num);
     initialize_leaf_node((void *)new_node);
     
     // Split at midpoint
-    int split_point = LEAF_NODE_MAX_CELLS / 2;
+    int split_point = tree->leaf_max_cells / 2;
     
     // Copy second half to new node
-    for (int i = split_point; i < LEAF_NODE_MAX_CELLS; i++) {
-        new_node->keys[i - split_point] = old_node->keys[i];
-        new_node->values[i - split_point] = old_node->values[i];
-    }
-    new_node->num_cells = LEAF_NODE_MAX_CELLS - split_point;
+    new_node->num_cells = tree->leaf_max_cells - split_point;
+    move_keys(tree, new_node->keys, key_slot(tree, old_node->keys, split_point), new_node->num_cells);
+    memcpy(leaf_values(tree, new_node), &leaf_values(tree, old_node)[split_point],
+           new_node->num_cells * sizeof(LeafValue));
     old_node->num_cells = split_point;
     
-    // Update parent
-    uint32_t new_key = new_node->keys[0];
-    
-    if (old_node->header.is_root) {
-        // Create new root
-        page_num_t root_page_num = pager_allocate_page(tree->pager);
-        if (root_page_num == INVALID_PAGE) return DB_FULL;
-        
-        InternalNode *root = get_internal_node(tree->pager, root_page_num);
-        initialize_internal_node(root);
-        root->header.is_root = 1;
-        
-        root->children[0] = old_page_num;
-        root->keys[0] = new_key;
-        root->children[1] = new_page_num;
-        root->num_keys = 1;
-        
-        old_node->header.is_root = 0;
-        old_node->header.parent = root_page_num;
-        new_node->header.parent = root_page_num;
-        
-        tree->root_page_num = root_page_num;
-    } else {
-        // Insert into parent
-        InternalNode *parent = get_internal_node(tree->pager, old_node->header.parent);
-        
-        // Find insertion point in parent
-        int insert_index = 0;
-        while (insert_index <= parent->num_keys && 
-               parent->children[insert_index] != old_page_num) {
-            insert_index++;
+    // Link the new leaf in after the old one
+    new_node->prev_leaf = old_page_num;
+    new_node->next_leaf = old_node->next_leaf;
+    old_node->next_leaf = new_page_num;
+    if (new_node->next_leaf != INVALID_PAGE) {
+        LeafNode *after = get_leaf_node(tree->pager, new_node->next_leaf);
+        if (!after) {
+            pager_unpin_page(tree->pager, new_page_num);
+            return DB_ERROR;
         }
-        
-        // Shift keys and children
-        for (int i = parent->num_keys; i > insert_index; i--) {
-            parent->keys[i] = parent->keys[i - 1];
-            parent->children[i + 1] = parent->children[i];
-        }
-        
-        // Insert new key and child
-        parent->keys[insert_index] = new_key;
-        parent->children[insert_index + 1] = new_page_num;
-        parent->num_keys++;
-        
-        new_node->header.parent = old_node->header.parent;
+        pager_mark_dirty(tree->pager, new_node->next_leaf);
+        after->prev_leaf = new_page_num;
+        pager_unpin_page(tree->pager, new_node->next_leaf);
     }
     
-    return DB_SUCCESS;
+    // Place the new cell in whichever half now covers it
+    uint64_t new_key = key_at(tree, new_node->keys, 0);
+    leaf_node_insert(tree, key < new_key ? old_node : new_node, key, value);
+    new_key = key_at(tree, new_node->keys, 0);
+    pager_unpin_page(tree->pager, new_page_num);
+    
+    return insert_into_parent(tree, path, depth, old_page_num, new_key, new_page_num);
 }
 
-DB_Result btree_insert(BTree *tree, uint32_t key, page_num_t value) {
+DB_Result btree_insert(BTree *tree, uint64_t key, LeafValue value) {
+    if (key > tree->max_key) return DB_ERROR;
+    
+    page_num_t path[BTREE_MAX_DEPTH];
+    int depth = 0;
+    
     page_num_t current_page = tree->root_page_num;
     void *node = pager_get_page(tree->pager, current_page);
+    if (!node) return DB_ERROR;
     NodeHeader *header = (NodeHeader *)node;
     
-    // Navigate to leaf
+    // Navigate to leaf, remembering the internal nodes passed
     while (header->type == NODE_INTERNAL) {
         InternalNode *internal = (InternalNode *)node;
+        int child_index = internal_node_child_index(tree, internal, key);
         
-        // Find correct child
-        int child_index = 0;
-        while (child_index < internal->num_keys && key >= internal->keys[child_index]) {
-            child_index++;
-        }
-        
-        current_page = internal->children[child_index];
+        page_num_t child_page = node_children(tree, internal)[child_index];
+        pager_unpin_page(tree->pager, current_page);
+        if (depth == BTREE_MAX_DEPTH) return DB_ERROR;
+        path[depth++] = current_page;
+        current_page = child_page;
         node = pager_get_page(tree->pager, current_page);
+        if (!node) return DB_ERROR;
         header = (NodeHeader *)node;
     }
     
     // Insert into leaf
     LeafNode *leaf = (LeafNode *)node;
     
-    // Check if leaf is full
-    if (leaf->num_cells >= LEAF_NODE_MAX_CELLS) {
-        DB_Result result = split_leaf_node(tree, leaf, current_page);
-        if (result != DB_SUCCESS) return result;
-        
-        // Retry insertion (now with new structure)
-        return btree_insert(tree, key, value);
+    // Existing key: replace its value in place
+    int cell = leaf_node_find_cell(tree, leaf, key);
+    if (cell >= 0) {
+        pager_mark_dirty(tree->pager, current_page);
+        leaf_values(tree, leaf)[cell] = value;
+        pager_unpin_page(tree->pager, current_page);
+        return DB_SUCCESS;
     }
     
-    return leaf_node_insert(leaf, key, value);
+    DB_Result result;
+    if (leaf->num_cells >= tree->leaf_max_cells) {
+        result = split_leaf_node(tree, path, depth, leaf, current_page, key, value);
+    } else {
+        pager_mark_dirty(tree->pager, current_page);
+        result = leaf_node_insert(tree, leaf, key, value);
+    }
+    pager_unpin_page(tree->pager, current_page);
+    
+    if (result == DB_SUCCESS) {
+        tree->num_keys++;
+        tree->mod_count++;
+        result = write_meta(tree);
+    }
+    return result;
+}
+
+typedef enum {
+    DESCEND_KEY,
+    DESCEND_FIRST,
+    DESCEND_LAST
+} DescendMode;
+
+// Outcome of reading one node without pinning it
+typedef enum {
+    PEEK_MISS,      // Not cached, or its frame was reused while being read
+    PEEK_CHILD,     // Internal node: *child is the page to descend into
+    PEEK_LEAF       // Leaf: with a value to fill, *found says whether key is there
+} PeekResult;
+
+// Descents read cached nodes this way, so threads passing through the same
+// upper levels never write to them or wait on a latch. The frame can be
+// refilled while it is read, so counts are clamped to keep every access
+// inside the page, and the result is thrown away if the frame was reused.
+static PeekResult peek_node(BTree *tree, page_num_t page_num, DescendMode mode, uint64_t key,
+                            page_num_t *child, LeafValue *value, bool *found) {
+    PagerPeek peek;
+    const NodeHeader *header = pager_peek_page(tree->pager, page_num, &peek);
+    if (!header) return PEEK_MISS;
+    
+    PeekResult result = PEEK_MISS;
+    NodeType type = header->type;
+    if (type == NODE_INTERNAL) {
+        InternalNode *internal = (InternalNode *)header;
+        uint32_t num_keys = __atomic_load_n(&internal->num_keys, __ATOMIC_RELAXED);
+        if (num_keys > tree->internal_max_keys) num_keys = tree->internal_max_keys;
+        uint32_t index = mode == DESCEND_FIRST ? 0 :
+                         mode == DESCEND_LAST ? num_keys :
+                         search_upper(tree, internal->keys, num_keys, key);
+        *child = node_children(tree, internal)[index];
+        result = PEEK_CHILD;
+    } else if (type == NODE_LEAF) {
+        if (value) {
+            LeafNode *leaf = (LeafNode *)header;
+            uint32_t num_cells = __atomic_load_n(&leaf->num_cells, __ATOMIC_RELAXED);
+            if (num_cells > tree->leaf_max_cells) num_cells = tree->leaf_max_cells;
+            uint32_t index = search_lower(tree, leaf->keys, num_cells, key);
+            *found = index < num_cells && key_at(tree, leaf->keys, index) == key;
+            if (*found) *value = leaf_values(tree, leaf)[index];
+        }
+        result = PEEK_LEAF;
+    }
+    return pager_peek_valid(&peek) ? result : PEEK_MISS;
 }
 
-DB_Result btree_find(BTree *tree, uint32_t key, page_num_t *value) {
-    printf("Debug: btree_find(key=%u)\n", key);
+DB_Result btree_find(BTree *tree, uint64_t key, LeafValue *value) {
+    LOG_TRACE("btree_find(key=%llu)", (unsigned long long)key);
     
+    // Cached nodes are read without pins; the first miss continues pinned
     page_num_t current_page = tree->root_page_num;
+    for (int depth = 0; depth <= BTREE_MAX_DEPTH; depth++) {
+        page_num_t child;
+        bool found;
+        PeekResult step = peek_node(tree, current_page, DESCEND_KEY, key, &child, value, &found);
+        if (step == PEEK_MISS) break;
+        if (step == PEEK_LEAF) return found ? DB_SUCCESS : DB_NOT_FOUND;
+        current_page = child;
+    }
+    
     void *node = pager_get_page(tree->pager, current_page);
+    if (!node) return DB_ERROR;
     NodeHeader *header = (NodeHeader *)node;
     
-    printf("Debug: Root page=%u, node type=%d\n", current_page, header->type);
+    LOG_TRACE("Root page=%u, node type=%d", current_page, header->type);
     
     // Navigate to leaf
     while (header->type == NODE_INTERNAL) {
         InternalNode *internal = (InternalNode *)node;
         
         // Find correct child
-        int child_index = 0;
-        while (child_index < internal->num_keys && key >= internal->keys[child_index]) {
-            child_index++;
-        }
+        int child_index = internal_node_child_index(tree, internal, key);
         
-        current_page = internal->children[child_index];
-        printf("Debug: Going to child page %u at index %d\n", current_page, child_index);
+        page_num_t child_page = node_children(tree, internal)[child_index];
+        pager_unpin_page(tree->pager, current_page);
+        current_page = child_page;
+        LOG_TRACE("Going to child page %u at index %d", current_page, child_index);
         
         node = pager_get_page(tree->pager, current_page);
+        if (!node) return DB_ERROR;
         header = (NodeHeader *)node;
     }
     
     // Search in leaf
     LeafNode *leaf = (LeafNode *)node;
-    printf("Debug: Leaf node has %u cells\n", leaf->num_cells);
+    LOG_TRACE("Leaf node has %u cells", leaf->num_cells);
     
-    for (int i = 0; i < leaf->num_cells; i++) {
-        printf("Debug: Cell %d: key=%u, value=%u\n", i, leaf->keys[i], leaf->values[i]);
-        if (leaf->keys[i] == key) {
-            *value = leaf->values[i];
-            printf("Debug: Found key %u at cell %d, value=%u\n", key, i, *value);
-            return DB_SUCCESS;
-        }
+    int cell = leaf_node_find_cell(tree, leaf, key);
+    if (cell >= 0) {
+        *value = leaf_values(tree, leaf)[cell];
+        LOG_TRACE("Found key %llu at cell %d, locator=0x%llX, length=%llu",
+                  (unsigned long long)key, cell,
+                  (unsigned long long)value->locator, (unsigned long long)value->length);
+        pager_unpin_page(tree->pager, current_page);
+        return DB_SUCCESS;
     }
     
-    printf("Debug: Key %u not found in leaf\n", key);
+    LOG_TRACE("Key %llu not found in leaf", (unsigned long long)key);
+    pager_unpin_page(tree->pager, current_page);
     return DB_NOT_FOUND;
 }
 
-void btree_print_node(Pager *pager, page_num_t page_num, int level) {
+static void btree_print_node(BTree *tree, page_num_t page_num, int level) {
+    Pager *pager = tree->pager;
     void *node = pager_get_page(pager, page_num);
+    if (!node) return;
     NodeHeader *header = (NodeHeader *)node;
     
     for (int i = 0; i < level; i++) printf("  ");
@@ -249,50 +574,224 @@ void btree_print_node(Pager *pager, page_num_t page_num, int level) {
     if (header->type == NODE_LEAF) {
         LeafNode *leaf = (LeafNode *)node;
         printf("Leaf[%d]: ", page_num);
-        for (int i = 0; i < leaf->num_cells; i++) {
-            printf("%d ", leaf->keys[i]);
+        for (uint32_t i = 0; i < leaf->num_cells; i++) {
+            printf("%llu ", (unsigned long long)key_at(tree, leaf->keys, i));
         }
         printf("\n");
     } else {
         InternalNode *internal = (InternalNode *)node;
         printf("Internal[%d]: ", page_num);
-        for (int i = 0; i < internal->num_keys; i++) {
-            printf("%d ", internal->keys[i]);
+        for (uint32_t i = 0; i < internal->num_keys; i++) {
+            printf("%llu ", (unsigned long long)key_at(tree, internal->keys, i));
         }
         printf("\n");
         
-        for (int i = 0; i <= internal->num_keys; i++) {
-            btree_print_node(pager, internal->children[i], level + 1);
+        for (uint32_t i = 0; i <= internal->num_keys; i++) {
+            btree_print_node(tree, node_children(tree, internal)[i], level + 1);
         }
     }
+    
+    pager_unpin_page(pager, page_num);
 }
 
 void btree_print(BTree *tree) {
     printf("B-Tree Structure:\n");
-    btree_print_node(tree->pager, tree->root_page_num, 0);
+    btree_print_node(tree, tree->root_page_num, 0);
+}
+
+// Evens out the cells of two adjacent leaves, or moves them all into the
+// left one when together they fall below two minimums. Returns true on merge.
+static bool redistribute_leaves(BTree *tree, LeafNode *left, LeafNode *right) {
+    uint8_t *keys = scratch_keys(tree);
+    LeafValue *values = scratch_payload(tree);
+    uint32_t total = left->num_cells + right->num_cells;
+    move_keys(tree, keys, left->keys, left->num_cells);
+    move_keys(tree, key_slot(tree, keys, left->num_cells), right->keys, right->num_cells);
+    memcpy(values, leaf_values(tree, left), left->num_cells * sizeof(LeafValue));
+    memcpy(values + left->num_cells, leaf_values(tree, right), right->num_cells * sizeof(LeafValue));
+    
+    bool merged = total < 2 * tree->leaf_min_cells;
+    uint32_t left_cells = merged ? total : total / 2;
+    
+    move_keys(tree, left->keys, keys, left_cells);
+    memcpy(leaf_values(tree, left), values, left_cells * sizeof(LeafValue));
+    left->num_cells = left_cells;
+    
+    right->num_cells = total - left_cells;
+    move_keys(tree, right->keys, key_slot(tree, keys, left_cells), right->num_cells);
+    memcpy(leaf_values(tree, right), values + left_cells, right->num_cells * sizeof(LeafValue));
+    return merged;
+}
+
+// Evens out two adjacent leaves, or merges the right one into the left when
+// they fit in one page. parent is pinned and dirty; children[left_index]
+// and children[left_index + 1] are the pair.
+static DB_Result rebalance_leaves(BTree *tree, InternalNode *parent, int left_index, bool *merged) {
+    page_num_t left_page = node_children(tree, parent)[left_index];
+    page_num_t right_page = node_children(tree, parent)[left_index + 1];
+    LeafNode *left = get_leaf_node(tree->pager, left_page);
+    if (!left) return DB_ERROR;
+    LeafNode *right = get_leaf_node(tree->pager, right_page);
+    if (!right) {
+        pager_unpin_page(tree->pager, left_page);
+        return DB_ERROR;
+    }
+    pager_mark_dirty(tree->pager, left_page);
+    pager_mark_dirty(tree->pager, right_page);
+    
+    *merged = redistribute_leaves(tree, left, right);
+    
+    page_num_t after_page = right->next_leaf;
+    if (!*merged) {
+        set_key(tree, parent->keys, left_index, key_at(tree, right->keys, 0));
+    } else {
+        // Unlink the emptied right leaf
+        left->next_leaf = after_page;
+    }
+    
+    pager_unpin_page(tree->pager, left_page);
+    pager_unpin_page(tree->pager, right_page);
+    
+    if (*merged && after_page != INVALID_PAGE) {
+        LeafNode *after = get_leaf_node(tree->pager, after_page);
+        if (!after) return DB_ERROR;
+        pager_mark_dirty(tree->pager, after_page);
+        after->prev_leaf = left_page;
+        pager_unpin_page(tree->pager, after_page);
+    }
+    
+    if (*merged) {
+        internal_node_remove(tree, parent, left_index);
+        pager_free_page(tree->pager, right_page);
+        LOG_DEBUG("Merged leaf %u into %u", right_page, left_page);
+    }
+    return DB_SUCCESS;
+}
+
+// Same as rebalance_leaves for internal nodes; the parent's separator is
+// pulled down between the two key runs and a new one is pushed back up
+static DB_Result rebalance_internals(BTree *tree, InternalNode *parent, int left_index, bool *merged) {
+    page_num_t left_page = node_children(tree, parent)[left_index];
+    page_num_t right_page = node_children(tree, parent)[left_index + 1];
+    InternalNode *left = get_internal_node(tree->pager, left_page);
+    if (!left) return DB_ERROR;
+    InternalNode *right = get_internal_node(tree->pager, right_page);
+    if (!right) {
+        pager_unpin_page(tree->pager, left_page);
+        return DB_ERROR;
+    }
+    pager_mark_dirty(tree->pager, left_page);
+    pager_mark_dirty(tree->pager, right_page);
+    
+    uint8_t *keys = scratch_keys(tree);
+    page_num_t *children = scratch_payload(tree);
+    uint32_t total = left->num_keys + right->num_keys;  // Excluding the separator
+    move_keys(tree, keys, left->keys, left->num_keys);
+    set_key(tree, keys, left->num_keys, key_at(tree, parent->keys, left_index));
+    move_keys(tree, key_slot(tree, keys, left->num_keys + 1), right->keys, right->num_keys);
+    memcpy(children, node_children(tree, left), (left->num_keys + 1) * sizeof(page_num_t));
+    memcpy(children + left->num_keys + 1, node_children(tree, right), (right->num_keys + 1) * sizeof(page_num_t));
+    
+    *merged = total < 2 * tree->internal_min_keys;
+    uint32_t left_keys = *merged ? total + 1 : total / 2;
+    
+    move_keys(tree, left->keys, keys, left_keys);
+    memcpy(node_children(tree, left), children, (left_keys + 1) * sizeof(page_num_t));
+    left->num_keys = left_keys;
+    
+    if (!*merged) {
+        set_key(tree, parent->keys, left_index, key_at(tree, keys, left_keys));
+        right->num_keys = total - left_keys;
+        move_keys(tree, right->keys, key_slot(tree, keys, left_keys + 1), right->num_keys);
+        memcpy(node_children(tree, right), children + left_keys + 1, (right->num_keys + 1) * sizeof(page_num_t));
+    }
+    
+    pager_unpin_page(tree->pager, left_page);
+    pager_unpin_page(tree->pager, right_page);
+    
+    if (*merged) {
+        internal_node_remove(tree, parent, left_index);
+        pager_free_page(tree->pager, right_page);
+        LOG_DEBUG("Merged internal %u into %u", right_page, left_page);
+    }
+    return DB_SUCCESS;
+}
+
+// Root with a single child: the child becomes the root
+static DB_Result shrink_root(BTree *tree, page_num_t new_root) {
+    NodeHeader *header = pager_get_page(tree->pager, new_root);
+    if (!header) return DB_ERROR;
+    pager_mark_dirty(tree->pager, new_root);
+    header->is_root = 1;
+    pager_unpin_page(tree->pager, new_root);
+    
+    pager_free_page(tree->pager, tree->root_page_num);
+    tree->root_page_num = new_root;
+    tree->height--;
+    LOG_DEBUG("Root moved to page %u, height %u", new_root, tree->height);
+    return DB_SUCCESS;
+}
+
+// Restores minimum occupancy after a delete left the node at the end of
+// path underfull, walking up while merges keep draining parents.
+// path[level] is an internal page and indexes[level] the child taken from it.
+static DB_Result rebalance_after_delete(BTree *tree, page_num_t *path, int *indexes, int depth) {
+    for (int level = depth - 1; level >= 0; level--) {
+        InternalNode *parent = get_internal_node(tree->pager, path[level]);
+        if (!parent) return DB_ERROR;
+        pager_mark_dirty(tree->pager, path[level]);
+        
+        // Pair the node with its left sibling, or its right one if it is first
+        int left_index = indexes[level] > 0 ? indexes[level] - 1 : 0;
+        bool merged = false;
+        DB_Result result = DB_SUCCESS;
+        if (parent->num_keys > 0) {
+            result = (level == depth - 1)
+                ? rebalance_leaves(tree, parent, left_index, &merged)
+                : rebalance_internals(tree, parent, left_index, &merged);
+        }
+        uint32_t parent_keys = parent->num_keys;
+        page_num_t only_child = node_children(tree, parent)[0];
+        pager_unpin_page(tree->pager, path[level]);
+        
+        if (result != DB_SUCCESS || !merged) return result;
+        if (level == 0) {
+            return parent_keys == 0 ? shrink_root(tree, only_child) : DB_SUCCESS;
+        }
+        if (parent_keys >= tree->internal_min_keys) return DB_SUCCESS;
+    }
+    return DB_SUCCESS;
 }
 
 // Add this function to btree.c
-DB_Result btree_delete(BTree *tree, uint32_t key) {
+DB_Result btree_delete(BTree *tree, uint64_t key) {
     if (!tree || !tree->pager) return DB_ERROR;
     
-    printf("Debug: btree_delete(key=%u)\n", key);
+    LOG_TRACE("btree_delete(key=%llu)", (unsigned long long)key);
+    
+    page_num_t path[BTREE_MAX_DEPTH];
+    int indexes[BTREE_MAX_DEPTH];
+    int depth = 0;
     
     page_num_t current_page = tree->root_page_num;
     void *node = pager_get_page(tree->pager, current_page);
+    if (!node) return DB_ERROR;
     NodeHeader *header = (NodeHeader *)node;
     
     // Navigate to leaf
     while (header->type == NODE_INTERNAL) {
         InternalNode *internal = (InternalNode *)node;
         
-        int child_index = 0;
-        while (child_index < internal->num_keys && key >= internal->keys[child_index]) {
-            child_index++;
-        }
+        int child_index = internal_node_child_index(tree, internal, key);
         
-        current_page = internal->children[child_index];
+        page_num_t child_page = node_children(tree, internal)[child_index];
+        pager_unpin_page(tree->pager, current_page);
+        if (depth == BTREE_MAX_DEPTH) return DB_ERROR;
+        path[depth] = current_page;
+        indexes[depth++] = child_index;
+        current_page = child_page;
         node = pager_get_page(tree->pager, current_page);
+        if (!node) return DB_ERROR;
         header = (NodeHeader *)node;
     }
     
@@ -300,32 +799,543 @@ DB_Result btree_delete(BTree *tree, uint32_t key) {
     LeafNode *leaf = (LeafNode *)node;
     
     // Find the key
-    int found_index = -1;
-    for (int i = 0; i < leaf->num_cells; i++) {
-        if (leaf->keys[i] == key) {
-            found_index = i;
-            break;
-        }
-    }
+    int found_index = leaf_node_find_cell(tree, leaf, key);
     
     if (found_index == -1) {
-        printf("Debug: Key %u not found in leaf\n", key);
+        LOG_TRACE("Key %llu not found in leaf", (unsigned long long)key);
+        pager_unpin_page(tree->pager, current_page);
         return DB_NOT_FOUND;
     }
     
     // Remove the key by shifting all cells after it left
-    printf("Debug: Removing key %u at index %d\n", key, found_index);
+    LOG_TRACE("Removing key %llu at index %d", (unsigned long long)key, found_index);
     
-    for (int i = found_index; i < leaf->num_cells - 1; i++) {
-        leaf->keys[i] = leaf->keys[i + 1];
-        leaf->values[i] = leaf->values[i + 1];
-    }
+    pager_mark_dirty(tree->pager, current_page);
+    uint32_t moved = leaf->num_cells - found_index - 1;
+    move_keys(tree, key_slot(tree, leaf->keys, found_index),
+              key_slot(tree, leaf->keys, found_index + 1), moved);
+    memmove(&leaf_values(tree, leaf)[found_index], &leaf_values(tree, leaf)[found_index + 1],
+            moved * sizeof(LeafValue));
     
     leaf->num_cells--;
-    printf("Debug: Leaf now has %u cells\n", leaf->num_cells);
+    LOG_TRACE("Leaf now has %u cells", leaf->num_cells);
+    
+    bool underfull = depth > 0 && leaf->num_cells < tree->leaf_min_cells;
+    pager_unpin_page(tree->pager, current_page);
+    
+    tree->num_keys--;
+    tree->mod_count++;
+    DB_Result result = underfull ? rebalance_after_delete(tree, path, indexes, depth) : DB_SUCCESS;
+    DB_Result meta_result = write_meta(tree);
+    return result != DB_SUCCESS ? result : meta_result;
+}
+// ==================== BATCHES ====================
+
+// Root-to-leaf path kept between the keys of a sorted batch. bounds[d] is
+// the exclusive upper key limit of nodes[d], unless the node is the last
+// on its level; a following key that is still below it is reached from
+// nodes[d] without going back to the root.
+typedef struct {
+    page_num_t nodes[BTREE_MAX_DEPTH + 1];
+    uint64_t bounds[BTREE_MAX_DEPTH + 1];
+    bool bounded[BTREE_MAX_DEPTH + 1];
+    int leaf_depth;             // -1 = no path yet
+} BatchPath;
+
+static bool batch_covers(const BatchPath *path, int depth, uint64_t key) {
+    return !path->bounded[depth] || key < path->bounds[depth];
+}
+
+// Pins and returns the leaf for key, reusing as much of the path as covers it
+static LeafNode *batch_descend(BTree *tree, BatchPath *path, uint64_t key) {
+    int depth = path->leaf_depth;
+    if (depth < 0) {
+        depth = 0;
+        path->nodes[0] = tree->root_page_num;
+        path->bounds[0] = 0;
+        path->bounded[0] = false;
+    }
+    while (depth > 0 && !batch_covers(path, depth, key)) depth--;
+    
+    for (;;) {
+        NodeHeader *header = pager_get_page(tree->pager, path->nodes[depth]);
+        if (!header) return NULL;
+        if (header->type == NODE_LEAF) {
+            path->leaf_depth = depth;
+            return (LeafNode *)header;
+        }
+        
+        InternalNode *internal = (InternalNode *)header;
+        int child_index = internal_node_child_index(tree, internal, key);
+        page_num_t child_page = node_children(tree, internal)[child_index];
+        bool last = (uint32_t)child_index == internal->num_keys;
+        uint64_t bound = last ? path->bounds[depth] : key_at(tree, internal->keys, child_index);
+        bool bounded = last ? path->bounded[depth] : true;
+        pager_unpin_page(tree->pager, path->nodes[depth]);
+        
+        if (depth == BTREE_MAX_DEPTH) return NULL;
+        depth++;
+        path->nodes[depth] = child_page;
+        path->bounds[depth] = bound;
+        path->bounded[depth] = bounded;
+    }
+}
+
+DB_Result btree_insert_batch(BTree *tree, const uint64_t *keys, const LeafValue *values,
+                             uint32_t count, LeafValue *previous, bool *existed,
+                             uint32_t *applied) {
+    // Keys ascend, so the last is the widest
+    *applied = 0;
+    if (count > 0 && keys[count - 1] > tree->max_key) return DB_ERROR;
+    
+    BatchPath path;
+    path.leaf_depth = -1;
+    DB_Result result = DB_SUCCESS;
+    uint32_t i = 0;
+    uint64_t added = 0;
+    
+    while (i < count && result == DB_SUCCESS) {
+        LeafNode *leaf = batch_descend(tree, &path, keys[i]);
+        if (!leaf) {
+            result = DB_ERROR;
+            break;
+        }
+        page_num_t leaf_page = path.nodes[path.leaf_depth];
+        pager_mark_dirty(tree->pager, leaf_page);
+        
+        // Every key below the leaf's bound lands in this leaf
+        while (i < count && batch_covers(&path, path.leaf_depth, keys[i])) {
+            int cell = leaf_node_find_cell(tree, leaf, keys[i]);
+            existed[i] = cell >= 0;
+            if (cell >= 0) {
+                previous[i] = leaf_values(tree, leaf)[cell];
+                leaf_values(tree, leaf)[cell] = values[i];
+            } else if (leaf->num_cells < tree->leaf_max_cells) {
+                leaf_node_insert(tree, leaf, keys[i], values[i]);
+                added++;
+            } else {
+                // The split reshapes the path; the next key starts from the root
+                result = split_leaf_node(tree, path.nodes, path.leaf_depth, leaf, leaf_page,
+                                         keys[i], values[i]);
+                path.leaf_depth = -1;
+                if (result == DB_SUCCESS) {
+                    added++;
+                    i++;
+                }
+                break;
+            }
+            i++;
+        }
+        pager_unpin_page(tree->pager, leaf_page);
+    }
     
-    // Force flush to disk
-    pager_flush_page(tree->pager, current_page);
+    *applied = i;
+    if (added > 0) {
+        tree->num_keys += added;
+        tree->mod_count++;
+    }
+    DB_Result meta_result = write_meta(tree);
+    return result != DB_SUCCESS ? result : meta_result;
+}
+
+DB_Result btree_find_batch(BTree *tree, const uint64_t *keys, uint32_t count,
+                           LeafValue *values, bool *found) {
+    BatchPath path;
+    path.leaf_depth = -1;
+    uint32_t i = 0;
     
+    while (i < count) {
+        LeafNode *leaf = batch_descend(tree, &path, keys[i]);
+        if (!leaf) return DB_ERROR;
+        page_num_t leaf_page = path.nodes[path.leaf_depth];
+        
+        while (i < count && batch_covers(&path, path.leaf_depth, keys[i])) {
+            int cell = leaf_node_find_cell(tree, leaf, keys[i]);
+            found[i] = cell >= 0;
+            if (cell >= 0) values[i] = leaf_values(tree, leaf)[cell];
+            i++;
+        }
+        pager_unpin_page(tree->pager, leaf_page);
+    }
     return DB_SUCCESS;
-}
\ No newline at end of file
+}
+
+// ==================== CURSORS ====================
+
+// Returns the leaf that covers key, or the leftmost / rightmost leaf
+static page_num_t descend_to_leaf(BTree *tree, DescendMode mode, uint64_t key) {
+    page_num_t current_page = tree->root_page_num;
+    for (;;) {
+        page_num_t child_page;
+        PeekResult step = peek_node(tree, current_page, mode, key, &child_page, NULL, NULL);
+        if (step == PEEK_LEAF) return current_page;
+        if (step == PEEK_CHILD) {
+            current_page = child_page;
+            continue;
+        }
+        
+        NodeHeader *header = (NodeHeader *)pager_get_page(tree->pager, current_page);
+        if (!header) return INVALID_PAGE;
+        if (header->type == NODE_LEAF) {
+            pager_unpin_page(tree->pager, current_page);
+            return current_page;
+        }
+        
+        InternalNode *internal = (InternalNode *)header;
+        int child_index = mode == DESCEND_FIRST ? 0 :
+                          mode == DESCEND_LAST ? (int)internal->num_keys :
+                          internal_node_child_index(tree, internal, key);
+        child_page = node_children(tree, internal)[child_index];
+        pager_unpin_page(tree->pager, current_page);
+        current_page = child_page;
+    }
+}
+
+// Puts the cursor on cell `index` of `leaf`, or on the nearest cell after
+// it (forward) or before it (backward) by following sibling links
+static DB_Result cursor_settle(BTreeCursor *cursor, page_num_t leaf, int64_t index, bool forward) {
+    BTree *tree = cursor->tree;
+    cursor->valid = false;
+    
+    while (leaf != INVALID_PAGE) {
+        LeafNode *node = get_leaf_node(tree->pager, leaf);
+        if (!node) return DB_ERROR;
+        
+        if (index >= 0 && index < node->num_cells) {
+            cursor->leaf = leaf;
+            cursor->index = (uint32_t)index;
+            cursor->key = key_at(tree, node->keys, (uint32_t)index);
+            cursor->mod_count = tree->mod_count;
+            cursor->valid = true;
+            pager_unpin_page(tree->pager, leaf);
+            return DB_SUCCESS;
+        }
+        
+        page_num_t sibling = forward ? node->next_leaf : node->prev_leaf;
+        pager_unpin_page(tree->pager, leaf);
+        leaf = sibling;
+        if (forward) {
+            index = 0;
+        } else if (leaf != INVALID_PAGE) {
+            // Index the last cell once the page is loaded
+            LeafNode *prev = get_leaf_node(tree->pager, leaf);
+            if (!prev) return DB_ERROR;
+            index = (int64_t)prev->num_cells - 1;
+            pager_unpin_page(tree->pager, leaf);
+        }
+    }
+    return DB_NOT_FOUND;
+}
+
+// If the tree changed under the cursor, re-seeks to its key. *moved is set
+// when that key is gone and the cursor now sits on its successor.
+static DB_Result cursor_revalidate(BTreeCursor *cursor, bool *moved) {
+    *moved = false;
+    if (!cursor->valid) return DB_NOT_FOUND;
+    if (cursor->mod_count == cursor->tree->mod_count) return DB_SUCCESS;
+    
+    uint64_t key = cursor->key;
+    DB_Result result = btree_cursor_seek(cursor, key);
+    if (result == DB_SUCCESS) *moved = cursor->key != key;
+    return result;
+}
+
+void btree_cursor_init(BTreeCursor *cursor, BTree *tree) {
+    memset(cursor, 0, sizeof(*cursor));
+    cursor->tree = tree;
+    cursor->leaf = INVALID_PAGE;
+}
+
+DB_Result btree_cursor_first(BTreeCursor *cursor) {
+    page_num_t leaf = descend_to_leaf(cursor->tree, DESCEND_FIRST, 0);
+    if (leaf == INVALID_PAGE) return DB_ERROR;
+    return cursor_settle(cursor, leaf, 0, true);
+}
+
+DB_Result btree_cursor_last(BTreeCursor *cursor) {
+    BTree *tree = cursor->tree;
+    page_num_t leaf = descend_to_leaf(tree, DESCEND_LAST, 0);
+    if (leaf == INVALID_PAGE) return DB_ERROR;
+    
+    LeafNode *node = get_leaf_node(tree->pager, leaf);
+    if (!node) return DB_ERROR;
+    int64_t index = (int64_t)node->num_cells - 1;
+    pager_unpin_page(tree->pager, leaf);
+    return cursor_settle(cursor, leaf, index, false);
+}
+
+DB_Result btree_cursor_seek(BTreeCursor *cursor, uint64_t key) {
+    BTree *tree = cursor->tree;
+    page_num_t leaf = descend_to_leaf(tree, DESCEND_KEY, key);
+    if (leaf == INVALID_PAGE) return DB_ERROR;
+    
+    LeafNode *node = get_leaf_node(tree->pager, leaf);
+    if (!node) return DB_ERROR;
+    uint32_t index = search_lower(tree, node->keys, node->num_cells, key);
+    pager_unpin_page(tree->pager, leaf);
+    
+    // Past the leaf's last key: the answer starts the next leaf
+    return cursor_settle(cursor, leaf, index, true);
+}
+
+DB_Result btree_cursor_next(BTreeCursor *cursor) {
+    bool moved;
+    DB_Result result = cursor_revalidate(cursor, &moved);
+    if (result != DB_SUCCESS || moved) return result;
+    return cursor_settle(cursor, cursor->leaf, (int64_t)cursor->index + 1, true);
+}
+
+DB_Result btree_cursor_prev(BTreeCursor *cursor) {
+    bool moved;
+    bool stale = cursor->valid && cursor->mod_count != cursor->tree->mod_count;
+    DB_Result result = cursor_revalidate(cursor, &moved);
+    // Nothing left at or after the old key: its predecessor is the last key
+    if (result == DB_NOT_FOUND && stale) return btree_cursor_last(cursor);
+    if (result != DB_SUCCESS) return result;
+    return cursor_settle(cursor, cursor->leaf, (int64_t)cursor->index - 1, false);
+}
+
+DB_Result btree_cursor_get(BTreeCursor *cursor, uint64_t *key, LeafValue *value) {
+    bool moved;
+    DB_Result result = cursor_revalidate(cursor, &moved);
+    if (result != DB_SUCCESS) return result;
+    // The cursor's own key was deleted
+    if (moved) return DB_NOT_FOUND;
+    
+    BTree *tree = cursor->tree;
+    LeafNode *node = get_leaf_node(tree->pager, cursor->leaf);
+    if (!node) return DB_ERROR;
+    if (key) *key = key_at(tree, node->keys, cursor->index);
+    if (value) *value = leaf_values(tree, node)[cursor->index];
+    pager_unpin_page(tree->pager, cursor->leaf);
+    return DB_SUCCESS;
+}
+
+uint32_t btree_cursor_fetch(BTreeCursor *cursor, uint64_t *keys, LeafValue *values, uint32_t max) {
+    bool moved;
+    if (cursor_revalidate(cursor, &moved) != DB_SUCCESS) return 0;
+    
+    BTree *tree = cursor->tree;
+    uint32_t count = 0;
+    while (count < max && cursor->valid) {
+        // Copy the rest of this leaf in one go, then step to its sibling
+        LeafNode *node = get_leaf_node(tree->pager, cursor->leaf);
+        if (!node) break;
+        uint32_t available = node->num_cells - cursor->index;
+        uint32_t take = available < max - count ? available : max - count;
+        for (uint32_t i = 0; i < take; i++) {
+            keys[count + i] = key_at(tree, node->keys, cursor->index + i);
+        }
+        if (values) {
+            memcpy(values + count, leaf_values(tree, node) + cursor->index, take * sizeof(LeafValue));
+        }
+        pager_unpin_page(tree->pager, cursor->leaf);
+        
+        count += take;
+        if (cursor_settle(cursor, cursor->leaf, (int64_t)cursor->index + take, true) != DB_SUCCESS) break;
+    }
+    return count;
+}
+
+// ==================== BULK LOAD ====================
+
+DB_Result btree_builder_begin(BTreeBuilder *builder, BTree *tree, uint32_t fill_percent) {
+    if (tree->num_keys > 0 || tree->height != 1) return DB_ERROR;
+    if (fill_percent < 50) fill_percent = 50;
+    if (fill_percent > 100) fill_percent = 100;
+    
+    memset(builder, 0, sizeof(*builder));
+    builder->tree = tree;
+    builder->leaf_fill = tree->leaf_max_cells * fill_percent / 100;
+    if (builder->leaf_fill < tree->leaf_min_cells) builder->leaf_fill = tree->leaf_min_cells;
+    builder->internal_fill = (tree->internal_max_keys + 1) * fill_percent / 100;
+    if (builder->internal_fill < tree->internal_min_keys + 1) builder->internal_fill = tree->internal_min_keys + 1;
+    
+    // The empty root leaf becomes the first leaf
+    builder->leaf = tree->root_page_num;
+    builder->prev_leaf = INVALID_PAGE;
+    builder->node = get_leaf_node(tree->pager, builder->leaf);
+    if (!builder->node) return DB_ERROR;
+    pager_mark_dirty(tree->pager, builder->leaf);
+    builder->node->header.is_root = 0;
+    
+    builder->capacity = 64;
+    builder->entries = malloc(builder->capacity * sizeof(BuildEntry));
+    if (!builder->entries) {
+        builder->node->header.is_root = 1;
+        pager_unpin_page(tree->pager, builder->leaf);
+        builder->node = NULL;
+        return DB_ERROR;
+    }
+    return DB_SUCCESS;
+}
+
+static DB_Result builder_start_leaf(BTreeBuilder *builder) {
+    BTree *tree = builder->tree;
+    page_num_t page = pager_allocate_page(tree->pager);
+    if (page == INVALID_PAGE) return DB_FULL;
+    LeafNode *node = get_leaf_node(tree->pager, page);
+    if (!node) return DB_ERROR;
+    pager_mark_dirty(tree->pager, page);
+    initialize_leaf_node(node);
+    
+    node->prev_leaf = builder->leaf;
+    builder->node->next_leaf = page;
+    pager_unpin_page(tree->pager, builder->leaf);
+    
+    builder->prev_leaf = builder->leaf;
+    builder->leaf = page;
+    builder->node = node;
+    return DB_SUCCESS;
+}
+
+DB_Result btree_builder_add(BTreeBuilder *builder, uint64_t key, LeafValue value) {
+    BTree *tree = builder->tree;
+    if (!builder->node || key > tree->max_key) return DB_ERROR;
+    
+    if (builder->num_keys > 0 && key <= builder->last_key) {
+        if (key < builder->last_key) return DB_ERROR;
+        leaf_values(tree, builder->node)[builder->node->num_cells - 1] = value;
+        return DB_SUCCESS;
+    }
+    
+    // Room for the entry of a new leaf comes first, so a failure leaves no
+    // leaf without one
+    bool full = builder->node->num_cells >= builder->leaf_fill;
+    if ((full || builder->node->num_cells == 0) && builder->num_entries == builder->capacity) {
+        BuildEntry *grown = realloc(builder->entries, 2 * builder->capacity * sizeof(BuildEntry));
+        if (!grown) return DB_ERROR;
+        builder->entries = grown;
+        builder->capacity *= 2;
+    }
+    if (full) {
+        DB_Result result = builder_start_leaf(builder);
+        if (result != DB_SUCCESS) return result;
+    }
+    
+    LeafNode *node = builder->node;
+    if (node->num_cells == 0) {
+        builder->entries[builder->num_entries].key = key;
+        builder->entries[builder->num_entries].page = builder->leaf;
+        builder->num_entries++;
+    }
+    set_key(tree, node->keys, node->num_cells, key);
+    leaf_values(tree, node)[node->num_cells] = value;
+    node->num_cells++;
+    
+    builder->last_key = key;
+    builder->num_keys++;
+    return DB_SUCCESS;
+}
+
+// The last leaf may be short; even it out with its left neighbour. An empty
+// last leaf, left by an add that failed after starting it, has no entry and
+// is dropped.
+static DB_Result builder_fix_last_leaf(BTreeBuilder *builder) {
+    BTree *tree = builder->tree;
+    LeafNode *last = builder->node;
+    if (builder->prev_leaf == INVALID_PAGE || last->num_cells >= tree->leaf_min_cells) {
+        return DB_SUCCESS;
+    }
+    
+    LeafNode *prev = get_leaf_node(tree->pager, builder->prev_leaf);
+    if (!prev) return DB_ERROR;
+    pager_mark_dirty(tree->pager, builder->prev_leaf);
+    
+    bool empty = (last->num_cells == 0);
+    if (empty || redistribute_leaves(tree, prev, last)) {
+        prev->next_leaf = INVALID_PAGE;
+        pager_unpin_page(tree->pager, builder->leaf);
+        pager_free_page(tree->pager, builder->leaf);
+        if (!empty) builder->num_entries--;
+        builder->node = prev;
+        builder->leaf = builder->prev_leaf;
+        return DB_SUCCESS;
+    }
+    builder->entries[builder->num_entries - 1].key = key_at(tree, last->keys, 0);
+    pager_unpin_page(tree->pager, builder->prev_leaf);
+    return DB_SUCCESS;
+}
+
+// Packs one level of children into parents, overwriting entries with the
+// new level. Children are spread evenly so every node meets the minimum.
+static DB_Result build_internal_level(BTreeBuilder *builder, uint32_t *count) {
+    BTree *tree = builder->tree;
+    BuildEntry *entries = builder->entries;
+    uint32_t children = *count;
+    uint32_t min_children = tree->internal_min_keys + 1;
+    
+    uint32_t nodes = (children + builder->internal_fill - 1) / builder->internal_fill;
+    while (nodes > 1 && children / nodes < min_children) nodes--;
+    uint32_t base = children / nodes;
+    uint32_t extra = children % nodes;
+    if (base + (extra > 0) > tree->internal_max_keys + 1) return DB_ERROR;
+    
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < nodes; i++) {
+        uint32_t take = base + (i < extra);
+        page_num_t page = pager_allocate_page(tree->pager);
+        if (page == INVALID_PAGE) return DB_FULL;
+        InternalNode *node = get_internal_node(tree->pager, page);
+        if (!node) return DB_ERROR;
+        pager_mark_dirty(tree->pager, page);
+        initialize_internal_node(node);
+        
+        page_num_t *node_pages = node_children(tree, node);
+        for (uint32_t j = 0; j < take; j++) {
+            if (j > 0) set_key(tree, node->keys, j - 1, entries[next + j].key);
+            node_pages[j] = entries[next + j].page;
+        }
+        node->num_keys = take - 1;
+        pager_unpin_page(tree->pager, page);
+        
+        // Output slot i never passes the first child still to be read
+        entries[i].key = entries[next].key;
+        entries[i].page = page;
+        next += take;
+    }
+    *count = nodes;
+    return DB_SUCCESS;
+}
+
+DB_Result btree_builder_finish(BTreeBuilder *builder) {
+    BTree *tree = builder->tree;
+    if (!builder->node) {
+        free(builder->entries);
+        return DB_ERROR;
+    }
+    
+    DB_Result result = builder_fix_last_leaf(builder);
+    pager_unpin_page(tree->pager, builder->leaf);
+    builder->node = NULL;
+    
+    uint32_t count = builder->num_entries;
+    uint32_t height = 1;
+    while (result == DB_SUCCESS && count > 1) {
+        result = build_internal_level(builder, &count);
+        height++;
+    }
+    
+    if (result == DB_SUCCESS) {
+        page_num_t root = count > 0 ? builder->entries[0].page : tree->root_page_num;
+        NodeHeader *header = pager_get_page(tree->pager, root);
+        if (header) {
+            pager_mark_dirty(tree->pager, root);
+            header->is_root = 1;
+            pager_unpin_page(tree->pager, root);
+            tree->root_page_num = root;
+            tree->height = height;
+            tree->num_keys = builder->num_keys;
+            tree->mod_count++;
+            result = write_meta(tree);
+        } else {
+            result = DB_ERROR;
+        }
+    }
+    LOG_INFO("Bulk loaded %llu keys into %u leaves, height %u",
+             (unsigned long long)builder->num_keys, builder->num_entries, tree->height);
+    
+    free(builder->entries);
+    builder->entries = NULL;
+    return result;
+}
@@ -10,45 +10,165 @@ typedef enum {
     NODE_LEAF
 } NodeType;
 
-// B-Tree node header (common for all nodes)
+// On-disk node format; bumped whenever the node layout changes
+#define BTREE_FORMAT_VERSION 6
+#define BTREE_MAGIC 0x58444B53      // "SKDX"
+#define BTREE_META_PAGE 0
+#define BTREE_MAX_DEPTH 32          // Longest root-to-leaf path an operation tracks
+
+// Index file page 0: locates the root, which moves as the tree grows, and
+// the root of the string-key tree (strtree.h) sharing the file. Files from
+// before string keys read zeros there, which means no string tree yet, and
+// files from before 64-bit keys read a key_size of 0, which means 4.
+typedef struct {
+    PagerHeader pager_header;
+    uint32_t magic;
+    uint32_t format;
+    page_num_t root_page;
+    uint32_t height;            // Levels, counting the leaves
+    uint64_t num_keys;
+    page_num_t string_root;     // 0 = none
+    uint32_t string_height;
+    uint64_t string_keys;
+    uint32_t key_size;          // Bytes per integer key, fixed when the index is created
+} BTreeMeta;
+
+// B-Tree node header (common for all nodes). Nodes keep no parent
+// pointer; operations remember the path they descended instead.
 typedef struct {
+    uint32_t format;            // BTREE_FORMAT_VERSION
     NodeType type;
     uint32_t is_root;
-    page_num_t parent;
 } NodeHeader;
 
-// Leaf node structure
-#define LEAF_NODE_MAX_CELLS 31  // (PAGE_SIZE - header) / (key + value)
+// Leaf cell payload: where the record lives and its size, so lookups can
+// size buffers without reading the data page
+typedef struct {
+    locator_t locator;
+    uint64_t length;
+} LeafValue;
 
+// Node capacities follow from the page size and the key width, so nodes
+// only declare their fixed prefix. Keys are uint32_t, or uint64_t in an
+// index created with 64-bit keys; 32-bit indexes fit twice as many keys in
+// an internal node. A leaf page holds keys[leaf_max_cells] followed by
+// LeafValue[leaf_max_cells]; keys are kept apart from values so searches
+// scan a dense key array. An internal page holds keys[internal_max_keys]
+// followed by children[internal_max_keys + 1]. BTree records where each
+// array starts. Leaves are chained in key order for range scans.
 typedef struct {
     NodeHeader header;
     uint32_t num_cells;
-    uint32_t keys[LEAF_NODE_MAX_CELLS];
-    page_num_t values[LEAF_NODE_MAX_CELLS];  // Pointers to data pages
+    page_num_t prev_leaf;       // INVALID_PAGE at either end of the chain
+    page_num_t next_leaf;
+    uint8_t keys[];             // key_size bytes each
 } LeafNode;
 
-// Internal node structure
-#define INTERNAL_NODE_MAX_KEYS 30  // (PAGE_SIZE - header) / (key + child)
-#define INTERNAL_NODE_MAX_CHILDREN 31
-
 typedef struct {
     NodeHeader header;
     uint32_t num_keys;
-    uint32_t keys[INTERNAL_NODE_MAX_KEYS];
-    page_num_t children[INTERNAL_NODE_MAX_CHILDREN];
+    uint8_t keys[];             // key_size bytes each
 } InternalNode;
 
 // B-Tree handle
 typedef struct {
     Pager *pager;
-    page_num_t root_page_num;
+    page_num_t root_page_num;   // Cached from BTreeMeta
+    uint32_t height;
+    uint64_t num_keys;
+    uint32_t key_size;          // 4 or 8, from BTreeMeta
+    uint64_t max_key;           // Largest key that width holds
+    
+    // Node layout for the pager's page size and key width. Non-root nodes are
+    // rebalanced when they drop below the minimum (half full).
+    uint32_t leaf_max_cells;
+    uint32_t leaf_min_cells;
+    uint32_t leaf_values_offset;
+    uint32_t internal_max_keys;
+    uint32_t internal_min_keys;
+    uint32_t internal_children_offset;
+    void *scratch;              // Room for the cells of two nodes during splits and merges
+    uint32_t scratch_payload_offset;    // Where their values or children start in it
+    uint64_t mod_count;         // Bumped when keys are added or removed; invalidates cursor positions
 } BTree;
 
-// B-Tree operations
-BTree *btree_create(Pager *pager);
-DB_Result btree_insert(BTree *tree, uint32_t key, page_num_t value);
-DB_Result btree_find(BTree *tree, uint32_t key, page_num_t *value);
-DB_Result btree_delete(BTree *tree, uint32_t key);
+// Position on one leaf cell. Cursors hold no pins between calls; when the
+// tree has changed since the cursor last moved, it re-seeks to its key.
+typedef struct {
+    BTree *tree;
+    page_num_t leaf;
+    uint32_t index;
+    uint64_t key;               // Key under the cursor
+    uint64_t mod_count;         // tree->mod_count when positioned
+    bool valid;
+} BTreeCursor;
+
+// Separator and page of one node during a bulk load
+typedef struct {
+    uint64_t key;               // Smallest key under the node
+    page_num_t page;
+} BuildEntry;
+
+// Builds the tree bottom-up from keys added in ascending order. Leaves are
+// filled left to right; the internal levels are built in one pass over the
+// recorded leaf separators when the builder finishes.
+typedef struct {
+    BTree *tree;
+    uint32_t leaf_fill;         // Cells per leaf before the next one is started
+    uint32_t internal_fill;     // Children per internal node
+    LeafNode *node;             // Leaf being filled, kept pinned
+    page_num_t leaf;
+    page_num_t prev_leaf;
+    uint64_t last_key;
+    uint64_t num_keys;
+    BuildEntry *entries;        // One per leaf, in key order
+    uint32_t num_entries;
+    uint32_t capacity;
+} BTreeBuilder;
+
+// B-Tree operations. key_size (4 or 8) sets the key width of a new index;
+// an existing one keeps the width it was created with.
+BTree *btree_create(Pager *pager, uint32_t key_size);
+// Re-reads the root, height and key count from the meta page, e.g. after
+// the pager dropped a rolled-back transaction
+DB_Result btree_reload(BTree *tree);
+void btree_destroy(BTree *tree);
+// Inserts key, or replaces the value if the key already exists. Keys above
+// max_key are rejected with DB_ERROR, and are never found.
+DB_Result btree_insert(BTree *tree, uint64_t key, LeafValue value);
+DB_Result btree_find(BTree *tree, uint64_t key, LeafValue *value);
+DB_Result btree_delete(BTree *tree, uint64_t key);
 void btree_print(BTree *tree);
 
+// Batches take strictly ascending keys and descend once per leaf touched
+// rather than once per key. For replaced keys existed[i] is set and
+// previous[i] holds the old value. *applied counts the keys processed
+// before any error.
+DB_Result btree_insert_batch(BTree *tree, const uint64_t *keys, const LeafValue *values,
+                             uint32_t count, LeafValue *previous, bool *existed,
+                             uint32_t *applied);
+DB_Result btree_find_batch(BTree *tree, const uint64_t *keys, uint32_t count,
+                           LeafValue *values, bool *found);
+
+// Bulk load into an empty tree. fill_percent (50-100) sets how full nodes
+// are packed. Adding the previous key again replaces its value. Finishing
+// after a failed add still leaves a valid tree of the keys added so far.
+DB_Result btree_builder_begin(BTreeBuilder *builder, BTree *tree, uint32_t fill_percent);
+DB_Result btree_builder_add(BTreeBuilder *builder, uint64_t key, LeafValue value);
+DB_Result btree_builder_finish(BTreeBuilder *builder);
+
+// Cursor operations return DB_NOT_FOUND when they run off either end,
+// which leaves the cursor invalid
+void btree_cursor_init(BTreeCursor *cursor, BTree *tree);
+DB_Result btree_cursor_first(BTreeCursor *cursor);
+DB_Result btree_cursor_last(BTreeCursor *cursor);
+// Positions on the first key >= key
+DB_Result btree_cursor_seek(BTreeCursor *cursor, uint64_t key);
+DB_Result btree_cursor_next(BTreeCursor *cursor);
+DB_Result btree_cursor_prev(BTreeCursor *cursor);
+DB_Result btree_cursor_get(BTreeCursor *cursor, uint64_t *key, LeafValue *value);
+// Copies up to max cells starting at the cursor and moves past them;
+// returns the number copied. values may be NULL.
+uint32_t btree_cursor_fetch(BTreeCursor *cursor, uint64_t *keys, LeafValue *values, uint32_t max);
+
 #endif
\ No newline at end of file
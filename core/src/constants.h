@@ -4,8 +4,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define PAGE_SIZE 4096          // 4KB pages - standard filesystem block
-#define TABLE_MAX_PAGES 100      // Max pages in memory
+#define PAGE_SIZE 4096          // Default page size: 4KB, a standard filesystem block
+#define PAGE_SIZE_MIN 4096      // Page size is fixed per file at creation,
+#define PAGE_SIZE_MAX 65536     // a power of two in this range
+#define PAGER_DEFAULT_FRAMES 1024  // Buffer pool frames per file
 #define INVALID_PAGE UINT32_MAX
 
 // Common return codes
@@ -15,11 +17,14 @@ typedef enum {
     DB_NOT_FOUND = -2,
     DB_FULL = -3,
     DB_IO_ERROR = -4,
-    DB_MEMORY_ERROR = -5
+    DB_MEMORY_ERROR = -5,
+    DB_READONLY = -6
 } DB_Result;
 
 // Common data types
 typedef uint32_t page_num_t;
 typedef uint64_t offset_t;
+typedef uint16_t slot_num_t;
+typedef uint64_t locator_t;     // Record address in the data file (see storage.h)
 
 #endif
\ No newline at end of file
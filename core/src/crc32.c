@@ -0,0 +1,26 @@
+#include "crc32.h"
+#include <pthread.h>
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+        crc_table[i] = crc;
+    }
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t size) {
+    pthread_once(&crc_once, crc_init);
+
+    const unsigned char *bytes = data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
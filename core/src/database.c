@@ -1,161 +1,1033 @@
 #include "database.h"
+#include "extsort.h"
+#include "shadow.h"
+#include "log.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
-Database *db_open(const char *db_name) {
-    Database *db = malloc(sizeof(Database));
+// Shadow-paged commits are durable when they return. Both files are
+// fsynced before either meta names the commit, and neither gives up the
+// pages of the last commit until both metas do.
+static DB_Result commit_shadow(Database *db) {
+    if (db->shadow_failed) return DB_IO_ERROR;
+    
+    Pager *pagers[] = { db->index->pager, db->storage->pager };
+    const int num_pagers = sizeof(pagers) / sizeof(pagers[0]);
+    DB_Result result = DB_SUCCESS;
+    bool changed = false;
+    for (int i = 0; i < num_pagers && result == DB_SUCCESS; i++) {
+        result = pager_flush_all(pagers[i]);
+        changed = changed || shadow_changed(pagers[i]->shadow, pagers[i]->num_pages);
+    }
+    if (result != DB_SUCCESS || !changed) return result;
+    
+    for (int i = 0; i < num_pagers && result == DB_SUCCESS; i++) {
+        result = shadow_prepare(pagers[i]->shadow, pagers[i]->num_pages);
+    }
+    if (result != DB_SUCCESS) return result;
+    
+    uint64_t generation = pagers[0]->shadow->generation + 1;
+    for (int i = 0; i < num_pagers; i++) {
+        result = shadow_publish(pagers[i]->shadow, generation);
+        if (result != DB_SUCCESS) {
+            // Files already published cannot be taken back; opening again
+            // settles on the commit all files have
+            if (i > 0) db->shadow_failed = true;
+            return result;
+        }
+    }
+    for (int i = 0; i < num_pagers; i++) shadow_release(pagers[i]->shadow);
+    return DB_SUCCESS;
+}
+
+// Commits the open changes: dirty pages go to the log, then a commit frame.
+// The caller makes it durable with sync_commit once readers are let back in.
+static DB_Result commit_changes(Database *db, uint64_t *commit_end) {
+    *commit_end = 0;
+    if (db->read_only) return DB_SUCCESS;
+    if (db->shadow_paging) return commit_shadow(db);
+    
+    DB_Result result = pager_flush_all(db->index->pager);
+    if (result == DB_SUCCESS) result = pager_flush_all(db->storage->pager);
+    
+    page_num_t num_pages[WAL_MAX_FILES];
+    num_pages[WAL_FILE_INDEX] = db->index->pager->num_pages;
+    num_pages[WAL_FILE_DATA] = db->storage->pager->num_pages;
+    if (result == DB_SUCCESS) result = wal_commit(db->wal, num_pages, commit_end);
+    return result;
+}
+
+// Only the log is fsynced, and concurrent committers share one fsync; async
+// commits skip waiting. The data files are left to the checkpointer thread.
+static DB_Result sync_commit(Database *db, uint64_t commit_end) {
+    if (db->async_commit || commit_end == 0) return DB_SUCCESS;
+    return wal_sync(db->wal, commit_end);
+}
+
+// Throws away everything since the last commit
+static DB_Result rollback_changes(Database *db) {
+    if (db->read_only) return DB_SUCCESS;
+    
+    DB_Result result = DB_SUCCESS;
+    if (db->shadow_paging) {
+        Shadow *index_shadow = db->index->pager->shadow;
+        Shadow *data_shadow = db->storage->pager->shadow;
+        shadow_rollback(index_shadow);
+        shadow_rollback(data_shadow);
+        pager_discard(db->index->pager, index_shadow->committed_pages);
+        pager_discard(db->storage->pager, data_shadow->committed_pages);
+    } else {
+        result = wal_rollback(db->wal);
+        pager_discard(db->index->pager, db->wal->committed_pages[WAL_FILE_INDEX]);
+        pager_discard(db->storage->pager, db->wal->committed_pages[WAL_FILE_DATA]);
+    }
+    
+    // The cached roots and key counts may describe the discarded state
+    DB_Result reload_result = btree_reload(db->index);
+    if (reload_result == DB_SUCCESS) reload_result = strtree_reload(db->strings);
+    return result != DB_SUCCESS ? result : reload_result;
+}
+
+// The view record of the calling thread, or NULL if it never took a view.
+// Called with view_lock held.
+static ViewHolder *find_holder(Database *db) {
+    pthread_t self = pthread_self();
+    for (ViewHolder *holder = db->view_holders; holder; holder = holder->next) {
+        if (pthread_equal(holder->thread, self)) return holder;
+    }
+    return NULL;
+}
+
+// Like find_holder, but takes over a record with no views open, or adds one
+static ViewHolder *take_holder(Database *db) {
+    ViewHolder *holder = find_holder(db);
+    if (holder) return holder;
+    for (holder = db->view_holders; holder; holder = holder->next) {
+        if (holder->count == 0) break;
+    }
+    if (!holder) {
+        holder = calloc(1, sizeof(ViewHolder));
+        if (!holder) return NULL;
+        holder->next = db->view_holders;
+        db->view_holders = holder;
+    }
+    holder->thread = pthread_self();
+    return holder;
+}
+
+// Whether the calling thread has views open; writing would wait for them
+static bool holds_views(Database *db) {
+    pthread_mutex_lock(&db->view_lock);
+    ViewHolder *holder = find_holder(db);
+    bool holds = holder && holder->count > 0;
+    pthread_mutex_unlock(&db->view_lock);
+    return holds;
+}
+
+static void free_holders(Database *db) {
+    while (db->view_holders) {
+        ViewHolder *next = db->view_holders->next;
+        free(db->view_holders);
+        db->view_holders = next;
+    }
+}
+
+// Transactions this thread has open, in any database; see owns_transaction
+static __thread uint32_t open_transactions;
+
+// True on the thread whose transaction is open, which already holds `lock`
+// exclusively. `writer` is recursive, so while it is taken only its holder
+// gets it, and in_transaction only changes under it.
+static bool owns_transaction(Database *db) {
+    if (open_transactions == 0 || pthread_mutex_trylock(&db->writer) != 0) return false;
+    bool owner = db->in_transaction;
+    pthread_mutex_unlock(&db->writer);
+    return owner;
+}
+
+// Takes `lock` exclusively once readers have left and no view is open.
+// While views are open it waits with `lock` released, so their holders can
+// still read or take more views.
+static void lock_pages(Database *db) {
+    pthread_mutex_lock(&db->view_lock);
+    db->waiting_writers++;
+    pthread_mutex_unlock(&db->view_lock);
+    
+    for (;;) {
+        pthread_rwlock_wrlock(&db->lock);
+        pthread_mutex_lock(&db->view_lock);
+        bool clear = (db->open_views == 0);
+        if (clear) {
+            if (--db->waiting_writers == 0) pthread_cond_broadcast(&db->view_change);
+        } else {
+            pthread_rwlock_unlock(&db->lock);
+            pthread_cond_wait(&db->view_change, &db->view_lock);
+        }
+        pthread_mutex_unlock(&db->view_lock);
+        if (clear) return;
+    }
+}
+
+// Waits for other threads' transactions, then for readers to leave. An
+// open transaction holds `lock` from db_begin on. A thread holding views
+// is refused rather than left waiting for itself.
+static DB_Result begin_write(Database *db) {
+    if (holds_views(db)) return DB_ERROR;
+    pthread_mutex_lock(&db->writer);
+    if (!db->in_transaction) lock_pages(db);
+    return DB_SUCCESS;
+}
+
+// Lets readers and the next writer in before waiting for the fsync, so one
+// fsync can cover commits from several threads
+static DB_Result finish_write(Database *db, DB_Result result, uint64_t commit_end, bool end_transaction) {
+    pthread_rwlock_unlock(&db->lock);
+    if (end_transaction) pthread_mutex_unlock(&db->writer);  // Taken by db_begin
+    pthread_mutex_unlock(&db->writer);
+    
+    DB_Result sync_result = sync_commit(db, commit_end);
+    return sync_result != DB_SUCCESS ? sync_result : result;
+}
+
+// Outside a transaction every write commits on its own, and a failed write
+// is rolled back so it leaves nothing half done
+static DB_Result end_write(Database *db, DB_Result result) {
+    if (db->in_transaction) {
+        pthread_mutex_unlock(&db->writer);
+        return result;
+    }
+    
+    uint64_t commit_end = 0;
+    bool succeeded = result == DB_SUCCESS || result == DB_NOT_FOUND;
+    if (succeeded) {
+        DB_Result commit_result = commit_changes(db, &commit_end);
+        if (commit_result != DB_SUCCESS) {
+            result = commit_result;
+            succeeded = false;
+        }
+    }
+    if (!succeeded) rollback_changes(db);
+    return finish_write(db, result, commit_end, false);
+}
+
+Database *db_open(const char *db_name, const DBOptions *options) {
+    Database *db = calloc(1, sizeof(Database));
     if (!db) return NULL;
     
+    uint32_t cache_pages = options ? options->cache_pages : 0;
+    uint32_t page_size = options ? options->page_size : 0;
+    unsigned pager_flags = 0;
+    if (options && options->read_only) pager_flags |= PAGER_READONLY;
+    if (options && options->use_mmap) pager_flags |= PAGER_MMAP;
+    db->read_only = (pager_flags != 0);
+    db->async_commit = options && options->async_commit;
+    db->shadow_paging = options && options->shadow_paging;
+    if (db->shadow_paging) pager_flags |= PAGER_SHADOW;
+    
     db->name = strdup(db_name);
     
+    // Writers first, so a steady stream of readers cannot starve them
+    pthread_rwlockattr_t lock_attr;
+    pthread_rwlockattr_init(&lock_attr);
+#ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&lock_attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    pthread_rwlock_init(&db->lock, &lock_attr);
+    pthread_rwlockattr_destroy(&lock_attr);
+    
+    // Recursive, so writes inside the owner's transaction pass through
+    pthread_mutexattr_t writer_attr;
+    pthread_mutexattr_init(&writer_attr);
+    pthread_mutexattr_settype(&writer_attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&db->writer, &writer_attr);
+    pthread_mutexattr_destroy(&writer_attr);
+    
+    pthread_mutex_init(&db->view_lock, NULL);
+    pthread_cond_init(&db->view_change, NULL);
+    
     // Construct filenames
     char index_filename[256];
     char data_filename[256];
+    char wal_filename[256];
     snprintf(index_filename, sizeof(index_filename), "%s.idx", db_name);
     snprintf(data_filename, sizeof(data_filename), "%s.dat", db_name);
+    snprintf(wal_filename, sizeof(wal_filename), "%s.wal", db_name);
     
-    // Open index file
-    Pager *index_pager = pager_open(index_filename);
-    if (!index_pager) {
-        free(db->name);
-        free(db);
-        return NULL;
+    Pager *index_pager = NULL;
+    Pager *data_pager = NULL;
+    
+    // The log comes first: recovered pages decide the page size of files
+    // that were never checkpointed. Shadow-paged files have no log.
+    if (!db->shadow_paging) {
+        db->wal = wal_open(wal_filename, page_size, db->read_only);
+        if (!db->wal) goto fail;
+        if (!wal_is_empty(db->wal)) {
+            page_size = db->wal->page_size;
+            // A mapping would miss the pages still in the log
+            pager_flags &= ~PAGER_MMAP;
+        }
     }
     
+    // Open index file
+    index_pager = pager_open(index_filename, cache_pages, page_size, pager_flags);
+    if (!index_pager) goto fail;
+    
     // Open data file
-    Pager *data_pager = pager_open(data_filename);
-    if (!data_pager) {
-        pager_close(index_pager);
-        free(db->name);
-        free(db);
-        return NULL;
+    data_pager = pager_open(data_filename, cache_pages, page_size, pager_flags);
+    if (!data_pager) goto fail;
+    
+    // Frames are whole pages, so both files and the log share one page size
+    if (index_pager->page_size != data_pager->page_size) goto fail;
+    if (db->shadow_paging) {
+        // A crash between the two metas of a commit leaves one file a
+        // commit ahead; both open at the one they share
+        uint64_t generation = shadow_newest(index_pager->shadow);
+        uint64_t data_generation = shadow_newest(data_pager->shadow);
+        if (data_generation < generation) generation = data_generation;
+        if (pager_load_shadow(index_pager, generation) != DB_SUCCESS ||
+            pager_load_shadow(data_pager, generation) != DB_SUCCESS) {
+            goto fail;
+        }
+    } else {
+        if (db->wal->page_size != index_pager->page_size &&
+            wal_reset(db->wal, index_pager->page_size) != DB_SUCCESS) {
+            LOG_ERROR("WAL page size %u does not match the database (%u)",
+                      db->wal->page_size, index_pager->page_size);
+            goto fail;
+        }
+        pager_attach_wal(index_pager, db->wal, WAL_FILE_INDEX);
+        pager_attach_wal(data_pager, db->wal, WAL_FILE_DATA);
     }
     
+    // B-tree descents touch index pages in no particular order
+    pager_advise(index_pager, PAGER_ACCESS_RANDOM);
+    
+    // A read-only open cannot create the root of an empty index
+    if (db->read_only && index_pager->num_pages == 0) goto fail;
+    
     // Create index
-    db->index = btree_create(index_pager);
-    if (!db->index) {
-        pager_close(index_pager);
-        pager_close(data_pager);
-        free(db->name);
-        free(db);
-        return NULL;
-    }
+    db->index = btree_create(index_pager, options ? options->key_size : 0);
+    if (!db->index) goto fail;
+    db->strings = strtree_create(index_pager);
+    if (!db->strings) goto fail;
     
     // Create storage
     db->storage = storage_create(data_pager);
-    if (!db->storage) {
-        // Cleanup
-        free(db);
-        return NULL;
+    if (!db->storage) goto fail;
+    
+    // Recovery: move what the log replayed into the files. A new database
+    // commits its freshly created meta pages.
+    if (!db->read_only) {
+        uint64_t commit_end;
+        if (db_checkpoint(db) != DB_SUCCESS || commit_changes(db, &commit_end) != DB_SUCCESS ||
+            sync_commit(db, commit_end) != DB_SUCCESS) {
+            goto fail;
+        }
+        if (db->shadow_paging) return db;
+        uint64_t checkpoint_bytes = options ? options->checkpoint_bytes : 0;
+        uint32_t checkpoint_interval = options ? options->checkpoint_interval_ms : 0;
+        if (wal_start_checkpointer(db->wal, checkpoint_bytes, checkpoint_interval) != DB_SUCCESS) {
+            goto fail;
+        }
     }
     
     return db;
+    
+fail:
+    // Closing the pagers logs their dirty pages, which no commit covers
+    pager_close(index_pager);
+    pager_close(data_pager);
+    btree_destroy(db->index);
+    strtree_destroy(db->strings);
+    free(db->storage);
+    wal_close(db->wal);
+    pthread_rwlock_destroy(&db->lock);
+    pthread_mutex_destroy(&db->writer);
+    pthread_mutex_destroy(&db->view_lock);
+    free_holders(db);
+    pthread_cond_destroy(&db->view_change);
+    free(db->name);
+    free(db);
+    return NULL;
 }
 
 DB_Result db_close(Database *db) {
     if (!db) return DB_ERROR;
     
-    // Flush all changes
-    pager_flush_all(db->index->pager);
-    pager_flush_all(db->storage->pager);
+    // An unfinished transaction is dropped; committed pages move into the files
+    DB_Result result = DB_SUCCESS;
+    if (db->wal) wal_stop_checkpointer(db->wal);
+    if (db->in_transaction) {
+        rollback_changes(db);
+        db->in_transaction = false;
+        if (open_transactions > 0) open_transactions--;
+        pthread_rwlock_unlock(&db->lock);
+        pthread_mutex_unlock(&db->writer);  // Taken by db_begin
+    }
+    if (!db->read_only) result = db_checkpoint(db);
     
-    // Close pagers
     pager_close(db->index->pager);
     pager_close(db->storage->pager);
+    wal_close(db->wal);
     
-    free(db->index);
+    btree_destroy(db->index);
+    strtree_destroy(db->strings);
     free(db->storage);
+    pthread_rwlock_destroy(&db->lock);
+    pthread_mutex_destroy(&db->writer);
+    pthread_mutex_destroy(&db->view_lock);
+    free_holders(db);
+    pthread_cond_destroy(&db->view_change);
     free(db->name);
     free(db);
     
+    return result;
+}
+
+// The open transaction's own reads go ahead under its exclusive hold
+void db_read_lock(Database *db) {
+    if (!owns_transaction(db)) pthread_rwlock_rdlock(&db->lock);
+}
+
+void db_read_unlock(Database *db) {
+    if (!owns_transaction(db)) pthread_rwlock_unlock(&db->lock);
+}
+
+DB_Result db_begin(Database *db) {
+    if (db->read_only) return DB_READONLY;
+    
+    // The writer lock and `lock` stay held until the transaction ends, so
+    // no other thread reads its changes before they commit
+    if (holds_views(db)) return DB_ERROR;
+    pthread_mutex_lock(&db->writer);
+    if (db->in_transaction) {
+        pthread_mutex_unlock(&db->writer);
+        return DB_ERROR;
+    }
+    lock_pages(db);
+    db->in_transaction = true;
+    open_transactions++;
     return DB_SUCCESS;
 }
 
-DB_Result db_insert(Database *db, uint32_t key, const void *data, size_t size) {
-    printf("Debug: Inserting key %u with data size %zu\n", key, size);
+DB_Result db_commit(Database *db) {
+    // The transaction stays open until this thread's views are released
+    if (holds_views(db)) return DB_ERROR;
+    // Another thread's transaction finishes first, and then there is none
+    pthread_mutex_lock(&db->writer);
+    if (!db->in_transaction) {
+        pthread_mutex_unlock(&db->writer);
+        return DB_ERROR;
+    }
+    db->in_transaction = false;
+    open_transactions--;
+    
+    uint64_t commit_end;
+    DB_Result result = commit_changes(db, &commit_end);
+    if (result != DB_SUCCESS) rollback_changes(db);
+    return finish_write(db, result, commit_end, true);
+}
+
+DB_Result db_rollback(Database *db) {
+    if (holds_views(db)) return DB_ERROR;
+    pthread_mutex_lock(&db->writer);
+    if (!db->in_transaction) {
+        pthread_mutex_unlock(&db->writer);
+        return DB_ERROR;
+    }
+    db->in_transaction = false;
+    open_transactions--;
+    return finish_write(db, rollback_changes(db), 0, true);
+}
+
+DB_Result db_checkpoint(Database *db) {
+    if (db->read_only || !db->wal) return DB_SUCCESS;
+    return wal_checkpoint(db->wal);
+}
+
+// Records are filed under an integer key in db->index or a byte-string key
+// in db->strings; the record handling is the same for both
+typedef struct {
+    uint64_t key;
+    const void *string;         // NULL for an integer key
+    uint32_t string_size;
+} RecordKey;
+
+static DB_Result index_find(Database *db, const RecordKey *key, LeafValue *value) {
+    if (key->string) return strtree_find(db->strings, key->string, key->string_size, value);
+    return btree_find(db->index, key->key, value);
+}
+
+static DB_Result index_insert(Database *db, const RecordKey *key, LeafValue value) {
+    if (key->string) return strtree_insert(db->strings, key->string, key->string_size, value);
+    return btree_insert(db->index, key->key, value);
+}
+
+static DB_Result index_delete(Database *db, const RecordKey *key) {
+    if (key->string) return strtree_delete(db->strings, key->string, key->string_size);
+    return btree_delete(db->index, key->key);
+}
+
+static DB_Result insert_record(Database *db, const RecordKey *key, const void *data, size_t size) {
+    // Existing key: try to rewrite the record where it is
+    LeafValue old_value;
+    bool exists = (index_find(db, key, &old_value) == DB_SUCCESS);
+    if (exists) {
+        DB_Result result = storage_update(db->storage, LOCATOR_PAGE(old_value.locator),
+                                          LOCATOR_SLOT(old_value.locator), data, size);
+        if (result == DB_SUCCESS) {
+            // Same locator; only the cached length changes
+            LeafValue value = { old_value.locator, size };
+            result = index_insert(db, key, value);
+            if (result == DB_SUCCESS) {
+                LOG_TRACE("Updated record in place");
+            }
+            return result;
+        }
+        if (result != DB_FULL) return result;
+    }
     
     // Write data to storage
     page_num_t data_page;
-    offset_t data_offset;
-    DB_Result result = storage_write(db->storage, data, size, &data_page, &data_offset);
+    slot_num_t data_slot;
+    DB_Result result = storage_write(db->storage, data, size, &data_page, &data_slot);
     if (result != DB_SUCCESS) {
-        printf("Debug: storage_write failed with code %d\n", result);
+        LOG_ERROR("storage_write failed with code %d", result);
         return result;
     }
     
-    printf("Debug: Stored at page %u, offset %u\n", data_page, data_offset);
+    LOG_TRACE("Stored at page %u, slot %u", data_page, data_slot);
     
-    // Pack page and offset into a single 32-bit value
-    // Use 16 bits for page (max 65535) and 16 bits for offset (max 65535)
-    uint32_t location = (data_page << 16) | (data_offset & 0xFFFF);
+    LeafValue value = { LOCATOR_MAKE(data_page, data_slot), size };
     
-    printf("Debug: Packed location=%u (0x%X)\n", location, location);
+    LOG_TRACE("Packed locator=0x%llX", (unsigned long long)value.locator);
     
-    result = btree_insert(db->index, key, location);
+    result = index_insert(db, key, value);
     if (result != DB_SUCCESS) {
-        printf("Debug: btree_insert failed with code %d\n", result);
+        LOG_ERROR("Index insert failed with code %d", result);
+        storage_delete(db->storage, data_page, data_slot);
+        return result;
+    }
+    
+    // The record moved: release the old copy
+    if (exists) {
+        storage_delete(db->storage, LOCATOR_PAGE(old_value.locator),
+                       LOCATOR_SLOT(old_value.locator));
     }
     
     return result;
 }
 
-DB_Result db_find(Database *db, uint32_t key, void *buffer, size_t *size) {
-    printf("Debug: db_find(key=%u)\n", key);
+DB_Result db_insert(Database *db, uint64_t key, const void *data, size_t size) {
+    LOG_TRACE("Inserting key %llu with data size %zu", (unsigned long long)key, size);
+    
+    if (db->read_only) return DB_READONLY;
+    if (key > db->index->max_key) return DB_ERROR;
+    
+    RecordKey record_key = { key, NULL, 0 };
+    DB_Result result = begin_write(db);
+    if (result != DB_SUCCESS) return result;
+    return end_write(db, insert_record(db, &record_key, data, size));
+}
+
+DB_Result db_find(Database *db, uint64_t key, void *buffer, size_t *size) {
+    LOG_TRACE("db_find(key=%llu)", (unsigned long long)key);
     
     // Find in index
-    page_num_t location;
-    DB_Result result = btree_find(db->index, key, &location);
+    LeafValue value;
+    DB_Result result = btree_find(db->index, key, &value);
     if (result != DB_SUCCESS) {
-        printf("Debug: btree_find failed with code %d\n", result);
+        LOG_TRACE("btree_find failed with code %d", result);
         return result;
     }
     
-    printf("Debug: btree_find returned location=%u (0x%X)\n", location, location);
+    return db_read_value(db, &value, buffer, size);
+}
+
+// A batch entry's key and its position in the caller's array
+typedef struct {
+    uint64_t key;
+    uint32_t position;
+} BatchOrder;
+
+// Ascending key, then position, so the last duplicate sorts last
+static int compare_batch_order(const void *a, const void *b) {
+    const BatchOrder *x = a;
+    const BatchOrder *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->position < y->position ? -1 : (x->position > y->position);
+}
+
+DB_Result db_insert_batch(Database *db, const DBRecord *records, uint32_t count) {
+    if (!db || !db->index) return DB_ERROR;
+    if (db->read_only) return DB_READONLY;
+    if (count == 0) return DB_SUCCESS;
+    
+    LOG_DEBUG("db_insert_batch(%u records)", count);
+    
+    if (begin_write(db) != DB_SUCCESS) return DB_ERROR;
+    BatchOrder *order = malloc(count * sizeof(BatchOrder));
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    const void **data = malloc(count * sizeof(void *));
+    size_t *sizes = malloc(count * sizeof(size_t));
+    locator_t *locators = malloc(count * sizeof(locator_t));
+    LeafValue *values = malloc(count * sizeof(LeafValue));
+    LeafValue *previous = malloc(count * sizeof(LeafValue));
+    bool *existed = malloc(count * sizeof(bool));
+    DB_Result result = DB_ERROR;
+    if (!order || !keys || !data || !sizes || !locators || !values || !previous || !existed) {
+        goto done;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        order[i].key = records[i].key;
+        order[i].position = i;
+    }
+    qsort(order, count, sizeof(BatchOrder), compare_batch_order);
+    
+    // Keep the last record of each key
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const DBRecord *record = &records[order[i].position];
+        if (i + 1 < count && order[i + 1].key == record->key) continue;
+        keys[unique] = record->key;
+        data[unique] = record->data;
+        sizes[unique] = record->size;
+        unique++;
+    }
+    
+    // Neighbouring keys share data pages, so later range reads stay local
+    result = storage_write_batch(db->storage, unique, data, sizes, locators);
+    if (result != DB_SUCCESS) goto done;
+    
+    for (uint32_t i = 0; i < unique; i++) {
+        values[i].locator = locators[i];
+        values[i].length = sizes[i];
+    }
+    uint32_t applied = 0;
+    result = btree_insert_batch(db->index, keys, values, unique, previous, existed, &applied);
+    if (result != DB_SUCCESS) {
+        // Take back the keys already applied. Outside a transaction the
+        // rollback would cover them, but inside one nothing else would.
+        for (uint32_t i = 0; i < applied; i++) {
+            DB_Result undo = existed[i] ? btree_insert(db->index, keys[i], previous[i])
+                                        : btree_delete(db->index, keys[i]);
+            if (undo != DB_SUCCESS) {
+                LOG_ERROR("Cannot undo a failed batch at key %llu; roll back the transaction",
+                          (unsigned long long)keys[i]);
+            }
+        }
+        applied = 0;
+    }
+    
+    // Release replaced records, and new ones that never reached the index
+    for (uint32_t i = 0; i < applied; i++) {
+        if (existed[i]) {
+            storage_delete(db->storage, LOCATOR_PAGE(previous[i].locator),
+                           LOCATOR_SLOT(previous[i].locator));
+        }
+    }
+    for (uint32_t i = applied; i < unique; i++) {
+        storage_delete(db->storage, LOCATOR_PAGE(locators[i]), LOCATOR_SLOT(locators[i]));
+    }
+    
+done:
+    free(order);
+    free(keys);
+    free(data);
+    free(sizes);
+    free(locators);
+    free(values);
+    free(previous);
+    free(existed);
+    return end_write(db, result);
+}
+
+DB_Result db_find_batch(Database *db, const uint64_t *keys, uint32_t count,
+                        LeafValue *values, bool *found) {
+    if (!db || !db->index) return DB_ERROR;
+    if (count == 0) return DB_SUCCESS;
+    
+    BatchOrder *order = malloc(count * sizeof(BatchOrder));
+    uint64_t *sorted = malloc(count * sizeof(uint64_t));
+    LeafValue *sorted_values = malloc(count * sizeof(LeafValue));
+    bool *sorted_found = malloc(count * sizeof(bool));
+    DB_Result result = DB_ERROR;
+    if (!order || !sorted || !sorted_values || !sorted_found) goto done;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        order[i].key = keys[i];
+        order[i].position = i;
+    }
+    qsort(order, count, sizeof(BatchOrder), compare_batch_order);
     
-    // Extract page and offset
-    page_num_t data_page = location >> 16;  // Use 16 bits for page
-    offset_t data_offset = location & 0xFFFF;  // Use 16 bits for offset
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (unique == 0 || sorted[unique - 1] != order[i].key) {
+            sorted[unique++] = order[i].key;
+        }
+    }
     
-    printf("Debug: Extracted page=%u, offset=%u\n", data_page, data_offset);
+    result = btree_find_batch(db->index, sorted, unique, sorted_values, sorted_found);
+    if (result != DB_SUCCESS) goto done;
+    
+    // Scatter the answers back to the caller's order
+    uint32_t position = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t index = order[i].position;
+        while (sorted[position] != order[i].key) position++;
+        found[index] = sorted_found[position];
+        if (found[index]) values[index] = sorted_values[position];
+    }
+    
+done:
+    free(order);
+    free(sorted);
+    free(sorted_values);
+    free(sorted_found);
+    return result;
+}
+
+// Writes records from source in ascending key order into the builder
+static DB_Result load_sorted(Database *db, BTreeBuilder *builder, DBRecordSource source, void *context) {
+    uint64_t key;
+    const void *data;
+    size_t size;
+    bool have_previous = false;
+    uint64_t previous_key = 0;
+    LeafValue previous = {0, 0};
+    
+    int status;
+    while ((status = source(context, &key, &data, &size)) > 0) {
+        page_num_t data_page;
+        slot_num_t data_slot;
+        DB_Result result = storage_write(db->storage, data, size, &data_page, &data_slot);
+        if (result != DB_SUCCESS) return result;
+        
+        LeafValue value = { LOCATOR_MAKE(data_page, data_slot), size };
+        result = btree_builder_add(builder, key, value);
+        if (result != DB_SUCCESS) {
+            storage_delete(db->storage, data_page, data_slot);
+            return result;
+        }
+        // A repeated key replaced the previous record
+        if (have_previous && key == previous_key) {
+            storage_delete(db->storage, LOCATOR_PAGE(previous.locator), LOCATOR_SLOT(previous.locator));
+        }
+        have_previous = true;
+        previous_key = key;
+        previous = value;
+    }
+    return status == 0 ? DB_SUCCESS : DB_ERROR;
+}
+
+static int sorter_source(void *context, uint64_t *key, const void **data, size_t *size) {
+    return extsort_next((ExternalSorter *)context, key, data, size);
+}
+
+DB_Result db_bulk_load(Database *db, DBRecordSource source, void *context, const DBBulkOptions *options) {
+    if (!db || !source) return DB_ERROR;
+    if (db->read_only) return DB_READONLY;
+    
+    uint32_t fill_percent = (options && options->fill_percent) ? options->fill_percent : 90;
+    bool presorted = options && options->presorted;
+    size_t sort_memory = (options && options->sort_memory) ? options->sort_memory : 64u << 20;
+    
+    // Only an empty index can be built bottom-up. The writer lock keeps it
+    // empty while the input is sorted; readers wait only for the build.
+    if (holds_views(db)) return DB_ERROR;
+    pthread_mutex_lock(&db->writer);
+    if (db->index->num_keys > 0) {
+        pthread_mutex_unlock(&db->writer);
+        return DB_ERROR;
+    }
+    
+    // Sort first so the index is only touched once the input is known good
+    ExternalSorter *sorter = NULL;
+    if (!presorted) {
+        sorter = extsort_create(sort_memory);
+        DB_Result result = sorter ? DB_SUCCESS : DB_ERROR;
+        
+        uint64_t key;
+        const void *data;
+        size_t size;
+        int status = 0;
+        while (result == DB_SUCCESS && (status = source(context, &key, &data, &size)) > 0) {
+            result = extsort_add(sorter, key, data, size);
+        }
+        if (result == DB_SUCCESS && status < 0) result = DB_ERROR;
+        if (result == DB_SUCCESS) result = extsort_finish(sorter);
+        if (result != DB_SUCCESS) {
+            extsort_destroy(sorter);
+            pthread_mutex_unlock(&db->writer);
+            return result;
+        }
+        source = sorter_source;
+        context = sorter;
+    }
+    if (!db->in_transaction) lock_pages(db);
+    
+    BTreeBuilder builder;
+    DB_Result result = btree_builder_begin(&builder, db->index, fill_percent);
+    if (result == DB_SUCCESS) {
+        result = load_sorted(db, &builder, source, context);
+        // Keeps whatever was loaded reachable even if the input failed
+        DB_Result finish_result = btree_builder_finish(&builder);
+        if (result == DB_SUCCESS) result = finish_result;
+    }
+    
+    extsort_destroy(sorter);
+    return end_write(db, result);
+}
+
+static DB_Result read_value(Storage *storage, const LeafValue *value, void *buffer, size_t *size) {
+    // The leaf caches the length, so a short buffer is reported without
+    // touching the data page
+    if (*size < value->length) {
+        *size = value->length;
+        return DB_ERROR;
+    }
+    
+    page_num_t data_page = LOCATOR_PAGE(value->locator);
+    slot_num_t data_slot = LOCATOR_SLOT(value->locator);
+    
+    LOG_TRACE("Extracted page=%u, slot=%u", data_page, data_slot);
     
     // Read from storage
-    result = storage_read(db->storage, data_page, data_offset, buffer, size);
-    printf("Debug: storage_read returned %d\n", result);
+    DB_Result result = storage_read(storage, data_page, data_slot, buffer, size);
+    LOG_TRACE("storage_read returned %d", result);
     
     return result;
 }
 
-DB_Result db_delete(Database *db, uint32_t key) {
-    if (!db || !db->index) return DB_ERROR;
+DB_Result db_read_value(Database *db, const LeafValue *value, void *buffer, size_t *size) {
+    return read_value(db->storage, value, buffer, size);
+}
+
+static DB_Result pin_value(Database *db, const RecordKey *key, const void **data, size_t *size,
+                           DBView *view) {
+    LeafValue value;
+    DB_Result result = index_find(db, key, &value);
+    if (result != DB_SUCCESS) return result;
+    
+    result = storage_view(db->storage, LOCATOR_PAGE(value.locator), LOCATOR_SLOT(value.locator),
+                          data, size);
+    if (result != DB_SUCCESS) return result;
+    
+    view->page = LOCATOR_PAGE(value.locator);
+    view->copy = NULL;
+    if (!*data) {
+        // Overflow values span pages that need not be cached side by side
+        view->page = INVALID_PAGE;
+        view->copy = malloc(*size ? *size : 1);
+        if (!view->copy) return DB_MEMORY_ERROR;
+        result = read_value(db->storage, &value, view->copy, size);
+        if (result != DB_SUCCESS) {
+            free(view->copy);
+            return result;
+        }
+        *data = view->copy;
+    }
+    return DB_SUCCESS;
+}
+
+static void unpin_view(Database *db, DBView *view) {
+    if (view->page != INVALID_PAGE) {
+        pager_unpin_page(db->storage->pager, view->page);
+    }
+    free(view->copy);
+}
+
+static DB_Result find_view(Database *db, const RecordKey *key, const void **data, size_t *size,
+                           DBView *view) {
+    // A writer waiting for the open views goes first, or a steady stream of
+    // overlapping views would starve it. A thread holding views must not
+    // wait: the writer may be waiting for those very views.
+    pthread_mutex_lock(&db->view_lock);
+    for (;;) {
+        ViewHolder *holder = find_holder(db);
+        if ((holder && holder->count > 0) || db->waiting_writers == 0) break;
+        pthread_cond_wait(&db->view_change, &db->view_lock);
+    }
+    pthread_mutex_unlock(&db->view_lock);
     
-    printf("Debug: db_delete(key=%u)\n", key);
+    db_read_lock(db);
+    DB_Result result = pin_value(db, key, data, size, view);
+    if (result == DB_SUCCESS) {
+        pthread_mutex_lock(&db->view_lock);
+        view->holder = take_holder(db);
+        if (view->holder) {
+            view->holder->count++;
+            db->open_views++;
+        }
+        pthread_mutex_unlock(&db->view_lock);
+        if (!view->holder) {
+            unpin_view(db, view);
+            result = DB_MEMORY_ERROR;
+        }
+    }
+    db_read_unlock(db);
+    return result;
+}
+
+DB_Result db_find_view(Database *db, uint64_t key, const void **data, size_t *size, DBView *view) {
+    RecordKey record_key = { key, NULL, 0 };
+    return find_view(db, &record_key, data, size, view);
+}
+
+DB_Result db_find_str_view(Database *db, const void *key, uint32_t key_size,
+                           const void **data, size_t *size, DBView *view) {
+    RecordKey record_key = { 0, key, key_size };
+    return find_view(db, &record_key, data, size, view);
+}
+
+void db_release_view(Database *db, DBView *view) {
+    unpin_view(db, view);
     
+    // Counted against the thread that took the view, wherever it is released
+    pthread_mutex_lock(&db->view_lock);
+    view->holder->count--;
+    if (--db->open_views == 0) pthread_cond_broadcast(&db->view_change);
+    pthread_mutex_unlock(&db->view_lock);
+}
+
+bool db_contains(Database *db, uint64_t key) {
+    LeafValue value;
+    return btree_find(db->index, key, &value) == DB_SUCCESS;
+}
+
+bool db_contains_str(Database *db, const void *key, uint32_t key_size) {
+    LeafValue value;
+    return strtree_find(db->strings, key, key_size, &value) == DB_SUCCESS;
+}
+
+static DB_Result delete_record(Database *db, const RecordKey *key) {
     // First find the key to get storage location (for cleanup)
-    page_num_t location;
-    DB_Result result = btree_find(db->index, key, &location);
+    LeafValue value;
+    DB_Result result = index_find(db, key, &value);
     
     if (result == DB_SUCCESS) {
-        // Extract storage location for potential cleanup
-        page_num_t data_page = location >> 16;
-        offset_t data_offset = location & 0xFFFF;
-        printf("Debug: Found at page %u, offset %u - will mark as free\n", 
-               data_page, data_offset);
+        // Release the record's bytes for reuse
+        page_num_t data_page = LOCATOR_PAGE(value.locator);
+        slot_num_t data_slot = LOCATOR_SLOT(value.locator);
+        LOG_TRACE("Found at page %u, slot %u - freeing record", 
+                  data_page, data_slot);
         
-        // In a real DB, you'd add this to a free list
-        // storage_delete(db->storage, data_page, data_offset);
+        storage_delete(db->storage, data_page, data_slot);
     }
     
     // Delete from index
-    result = btree_delete(db->index, key);
+    result = index_delete(db, key);
     
-    if (result == DB_SUCCESS) {
-        printf("Deleted key %u\n", key);
-    } else if (result == DB_NOT_FOUND) {
-        printf("Key %u not found\n", key);
-    } else {
-        printf("Delete failed: %d\n", result);
+    if (result == DB_NOT_FOUND) {
+        LOG_TRACE("Key not found");
+    } else if (result != DB_SUCCESS) {
+        LOG_WARN("Delete failed: %d", result);
     }
-    
     return result;
-}
\ No newline at end of file
+}
+
+DB_Result db_delete(Database *db, uint64_t key) {
+    if (!db || !db->index) return DB_ERROR;
+    if (db->read_only) return DB_READONLY;
+    
+    LOG_TRACE("db_delete(key=%llu)", (unsigned long long)key);
+    
+    RecordKey record_key = { key, NULL, 0 };
+    DB_Result result = begin_write(db);
+    if (result != DB_SUCCESS) return result;
+    return end_write(db, delete_record(db, &record_key));
+}
+
+// ==================== STRING KEYS ====================
+
+DB_Result db_insert_str(Database *db, const void *key, uint32_t key_size,
+                        const void *data, size_t size) {
+    if (db->read_only) return DB_READONLY;
+    if (key_size > STRTREE_MAX_KEY) return DB_ERROR;
+    
+    LOG_TRACE("Inserting string key '%.*s' with data size %zu", (int)key_size,
+              (const char *)key, size);
+    
+    RecordKey record_key = { 0, key, key_size };
+    DB_Result result = begin_write(db);
+    if (result != DB_SUCCESS) return result;
+    return end_write(db, insert_record(db, &record_key, data, size));
+}
+
+DB_Result db_find_str(Database *db, const void *key, uint32_t key_size, void *buffer, size_t *size) {
+    LeafValue value;
+    DB_Result result = strtree_find(db->strings, key, key_size, &value);
+    if (result != DB_SUCCESS) return result;
+    return db_read_value(db, &value, buffer, size);
+}
+
+DB_Result db_delete_str(Database *db, const void *key, uint32_t key_size) {
+    if (db->read_only) return DB_READONLY;
+    
+    RecordKey record_key = { 0, key, key_size };
+    DB_Result result = begin_write(db);
+    if (result != DB_SUCCESS) return result;
+    return end_write(db, delete_record(db, &record_key));
+}
+
+DBSnapshot *db_snapshot_open(Database *db) {
+    if (!db->wal) return NULL;
+    
+    DBSnapshot *snapshot = calloc(1, sizeof(DBSnapshot));
+    if (!snapshot) return NULL;
+    snapshot->db = db;
+    
+    // Pinning the commit keeps the checkpoint from overwriting the file
+    // pages it sees
+    page_num_t num_pages[WAL_MAX_FILES];
+    if (wal_snapshot_open(db->wal, &snapshot->lsn, num_pages) != DB_SUCCESS) {
+        free(snapshot);
+        return NULL;
+    }
+    
+    Pager *index_pager = pager_open_snapshot(db->index->pager, DB_SNAPSHOT_CACHE_PAGES,
+                                             snapshot->lsn, num_pages[WAL_FILE_INDEX]);
+    Pager *data_pager = pager_open_snapshot(db->storage->pager, DB_SNAPSHOT_CACHE_PAGES,
+                                            snapshot->lsn, num_pages[WAL_FILE_DATA]);
+    // The meta page and the storage header are read as of the commit
+    if (index_pager && data_pager && num_pages[WAL_FILE_INDEX] > 0) {
+        snapshot->index = btree_create(index_pager, 0);
+        if (snapshot->index) snapshot->storage = storage_create(data_pager);
+    }
+    if (!snapshot->storage) {
+        btree_destroy(snapshot->index);
+        pager_close(index_pager);
+        pager_close(data_pager);
+        wal_snapshot_close(db->wal, snapshot->lsn);
+        free(snapshot);
+        return NULL;
+    }
+    
+    LOG_INFO("Opened snapshot at LSN %llu", (unsigned long long)snapshot->lsn);
+    return snapshot;
+}
+
+void db_snapshot_close(DBSnapshot *snapshot) {
+    if (!snapshot) return;
+    
+    pager_close(snapshot->index->pager);
+    pager_close(snapshot->storage->pager);
+    btree_destroy(snapshot->index);
+    free(snapshot->storage);
+    wal_snapshot_close(snapshot->db->wal, snapshot->lsn);
+    free(snapshot);
+}
+
+DB_Result db_snapshot_find(DBSnapshot *snapshot, uint64_t key, void *buffer, size_t *size) {
+    LeafValue value;
+    DB_Result result = btree_find(snapshot->index, key, &value);
+    if (result != DB_SUCCESS) return result;
+    return read_value(snapshot->storage, &value, buffer, size);
+}
+
+DB_Result db_snapshot_read_value(DBSnapshot *snapshot, const LeafValue *value,
+                                 void *buffer, size_t *size) {
+    return read_value(snapshot->storage, value, buffer, size);
+}
@@ -3,22 +3,173 @@
 
 #include "constants.h"
 #include "btree.h"
+#include "strtree.h"
 #include "storage.h"
+#include "wal.h"
+#include <pthread.h>
+
+typedef struct {
+    uint32_t cache_pages;     // Buffer pool frames per file (0 = default)
+    uint32_t page_size;       // For new files (0 = PAGE_SIZE)
+    uint32_t key_size;        // Integer key bytes for a new index, 4 or 8 (0 = 4)
+    bool read_only;           // Reject writes; files must already exist
+    bool use_mmap;            // Serve pages from read-only mappings (implies read_only)
+    bool async_commit;        // Commits return before the log is fsynced
+    bool shadow_paging;       // Shadow-paged files instead of a write-ahead log
+    uint64_t checkpoint_bytes;        // Unapplied log size that triggers a checkpoint (0 = 8 MB)
+    uint32_t checkpoint_interval_ms;  // Checkpoint pending commits at least this often (0 = 1 s)
+} DBOptions;
+
+// One record of a db_insert_batch
+typedef struct {
+    uint64_t key;
+    const void *data;
+    size_t size;
+} DBRecord;
+
+// Feeds db_bulk_load: returns 1 with a record, 0 at the end of input and a
+// negative value on error. *data must stay valid until the next call.
+typedef int (*DBRecordSource)(void *context, uint64_t *key, const void **data, size_t *size);
+
+typedef struct {
+    uint32_t fill_percent;    // How full index nodes are packed, 50-100 (0 = 90)
+    bool presorted;           // Keys arrive in ascending order; otherwise they are sorted first
+    size_t sort_memory;       // Bytes buffered per sorted run (0 = 64 MB)
+} DBBulkOptions;
+
+// Concurrency: any number of threads may read while no write is running.
+// Writes hold `writer` for their whole transaction (a single write outside
+// db_begin is its own transaction). A single write takes `lock` exclusively
+// only while it changes pages, so readers wait for page changes but not for
+// fsyncs; db_begin takes it until the commit, so other threads never read
+// a transaction's changes before they commit. Snapshots still read the
+// last commit meanwhile. The transaction's own thread reads as usual. Views
+// (db_find_view) point into data pages, so page changes also wait until
+// none is open. They wait without holding `lock`, and meanwhile only
+// threads that already hold views may take new ones: a thread may read
+// and take more views while it holds one. Its writes, db_begin, db_commit
+// and db_rollback fail with DB_ERROR until its views are released, as it
+// would otherwise wait for itself.
+
+// Views one thread took and has not released yet. A view may be released
+// on any thread, so it keeps the record of the thread that took it.
+typedef struct ViewHolder {
+    pthread_t thread;
+    uint32_t count;
+    struct ViewHolder *next;
+} ViewHolder;
 
 typedef struct Database {
     BTree *index;
+    StrTree *strings;         // String keys; shares the index file
     Storage *storage;
+    Wal *wal;                 // NULL with shadow paging
     char *name;
+    bool read_only;
+    bool async_commit;
+    bool in_transaction;      // Set by db_begin; otherwise every write commits on its own
+    bool shadow_paging;       // Files are shadow-paged and there is no log
+    bool shadow_failed;       // A commit reached only some files; reopen to recover
+    pthread_rwlock_t lock;    // Shared by readers, exclusive while pages change
+    pthread_mutex_t writer;   // Recursive; held from db_begin to db_commit / db_rollback
+    pthread_mutex_t view_lock;
+    pthread_cond_t view_change;     // Signalled when open_views or waiting_writers drops to 0
+    uint32_t open_views;      // Views handed out and not yet released
+    uint32_t waiting_writers; // Writers waiting for open views to be released
+    ViewHolder *view_holders; // Under view_lock; a record is reused once its count is 0
     uint64_t total_keys;      // Add this
     uint64_t total_data_size;
 } Database;
 
+// A value read in place by db_find_view
+typedef struct {
+    page_num_t page;          // Pinned data page, or INVALID_PAGE for a copy
+    void *copy;               // malloc'd value from an overflow extent
+    ViewHolder *holder;       // Thread the view counts against
+} DBView;
 
-// Database operations
-Database *db_open(const char *db_name);
+#define DB_SNAPSHOT_CACHE_PAGES 256   // Buffer pool frames per file of a snapshot
+
+// A read-only view of the database as of the last commit before it was
+// opened. It reads through pagers of its own and takes none of the
+// database's locks: writers never wait for it, and it sees neither later
+// commits nor an open transaction. Many threads may read through one
+// snapshot. The log cannot be checkpointed past an open snapshot, so close
+// it when done, and always before the database.
+typedef struct {
+    Database *db;
+    BTree *index;
+    Storage *storage;
+    uint64_t lsn;             // Commit the snapshot sees
+} DBSnapshot;
+
+
+// Database operations. Opening replays committed transactions left in the
+// write-ahead log by a crash; shadow-paged files open at their newest commit
+// that both files completed. Closing must wait until no other thread uses
+// the database.
+Database *db_open(const char *db_name, const DBOptions *options);
 DB_Result db_close(Database *db);
-DB_Result db_insert(Database *db, uint32_t key, const void *data, size_t size);
-DB_Result db_find(Database *db, uint32_t key, void *buffer, size_t *size);
-DB_Result db_delete(Database *db, uint32_t key);
+// Readers bracket db_find, db_find_str, db_find_batch, db_read_value and direct
+// index access (cursors, statistics) with these; writes lock for themselves
+void db_read_lock(Database *db);
+void db_read_unlock(Database *db);
+// Transactions. Changes are logged to <name>.wal and become durable at
+// commit; a rollback restores the state of the last commit. Other threads'
+// writes wait until the transaction ends. With shadow paging every commit is
+// fsynced before it returns.
+DB_Result db_begin(Database *db);
+DB_Result db_commit(Database *db);
+DB_Result db_rollback(Database *db);
+// Copies committed pages from the log into the data files right away; a
+// background thread otherwise does this as the log grows. Shadow-paged
+// files have nothing to copy.
+DB_Result db_checkpoint(Database *db);
+// Integer keys go up to db->index->max_key, which depends on the key width
+// the index was created with; wider keys fail with DB_ERROR on insert and
+// are never found.
+DB_Result db_insert(Database *db, uint64_t key, const void *data, size_t size);
+DB_Result db_find(Database *db, uint64_t key, void *buffer, size_t *size);
+DB_Result db_delete(Database *db, uint64_t key);
+// Inserts or replaces many records in key order; a key repeated within the
+// batch keeps its last record. Nothing is written if the data does not fit.
+DB_Result db_insert_batch(Database *db, const DBRecord *records, uint32_t count);
+// Looks up many keys at once. found[i] and values[i] describe keys[i].
+DB_Result db_find_batch(Database *db, const uint64_t *keys, uint32_t count,
+                        LeafValue *values, bool *found);
+// Loads records into an empty database, writing data pages in order and
+// building the index bottom-up. Later records replace earlier ones with the
+// same key.
+DB_Result db_bulk_load(Database *db, DBRecordSource source, void *context, const DBBulkOptions *options);
+// String keys: byte strings of up to STRTREE_MAX_KEY bytes, kept apart from
+// the integer keys and in memcmp order. Longer keys fail with DB_ERROR.
+DB_Result db_insert_str(Database *db, const void *key, uint32_t key_size,
+                        const void *data, size_t size);
+DB_Result db_find_str(Database *db, const void *key, uint32_t key_size, void *buffer, size_t *size);
+DB_Result db_delete_str(Database *db, const void *key, uint32_t key_size);
+// Zero-copy reads. *data points into the pinned data page of the value, or
+// for a value in an overflow extent into a malloc'd copy, until
+// db_release_view, which may run on any thread. Unlike
+// db_find these take the read lock themselves, after letting a waiting
+// writer go first.
+DB_Result db_find_view(Database *db, uint64_t key, const void **data, size_t *size, DBView *view);
+DB_Result db_find_str_view(Database *db, const void *key, uint32_t key_size,
+                           const void **data, size_t *size, DBView *view);
+void db_release_view(Database *db, DBView *view);
+// Whether a key has a record; reads only the index
+bool db_contains(Database *db, uint64_t key);
+bool db_contains_str(Database *db, const void *key, uint32_t key_size);
+// Reads the record an index entry points at; DB_ERROR with *size set to the
+// value length when the buffer is too small
+DB_Result db_read_value(Database *db, const LeafValue *value, void *buffer, size_t *size);
+
+// Snapshots. Cursors over snapshot->index read their values with
+// db_snapshot_read_value. They need the write-ahead log: db_snapshot_open
+// returns NULL with shadow paging.
+DBSnapshot *db_snapshot_open(Database *db);
+void db_snapshot_close(DBSnapshot *snapshot);
+DB_Result db_snapshot_find(DBSnapshot *snapshot, uint64_t key, void *buffer, size_t *size);
+DB_Result db_snapshot_read_value(DBSnapshot *snapshot, const LeafValue *value,
+                                 void *buffer, size_t *size);
 
 #endif
\ No newline at end of file
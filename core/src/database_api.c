@@ -1,6 +1,7 @@
 #include "stark.h"
 #include "database.h"
 #include "type.h"
+#include "log.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -9,25 +10,41 @@ struct stark_db {
     Database* internal_db;
     char last_error[256];
     char* path;
-    
-    // Transaction support
-    int in_transaction;
-    void* transaction_log; 
-    size_t log_size;
 };
 
 // ==================== LIFECYCLE ====================
 
 STARK_API stark_db_t* stark_open(const char* path, unsigned flags) {
-    (void)flags;  // Unused for now
-    
+    return stark_open_ex(path, flags, NULL);
+}
+
+STARK_API stark_db_t* stark_open_ex(const char* path, unsigned flags,
+                                    const stark_options_t* options) {
     stark_db_t* db = (stark_db_t*)calloc(1, sizeof(stark_db_t));
     if (!db) return NULL;
     
     db->path = strdup(path);
     
+    DBOptions db_options = {0};
+    if (options) {
+        db_options.cache_pages = options->cache_pages;
+        db_options.page_size = options->page_size;
+        db_options.async_commit = options->async_commit != 0;
+        db_options.checkpoint_bytes = options->checkpoint_bytes;
+        db_options.checkpoint_interval_ms = options->checkpoint_interval_ms;
+        if (options->key_bits != 0 && options->key_bits != 32 && options->key_bits != 64) {
+            free(db->path);
+            free(db);
+            return NULL;
+        }
+        db_options.key_size = options->key_bits / 8;
+    }
+    db_options.read_only = (flags & STARK_OPEN_READONLY) != 0;
+    db_options.use_mmap = (flags & STARK_OPEN_MMAP) != 0;
+    db_options.shadow_paging = (flags & STARK_OPEN_SHADOW) != 0;
+    
     // Call your existing database code
-    db->internal_db = db_open(path);
+    db->internal_db = db_open(path, &db_options);
     if (!db->internal_db) {
         snprintf(db->last_error, sizeof(db->last_error), 
                  "Failed to open database: %s", path);
@@ -43,34 +60,23 @@ STARK_API void stark_close(stark_db_t* db) {
     if (!db) return;
     
     if (db->internal_db) {
-        // Force sync to disk before closing
-        stark_sync(db); 
+        // Checkpoints the log into the data files
         db_close(db->internal_db);
     }
     
     free(db->path);
     free(db);
-    printf("💾 Database synced and closed.\n");
+    LOG_INFO("Database synced and closed.");
 }
 
 // ==================== CRUD ====================
 
-STARK_API stark_result_t stark_add(stark_db_t* db, uint32_t key,
-                                   const void* value, size_t value_size) {
+// The 32- and 64-bit entry points share these; a 32-bit key is valid in a
+// database of either width
+static stark_result_t add_key(stark_db_t* db, uint64_t key,
+                              const void* value, size_t value_size) {
     if (!db || !db->internal_db) return STARK_CLOSED;
-    
-    // If in transaction, log the change
-    if (db->in_transaction) {
-        printf("📝 Logging change for key %u in transaction\n", key);
-        
-        // Get old value if exists
-        char old_buffer[256];
-        size_t old_size = sizeof(old_buffer);
-        int exists = (stark_get(db, key, old_buffer, &old_size) == STARK_OK);
-        
-        // Log the change (simplified)
-        // In real implementation, you'd store in transaction_log
-    }
+    if (key > db->internal_db->index->max_key) return STARK_INVALID_ARG;
     
     DB_Result result = db_insert(db->internal_db, key, value, value_size);
     
@@ -79,16 +85,19 @@ STARK_API stark_result_t stark_add(stark_db_t* db, uint32_t key,
         case DB_FULL: return STARK_FULL;
         case DB_IO_ERROR: return STARK_IO_ERROR;
         case DB_MEMORY_ERROR: return STARK_MEMORY_ERROR;
+        case DB_READONLY: return STARK_READONLY;
         default: return STARK_ERROR;
     }
 }
 
-STARK_API stark_result_t stark_get(stark_db_t* db, uint32_t key,
-                                   void* buffer, size_t* buffer_size) {
+static stark_result_t get_key(stark_db_t* db, uint64_t key,
+                              void* buffer, size_t* buffer_size) {
     if (!db || !db->internal_db) return STARK_CLOSED;
     if (!buffer || !buffer_size) return STARK_INVALID_ARG;
     
+    db_read_lock(db->internal_db);
     DB_Result result = db_find(db->internal_db, key, buffer, buffer_size);
+    db_read_unlock(db->internal_db);
     
     switch (result) {
         case DB_SUCCESS: return STARK_OK;
@@ -98,7 +107,7 @@ STARK_API stark_result_t stark_get(stark_db_t* db, uint32_t key,
     }
 }
 
-STARK_API stark_result_t stark_delete(stark_db_t* db, uint32_t key) {
+static stark_result_t delete_key(stark_db_t* db, uint64_t key) {
     if (!db || !db->internal_db) return STARK_CLOSED;
     
     DB_Result result = db_delete(db->internal_db, key);
@@ -106,100 +115,587 @@ STARK_API stark_result_t stark_delete(stark_db_t* db, uint32_t key) {
     switch (result) {
         case DB_SUCCESS: return STARK_OK;
         case DB_NOT_FOUND: return STARK_NOT_FOUND;
+        case DB_READONLY: return STARK_READONLY;
         default: return STARK_ERROR;
     }
 }
 
-STARK_API int stark_exists(stark_db_t* db, uint32_t key) {
+static int key_exists(stark_db_t* db, uint64_t key) {
     if (!db || !db->internal_db) return 0;
     
-    char dummy[256];
-    size_t size = sizeof(dummy);
-    DB_Result result = db_find(db->internal_db, key, dummy, &size);
+    db_read_lock(db->internal_db);
+    bool found = db_contains(db->internal_db, key);
+    db_read_unlock(db->internal_db);
+    
+    return found;
+}
+
+STARK_API stark_result_t stark_add(stark_db_t* db, uint32_t key,
+                                   const void* value, size_t value_size) {
+    return add_key(db, key, value, value_size);
+}
+
+STARK_API stark_result_t stark_get(stark_db_t* db, uint32_t key,
+                                   void* buffer, size_t* buffer_size) {
+    return get_key(db, key, buffer, buffer_size);
+}
+
+STARK_API stark_result_t stark_delete(stark_db_t* db, uint32_t key) {
+    return delete_key(db, key);
+}
+
+STARK_API int stark_exists(stark_db_t* db, uint32_t key) {
+    return key_exists(db, key);
+}
+
+// ==================== 64-BIT KEYS ====================
+
+STARK_API stark_result_t stark_add64(stark_db_t* db, uint64_t key,
+                                     const void* value, size_t value_size) {
+    return add_key(db, key, value, value_size);
+}
+
+STARK_API stark_result_t stark_get64(stark_db_t* db, uint64_t key,
+                                     void* buffer, size_t* buffer_size) {
+    return get_key(db, key, buffer, buffer_size);
+}
+
+STARK_API stark_result_t stark_delete64(stark_db_t* db, uint64_t key) {
+    return delete_key(db, key);
+}
+
+STARK_API int stark_exists64(stark_db_t* db, uint64_t key) {
+    return key_exists(db, key);
+}
+
+// ==================== ZERO-COPY READS ====================
+
+// Hands a view to the caller's pin; a failed lookup leaves nothing to release
+static stark_result_t view_result(stark_db_t* db, DB_Result result,
+                                  const DBView* view, stark_pin_t* pin) {
+    switch (result) {
+        case DB_SUCCESS: break;
+        case DB_NOT_FOUND: return STARK_NOT_FOUND;
+        case DB_MEMORY_ERROR: return STARK_MEMORY_ERROR;
+        default: return STARK_ERROR;
+    }
+    
+    pin->db = db;
+    pin->page = view->page;
+    pin->copy = view->copy;
+    pin->holder = view->holder;
+    return STARK_OK;
+}
+
+static stark_result_t get_key_view(stark_db_t* db, uint64_t key, const void** value,
+                                   size_t* value_size, stark_pin_t* pin) {
+    if (!pin) return STARK_INVALID_ARG;
+    pin->db = NULL;
+    if (!db || !db->internal_db) return STARK_CLOSED;
+    if (!value || !value_size) return STARK_INVALID_ARG;
+    
+    DBView view;
+    DB_Result result = db_find_view(db->internal_db, key, value, value_size, &view);
+    
+    return view_result(db, result, &view, pin);
+}
+
+STARK_API stark_result_t stark_get_view(stark_db_t* db, uint32_t key,
+                                        const void** value, size_t* value_size,
+                                        stark_pin_t* pin) {
+    return get_key_view(db, key, value, value_size, pin);
+}
+
+STARK_API stark_result_t stark_get_view64(stark_db_t* db, uint64_t key,
+                                          const void** value, size_t* value_size,
+                                          stark_pin_t* pin) {
+    return get_key_view(db, key, value, value_size, pin);
+}
+
+STARK_API void stark_release(stark_pin_t* pin) {
+    if (!pin || !pin->db) return;
+    
+    stark_db_t* db = pin->db;
+    DBView view = { (page_num_t)pin->page, pin->copy, pin->holder };
+    db_release_view(db->internal_db, &view);
+    pin->db = NULL;
+}
+
+// ==================== BATCH OPERATIONS ====================
+
+// Both batch widths fill DBRecords; this writes and frees them
+static stark_result_t put_records(stark_db_t* db, DBRecord* records, size_t count) {
+    DB_Result result = db_insert_batch(db->internal_db, records, (uint32_t)count);
+    free(records);
+    
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_FULL: return STARK_FULL;
+        case DB_READONLY: return STARK_READONLY;
+        default: return STARK_ERROR;
+    }
+}
+
+STARK_API stark_result_t stark_put_batch(stark_db_t* db, const stark_kv_t* items, size_t count) {
+    if (!db || !db->internal_db) return STARK_CLOSED;
+    if ((!items && count > 0) || count > UINT32_MAX) return STARK_INVALID_ARG;
+    if (count == 0) return STARK_OK;
+    
+    DBRecord* records = (DBRecord*)malloc(count * sizeof(DBRecord));
+    if (!records) return STARK_MEMORY_ERROR;
+    for (size_t i = 0; i < count; i++) {
+        records[i].key = items[i].key;
+        records[i].data = items[i].value;
+        records[i].size = items[i].value_size;
+    }
+    return put_records(db, records, count);
+}
+
+STARK_API stark_result_t stark_put_batch64(stark_db_t* db, const stark_kv64_t* items, size_t count) {
+    if (!db || !db->internal_db) return STARK_CLOSED;
+    if ((!items && count > 0) || count > UINT32_MAX) return STARK_INVALID_ARG;
+    if (count == 0) return STARK_OK;
+    
+    DBRecord* records = (DBRecord*)malloc(count * sizeof(DBRecord));
+    if (!records) return STARK_MEMORY_ERROR;
+    for (size_t i = 0; i < count; i++) {
+        if (items[i].key > db->internal_db->index->max_key) {
+            free(records);
+            return STARK_INVALID_ARG;
+        }
+        records[i].key = items[i].key;
+        records[i].data = items[i].value;
+        records[i].size = items[i].value_size;
+    }
+    return put_records(db, records, count);
+}
+
+// Reads batch values in locator order so data pages are visited once each
+typedef struct {
+    locator_t locator;
+    size_t index;
+} batch_read_t;
+
+static int compare_batch_reads(const void* a, const void* b) {
+    locator_t x = ((const batch_read_t*)a)->locator;
+    locator_t y = ((const batch_read_t*)b)->locator;
+    return x < y ? -1 : (x > y);
+}
+
+static stark_result_t get_keys(stark_db_t* db, const uint64_t* keys, size_t count,
+                               void* buffer, size_t buffer_size,
+                               stark_get_result_t* results) {
+    if (!db || !db->internal_db) return STARK_CLOSED;
+    if ((!keys || !results) && count > 0) return STARK_INVALID_ARG;
+    if (count > UINT32_MAX) return STARK_INVALID_ARG;
+    if (count == 0) return STARK_OK;
+    
+    LeafValue* values = (LeafValue*)malloc(count * sizeof(LeafValue));
+    bool* found = (bool*)malloc(count * sizeof(bool));
+    batch_read_t* reads = (batch_read_t*)malloc(count * sizeof(batch_read_t));
+    stark_result_t status = STARK_MEMORY_ERROR;
+    if (!values || !found || !reads) goto done;
+    
+    // Locators stay valid only while no write can move the records
+    db_read_lock(db->internal_db);
+    status = STARK_ERROR;
+    if (db_find_batch(db->internal_db, keys, (uint32_t)count, values, found) != DB_SUCCESS) {
+        db_read_unlock(db->internal_db);
+        goto done;
+    }
+    
+    // Lay values out in the caller's order; sizes come from the index
+    size_t used = 0;
+    size_t num_reads = 0;
+    for (size_t i = 0; i < count; i++) {
+        results[i].value_offset = 0;
+        results[i].value_size = found[i] ? values[i].length : 0;
+        results[i].status = found[i] ? STARK_OK : STARK_NOT_FOUND;
+        if (!found[i] || !buffer) continue;
+        
+        if (values[i].length > buffer_size - used) {
+            results[i].status = STARK_ERROR;
+            continue;
+        }
+        results[i].value_offset = used;
+        used += values[i].length;
+        reads[num_reads].locator = values[i].locator;
+        reads[num_reads].index = i;
+        num_reads++;
+    }
     
-    return (result == DB_SUCCESS) || (result == DB_ERROR && size > 0);
+    qsort(reads, num_reads, sizeof(batch_read_t), compare_batch_reads);
+    for (size_t r = 0; r < num_reads; r++) {
+        size_t i = reads[r].index;
+        size_t size = results[i].value_size;
+        if (db_read_value(db->internal_db, &values[i], (char*)buffer + results[i].value_offset,
+                          &size) != DB_SUCCESS) {
+            results[i].status = STARK_ERROR;
+        }
+    }
+    db_read_unlock(db->internal_db);
+    status = STARK_OK;
+    
+done:
+    free(values);
+    free(found);
+    free(reads);
+    return status;
+}
+
+STARK_API stark_result_t stark_get_batch(stark_db_t* db, const uint32_t* keys, size_t count,
+                                        void* buffer, size_t buffer_size,
+                                        stark_get_result_t* results) {
+    // Nothing to widen; get_keys reports the arguments
+    if (!keys || count == 0 || count > UINT32_MAX) {
+        return get_keys(db, NULL, count, buffer, buffer_size, results);
+    }
+    
+    uint64_t* wide = (uint64_t*)malloc(count * sizeof(uint64_t));
+    if (!wide) return STARK_MEMORY_ERROR;
+    for (size_t i = 0; i < count; i++) wide[i] = keys[i];
+    stark_result_t status = get_keys(db, wide, count, buffer, buffer_size, results);
+    free(wide);
+    return status;
+}
+
+STARK_API stark_result_t stark_get_batch64(stark_db_t* db, const uint64_t* keys, size_t count,
+                                          void* buffer, size_t buffer_size,
+                                          stark_get_result_t* results) {
+    return get_keys(db, keys, count, buffer, buffer_size, results);
 }
 
 // ==================== CURSOR ====================
 
 struct stark_cursor {
     stark_db_t* db;
-    uint32_t current_key;
-    int valid;
+    DBSnapshot* snapshot;       // Set for cursors over a snapshot
+    BTreeCursor position;
+};
+
+struct stark_snapshot {
+    stark_db_t* db;
+    DBSnapshot* internal;
 };
 
+// Entries pulled from the index per step of stark_cursor_fetch
+#define CURSOR_FETCH_CHUNK 64
+
+static stark_result_t cursor_result(DB_Result result) {
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_NOT_FOUND: return STARK_NOT_FOUND;
+        default: return STARK_ERROR;
+    }
+}
+
+// Cursors keep no lock between calls; each step re-checks the tree's
+// modification count under the read lock. Snapshots never change, so their
+// cursors need no lock at all.
+static void cursor_lock(stark_cursor_t* cursor) {
+    if (!cursor->snapshot) db_read_lock(cursor->db->internal_db);
+}
+
+static void cursor_unlock(stark_cursor_t* cursor) {
+    if (!cursor->snapshot) db_read_unlock(cursor->db->internal_db);
+}
+
+static DB_Result cursor_read_value(stark_cursor_t* cursor, const LeafValue* value,
+                                   void* buffer, size_t* size) {
+    if (cursor->snapshot) return db_snapshot_read_value(cursor->snapshot, value, buffer, size);
+    return db_read_value(cursor->db->internal_db, value, buffer, size);
+}
+
+typedef DB_Result (*cursor_move_t)(BTreeCursor* position);
+
+static stark_result_t cursor_move(stark_cursor_t* cursor, cursor_move_t move) {
+    if (!cursor) return STARK_INVALID_ARG;
+    cursor_lock(cursor);
+    DB_Result result = move(&cursor->position);
+    cursor_unlock(cursor);
+    return cursor_result(result);
+}
+
 STARK_API stark_cursor_t* stark_cursor_create(stark_db_t* db) {
-    if (!db) return NULL;
+    if (!db || !db->internal_db) return NULL;
     
     stark_cursor_t* cursor = (stark_cursor_t*)calloc(1, sizeof(stark_cursor_t));
     if (!cursor) return NULL;
     
     cursor->db = db;
-    cursor->valid = 0;
-    cursor->current_key = 0;
+    btree_cursor_init(&cursor->position, db->internal_db->index);
     
     return cursor;
 }
 
 STARK_API stark_result_t stark_cursor_first(stark_cursor_t* cursor) {
-    if (!cursor) return STARK_INVALID_ARG;
-    cursor->valid = 0;
-    return STARK_NOT_FOUND;
+    return cursor_move(cursor, btree_cursor_first);
 }
 
 STARK_API stark_result_t stark_cursor_last(stark_cursor_t* cursor) {
+    return cursor_move(cursor, btree_cursor_last);
+}
+
+STARK_API stark_result_t stark_cursor_seek(stark_cursor_t* cursor, uint32_t key) {
+    return stark_cursor_seek64(cursor, key);
+}
+
+STARK_API stark_result_t stark_cursor_seek64(stark_cursor_t* cursor, uint64_t key) {
     if (!cursor) return STARK_INVALID_ARG;
-    cursor->valid = 0;
-    return STARK_NOT_FOUND;
+    cursor_lock(cursor);
+    DB_Result result = btree_cursor_seek(&cursor->position, key);
+    cursor_unlock(cursor);
+    return cursor_result(result);
 }
 
 STARK_API stark_result_t stark_cursor_next(stark_cursor_t* cursor) {
-    if (!cursor) return STARK_INVALID_ARG;
-    return STARK_NOT_FOUND;
+    return cursor_move(cursor, btree_cursor_next);
 }
 
 STARK_API stark_result_t stark_cursor_prev(stark_cursor_t* cursor) {
-    if (!cursor) return STARK_INVALID_ARG;
-    return STARK_NOT_FOUND;
+    return cursor_move(cursor, btree_cursor_prev);
 }
 
 STARK_API stark_result_t stark_cursor_get(stark_cursor_t* cursor,
                                          uint32_t* key,
                                          void* buffer, size_t* buffer_size) {
-    if (!cursor || !cursor->valid) return STARK_NOT_FOUND;
+    if (!key) return STARK_INVALID_ARG;
+    
+    uint64_t wide_key;
+    stark_result_t result = stark_cursor_get64(cursor, &wide_key, buffer, buffer_size);
+    if (result == STARK_OK && wide_key > UINT32_MAX) return STARK_ERROR;
+    *key = (uint32_t)wide_key;
+    return result;
+}
+
+STARK_API stark_result_t stark_cursor_get64(stark_cursor_t* cursor,
+                                           uint64_t* key,
+                                           void* buffer, size_t* buffer_size) {
+    if (!cursor) return STARK_INVALID_ARG;
     if (!key || !buffer || !buffer_size) return STARK_INVALID_ARG;
     
-    return STARK_NOT_FOUND;
+    LeafValue value;
+    cursor_lock(cursor);
+    DB_Result result = btree_cursor_get(&cursor->position, key, &value);
+    if (result == DB_SUCCESS) {
+        result = cursor_read_value(cursor, &value, buffer, buffer_size);
+    }
+    cursor_unlock(cursor);
+    return cursor_result(result);
+}
+
+// Fills entries, or entries64 when it is set
+static stark_result_t fetch_entries(stark_cursor_t* cursor,
+                                    stark_entry_t* entries, stark_entry64_t* entries64,
+                                    size_t max_entries, void* buffer, size_t buffer_size,
+                                    size_t* count) {
+    if (!cursor || (!entries && !entries64) || !count) return STARK_INVALID_ARG;
+    uint64_t max_key = entries64 ? UINT64_MAX : UINT32_MAX;
+    *count = 0;
+    
+    uint64_t keys[CURSOR_FETCH_CHUNK];
+    LeafValue values[CURSOR_FETCH_CHUNK];
+    size_t used = 0;
+    
+    cursor_lock(cursor);
+    while (*count < max_entries) {
+        size_t wanted = max_entries - *count;
+        uint32_t chunk = wanted < CURSOR_FETCH_CHUNK ? (uint32_t)wanted : CURSOR_FETCH_CHUNK;
+        uint32_t fetched = btree_cursor_fetch(&cursor->position, keys, values, chunk);
+        if (fetched == 0) break;
+        
+        for (uint32_t i = 0; i < fetched; i++) {
+            if (entries64) {
+                stark_entry64_t* entry = &entries64[*count];
+                entry->key = keys[i];
+                entry->value_size = values[i].length;
+                entry->value_offset = used;
+            } else {
+                stark_entry_t* entry = &entries[*count];
+                entry->key = (uint32_t)keys[i];
+                entry->value_size = values[i].length;
+                entry->value_offset = used;
+            }
+            
+            // Keys wider than an entry holds end the batch like a value
+            // that does not fit
+            DB_Result result = keys[i] > max_key ? DB_ERROR : DB_SUCCESS;
+            size_t size = 0;
+            if (buffer && result == DB_SUCCESS) {
+                size = buffer_size - used;
+                result = size < values[i].length ? DB_ERROR :
+                    cursor_read_value(cursor, &values[i], (char*)buffer + used, &size);
+            }
+            if (result != DB_SUCCESS) {
+                // Leave the cursor on the entry that was not returned
+                btree_cursor_seek(&cursor->position, keys[i]);
+                cursor_unlock(cursor);
+                if (*count > 0) return STARK_OK;
+                return STARK_ERROR;
+            }
+            used += size;
+            (*count)++;
+        }
+        if (fetched < chunk) break;
+    }
+    cursor_unlock(cursor);
+    
+    return *count > 0 ? STARK_OK : STARK_NOT_FOUND;
+}
+
+STARK_API stark_result_t stark_cursor_fetch(stark_cursor_t* cursor,
+                                           stark_entry_t* entries, size_t max_entries,
+                                           void* buffer, size_t buffer_size,
+                                           size_t* count) {
+    return fetch_entries(cursor, entries, NULL, max_entries, buffer, buffer_size, count);
+}
+
+STARK_API stark_result_t stark_cursor_fetch64(stark_cursor_t* cursor,
+                                             stark_entry64_t* entries, size_t max_entries,
+                                             void* buffer, size_t buffer_size,
+                                             size_t* count) {
+    return fetch_entries(cursor, NULL, entries, max_entries, buffer, buffer_size, count);
 }
 
 STARK_API void stark_cursor_destroy(stark_cursor_t* cursor) {
     free(cursor);
 }
 
-// ==================== STRING KEY HASHING ====================
+// ==================== SNAPSHOTS ====================
 
-static uint32_t hash_string(const char* str) {
-    uint32_t hash = 5381;
-    int c;
+STARK_API stark_snapshot_t* stark_snapshot_open(stark_db_t* db) {
+    if (!db || !db->internal_db) return NULL;
+    
+    stark_snapshot_t* snapshot = (stark_snapshot_t*)calloc(1, sizeof(stark_snapshot_t));
+    if (!snapshot) return NULL;
     
-    while ((c = *str++)) {
-        hash = ((hash << 5) + hash) + c;
+    snapshot->db = db;
+    snapshot->internal = db_snapshot_open(db->internal_db);
+    if (!snapshot->internal) {
+        snprintf(db->last_error, sizeof(db->last_error), "Failed to open snapshot");
+        free(snapshot);
+        return NULL;
     }
+    return snapshot;
+}
+
+static stark_result_t snapshot_get_key(stark_snapshot_t* snapshot, uint64_t key,
+                                       void* buffer, size_t* buffer_size) {
+    if (!snapshot) return STARK_INVALID_ARG;
+    if (!buffer || !buffer_size) return STARK_INVALID_ARG;
+    
+    // No lock: nothing the snapshot reads ever changes
+    DB_Result result = db_snapshot_find(snapshot->internal, key, buffer, buffer_size);
     
-    return hash;
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_NOT_FOUND: return STARK_NOT_FOUND;
+        default: return STARK_ERROR;
+    }
+}
+
+STARK_API stark_result_t stark_snapshot_get(stark_snapshot_t* snapshot, uint32_t key,
+                                            void* buffer, size_t* buffer_size) {
+    return snapshot_get_key(snapshot, key, buffer, buffer_size);
+}
+
+STARK_API stark_result_t stark_snapshot_get64(stark_snapshot_t* snapshot, uint64_t key,
+                                              void* buffer, size_t* buffer_size) {
+    return snapshot_get_key(snapshot, key, buffer, buffer_size);
+}
+
+STARK_API stark_cursor_t* stark_snapshot_cursor(stark_snapshot_t* snapshot) {
+    if (!snapshot) return NULL;
+    
+    stark_cursor_t* cursor = (stark_cursor_t*)calloc(1, sizeof(stark_cursor_t));
+    if (!cursor) return NULL;
+    
+    cursor->db = snapshot->db;
+    cursor->snapshot = snapshot->internal;
+    btree_cursor_init(&cursor->position, snapshot->internal->index);
+    
+    return cursor;
 }
 
+STARK_API void stark_snapshot_close(stark_snapshot_t* snapshot) {
+    if (!snapshot) return;
+    db_snapshot_close(snapshot->internal);
+    free(snapshot);
+}
+
+// ==================== BULK LOAD ====================
+
+static stark_result_t bulk_load(stark_db_t* db, DBRecordSource source,
+                                void* context, const stark_bulk_options_t* options) {
+    if (!db || !db->internal_db) return STARK_CLOSED;
+    if (!source) return STARK_INVALID_ARG;
+    
+    DBBulkOptions bulk = {0};
+    if (options) {
+        bulk.fill_percent = options->fill_percent;
+        bulk.presorted = options->presorted != 0;
+        bulk.sort_memory = options->sort_memory;
+    }
+    
+    DB_Result result = db_bulk_load(db->internal_db, source, context, &bulk);
+    
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_FULL: return STARK_FULL;
+        case DB_READONLY: return STARK_READONLY;
+        default: return STARK_ERROR;
+    }
+}
+
+// A 32-bit record source, read through the 64-bit one db_bulk_load takes
+typedef struct {
+    stark_record_source_t source;
+    void* context;
+} narrow_source_t;
+
+static int widen_source(void* context, uint64_t* key, const void** value, size_t* value_size) {
+    narrow_source_t* narrow = (narrow_source_t*)context;
+    uint32_t narrow_key = 0;
+    int status = narrow->source(narrow->context, &narrow_key, value, value_size);
+    *key = narrow_key;
+    return status;
+}
+
+STARK_API stark_result_t stark_bulk_load(stark_db_t* db, stark_record_source_t source,
+                                        void* context, const stark_bulk_options_t* options) {
+    narrow_source_t narrow = { source, context };
+    return bulk_load(db, source ? widen_source : NULL, &narrow, options);
+}
+
+STARK_API stark_result_t stark_bulk_load64(stark_db_t* db, stark_record_source64_t source,
+                                          void* context, const stark_bulk_options_t* options) {
+    return bulk_load(db, source, context, options);
+}
+
+// ==================== STRING KEYS ====================
+
+#if STARK_MAX_STR_KEY != STRTREE_MAX_KEY
+#error "STARK_MAX_STR_KEY must match STRTREE_MAX_KEY"
+#endif
+
 STARK_API stark_result_t stark_put_str(stark_db_t* db, const char* key,
                                        const void* value, size_t value_size) {
     if (!db || !db->internal_db) return STARK_CLOSED;
     if (!key || !value || value_size == 0) return STARK_INVALID_ARG;
     
-    // Hash the string key to uint32_t
-    uint32_t hashed_key = hash_string(key);
-    printf("Debug: String key '%s' hashed to %u\n", key, hashed_key);
+    size_t key_size = strlen(key);
+    if (key_size > STARK_MAX_STR_KEY) return STARK_INVALID_ARG;
+    
+    DB_Result result = db_insert_str(db->internal_db, key, (uint32_t)key_size, value, value_size);
     
-    // Use existing stark_add with hashed key
-    return stark_add(db, hashed_key, value, value_size);
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_FULL: return STARK_FULL;
+        case DB_IO_ERROR: return STARK_IO_ERROR;
+        case DB_MEMORY_ERROR: return STARK_MEMORY_ERROR;
+        case DB_READONLY: return STARK_READONLY;
+        default: return STARK_ERROR;
+    }
 }
 
 STARK_API stark_result_t stark_get_str(stark_db_t* db, const char* key,
@@ -207,41 +703,130 @@ STARK_API stark_result_t stark_get_str(stark_db_t* db, const char* key,
     if (!db || !db->internal_db) return STARK_CLOSED;
     if (!key || !buffer_size) return STARK_INVALID_ARG;
     
-    // Hash the string key to uint32_t
-    uint32_t hashed_key = hash_string(key);
-    printf("Debug: String key '%s' hashed to %u\n", key, hashed_key);
-    
-    // If buffer is NULL, we're just checking existence/size
-    if (buffer == NULL) {
-        // Create a dummy buffer to get the size
-        char dummy[1];
-        size_t dummy_size = 0;
-        DB_Result result = db_find(db->internal_db, hashed_key, dummy, &dummy_size);
-        if (result == DB_SUCCESS || (result == DB_ERROR && dummy_size > 0)) {
-            *buffer_size = dummy_size;
-            return STARK_ERROR;  // Return error but with valid size
-        }
-        return STARK_NOT_FOUND;
+    // A NULL buffer only asks for the size: STARK_ERROR with *buffer_size set
+    char dummy[1];
+    if (!buffer) *buffer_size = 0;
+    
+    db_read_lock(db->internal_db);
+    DB_Result result = db_find_str(db->internal_db, key, (uint32_t)strlen(key),
+                                   buffer ? buffer : dummy, buffer_size);
+    db_read_unlock(db->internal_db);
+    
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_NOT_FOUND: return STARK_NOT_FOUND;
+        default: return STARK_ERROR;
     }
+}
+
+STARK_API stark_result_t stark_get_str_view(stark_db_t* db, const char* key,
+                                            const void** value, size_t* value_size,
+                                            stark_pin_t* pin) {
+    if (!pin) return STARK_INVALID_ARG;
+    pin->db = NULL;
+    if (!db || !db->internal_db) return STARK_CLOSED;
+    if (!key || !value || !value_size) return STARK_INVALID_ARG;
+    
+    DBView view;
+    DB_Result result = db_find_str_view(db->internal_db, key, (uint32_t)strlen(key),
+                                        value, value_size, &view);
     
-    // Normal get operation
-    return stark_get(db, hashed_key, buffer, buffer_size);
+    return view_result(db, result, &view, pin);
 }
 
 STARK_API stark_result_t stark_del_str(stark_db_t* db, const char* key) {
     if (!db || !db->internal_db) return STARK_CLOSED;
     if (!key) return STARK_INVALID_ARG;
     
-    uint32_t hashed_key = hash_string(key);
-    return stark_delete(db, hashed_key);
+    size_t key_size = strlen(key);
+    if (key_size > STARK_MAX_STR_KEY) return STARK_NOT_FOUND;
+    
+    DB_Result result = db_delete_str(db->internal_db, key, (uint32_t)key_size);
+    
+    switch (result) {
+        case DB_SUCCESS: return STARK_OK;
+        case DB_NOT_FOUND: return STARK_NOT_FOUND;
+        case DB_READONLY: return STARK_READONLY;
+        default: return STARK_ERROR;
+    }
 }
 
 STARK_API int stark_exists_str(stark_db_t* db, const char* key) {
     if (!db || !db->internal_db) return 0;
     if (!key) return 0;
     
-    uint32_t hashed_key = hash_string(key);
-    return stark_exists(db, hashed_key);
+    db_read_lock(db->internal_db);
+    bool found = db_contains_str(db->internal_db, key, (uint32_t)strlen(key));
+    db_read_unlock(db->internal_db);
+    
+    return found;
+}
+
+struct stark_str_cursor {
+    stark_db_t* db;
+    StrTreeCursor position;
+};
+
+STARK_API stark_str_cursor_t* stark_str_cursor_create(stark_db_t* db) {
+    if (!db || !db->internal_db) return NULL;
+    
+    stark_str_cursor_t* cursor = (stark_str_cursor_t*)calloc(1, sizeof(stark_str_cursor_t));
+    if (!cursor) return NULL;
+    
+    cursor->db = db;
+    strtree_cursor_init(&cursor->position, db->internal_db->strings);
+    
+    return cursor;
+}
+
+STARK_API stark_result_t stark_str_cursor_seek(stark_str_cursor_t* cursor, const char* key) {
+    if (!cursor || !key) return STARK_INVALID_ARG;
+    
+    db_read_lock(cursor->db->internal_db);
+    DB_Result result = strtree_cursor_seek(&cursor->position, key, (uint32_t)strlen(key));
+    db_read_unlock(cursor->db->internal_db);
+    return cursor_result(result);
+}
+
+STARK_API stark_result_t stark_str_cursor_next(stark_str_cursor_t* cursor) {
+    if (!cursor) return STARK_INVALID_ARG;
+    
+    db_read_lock(cursor->db->internal_db);
+    DB_Result result = strtree_cursor_next(&cursor->position);
+    db_read_unlock(cursor->db->internal_db);
+    return cursor_result(result);
+}
+
+STARK_API stark_result_t stark_str_cursor_get(stark_str_cursor_t* cursor,
+                                             char* key, size_t key_size,
+                                             void* buffer, size_t* buffer_size) {
+    if (!cursor || !key || key_size == 0) return STARK_INVALID_ARG;
+    if (buffer && !buffer_size) return STARK_INVALID_ARG;
+    
+    Database* internal = cursor->db->internal_db;
+    LeafValue value;
+    db_read_lock(internal);
+    DB_Result result = strtree_cursor_get(&cursor->position, &value);
+    // A short key buffer fails before the value is read into the caller's
+    if (result == DB_SUCCESS && cursor->position.key_size >= key_size) {
+        db_read_unlock(internal);
+        return STARK_ERROR;
+    }
+    if (result == DB_SUCCESS && buffer) {
+        result = db_read_value(internal, &value, buffer, buffer_size);
+    } else if (result == DB_SUCCESS && buffer_size) {
+        *buffer_size = value.length;
+    }
+    db_read_unlock(internal);
+    if (result != DB_SUCCESS) return cursor_result(result);
+    
+    memcpy(key, cursor->position.key, cursor->position.key_size);
+    key[cursor->position.key_size] = '\0';
+    return STARK_OK;
+}
+
+STARK_API void stark_str_cursor_destroy(stark_str_cursor_t* cursor) {
+    free(cursor);
 }
 
 // ==================== STATISTICS ====================
@@ -252,20 +837,14 @@ STARK_API stark_result_t stark_stats(stark_db_t* db, stark_stats_t* stats) {
     
     Database* internal = db->internal_db;
     
+    db_read_lock(internal);
     stats->page_count = internal->storage->pager->num_pages;
     
-    void* root = pager_get_page(internal->index->pager, internal->index->root_page_num);
-    NodeHeader* header = (NodeHeader*)root;
-    
-    if (header->type == NODE_LEAF) {
-        LeafNode* leaf = (LeafNode*)root;
-        stats->keys_count = leaf->num_cells;
-    } else {
-        stats->keys_count = 0;
-    }
-    
-    stats->btree_height = 1;
-    stats->data_size = internal->storage->next_offset;
+    stats->keys_count = internal->index->num_keys + internal->strings->num_keys;
+    stats->btree_height = internal->index->height;
+    stats->key_bits = internal->index->key_size * 8;
+    stats->data_size = storage_data_size(internal->storage);
+    db_read_unlock(internal);
     
     return STARK_OK;
 }
@@ -278,24 +857,20 @@ STARK_API const char* stark_error(stark_db_t* db) {
 STARK_API stark_result_t stark_sync(stark_db_t* db) {
     if (!db || !db->internal_db) return STARK_CLOSED;
     
-    Database* internal = db->internal_db;
-    
-    printf("💾 Syncing to disk...\n");
+    LOG_INFO("Syncing to disk...");
     
-    // Flush index pages (THIS INCLUDES PAGE 0!)
-    if (internal->index && internal->index->pager) {
-        printf("  Flushing index pager (%u pages)\n", internal->index->pager->num_pages);
-        pager_flush_all(internal->index->pager);
-    }
+    // Commits are already durable in the log; this moves them into the
+    // data files now instead of waiting for the checkpointer
+    DB_Result result = db_checkpoint(db->internal_db);
     
-    // Flush data pages
-    if (internal->storage && internal->storage->pager) {
-        printf("  Flushing storage pager (%u pages)\n", internal->storage->pager->num_pages);
-        pager_flush_all(internal->storage->pager);
+    switch (result) {
+        case DB_SUCCESS:
+            LOG_INFO("Synced to disk");
+            return STARK_OK;
+        case DB_IO_ERROR: return STARK_IO_ERROR;
+        case DB_READONLY: return STARK_READONLY;
+        default: return STARK_ERROR;
     }
-    
-    printf("✅ Synced to disk\n");
-    return STARK_OK;
 }
 
 // ==================== TYPE SYSTEM IMPLEMENTATION ====================
@@ -377,21 +952,21 @@ STARK_API stark_result_t stark_get_typed(stark_db_t* db, const char* type_name,
     if (!db || !db->internal_db) return STARK_CLOSED;
     if (!type_name || !output || output_size == 0) return STARK_INVALID_ARG;
     
-    printf("🔍 Looking up type: '%s'\n", type_name);
+    LOG_DEBUG("Looking up type: '%s'", type_name);
     
     // Get type definition
     TypeDef* type = type_get(db, type_name);
     if (!type) {
-        printf("❌ Type '%s' not found in database\n", type_name);
+        LOG_DEBUG("Type '%s' not found in database", type_name);
         return STARK_NOT_FOUND;
     }
     
-    printf("✅ Found type: %s (ID: %u, size: %u bytes)\n", type->name, type->id, type->size);
+    LOG_DEBUG("Found type: %s (ID: %u, size: %u bytes)", type->name, type->id, type->size);
     
     // Read data
     char data_key[256];
     snprintf(data_key, sizeof(data_key), "%s:%u", type_name, key);
-    printf("🔑 Data key: %s\n", data_key);
+    LOG_DEBUG("Data key: %s", data_key);
     
     void* buffer = malloc(type->size);
     if (!buffer) {
@@ -403,12 +978,12 @@ STARK_API stark_result_t stark_get_typed(stark_db_t* db, const char* type_name,
     stark_result_t result = stark_get_str(db, data_key, buffer, &size);
     
     if (result == STARK_OK) {
-        printf("✅ Data retrieved, size: %zu bytes\n", size);
+        LOG_DEBUG("Data retrieved, size: %zu bytes", size);
         // Format output using type fields
         result = type_deserialize(type->fields, type->field_count, 
                                   buffer, output, output_size);
     } else if (result == STARK_NOT_FOUND) {
-        printf("❌ Data key '%s' not found\n", data_key);
+        LOG_DEBUG("Data key '%s' not found", data_key);
         free(buffer);
         free(type);
         return STARK_NOT_FOUND;
@@ -421,74 +996,43 @@ STARK_API stark_result_t stark_get_typed(stark_db_t* db, const char* type_name,
 
 // ==================== TRANSACTIONS ====================
 
-// Simple transaction record
-typedef struct {
-    uint32_t key;
-    void* old_value;
-    size_t old_size;
-    void* new_value;
-    size_t new_size;
-    int is_delete;
-} TransactionEntry;
-
 STARK_API stark_result_t stark_begin(stark_db_t* db) {
     if (!db || !db->internal_db) return STARK_CLOSED;
     
-    if (db->in_transaction) {
-        return STARK_ERROR;  // Already in transaction
-    }
-    
-    db->in_transaction = 1;
-    db->transaction_log = malloc(1024);  // Initial log space
-    db->log_size = 0;
-    
-    if (!db->transaction_log) {
-        db->in_transaction = 0;
-        return STARK_MEMORY_ERROR;
-    }
+    DB_Result result = db_begin(db->internal_db);
+    if (result == DB_READONLY) return STARK_READONLY;
+    if (result != DB_SUCCESS) return STARK_ERROR;  // Already in transaction, or views held
     
-    printf("✅ Transaction started\n");
+    LOG_INFO("Transaction started");
     return STARK_OK;
 }
 
 STARK_API stark_result_t stark_commit(stark_db_t* db) {
     if (!db || !db->internal_db) return STARK_CLOSED;
-    if (!db->in_transaction) return STARK_ERROR;
-    
-    // In a real implementation, you'd:
-    // 1. Write all changes to disk
-    // 2. Remove transaction log
-    // 3. Mark transaction as complete
     
-    free(db->transaction_log);
-    db->transaction_log = NULL;
-    db->log_size = 0;
-    db->in_transaction = 0;
+    // Fails without a transaction to commit. Logs the changed pages and fsyncs the log; a failed commit rolls back
+    DB_Result result = db_commit(db->internal_db);
+    if (result == DB_IO_ERROR) return STARK_IO_ERROR;
+    if (result != DB_SUCCESS) return STARK_ERROR;
     
-    printf("✅ Transaction committed\n");
+    LOG_INFO("Transaction committed");
     return STARK_OK;
 }
 
 STARK_API stark_result_t stark_rollback(stark_db_t* db) {
     if (!db || !db->internal_db) return STARK_CLOSED;
-    if (!db->in_transaction) return STARK_ERROR;
     
-    // In a real implementation, you'd:
-    // 1. Restore all original values from log
-    // 2. Clear transaction log
+    DB_Result result = db_rollback(db->internal_db);
+    if (result == DB_IO_ERROR) return STARK_IO_ERROR;
+    if (result != DB_SUCCESS) return STARK_ERROR;
     
-    free(db->transaction_log);
-    db->transaction_log = NULL;
-    db->log_size = 0;
-    db->in_transaction = 0;
-    
-    printf("✅ Transaction rolled back\n");
+    LOG_INFO("Transaction rolled back");
     return STARK_OK;
 }
 
 STARK_API int stark_in_transaction(stark_db_t* db) {
-    if (!db) return 0;
-    return db->in_transaction;
+    if (!db || !db->internal_db) return 0;
+    return db->internal_db->in_transaction;
 }
 
 
@@ -0,0 +1,284 @@
+#include "extsort.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RUN_BUFFER_SIZE (256 * 1024)
+
+// A buffered record; data lives in the arena at offset
+typedef struct {
+    uint64_t key;
+    uint32_t seq;               // Insertion order, so later duplicates win
+    size_t offset;
+    size_t size;
+} SortItem;
+
+// A sorted run file and the record at its read position
+typedef struct {
+    FILE *file;
+    char *io_buffer;
+    uint64_t key;
+    size_t size;
+    void *data;
+    size_t data_capacity;
+} SortRun;
+
+struct ExternalSorter {
+    size_t memory_limit;
+
+    char *arena;
+    size_t arena_used;
+    size_t arena_capacity;
+    SortItem *items;
+    uint32_t num_items;
+    uint32_t items_capacity;
+    uint32_t next_seq;
+
+    SortRun *runs;
+    uint32_t num_runs;
+    uint32_t runs_capacity;
+
+    // Read side. Without runs the buffer is read back directly.
+    bool finished;
+    uint32_t next_item;
+    uint32_t *heap;             // Run indices, smallest key first
+    uint32_t heap_size;
+    int held_run;               // Run holding the record returned last (-1 = none)
+};
+
+static int compare_items(const void *a, const void *b) {
+    const SortItem *x = a;
+    const SortItem *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+// ==================== RUNS ====================
+
+static DB_Result spill_run(ExternalSorter *sorter) {
+    qsort(sorter->items, sorter->num_items, sizeof(SortItem), compare_items);
+
+    if (sorter->num_runs == sorter->runs_capacity) {
+        uint32_t capacity = sorter->runs_capacity ? 2 * sorter->runs_capacity : 8;
+        SortRun *grown = realloc(sorter->runs, capacity * sizeof(SortRun));
+        if (!grown) return DB_ERROR;
+        sorter->runs = grown;
+        sorter->runs_capacity = capacity;
+    }
+    SortRun *run = &sorter->runs[sorter->num_runs];
+    memset(run, 0, sizeof(*run));
+    run->file = tmpfile();
+    run->io_buffer = malloc(RUN_BUFFER_SIZE);
+    if (!run->file || !run->io_buffer) {
+        if (run->file) fclose(run->file);
+        free(run->io_buffer);
+        return DB_ERROR;
+    }
+    setvbuf(run->file, run->io_buffer, _IOFBF, RUN_BUFFER_SIZE);
+    sorter->num_runs++;
+
+    // Record format: key, 64-bit size, bytes. Only the last of equal keys is kept.
+    for (uint32_t i = 0; i < sorter->num_items; i++) {
+        SortItem *item = &sorter->items[i];
+        if (i + 1 < sorter->num_items && sorter->items[i + 1].key == item->key) continue;
+        uint64_t size = item->size;
+        if (fwrite(&item->key, sizeof(item->key), 1, run->file) != 1 ||
+            fwrite(&size, sizeof(size), 1, run->file) != 1 ||
+            (size > 0 && fwrite(sorter->arena + item->offset, size, 1, run->file) != 1)) {
+            return DB_ERROR;
+        }
+    }
+    if (fflush(run->file) != 0) return DB_ERROR;
+    LOG_DEBUG("Spilled sort run %u (%u records)", sorter->num_runs - 1, sorter->num_items);
+
+    sorter->num_items = 0;
+    sorter->arena_used = 0;
+    return DB_SUCCESS;
+}
+
+// Loads the run's next record: 1 = loaded, 0 = run exhausted, -1 = error
+static int run_advance(SortRun *run) {
+    uint64_t size;
+    if (fread(&run->key, sizeof(run->key), 1, run->file) != 1) {
+        return feof(run->file) ? 0 : -1;
+    }
+    if (fread(&size, sizeof(size), 1, run->file) != 1) return -1;
+    if (size > run->data_capacity) {
+        void *grown = realloc(run->data, size);
+        if (!grown) return -1;
+        run->data = grown;
+        run->data_capacity = size;
+    }
+    if (size > 0 && fread(run->data, size, 1, run->file) != 1) return -1;
+    run->size = size;
+    return 1;
+}
+
+// ==================== MERGE HEAP ====================
+
+// Equal keys pop newest run first, so the first record seen for a key wins
+static bool heap_before(ExternalSorter *sorter, uint32_t a, uint32_t b) {
+    uint64_t key_a = sorter->runs[a].key;
+    uint64_t key_b = sorter->runs[b].key;
+    return key_a < key_b || (key_a == key_b && a > b);
+}
+
+static void heap_push(ExternalSorter *sorter, uint32_t run) {
+    uint32_t *heap = sorter->heap;
+    uint32_t i = sorter->heap_size++;
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!heap_before(sorter, run, heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = run;
+}
+
+static uint32_t heap_pop(ExternalSorter *sorter) {
+    uint32_t *heap = sorter->heap;
+    uint32_t top = heap[0];
+    uint32_t last = heap[--sorter->heap_size];
+    uint32_t i = 0;
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= sorter->heap_size) break;
+        if (child + 1 < sorter->heap_size && heap_before(sorter, heap[child + 1], heap[child])) child++;
+        if (!heap_before(sorter, heap[child], last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (sorter->heap_size > 0) heap[i] = last;
+    return top;
+}
+
+// ==================== SORTER ====================
+
+ExternalSorter *extsort_create(size_t memory_limit) {
+    ExternalSorter *sorter = calloc(1, sizeof(ExternalSorter));
+    if (!sorter) return NULL;
+    sorter->memory_limit = memory_limit;
+    sorter->held_run = -1;
+    return sorter;
+}
+
+DB_Result extsort_add(ExternalSorter *sorter, uint64_t key, const void *data, size_t size) {
+    if (sorter->finished) return DB_ERROR;
+
+    size_t buffered = sorter->arena_used + (size_t)(sorter->num_items + 1) * sizeof(SortItem) + size;
+    if (sorter->num_items > 0 && buffered > sorter->memory_limit) {
+        DB_Result result = spill_run(sorter);
+        if (result != DB_SUCCESS) return result;
+    }
+
+    if (sorter->arena_used + size > sorter->arena_capacity) {
+        size_t capacity = sorter->arena_capacity ? sorter->arena_capacity : 64 * 1024;
+        while (capacity < sorter->arena_used + size) capacity *= 2;
+        char *grown = realloc(sorter->arena, capacity);
+        if (!grown) return DB_ERROR;
+        sorter->arena = grown;
+        sorter->arena_capacity = capacity;
+    }
+    if (sorter->num_items == sorter->items_capacity) {
+        uint32_t capacity = sorter->items_capacity ? 2 * sorter->items_capacity : 1024;
+        SortItem *grown = realloc(sorter->items, capacity * sizeof(SortItem));
+        if (!grown) return DB_ERROR;
+        sorter->items = grown;
+        sorter->items_capacity = capacity;
+    }
+
+    SortItem *item = &sorter->items[sorter->num_items++];
+    item->key = key;
+    item->seq = sorter->next_seq++;
+    item->offset = sorter->arena_used;
+    item->size = size;
+    if (size > 0) memcpy(sorter->arena + sorter->arena_used, data, size);
+    sorter->arena_used += size;
+    return DB_SUCCESS;
+}
+
+DB_Result extsort_finish(ExternalSorter *sorter) {
+    if (sorter->finished) return DB_ERROR;
+    sorter->finished = true;
+
+    if (sorter->num_runs == 0) {
+        qsort(sorter->items, sorter->num_items, sizeof(SortItem), compare_items);
+        return DB_SUCCESS;
+    }
+
+    if (sorter->num_items > 0) {
+        DB_Result result = spill_run(sorter);
+        if (result != DB_SUCCESS) return result;
+    }
+    free(sorter->arena);
+    free(sorter->items);
+    sorter->arena = NULL;
+    sorter->items = NULL;
+
+    sorter->heap = malloc(sorter->num_runs * sizeof(uint32_t));
+    if (!sorter->heap) return DB_ERROR;
+    for (uint32_t i = 0; i < sorter->num_runs; i++) {
+        SortRun *run = &sorter->runs[i];
+        if (fseek(run->file, 0, SEEK_SET) != 0) return DB_ERROR;
+        int loaded = run_advance(run);
+        if (loaded < 0) return DB_ERROR;
+        if (loaded > 0) heap_push(sorter, i);
+    }
+    return DB_SUCCESS;
+}
+
+int extsort_next(ExternalSorter *sorter, uint64_t *key, const void **data, size_t *size) {
+    if (!sorter->finished) return -1;
+
+    if (sorter->num_runs == 0) {
+        if (sorter->next_item >= sorter->num_items) return 0;
+        // Items are ordered by key, then insertion; take the last of each key
+        uint32_t i = sorter->next_item;
+        while (i + 1 < sorter->num_items && sorter->items[i + 1].key == sorter->items[i].key) i++;
+        sorter->next_item = i + 1;
+        *key = sorter->items[i].key;
+        *data = sorter->arena + sorter->items[i].offset;
+        *size = sorter->items[i].size;
+        return 1;
+    }
+
+    // The record handed out last is still in its run's buffer; move past it now
+    if (sorter->held_run >= 0) {
+        int loaded = run_advance(&sorter->runs[sorter->held_run]);
+        if (loaded < 0) return -1;
+        if (loaded > 0) heap_push(sorter, (uint32_t)sorter->held_run);
+        sorter->held_run = -1;
+    }
+    if (sorter->heap_size == 0) return 0;
+
+    uint32_t top = heap_pop(sorter);
+    SortRun *run = &sorter->runs[top];
+    // Older runs holding the same key are superseded
+    while (sorter->heap_size > 0 && sorter->runs[sorter->heap[0]].key == run->key) {
+        uint32_t stale = heap_pop(sorter);
+        int loaded = run_advance(&sorter->runs[stale]);
+        if (loaded < 0) return -1;
+        if (loaded > 0) heap_push(sorter, stale);
+    }
+
+    sorter->held_run = (int)top;
+    *key = run->key;
+    *data = run->data;
+    *size = run->size;
+    return 1;
+}
+
+void extsort_destroy(ExternalSorter *sorter) {
+    if (!sorter) return;
+    for (uint32_t i = 0; i < sorter->num_runs; i++) {
+        fclose(sorter->runs[i].file);
+        free(sorter->runs[i].io_buffer);
+        free(sorter->runs[i].data);
+    }
+    free(sorter->runs);
+    free(sorter->heap);
+    free(sorter->arena);
+    free(sorter->items);
+    free(sorter);
+}
@@ -0,0 +1,22 @@
+#ifndef EXTSORT_H
+#define EXTSORT_H
+
+#include "constants.h"
+#include <stddef.h>
+
+// Sorts key/value records that may not fit in memory. Records are buffered
+// up to the memory limit, then sorted and spilled to a temporary run file;
+// the runs are merged when the records are read back. For a key added more
+// than once only the last record survives.
+typedef struct ExternalSorter ExternalSorter;
+
+ExternalSorter *extsort_create(size_t memory_limit);
+DB_Result extsort_add(ExternalSorter *sorter, uint64_t key, const void *data, size_t size);
+// Ends input; records then come back from extsort_next in ascending key order
+DB_Result extsort_finish(ExternalSorter *sorter);
+// Returns 1 with the next record, 0 at the end, -1 on error. *data stays
+// valid until the next call.
+int extsort_next(ExternalSorter *sorter, uint64_t *key, const void **data, size_t *size);
+void extsort_destroy(ExternalSorter *sorter);
+
+#endif
@@ -0,0 +1,234 @@
+#include "keysearch.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KEYSEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+// Keys compared at once after the binary search narrows the range
+#define SSE_WINDOW 16
+#define AVX2_WINDOW 32
+#define SSE_WINDOW64 8
+#define AVX2_WINDOW64 16
+
+typedef uint32_t (*KeySearch64Fn)(const uint64_t *keys, uint32_t count, uint64_t key);
+
+// ==================== SCALAR ====================
+
+// Invariant: the answer lies in [base, base + count]. The comparison
+// becomes a conditional move, so the loop has no data-dependent branch.
+static const uint32_t *narrow_range(const uint32_t *base, uint32_t *count, uint32_t key,
+                                    uint32_t window) {
+    uint32_t n = *count;
+    while (n > window) {
+        uint32_t half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    *count = n;
+    return base;
+}
+
+static uint32_t upper_bound_scalar(const uint32_t *keys, uint32_t count, uint32_t key) {
+    if (count == 0) return 0;
+    const uint32_t *base = narrow_range(keys, &count, key, 1);
+    return (uint32_t)(base - keys) + (*base <= key);
+}
+
+static const uint64_t *narrow_range64(const uint64_t *base, uint32_t *count, uint64_t key,
+                                      uint32_t window) {
+    uint32_t n = *count;
+    while (n > window) {
+        uint32_t half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    *count = n;
+    return base;
+}
+
+static uint32_t upper_bound64_scalar(const uint64_t *keys, uint32_t count, uint64_t key) {
+    if (count == 0) return 0;
+    const uint64_t *base = narrow_range64(keys, &count, key, 1);
+    return (uint32_t)(base - keys) + (*base <= key);
+}
+
+// ==================== SIMD ====================
+
+#ifdef KEYSEARCH_X86
+
+// Both kernels binary-search down to a fixed-size window that contains the
+// answer, then count the window's keys <= key with vector compares. The
+// window is slid left when needed so it never reads past the array, and
+// because keys are sorted the count is the answer's offset in the window.
+// SSE/AVX2 only compare signed integers; flipping the sign bit of both
+// sides turns that into an unsigned comparison.
+
+__attribute__((target("sse4.2,popcnt")))
+static uint32_t upper_bound_sse42(const uint32_t *keys, uint32_t count, uint32_t key) {
+    if (count < SSE_WINDOW) return upper_bound_scalar(keys, count, key);
+    uint32_t n = count;
+    const uint32_t *base = narrow_range(keys, &n, key, SSE_WINDOW);
+    if (base > keys + count - SSE_WINDOW) base = keys + count - SSE_WINDOW;
+
+    const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+    const __m128i probe = _mm_xor_si128(_mm_set1_epi32((int)key), bias);
+    uint32_t below = 0;
+    for (uint32_t i = 0; i < SSE_WINDOW; i += 4) {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(base + i)), bias);
+        __m128i greater = _mm_cmpgt_epi32(block, probe);
+        below += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(greater)));
+    }
+    return (uint32_t)(base - keys) + below;
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint32_t upper_bound_avx2(const uint32_t *keys, uint32_t count, uint32_t key) {
+    if (count < AVX2_WINDOW) return upper_bound_scalar(keys, count, key);
+    uint32_t n = count;
+    const uint32_t *base = narrow_range(keys, &n, key, AVX2_WINDOW);
+    if (base > keys + count - AVX2_WINDOW) base = keys + count - AVX2_WINDOW;
+
+    const __m256i bias = _mm256_set1_epi32((int)0x80000000u);
+    const __m256i probe = _mm256_xor_si256(_mm256_set1_epi32((int)key), bias);
+    uint32_t below = 0;
+    for (uint32_t i = 0; i < AVX2_WINDOW; i += 8) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(base + i)), bias);
+        __m256i greater = _mm256_cmpgt_epi32(block, probe);
+        below += 8 - __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(greater)));
+    }
+    return (uint32_t)(base - keys) + below;
+}
+
+// 64-bit keys: half as many per vector, in windows of the same byte size
+
+__attribute__((target("sse4.2,popcnt")))
+static uint32_t upper_bound64_sse42(const uint64_t *keys, uint32_t count, uint64_t key) {
+    if (count < SSE_WINDOW64) return upper_bound64_scalar(keys, count, key);
+    uint32_t n = count;
+    const uint64_t *base = narrow_range64(keys, &n, key, SSE_WINDOW64);
+    if (base > keys + count - SSE_WINDOW64) base = keys + count - SSE_WINDOW64;
+
+    const __m128i bias = _mm_set1_epi64x((long long)0x8000000000000000ull);
+    const __m128i probe = _mm_xor_si128(_mm_set1_epi64x((long long)key), bias);
+    uint32_t below = 0;
+    for (uint32_t i = 0; i < SSE_WINDOW64; i += 2) {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(base + i)), bias);
+        __m128i greater = _mm_cmpgt_epi64(block, probe);
+        below += 2 - __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(greater)));
+    }
+    return (uint32_t)(base - keys) + below;
+}
+
+__attribute__((target("avx2,popcnt")))
+static uint32_t upper_bound64_avx2(const uint64_t *keys, uint32_t count, uint64_t key) {
+    if (count < AVX2_WINDOW64) return upper_bound64_scalar(keys, count, key);
+    uint32_t n = count;
+    const uint64_t *base = narrow_range64(keys, &n, key, AVX2_WINDOW64);
+    if (base > keys + count - AVX2_WINDOW64) base = keys + count - AVX2_WINDOW64;
+
+    const __m256i bias = _mm256_set1_epi64x((long long)0x8000000000000000ull);
+    const __m256i probe = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), bias);
+    uint32_t below = 0;
+    for (uint32_t i = 0; i < AVX2_WINDOW64; i += 4) {
+        __m256i block = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(base + i)), bias);
+        __m256i greater = _mm256_cmpgt_epi64(block, probe);
+        below += 4 - __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(greater)));
+    }
+    return (uint32_t)(base - keys) + below;
+}
+
+#endif
+
+// ==================== DISPATCH ====================
+
+static KeySearchFn kernel_function(KeySearchKernel kernel) {
+#ifdef KEYSEARCH_X86
+    if (kernel == KEYSEARCH_AVX2) return upper_bound_avx2;
+    if (kernel == KEYSEARCH_SSE42) return upper_bound_sse42;
+#endif
+    (void)kernel;
+    return upper_bound_scalar;
+}
+
+static KeySearch64Fn kernel_function64(KeySearchKernel kernel) {
+#ifdef KEYSEARCH_X86
+    if (kernel == KEYSEARCH_AVX2) return upper_bound64_avx2;
+    if (kernel == KEYSEARCH_SSE42) return upper_bound64_sse42;
+#endif
+    (void)kernel;
+    return upper_bound64_scalar;
+}
+
+bool keysearch_kernel_supported(KeySearchKernel kernel) {
+    if (kernel == KEYSEARCH_SCALAR) return true;
+#ifdef KEYSEARCH_X86
+    __builtin_cpu_init();
+    if (kernel == KEYSEARCH_AVX2) return __builtin_cpu_supports("avx2");
+    if (kernel == KEYSEARCH_SSE42) return __builtin_cpu_supports("sse4.2");
+#endif
+    return false;
+}
+
+// Resolved on first use. Concurrent first calls all store the same values;
+// the stores are atomic, and active_function64 goes last with release
+// order, so a thread that sees it set sees the other two as well.
+static KeySearchKernel active_kernel = (KeySearchKernel)-1;
+static KeySearchFn active_function = NULL;
+static KeySearch64Fn active_function64 = NULL;
+
+KeySearchKernel keysearch_active_kernel(void) {
+    if (__atomic_load_n(&active_function64, __ATOMIC_ACQUIRE) == NULL) {
+        KeySearchKernel kernel = KEYSEARCH_SCALAR;
+        if (keysearch_kernel_supported(KEYSEARCH_AVX2)) {
+            kernel = KEYSEARCH_AVX2;
+        } else if (keysearch_kernel_supported(KEYSEARCH_SSE42)) {
+            kernel = KEYSEARCH_SSE42;
+        }
+        __atomic_store_n(&active_kernel, kernel, __ATOMIC_RELAXED);
+        __atomic_store_n(&active_function, kernel_function(kernel), __ATOMIC_RELEASE);
+        __atomic_store_n(&active_function64, kernel_function64(kernel), __ATOMIC_RELEASE);
+    }
+    return __atomic_load_n(&active_kernel, __ATOMIC_RELAXED);
+}
+
+const char *keysearch_kernel_name(KeySearchKernel kernel) {
+    switch (kernel) {
+        case KEYSEARCH_AVX2: return "avx2";
+        case KEYSEARCH_SSE42: return "sse4.2";
+        default: return "scalar";
+    }
+}
+
+KeySearchFn keysearch_kernel(KeySearchKernel kernel) {
+    return keysearch_kernel_supported(kernel) ? kernel_function(kernel) : NULL;
+}
+
+uint32_t keys_upper_bound(const uint32_t *keys, uint32_t count, uint32_t key) {
+    KeySearchFn function = __atomic_load_n(&active_function, __ATOMIC_ACQUIRE);
+    if (function == NULL) {
+        keysearch_active_kernel();
+        function = __atomic_load_n(&active_function, __ATOMIC_ACQUIRE);
+    }
+    return function(keys, count, key);
+}
+
+uint32_t keys_lower_bound(const uint32_t *keys, uint32_t count, uint32_t key) {
+    // First key >= key is the first key > key - 1
+    if (key == 0) return 0;
+    return keys_upper_bound(keys, count, key - 1);
+}
+
+uint32_t keys64_upper_bound(const uint64_t *keys, uint32_t count, uint64_t key) {
+    KeySearch64Fn function = __atomic_load_n(&active_function64, __ATOMIC_ACQUIRE);
+    if (function == NULL) {
+        keysearch_active_kernel();
+        function = __atomic_load_n(&active_function64, __ATOMIC_ACQUIRE);
+    }
+    return function(keys, count, key);
+}
+
+uint32_t keys64_lower_bound(const uint64_t *keys, uint32_t count, uint64_t key) {
+    if (key == 0) return 0;
+    return keys64_upper_bound(keys, count, key - 1);
+}
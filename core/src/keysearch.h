@@ -0,0 +1,34 @@
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+#include "constants.h"
+
+// Search kernels for the sorted key arrays inside B-tree nodes.
+// The fastest kernel the CPU supports is picked via CPUID on first use.
+typedef enum {
+    KEYSEARCH_SCALAR,   // Branchless binary search
+    KEYSEARCH_SSE42,    // Binary search down to a small window, then 4-wide compares
+    KEYSEARCH_AVX2      // Same, with 8-wide compares
+} KeySearchKernel;
+
+// Index of the first key greater than `key` (count if none): the child to
+// descend into from an internal node
+uint32_t keys_upper_bound(const uint32_t *keys, uint32_t count, uint32_t key);
+// Index of the first key not less than `key` (count if none): a key's
+// position in a leaf
+uint32_t keys_lower_bound(const uint32_t *keys, uint32_t count, uint32_t key);
+// The same searches over the uint64_t keys of indexes created with 64-bit
+// keys, using the same kernel
+uint32_t keys64_upper_bound(const uint64_t *keys, uint32_t count, uint64_t key);
+uint32_t keys64_lower_bound(const uint64_t *keys, uint32_t count, uint64_t key);
+
+KeySearchKernel keysearch_active_kernel(void);
+const char *keysearch_kernel_name(KeySearchKernel kernel);
+
+// Direct access to one kernel's upper-bound function, for benchmarks;
+// NULL if the CPU does not support it
+typedef uint32_t (*KeySearchFn)(const uint32_t *keys, uint32_t count, uint32_t key);
+bool keysearch_kernel_supported(KeySearchKernel kernel);
+KeySearchFn keysearch_kernel(KeySearchKernel kernel);
+
+#endif
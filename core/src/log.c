@@ -0,0 +1,58 @@
+#include "log.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#define LOG_MESSAGE_SIZE 512
+
+int log_threshold = STARK_LOG_WARN;
+
+static pthread_mutex_t sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static stark_log_sink_t sink;
+static void *sink_context;
+
+static const char *level_name(int level) {
+    switch (level) {
+        case STARK_LOG_ERROR: return "error";
+        case STARK_LOG_WARN:  return "warning";
+        case STARK_LOG_INFO:  return "info";
+        case STARK_LOG_DEBUG: return "debug";
+        default:              return "trace";
+    }
+}
+
+void log_write(int level, const char *format, ...) {
+    char message[LOG_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    pthread_mutex_lock(&sink_lock);
+    stark_log_sink_t current = sink;
+    void *context = sink_context;
+    pthread_mutex_unlock(&sink_lock);
+
+    if (current) {
+        current(level, message, context);
+    } else {
+        fprintf(stderr, "stark %s: %s\n", level_name(level), message);
+    }
+}
+
+STARK_API void stark_set_log_level(int level) {
+    if (level < STARK_LOG_NONE) level = STARK_LOG_NONE;
+    if (level > STARK_LOG_TRACE) level = STARK_LOG_TRACE;
+    __atomic_store_n(&log_threshold, level, __ATOMIC_RELAXED);
+}
+
+STARK_API int stark_get_log_level(void) {
+    return __atomic_load_n(&log_threshold, __ATOMIC_RELAXED);
+}
+
+STARK_API void stark_set_log_sink(stark_log_sink_t new_sink, void *context) {
+    pthread_mutex_lock(&sink_lock);
+    sink = new_sink;
+    sink_context = context;
+    pthread_mutex_unlock(&sink_lock);
+}
@@ -0,0 +1,29 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "stark.h"
+
+// Messages above STARK_LOG_LEVEL are compiled out, arguments and all; the
+// rest are checked against the runtime level before anything is formatted
+#ifndef STARK_LOG_LEVEL
+#define STARK_LOG_LEVEL STARK_LOG_DEBUG
+#endif
+
+extern int log_threshold;   // Runtime level, set by stark_set_log_level
+
+#define LOG_ENABLED(level) \
+    ((level) <= STARK_LOG_LEVEL && (level) <= __atomic_load_n(&log_threshold, __ATOMIC_RELAXED))
+
+#define LOG_AT(level, ...) \
+    do { if (LOG_ENABLED(level)) log_write((level), __VA_ARGS__); } while (0)
+
+#define LOG_ERROR(...) LOG_AT(STARK_LOG_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(STARK_LOG_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(STARK_LOG_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(STARK_LOG_DEBUG, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(STARK_LOG_TRACE, __VA_ARGS__)
+
+// Formats one message and hands it to the sink; use the macros instead
+void log_write(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -1,173 +1,1026 @@
 #include "pager.h"
-#include "btree.h"
+#include "wal.h"
+#include "shadow.h"
+#include "log.h"
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// ==================== PAGE TABLE ====================
+
+static uint32_t page_hash(page_num_t page_num) {
+    return page_num * 2654435761u;  // Knuth multiplicative hash
+}
+
+static PagerShard *page_shard(Pager *pager, page_num_t page_num) {
+    // The top hash bits pick the shard; page tables probe from the low bits
+    if (pager->num_shards == 1) return &pager->shards[0];
+    return &pager->shards[page_hash(page_num) >> pager->shard_shift];
+}
+
+static uint32_t page_table_lookup(PagerShard *shard, page_num_t page_num) {
+    uint32_t slot = page_hash(page_num) & shard->page_table_mask;
+
+    while (shard->page_table[slot] != FRAME_NONE) {
+        uint32_t frame_index = shard->page_table[slot];
+        if (shard->frames[frame_index].page_num == page_num) {
+            return frame_index;
+        }
+        slot = (slot + 1) & shard->page_table_mask;
+    }
+    return FRAME_NONE;
+}
+
+// Lookup without the latch, for pager_peek_page. Entries can move under it,
+// so it may miss a cached page or return a frame that has since changed
+// pages; the caller checks the frame's page and version.
+static uint32_t page_table_peek(PagerShard *shard, page_num_t page_num) {
+    uint32_t mask = shard->page_table_mask;
+    uint32_t slot = page_hash(page_num) & mask;
+
+    for (uint32_t probes = 0; probes <= mask; probes++) {
+        uint32_t frame_index = __atomic_load_n(&shard->page_table[slot], __ATOMIC_RELAXED);
+        if (frame_index == FRAME_NONE) break;
+        if (__atomic_load_n(&shard->frames[frame_index].page_num, __ATOMIC_RELAXED) == page_num) {
+            return frame_index;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return FRAME_NONE;
+}
+
+// page_table_peek and pager_peek_page read page-table slots and frame pages
+// without the latch, so latched writers store them atomically
+static void page_table_set(PagerShard *shard, uint32_t slot, uint32_t frame_index) {
+    __atomic_store_n(&shard->page_table[slot], frame_index, __ATOMIC_RELAXED);
+}
+
+static void frame_set_page(Frame *frame, page_num_t page_num) {
+    __atomic_store_n(&frame->page_num, page_num, __ATOMIC_RELAXED);
+}
+
+static void page_table_insert(PagerShard *shard, page_num_t page_num, uint32_t frame_index) {
+    uint32_t slot = page_hash(page_num) & shard->page_table_mask;
+
+    while (shard->page_table[slot] != FRAME_NONE) {
+        slot = (slot + 1) & shard->page_table_mask;
+    }
+    page_table_set(shard, slot, frame_index);
+}
+
+static void page_table_remove(PagerShard *shard, page_num_t page_num) {
+    uint32_t mask = shard->page_table_mask;
+    uint32_t slot = page_hash(page_num) & mask;
+
+    while (shard->page_table[slot] != FRAME_NONE) {
+        if (shard->frames[shard->page_table[slot]].page_num == page_num) break;
+        slot = (slot + 1) & mask;
+    }
+    if (shard->page_table[slot] == FRAME_NONE) return;
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & mask;
+    while (shard->page_table[next] != FRAME_NONE) {
+        uint32_t frame_index = shard->page_table[next];
+        uint32_t home = page_hash(shard->frames[frame_index].page_num) & mask;
+
+        // Move the entry into the hole if its home slot is not in (hole, next]
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            page_table_set(shard, hole, frame_index);
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    page_table_set(shard, hole, FRAME_NONE);
+}
+
+// A frame changes pages inside an odd version, so unpinned readers that
+// overlap the change see the version move and discard what they read
+static void frame_begin_change(Frame *frame) {
+    __atomic_store_n(&frame->version, frame->version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void frame_end_change(Frame *frame) {
+    __atomic_store_n(&frame->version, frame->version + 1, __ATOMIC_RELEASE);
+}
+
+// ==================== FILE I/O ====================
+
+// pwritev that retries on EINTR and resumes after partial writes
+static DB_Result pwritev_full(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        ssize_t written = pwritev(fd, iov, iovcnt, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (written == 0) return DB_IO_ERROR;
+
+        offset += written;
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return DB_SUCCESS;
+}
+
+// preadv that retries on EINTR; hitting end of file is reported as an error
+static DB_Result preadv_full(int fd, struct iovec *iov, int iovcnt, off_t offset) {
+    while (iovcnt > 0) {
+        ssize_t bytes_read = preadv(fd, iov, iovcnt, offset);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (bytes_read == 0) return DB_IO_ERROR;
+
+        offset += bytes_read;
+        while (iovcnt > 0 && (size_t)bytes_read >= iov->iov_len) {
+            bytes_read -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + bytes_read;
+            iov->iov_len -= bytes_read;
+        }
+    }
+    return DB_SUCCESS;
+}
+
+// Writes a run of frames holding consecutive pages with vectored writes
+static DB_Result write_frames(Pager *pager, Frame **run, uint32_t count) {
+    struct iovec iov[IOV_MAX < 256 ? IOV_MAX : 256];
+    uint32_t max_batch = sizeof(iov) / sizeof(iov[0]);
+
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t batch = count - done < max_batch ? count - done : max_batch;
+        for (uint32_t i = 0; i < batch; i++) {
+            iov[i].iov_base = run[done + i]->data;
+            iov[i].iov_len = pager->page_size;
+        }
+
+        off_t offset = (off_t)run[done]->page_num * pager->page_size;
+        if (pwritev_full(pager->fd, iov, batch, offset) != DB_SUCCESS) {
+            return DB_IO_ERROR;
+        }
+
+        for (uint32_t i = 0; i < batch; i++) {
+            run[done + i]->dirty = false;
+        }
+        done += batch;
+    }
+
+    page_num_t last = run[count - 1]->page_num;
+    if (last >= pager->file_pages) {
+        pager->file_pages = last + 1;
+    }
+    return DB_SUCCESS;
+}
+
+// Hands one page image to the log or the shadow page map
+static DB_Result write_image(Pager *pager, page_num_t page_num, const void *image) {
+    if (pager->shadow) return shadow_write(pager->shadow, page_num, image);
+    return wal_append_page(pager->wal, pager->wal_file, page_num, image);
+}
+
+static DB_Result write_frame(Pager *pager, Frame *frame) {
+    // Logged pages reach the file only through a checkpoint; shadowed pages
+    // go to a free place in it
+    if (pager->wal || pager->shadow) {
+        DB_Result result = write_image(pager, frame->page_num, frame->data);
+        if (result == DB_SUCCESS) frame->dirty = false;
+        return result;
+    }
+    return write_frames(pager, &frame, 1);
+}
+
+static int compare_frame_pages(const void *a, const void *b) {
+    page_num_t pa = (*(Frame *const *)a)->page_num;
+    page_num_t pb = (*(Frame *const *)b)->page_num;
+    return (pa > pb) - (pa < pb);
+}
+
+// Copies the page's logged image, as the pager's snapshot sees it:
+// 1 = read, 0 = not in the log, -1 = I/O error
+static int read_logged(Pager *pager, page_num_t page_num, void *dest, size_t bytes) {
+    if (!pager->wal) return 0;
+    if (pager->base) {
+        return wal_read_page_at(pager->wal, pager->wal_file, page_num, pager->snapshot_lsn,
+                                dest, bytes);
+    }
+    return wal_read_page(pager->wal, pager->wal_file, page_num, dest, bytes);
+}
+
+// The checkpointer thread may be raising file_pages at any time; either
+// value is right for a page the log did not have
+static page_num_t file_pages(Pager *pager) {
+    Pager *owner = pager->base ? pager->base : pager;
+    return __atomic_load_n(&owner->file_pages, __ATOMIC_RELAXED);
+}
+
+// Where a page is in the file, or INVALID_PAGE if it was never written
+static page_num_t physical_page(Pager *pager, page_num_t page_num) {
+    if (pager->shadow) return shadow_lookup(pager->shadow, page_num);
+    return page_num < file_pages(pager) ? page_num : INVALID_PAGE;
+}
+
+static DB_Result read_frame(Pager *pager, Frame *frame) {
+    // The log holds the newest version of the pages it has
+    int logged = read_logged(pager, frame->page_num, frame->data, pager->page_size);
+    if (logged != 0) return logged > 0 ? DB_SUCCESS : DB_IO_ERROR;
+
+    // Allocated pages that were never written read back as zeros
+    page_num_t location = physical_page(pager, frame->page_num);
+    if (location == INVALID_PAGE) {
+        memset(frame->data, 0, pager->page_size);
+        return DB_SUCCESS;
+    }
+
+    off_t offset = (off_t)location * pager->page_size;
+    size_t done = 0;
+    while (done < pager->page_size) {
+        ssize_t bytes_read = pread(pager->fd, (char *)frame->data + done,
+                                   pager->page_size - done, offset + done);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (bytes_read == 0) {
+            // The file is shorter than it was at open: truncated underneath us
+            LOG_ERROR("Short read on page %u (%zu of %u bytes)",
+                      frame->page_num, done, pager->page_size);
+            return DB_IO_ERROR;
+        }
+        done += bytes_read;
+    }
+    return DB_SUCCESS;
+}
+
+// ==================== BUFFER POOL ====================
+
+// CLOCK sweep over one shard: returns a free or evictable frame, writing
+// back its old page. Called with the shard latched.
+static uint32_t find_victim_frame(Pager *pager, PagerShard *shard) {
+    // Two full sweeps are enough to clear every reference bit once
+    for (uint32_t scanned = 0; scanned < 2 * shard->num_frames; scanned++) {
+        uint32_t frame_index = shard->clock_hand;
+        Frame *frame = &shard->frames[frame_index];
+        shard->clock_hand = (shard->clock_hand + 1) % shard->num_frames;
+
+        if (frame->page_num == INVALID_PAGE) {
+            return frame_index;
+        }
+        if (frame->pin_count > 0) {
+            continue;
+        }
+        // pager_peek_page sets the bit without the latch
+        if (__atomic_load_n(&frame->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&frame->referenced, false, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // Write back before reuse
+        if (frame->dirty && write_frame(pager, frame) != DB_SUCCESS) {
+            return FRAME_NONE;
+        }
+        page_table_remove(shard, frame->page_num);
+        frame_set_page(frame, INVALID_PAGE);
+        return frame_index;
+    }
+
+    LOG_WARN("Buffer pool shard exhausted, all %u frames pinned", shard->num_frames);
+    return FRAME_NONE;
+}
+
+static void free_pager(Pager *pager) {
+    if (pager->map) munmap(pager->map, pager->map_size);
+    shadow_close(pager->shadow);
+    if (pager->fd >= 0 && !pager->base) close(pager->fd);
+    if (pager->shards) {
+        for (uint32_t i = 0; i < pager->num_shards; i++) {
+            pthread_mutex_destroy(&pager->shards[i].latch);
+        }
+    }
+    free(pager->shards);
+    free(pager->frames);
+    free(pager->page_tables);
+    free(pager->frame_memory);
+    free(pager);
+}
+
+static DB_Result init_buffer_pool(Pager *pager, uint32_t num_frames) {
+    pager->num_frames = num_frames;
+
+    // As many shards as keep each one big enough for a few pinned paths
+    uint32_t num_shards = 1;
+    uint32_t shard_bits = 0;
+    while (num_shards < PAGER_MAX_SHARDS &&
+           num_frames / (num_shards * 2) >= PAGER_SHARD_MIN_FRAMES) {
+        num_shards *= 2;
+        shard_bits++;
+    }
+    pager->num_shards = num_shards;
+    pager->shard_shift = 32 - shard_bits;
+
+    // Size each page table to at most 50% load
+    uint32_t frames_per_shard = (num_frames + num_shards - 1) / num_shards;
+    uint32_t table_size = 1;
+    while (table_size < frames_per_shard * 2) table_size <<= 1;
+
+    pager->frames = calloc(num_frames, sizeof(Frame));
+    pager->page_tables = malloc((size_t)num_shards * table_size * sizeof(uint32_t));
+    pager->frame_memory = calloc(num_frames, pager->page_size);
+    if (!pager->frames || !pager->page_tables || !pager->frame_memory) {
+        return DB_MEMORY_ERROR;
+    }
+
+    memset(pager->page_tables, 0xFF, (size_t)num_shards * table_size * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_frames; i++) {
+        pager->frames[i].page_num = INVALID_PAGE;
+        pager->frames[i].data = (char *)pager->frame_memory + (size_t)i * pager->page_size;
+    }
+
+    pager->shards = calloc(num_shards, sizeof(PagerShard));
+    if (!pager->shards) return DB_MEMORY_ERROR;
+
+    // Frames are dealt out as evenly as they divide
+    uint32_t first_frame = 0;
+    for (uint32_t i = 0; i < num_shards; i++) {
+        PagerShard *shard = &pager->shards[i];
+        pthread_mutex_init(&shard->latch, NULL);
+        shard->num_frames = num_frames / num_shards + (i < num_frames % num_shards);
+        shard->frames = &pager->frames[first_frame];
+        shard->page_table = &pager->page_tables[(size_t)i * table_size];
+        shard->page_table_mask = table_size - 1;
+        first_frame += shard->num_frames;
+    }
+    return DB_SUCCESS;
+}
+
+static bool valid_page_size(uint32_t page_size) {
+    return page_size >= PAGE_SIZE_MIN && page_size <= PAGE_SIZE_MAX &&
+           (page_size & (page_size - 1)) == 0;
+}
+
+Pager *pager_open(const char *filename, uint32_t num_frames, uint32_t page_size, unsigned flags) {
+    if (page_size == 0) page_size = PAGE_SIZE;
+    if (!valid_page_size(page_size)) return NULL;
 
-Pager *pager_open(const char *filename) {
     Pager *pager = calloc(1, sizeof(Pager));  // calloc zeros everything
     if (!pager) return NULL;
-    
-    // Make sure pages array is NULL
-    for (int i = 0; i < TABLE_MAX_PAGES; i++) {
-        pager->pages[i] = NULL;  // Explicitly set to NULL
-    }
-    
-    pager->file = fopen(filename, "rb+");
-    if (!pager->file) {
-        // File doesn't exist - create it
-        pager->file = fopen(filename, "wb+");
-        if (!pager->file) {
-            free(pager);
+
+    if (num_frames == 0) num_frames = PAGER_DEFAULT_FRAMES;
+
+    // Mapped files are read-only: pages are handed out straight from the mapping
+    if (flags & PAGER_MMAP) flags |= PAGER_READONLY;
+    // Pages of a shadowed file are not where their numbers say
+    if (flags & PAGER_SHADOW) flags &= ~PAGER_MMAP;
+    pager->flags = flags;
+
+    if (flags & PAGER_READONLY) {
+        pager->fd = open(filename, O_RDONLY | O_CLOEXEC);
+    } else {
+        pager->fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (pager->fd < 0) {
+        free(pager);
+        return NULL;
+    }
+
+    // The meta slots of a shadowed file record its page size
+    if (flags & PAGER_SHADOW) {
+        pager->shadow = shadow_open(pager->fd, page_size, flags & PAGER_READONLY);
+        if (!pager->shadow) {
+            LOG_ERROR("%s is not a shadow-paged file", filename);
+            free_pager(pager);
             return NULL;
         }
+        pager->page_size = pager->shadow->page_size;
+        if (init_buffer_pool(pager, num_frames) != DB_SUCCESS) {
+            free_pager(pager);
+            return NULL;
+        }
+        return pager;
     }
-    
-    pager->page_size = PAGE_SIZE;
-    
+
+    struct stat st;
+    if (fstat(pager->fd, &st) != 0) st.st_size = -1;
+    off_t file_size = st.st_size;
+
+    // An existing file dictates its own page size
+    if (file_size > 0) {
+        ShadowMeta meta;
+        if (pread(pager->fd, &meta, sizeof(meta), 0) != (ssize_t)sizeof(meta)) {
+            free_pager(pager);
+            return NULL;
+        }
+        // Page 0 of a shadow-paged file is a meta slot, not the first page
+        if (meta.magic == SHADOW_MAGIC) {
+            LOG_ERROR("%s is shadow-paged", filename);
+            free_pager(pager);
+            return NULL;
+        }
+        PagerHeader header = meta.pager_header;
+        page_size = header.page_size;
+        if (!valid_page_size(page_size)) {
+            LOG_ERROR("%s has no valid page size (%u)", filename, page_size);
+            free_pager(pager);
+            return NULL;
+        }
+    }
+    pager->page_size = page_size;
+
     // Determine number of pages
-    fseek(pager->file, 0, SEEK_END);
-    long file_size = ftell(pager->file);
-    pager->num_pages = file_size / PAGE_SIZE;
-    
-    if (file_size % PAGE_SIZE != 0) {
+    pager->num_pages = file_size / page_size;
+    pager->file_pages = pager->num_pages;
+
+    if (file_size < 0 || file_size % page_size != 0) {
         // Corrupted file
-        fclose(pager->file);
-        free(pager);
+        free_pager(pager);
+        return NULL;
+    }
+
+    if (flags & PAGER_MMAP) {
+        if (file_size > 0) {
+            pager->map_size = (size_t)file_size;
+            pager->map = mmap(NULL, pager->map_size, PROT_READ, MAP_SHARED, pager->fd, 0);
+            if (pager->map == MAP_FAILED) {
+                pager->map = NULL;
+                free_pager(pager);
+                return NULL;
+            }
+        }
+        return pager;
+    }
+
+    if (init_buffer_pool(pager, num_frames) != DB_SUCCESS) {
+        free_pager(pager);
+        return NULL;
+    }
+
+    return pager;
+}
+
+Pager *pager_open_snapshot(Pager *base, uint32_t num_frames, uint64_t lsn, page_num_t num_pages) {
+    Pager *pager = calloc(1, sizeof(Pager));
+    if (!pager) return NULL;
+
+    pager->fd = base->fd;
+    pager->flags = PAGER_READONLY;
+    pager->page_size = base->page_size;
+    pager->num_pages = num_pages;
+    pager->wal = base->wal;
+    pager->wal_file = base->wal_file;
+    pager->base = base;
+    pager->snapshot_lsn = lsn;
+
+    if (init_buffer_pool(pager, num_frames ? num_frames : PAGER_DEFAULT_FRAMES) != DB_SUCCESS) {
+        free_pager(pager);
         return NULL;
     }
-    
     return pager;
 }
 
 void pager_close(Pager *pager) {
     if (!pager) return;
-    
+
     // Flush all pages to disk
-    for (int i = 0; i < TABLE_MAX_PAGES; i++) {
-        if (pager->pages[i]) {
-            pager_flush_page(pager, i);
-            free(pager->pages[i]);
-            pager->pages[i] = NULL;
-        }
-    }
-    
-    fclose(pager->file);
-    free(pager);
+    pager_flush_all(pager);
+
+    free_pager(pager);
 }
 
 void *pager_get_page(Pager *pager, page_num_t page_num) {
-    if (page_num > TABLE_MAX_PAGES) return NULL;
-    
-    printf("Debug: pager_get_page(%u), num_pages=%u\n", page_num, pager->num_pages);
-    
-    // Cache miss - load from disk
-    if (!pager->pages[page_num]) {
-        printf("Debug: Loading page %u from disk\n", page_num);
-        void *page = calloc(1, pager->page_size);
-        if (!page) return NULL;
-        
-        // Seek to page location
-        if (fseek(pager->file, page_num * pager->page_size, SEEK_SET) != 0) {
-            free(page);
-            return NULL;
-        }
-        
-        // Read the page
-        size_t bytes_read = fread(page, pager->page_size, 1, pager->file);
-        if (bytes_read < 1 && !feof(pager->file)) {
-            free(page);
-            return NULL;
-        }
-        
-        // ✅ Assign to cache AFTER reading
-        pager->pages[page_num] = page;
-        
-        // Now we can safely access it
-        printf("    📖 Loaded page %u from disk\n", page_num);
-        if (page_num == 0) {
-            LeafNode* leaf = (LeafNode*)pager->pages[page_num];
-            printf("      Page 0 has %u cells\n", leaf->num_cells);
-        }
-        
-        // If this was the last page, update count
-        if (page_num >= pager->num_pages) {
-            pager->num_pages = page_num + 1;
-        }
-        
-        printf("Debug: Page %u loaded, first 16 bytes:\n", page_num);
+    if (page_num == INVALID_PAGE) return NULL;
+
+    // Mapped pages need no frame, no copy and no pin
+    if (pager->flags & PAGER_MMAP) {
+        if (page_num >= pager->num_pages) return NULL;
+        return (char *)pager->map + (size_t)page_num * pager->page_size;
+    }
+
+    LOG_TRACE("pager_get_page(%u), num_pages=%u", page_num, pager->num_pages);
+
+    PagerShard *shard = page_shard(pager, page_num);
+    pthread_mutex_lock(&shard->latch);
+    uint32_t frame_index = page_table_lookup(shard, page_num);
+    if (frame_index != FRAME_NONE) {
+        LOG_TRACE("Page %u found in cache", page_num);
+        Frame *frame = &shard->frames[frame_index];
+        frame->pin_count++;
+        __atomic_store_n(&frame->referenced, true, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&shard->latch);
+        return frame->data;
+    }
+
+    // Cache miss - load from disk. The shard stays latched through the
+    // read, so two threads never load the same page twice.
+    LOG_TRACE("Loading page %u from disk", page_num);
+    frame_index = find_victim_frame(pager, shard);
+    if (frame_index == FRAME_NONE) {
+        pthread_mutex_unlock(&shard->latch);
+        return NULL;
+    }
+
+    Frame *frame = &shard->frames[frame_index];
+    frame_begin_change(frame);
+    frame_set_page(frame, page_num);
+    if (read_frame(pager, frame) != DB_SUCCESS) {
+        frame_set_page(frame, INVALID_PAGE);
+        frame_end_change(frame);
+        pthread_mutex_unlock(&shard->latch);
+        return NULL;
+    }
+
+    // ✅ Register in the page table AFTER reading
+    page_table_insert(shard, page_num, frame_index);
+    frame->pin_count = 1;
+    __atomic_store_n(&frame->referenced, true, __ATOMIC_RELAXED);
+    frame->dirty = false;
+    frame_end_change(frame);
+    pthread_mutex_unlock(&shard->latch);
+
+    // If this was the last page, update count. Readers in other shards may
+    // raise it at the same time, so it only ever grows to the larger page.
+    page_num_t pages = __atomic_load_n(&pager->num_pages, __ATOMIC_RELAXED);
+    while (page_num >= pages &&
+           !__atomic_compare_exchange_n(&pager->num_pages, &pages, page_num + 1, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    if (LOG_ENABLED(STARK_LOG_TRACE)) {
+        const unsigned char *bytes = frame->data;
+        char hex[16 * 3 + 1];
         for (int i = 0; i < 16; i++) {
-            printf("%02X ", ((unsigned char*)page)[i]);
+            snprintf(hex + 3 * i, sizeof(hex) - 3 * i, "%02X ", bytes[i]);
         }
-        printf("\n");
-    } else {
-        printf("Debug: Page %u found in cache\n", page_num);
+        LOG_TRACE("Loaded page %u from disk, first 16 bytes: %s", page_num, hex);
     }
-    
-    return pager->pages[page_num];
+
+    return frame->data;
+}
+
+const void *pager_peek_page(Pager *pager, page_num_t page_num, PagerPeek *peek) {
+    if (page_num == INVALID_PAGE) return NULL;
+
+    if (pager->flags & PAGER_MMAP) {
+        if (page_num >= pager->num_pages) return NULL;
+        peek->frame = NULL;
+        peek->version = 0;
+        return (char *)pager->map + (size_t)page_num * pager->page_size;
+    }
+
+    PagerShard *shard = page_shard(pager, page_num);
+    uint32_t frame_index = page_table_peek(shard, page_num);
+    if (frame_index == FRAME_NONE) return NULL;
+
+    Frame *frame = &shard->frames[frame_index];
+    uint32_t version = __atomic_load_n(&frame->version, __ATOMIC_ACQUIRE);
+    if ((version & 1) || __atomic_load_n(&frame->page_num, __ATOMIC_RELAXED) != page_num) {
+        return NULL;
+    }
+
+    // Hot pages stay cached; the bit is only written when CLOCK cleared it,
+    // so readers sharing a page do not fight over its cache line
+    if (!__atomic_load_n(&frame->referenced, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&frame->referenced, true, __ATOMIC_RELAXED);
+    }
+
+    peek->frame = frame;
+    peek->version = version;
+    return frame->data;
+}
+
+bool pager_peek_valid(const PagerPeek *peek) {
+    if (!peek->frame) return true;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&peek->frame->version, __ATOMIC_RELAXED) == peek->version;
+}
+
+void pager_unpin_page(Pager *pager, page_num_t page_num) {
+    if (pager->flags & PAGER_MMAP) return;
+
+    PagerShard *shard = page_shard(pager, page_num);
+    pthread_mutex_lock(&shard->latch);
+    uint32_t frame_index = page_table_lookup(shard, page_num);
+    if (frame_index != FRAME_NONE && shard->frames[frame_index].pin_count > 0) {
+        shard->frames[frame_index].pin_count--;
+    }
+    pthread_mutex_unlock(&shard->latch);
+}
+
+void pager_mark_dirty(Pager *pager, page_num_t page_num) {
+    if (pager->flags & PAGER_READONLY) return;
+
+    PagerShard *shard = page_shard(pager, page_num);
+    pthread_mutex_lock(&shard->latch);
+    uint32_t frame_index = page_table_lookup(shard, page_num);
+    if (frame_index != FRAME_NONE) {
+        shard->frames[frame_index].dirty = true;
+    }
+    pthread_mutex_unlock(&shard->latch);
 }
 
 DB_Result pager_flush_page(Pager *pager, page_num_t page_num) {
-    if (!pager->pages[page_num]) return DB_SUCCESS;
-    
-    printf("    💾 Writing page %d to disk\n", page_num);
-    
-    // For page 0, show what's being written
-    if (page_num == 0) {
-        LeafNode* leaf = (LeafNode*)pager->pages[page_num];
-        printf("      Page 0 has %u cells\n", leaf->num_cells);
-        for (int i = 0; i < leaf->num_cells; i++) {
-            printf("        Cell %d: key=%u, value=%u\n", 
-                   i, leaf->keys[i], leaf->values[i]);
-        }
-    }
-    
-    // Seek to page location
-    if (fseek(pager->file, page_num * pager->page_size, SEEK_SET) != 0) {
+    if (pager->flags & PAGER_READONLY) return DB_SUCCESS;
+
+    PagerShard *shard = page_shard(pager, page_num);
+    pthread_mutex_lock(&shard->latch);
+    uint32_t frame_index = page_table_lookup(shard, page_num);
+    Frame *frame = frame_index != FRAME_NONE ? &shard->frames[frame_index] : NULL;
+    if (!frame || !frame->dirty) {
+        pthread_mutex_unlock(&shard->latch);
+        return DB_SUCCESS;
+    }
+
+    LOG_TRACE("Writing page %u to disk", page_num);
+
+    DB_Result result = write_frame(pager, frame);
+    pthread_mutex_unlock(&shard->latch);
+    return result;
+}
+
+DB_Result pager_flush_all(Pager *pager) {
+    if (pager->flags & PAGER_READONLY) return DB_SUCCESS;
+
+    // Collect dirty frames and write them in page order
+    Frame **dirty = malloc(pager->num_frames * sizeof(Frame *));
+    if (!dirty) return DB_MEMORY_ERROR;
+
+    uint32_t num_dirty = 0;
+    for (uint32_t i = 0; i < pager->num_frames; i++) {
+        Frame *frame = &pager->frames[i];
+        if (frame->page_num != INVALID_PAGE && frame->dirty) {
+            dirty[num_dirty++] = frame;
+        }
+    }
+    qsort(dirty, num_dirty, sizeof(Frame *), compare_frame_pages);
+
+    LOG_DEBUG("Pager flushing %u of %u pages", num_dirty, pager->num_pages);
+
+    if (pager->wal || pager->shadow) {
+        DB_Result result = DB_SUCCESS;
+        for (uint32_t i = 0; i < num_dirty && result == DB_SUCCESS; i++) {
+            result = write_frame(pager, dirty[i]);
+        }
+        free(dirty);
+        return result;
+    }
+
+    // Coalesce runs of adjacent pages into one write each
+    DB_Result result = DB_SUCCESS;
+    uint32_t run_start = 0;
+    while (run_start < num_dirty) {
+        uint32_t run_end = run_start + 1;
+        while (run_end < num_dirty &&
+               dirty[run_end]->page_num == dirty[run_end - 1]->page_num + 1) {
+            run_end++;
+        }
+
+        LOG_TRACE("Flushing pages %u-%u", dirty[run_start]->page_num,
+                  dirty[run_end - 1]->page_num);
+        if (write_frames(pager, &dirty[run_start], run_end - run_start) != DB_SUCCESS) {
+            result = DB_IO_ERROR;
+        }
+        run_start = run_end;
+    }
+    free(dirty);
+
+    if (num_dirty > 0 && fdatasync(pager->fd) != 0) {
         return DB_IO_ERROR;
     }
-    
-    // Write the page
-    size_t bytes_written = fwrite(pager->pages[page_num], 
-                                  pager->page_size, 1, pager->file);
-    if (bytes_written < 1) {
+
+    return result;
+}
+
+void pager_advise(Pager *pager, PagerAccess access) {
+#ifdef POSIX_FADV_NORMAL
+    int advice = POSIX_FADV_NORMAL;
+    if (access == PAGER_ACCESS_RANDOM) advice = POSIX_FADV_RANDOM;
+    if (access == PAGER_ACCESS_SEQUENTIAL) advice = POSIX_FADV_SEQUENTIAL;
+
+    // Advisory only; failure is harmless
+    (void)posix_fadvise(pager->fd, 0, 0, advice);
+    if (pager->map) {
+        int madvice = POSIX_MADV_NORMAL;
+        if (access == PAGER_ACCESS_RANDOM) madvice = POSIX_MADV_RANDOM;
+        if (access == PAGER_ACCESS_SEQUENTIAL) madvice = POSIX_MADV_SEQUENTIAL;
+        (void)posix_madvise(pager->map, pager->map_size, madvice);
+    }
+#else
+    (void)pager;
+    (void)access;
+#endif
+}
+
+DB_Result pager_read_run(Pager *pager, page_num_t first, uint32_t count,
+                         void *buffer, size_t length) {
+    if (length > (size_t)count * pager->page_size) return DB_ERROR;
+
+    if (pager->flags & PAGER_MMAP) {
+        if ((uint64_t)first + count > pager->num_pages) return DB_IO_ERROR;
+        memcpy(buffer, (char *)pager->map + (size_t)first * pager->page_size, length);
+        return DB_SUCCESS;
+    }
+
+    struct iovec iov[IOV_MAX < 256 ? IOV_MAX : 256];
+    uint32_t max_batch = sizeof(iov) / sizeof(iov[0]);
+    uint32_t batch = 0;
+    page_num_t batch_first = first;
+
+    for (uint32_t i = 0; i < count; i++) {
+        size_t page_offset = (size_t)i * pager->page_size;
+        if (page_offset >= length) break;
+
+        page_num_t page_num = first + i;
+        char *dest = (char *)buffer + page_offset;
+        size_t bytes = length - page_offset < pager->page_size ? length - page_offset : pager->page_size;
+
+        // Cached and logged copies may be newer than the file; unwritten pages are zeros
+        PagerShard *shard = page_shard(pager, page_num);
+        pthread_mutex_lock(&shard->latch);
+        uint32_t frame_index = page_table_lookup(shard, page_num);
+        if (frame_index != FRAME_NONE) {
+            memcpy(dest, shard->frames[frame_index].data, bytes);
+        }
+        pthread_mutex_unlock(&shard->latch);
+
+        int logged = 0;
+        if (frame_index == FRAME_NONE) {
+            logged = read_logged(pager, page_num, dest, bytes);
+            if (logged < 0) return DB_IO_ERROR;
+        }
+        page_num_t location = INVALID_PAGE;
+        if (frame_index == FRAME_NONE && !logged) location = physical_page(pager, page_num);
+        bool from_disk = location != INVALID_PAGE;
+
+        // Shadowed pages are batched only while they lie next to each other
+        bool adjacent = location == batch_first + batch;
+        if (batch > 0 && (!from_disk || !adjacent || batch == max_batch)) {
+            if (preadv_full(pager->fd, iov, batch,
+                            (off_t)batch_first * pager->page_size) != DB_SUCCESS) {
+                return DB_IO_ERROR;
+            }
+            batch = 0;
+        }
+
+        if (frame_index != FRAME_NONE) {
+            // Already copied from the cache
+        } else if (logged) {
+            // Already copied from the log
+        } else if (!from_disk) {
+            memset(dest, 0, bytes);
+        } else {
+            if (batch == 0) batch_first = location;
+            iov[batch].iov_base = dest;
+            iov[batch].iov_len = bytes;
+            batch++;
+        }
+    }
+
+    if (batch > 0 &&
+        preadv_full(pager->fd, iov, batch, (off_t)batch_first * pager->page_size) != DB_SUCCESS) {
         return DB_IO_ERROR;
     }
-    
     return DB_SUCCESS;
 }
 
-DB_Result pager_flush_all(Pager *pager) {
-    printf("  Pager flushing %u pages\n", pager->num_pages);
-    
-    for (int i = 0; i < TABLE_MAX_PAGES; i++) {
-        if (pager->pages[i]) {
-            printf("    Flushing page %d\n", i);
-            pager_flush_page(pager, i);
+// Appends a run to the open transaction, one page image per frame
+static DB_Result log_run(Pager *pager, page_num_t first, uint32_t count,
+                         const void *buffer, size_t length) {
+    void *partial = NULL;
+    DB_Result result = DB_SUCCESS;
+    for (uint32_t i = 0; i < count && result == DB_SUCCESS; i++) {
+        size_t page_offset = (size_t)i * pager->page_size;
+        const void *image = (const char *)buffer + page_offset;
+        if (page_offset + pager->page_size > length) {
+            // The tail of the run is zero padding
+            if (!partial) partial = malloc(pager->page_size);
+            if (!partial) return DB_MEMORY_ERROR;
+            size_t bytes = page_offset < length ? length - page_offset : 0;
+            memcpy(partial, image, bytes);
+            memset((char *)partial + bytes, 0, pager->page_size - bytes);
+            image = partial;
         }
+        result = write_image(pager, first + i, image);
     }
-    
-    if (fflush(pager->file) != 0) {
-        return DB_IO_ERROR;
+    free(partial);
+    return result;
+}
+
+DB_Result pager_write_run(Pager *pager, page_num_t first, uint32_t count,
+                          const void *buffer, size_t length) {
+    if (pager->flags & PAGER_READONLY) return DB_READONLY;
+    if (length > (size_t)count * pager->page_size) return DB_ERROR;
+
+    // Keep any cached copies in step with what goes to disk
+    for (uint32_t i = 0; i < count; i++) {
+        PagerShard *shard = page_shard(pager, first + i);
+        pthread_mutex_lock(&shard->latch);
+        uint32_t frame_index = page_table_lookup(shard, first + i);
+        if (frame_index != FRAME_NONE) {
+            Frame *frame = &shard->frames[frame_index];
+            size_t page_offset = (size_t)i * pager->page_size;
+            size_t bytes = 0;
+            if (page_offset < length) {
+                bytes = length - page_offset < pager->page_size ? length - page_offset : pager->page_size;
+            }
+            memcpy(frame->data, (const char *)buffer + page_offset, bytes);
+            memset((char *)frame->data + bytes, 0, pager->page_size - bytes);
+            frame->dirty = false;
+        }
+        pthread_mutex_unlock(&shard->latch);
+    }
+
+    if (pager->wal || pager->shadow) return log_run(pager, first, count, buffer, length);
+
+    // Payload straight from the caller's buffer, zero padding after it
+    size_t padding = (size_t)count * pager->page_size - length;
+    void *zeros = padding > 0 ? calloc(1, padding) : NULL;
+    if (padding > 0 && !zeros) return DB_MEMORY_ERROR;
+
+    struct iovec iov[2];
+    int iovcnt = 0;
+    if (length > 0) {
+        iov[iovcnt].iov_base = (void *)buffer;
+        iov[iovcnt].iov_len = length;
+        iovcnt++;
+    }
+    if (padding > 0) {
+        iov[iovcnt].iov_base = zeros;
+        iov[iovcnt].iov_len = padding;
+        iovcnt++;
+    }
+
+    DB_Result result = pwritev_full(pager->fd, iov, iovcnt, (off_t)first * pager->page_size);
+    free(zeros);
+    if (result != DB_SUCCESS) return result;
+
+    if (first + count > pager->file_pages) {
+        pager->file_pages = first + count;
     }
-    
     return DB_SUCCESS;
 }
 
 page_num_t pager_allocate_page(Pager *pager) {
-    // Find a free slot in memory
-    for (int i = 0; i < TABLE_MAX_PAGES; i++) {
-        if (!pager->pages[i]) {
-            void *page = calloc(1, pager->page_size);
-            if (!page) return INVALID_PAGE;
-            pager->pages[i] = page;
-            
-            if (i >= pager->num_pages) {
-                pager->num_pages = i + 1;
+    if (pager->flags & PAGER_READONLY) return INVALID_PAGE;
+
+    if (pager->num_pages > PAGER_HEADER_PAGE) {
+        PagerHeader *header = pager_get_page(pager, PAGER_HEADER_PAGE);
+        if (!header) return INVALID_PAGE;
+
+        page_num_t page_num = header->free_head;
+        if (page_num != 0) {
+            // Each free page stores the next one in its first word
+            page_num_t *free_page = pager_get_page(pager, page_num);
+            if (!free_page) {
+                pager_unpin_page(pager, PAGER_HEADER_PAGE);
+                return INVALID_PAGE;
             }
-            return i;
+            pager_mark_dirty(pager, PAGER_HEADER_PAGE);
+            header->free_head = *free_page;
+            header->free_count--;
+
+            // Hand out a zeroed page, like a freshly appended one
+            pager_mark_dirty(pager, page_num);
+            memset(free_page, 0, pager->page_size);
+            pager_unpin_page(pager, page_num);
+            pager_unpin_page(pager, PAGER_HEADER_PAGE);
+            return page_num;
+        }
+        pager_unpin_page(pager, PAGER_HEADER_PAGE);
+    }
+
+    // New pages are appended; they read back as zeros until first written
+    if (pager->num_pages == INVALID_PAGE) return INVALID_PAGE;
+    page_num_t page_num = pager->num_pages++;
+
+    // A new file: record the page size for later opens
+    if (page_num == PAGER_HEADER_PAGE) {
+        PagerHeader *header = pager_get_page(pager, PAGER_HEADER_PAGE);
+        if (!header) {
+            pager->num_pages--;
+            return INVALID_PAGE;
         }
+        pager_mark_dirty(pager, PAGER_HEADER_PAGE);
+        header->page_size = pager->page_size;
+        pager_unpin_page(pager, PAGER_HEADER_PAGE);
     }
-    return INVALID_PAGE;
+    return page_num;
 }
 
+void pager_free_page(Pager *pager, page_num_t page_num) {
+    if (pager->flags & PAGER_READONLY) return;
+    if (page_num == PAGER_HEADER_PAGE || page_num >= pager->num_pages) return;
+
+    PagerHeader *header = pager_get_page(pager, PAGER_HEADER_PAGE);
+    if (!header) return;
+    page_num_t *free_page = pager_get_page(pager, page_num);
+    if (!free_page) {
+        pager_unpin_page(pager, PAGER_HEADER_PAGE);
+        return;
+    }
+
+    pager_mark_dirty(pager, page_num);
+    pager_mark_dirty(pager, PAGER_HEADER_PAGE);
+    *free_page = header->free_head;
+    header->free_head = page_num;
+    header->free_count++;
+
+    pager_unpin_page(pager, page_num);
+    pager_unpin_page(pager, PAGER_HEADER_PAGE);
+}
+
+// ==================== WRITE-AHEAD LOG ====================
+
+void pager_attach_wal(Pager *pager, Wal *wal, uint32_t file) {
+    pager->wal = wal;
+    pager->wal_file = file;
+    wal_set_pager(wal, file, pager);
+
+    if (wal->has_commit) {
+        // Committed pages may exist only in the log so far
+        if (wal->committed_pages[file] > pager->num_pages) {
+            pager->num_pages = wal->committed_pages[file];
+        }
+    } else {
+        wal->committed_pages[file] = pager->num_pages;
+    }
+}
+
+void pager_discard(Pager *pager, page_num_t num_pages) {
+    if (pager->flags & PAGER_MMAP) return;
+
+    for (uint32_t shard_index = 0; shard_index < pager->num_shards; shard_index++) {
+        PagerShard *shard = &pager->shards[shard_index];
+        pthread_mutex_lock(&shard->latch);
+        for (uint32_t i = 0; i < shard->num_frames; i++) {
+            Frame *frame = &shard->frames[i];
+            if (frame->page_num == INVALID_PAGE) continue;
+            frame_begin_change(frame);
+            page_table_remove(shard, frame->page_num);
+            frame_set_page(frame, INVALID_PAGE);
+            frame->pin_count = 0;
+            __atomic_store_n(&frame->referenced, false, __ATOMIC_RELAXED);
+            frame->dirty = false;
+            frame_end_change(frame);
+        }
+        pthread_mutex_unlock(&shard->latch);
+    }
+    pager->num_pages = num_pages;
+}
+
+DB_Result pager_write_pages(Pager *pager, page_num_t first, uint32_t count, void *const *images) {
+    struct iovec iov[IOV_MAX < 256 ? IOV_MAX : 256];
+    uint32_t max_batch = sizeof(iov) / sizeof(iov[0]);
+
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t batch = count - done < max_batch ? count - done : max_batch;
+        for (uint32_t i = 0; i < batch; i++) {
+            iov[i].iov_base = images[done + i];
+            iov[i].iov_len = pager->page_size;
+        }
+        off_t offset = (off_t)(first + done) * pager->page_size;
+        if (pwritev_full(pager->fd, iov, batch, offset) != DB_SUCCESS) return DB_IO_ERROR;
+        done += batch;
+    }
+    return DB_SUCCESS;
+}
+
+DB_Result pager_sync_file(Pager *pager, page_num_t num_pages) {
+    // Allocated pages that were never written still count towards the length
+    struct stat st;
+    if (fstat(pager->fd, &st) != 0) return DB_IO_ERROR;
+    off_t length = (off_t)num_pages * pager->page_size;
+    if (st.st_size < length && ftruncate(pager->fd, length) != 0) return DB_IO_ERROR;
+    return fdatasync(pager->fd) == 0 ? DB_SUCCESS : DB_IO_ERROR;
+}
+
+// ==================== SHADOW PAGING ====================
+
+DB_Result pager_load_shadow(Pager *pager, uint64_t generation) {
+    DB_Result result = shadow_load(pager->shadow, generation);
+    if (result != DB_SUCCESS) return result;
+    pager->num_pages = pager->shadow->committed_pages;
+    return DB_SUCCESS;
+}
@@ -3,22 +3,161 @@
 
 #include "constants.h"
 #include <stdio.h>
+#include <pthread.h>
+
+#define FRAME_NONE UINT32_MAX
+#define PAGER_MAX_SHARDS 16         // Buffer pool partitions, each with its own latch
+#define PAGER_SHARD_MIN_FRAMES 32   // Small pools use fewer shards
+
+struct Wal;
+struct Shadow;
+
+// Access pattern hints passed to posix_fadvise
+typedef enum {
+    PAGER_ACCESS_NORMAL,
+    PAGER_ACCESS_RANDOM,
+    PAGER_ACCESS_SEQUENTIAL
+} PagerAccess;
+
+// pager_open flags
+#define PAGER_READONLY  0x1     // Open without write access; allocation fails
+#define PAGER_MMAP      0x2     // Serve pages from a read-only mapping (implies READONLY)
+#define PAGER_SHADOW    0x4     // Shadow-paged file (see shadow.h); excludes MMAP
+
+// Every file starts with this header on page 0; the file's owner embeds it
+// as the first member of its own page-0 structure. Page 0 is never free, so
+// a zero-filled header means an empty free list.
+#define PAGER_HEADER_PAGE 0
+
+typedef struct {
+    page_num_t free_head;   // First page of the free list (0 = empty)
+    uint32_t free_count;
+    uint32_t page_size;     // Set when page 0 is allocated
+} PagerHeader;
+
+// One slot of the buffer pool
+typedef struct {
+    page_num_t page_num;    // Page held by this frame (INVALID_PAGE if empty)
+    uint32_t pin_count;     // Frames with pin_count > 0 are never evicted
+    uint32_t version;       // Odd while the frame is switching pages; see pager_peek_page
+    bool referenced;        // CLOCK reference bit
+    bool dirty;             // Modified since last written back
+    void *data;
+} Frame;
+
+// A partition of the buffer pool. Pages hash to a shard, and each shard has
+// its own latch, frames, page table and CLOCK hand, so threads working on
+// different pages rarely wait for each other.
+typedef struct {
+    pthread_mutex_t latch;
+    Frame *frames;
+    uint32_t num_frames;
+    uint32_t clock_hand;
+
+    // Page number -> frame index (open addressing, linear probing)
+    uint32_t *page_table;
+    uint32_t page_table_mask;
+    char padding[64];       // Keeps neighbouring latches off one cache line
+} PagerShard;
+
+// Token for an unpinned read of a cached page
+typedef struct {
+    Frame *frame;           // NULL for mapped pages, which never move
+    uint32_t version;
+} PagerPeek;
 
 typedef struct Pager {
-    FILE *file;
-    void *pages[TABLE_MAX_PAGES];  // Page cache
-    page_num_t num_pages;
+    int fd;
+    unsigned flags;
+
+    // Read-only mapping of the whole file (PAGER_MMAP only)
+    void *map;
+    size_t map_size;
+
+    // Buffer pool
+    PagerShard *shards;
+    uint32_t num_shards;
+    uint32_t shard_shift;   // High page-hash bits pick the shard
+    Frame *frames;          // All shards' frames
+    uint32_t num_frames;
+    uint32_t *page_tables;  // All shards' page tables
+    void *frame_memory;     // Backing store for all frames
+
+    page_num_t num_pages;   // Logical size, including allocated but unwritten pages
+    page_num_t file_pages;  // Pages physically present in the file
     uint32_t page_size;
+
+    // With a write-ahead log, dirty pages go to the log instead of the file
+    // and reads check the log first; only the checkpoint writes the file
+    struct Wal *wal;
+    uint32_t wal_file;      // WAL_FILE_* id of this file
+
+    // With shadow paging, page numbers go through the shadow's page map and
+    // written pages never overwrite committed ones
+    struct Shadow *shadow;
+
+    // Snapshot pagers read another pager's file as of one commit
+    struct Pager *base;     // NULL for a pager that owns its file
+    uint64_t snapshot_lsn;
 } Pager;
 
-// Initialize and destroy
-Pager *pager_open(const char *filename);
+// Initialize and destroy. page_size applies to new files (0 = PAGE_SIZE);
+// existing files keep the size recorded in their PagerHeader. A PAGER_SHADOW
+// pager has no pages until pager_load_shadow picks the commit to open.
+Pager *pager_open(const char *filename, uint32_t num_frames, uint32_t page_size, unsigned flags);
+// A read-only pager over base's file with a buffer pool of its own, which
+// sees the file as of the commit at `lsn` (see wal_snapshot_open). Pages the
+// log has are read as of that commit; the rest come from the file, which
+// the checkpoint keeps at or before it. Close it before base.
+Pager *pager_open_snapshot(Pager *base, uint32_t num_frames, uint64_t lsn, page_num_t num_pages);
 void pager_close(Pager *pager);
 
 // Page operations
+// pager_get_page pins the page; every call must be paired with pager_unpin_page.
+// Pages of a PAGER_MMAP pager point into the mapping and must not be written.
+// Getting, unpinning and peeking at pages is safe from many threads at once;
+// everything that changes pages or the file expects the caller to keep
+// other threads out.
 void *pager_get_page(Pager *pager, page_num_t page_num);
+void pager_unpin_page(Pager *pager, page_num_t page_num);
+// Reads a cached page without pinning or latching it: returns NULL if the
+// page is not cached. The caller copies out what it needs and keeps it only
+// if pager_peek_valid then says the frame was not reused meanwhile; until
+// then the bytes may be torn, so counts read from them must be bounded.
+// Only reuse is detected: changes to the page itself must be kept out.
+const void *pager_peek_page(Pager *pager, page_num_t page_num, PagerPeek *peek);
+bool pager_peek_valid(const PagerPeek *peek);
+// Call on a pinned page before modifying it; only dirty pages are written back
+void pager_mark_dirty(Pager *pager, page_num_t page_num);
 DB_Result pager_flush_page(Pager *pager, page_num_t page_num);
+// Writes back every dirty page and fsyncs; with a WAL the pages are appended
+// to the open transaction instead, without a sync
 DB_Result pager_flush_all(Pager *pager);
+// Reuses a page from the free list when there is one, otherwise appends
 page_num_t pager_allocate_page(Pager *pager);
+// Puts a page on the free list; it must not be pinned or referenced again
+void pager_free_page(Pager *pager, page_num_t page_num);
+
+// Multi-page I/O for runs of consecutive pages, bypassing frame allocation.
+// Reads merge cached pages with preadv of the rest; writes go straight to the
+// file with pwritev. `length` may end mid-page; the rest of the run is zeros.
+DB_Result pager_read_run(Pager *pager, page_num_t first, uint32_t count,
+                         void *buffer, size_t length);
+DB_Result pager_write_run(Pager *pager, page_num_t first, uint32_t count,
+                          const void *buffer, size_t length);
+void pager_advise(Pager *pager, PagerAccess access);
+
+// Write-ahead logging. Attaching adopts the file length of the log's last commit.
+void pager_attach_wal(Pager *pager, struct Wal *wal, uint32_t file);
+// Drops every cached page and restores the logical size; rolls back a transaction
+void pager_discard(Pager *pager, page_num_t num_pages);
+// Checkpoint helpers: write page images straight to the file, leaving cached
+// copies alone, then extend the file to num_pages and fsync it. They may run
+// on the checkpointer thread, so they leave the pager's fields to the caller.
+DB_Result pager_write_pages(Pager *pager, page_num_t first, uint32_t count, void *const *images);
+DB_Result pager_sync_file(Pager *pager, page_num_t num_pages);
+
+// Shadow paging. Loads the page map of a commit and adopts its file length.
+DB_Result pager_load_shadow(Pager *pager, uint64_t generation);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,474 @@
+#include "shadow.h"
+#include "crc32.h"
+#include "log.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// ==================== FILE I/O ====================
+
+static DB_Result pwrite_full(int fd, const void *data, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t written = pwrite(fd, (const char *)data + done, size - done, offset + done);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (written == 0) return DB_IO_ERROR;
+        done += written;
+    }
+    return DB_SUCCESS;
+}
+
+static DB_Result pread_full(int fd, void *data, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t bytes_read = pread(fd, (char *)data + done, size - done, offset + done);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (bytes_read == 0) return DB_IO_ERROR;
+        done += bytes_read;
+    }
+    return DB_SUCCESS;
+}
+
+// ==================== META ====================
+
+static uint32_t max_map_pages(uint32_t page_size) {
+    return (page_size - sizeof(ShadowMeta)) / sizeof(page_num_t);
+}
+
+static uint32_t meta_crc(const ShadowMeta *meta) {
+    ShadowMeta copy = *meta;
+    copy.crc = 0;
+    uint32_t crc = crc32_update(0, &copy, sizeof(copy));
+    return crc32_update(crc, meta->map_pages, (size_t)meta->num_map_pages * sizeof(page_num_t));
+}
+
+// Reads one slot; NULL unless it holds an intact meta for this page size
+static ShadowMeta *read_meta(int fd, uint32_t slot, uint32_t page_size) {
+    ShadowMeta *meta = malloc(page_size);
+    if (!meta) return NULL;
+    bool valid = pread_full(fd, meta, page_size, (off_t)slot * page_size) == DB_SUCCESS &&
+                 meta->magic == SHADOW_MAGIC && meta->version == SHADOW_VERSION &&
+                 meta->pager_header.page_size == page_size &&
+                 meta->generation % SHADOW_META_SLOTS == slot &&
+                 meta->num_map_pages <= max_map_pages(page_size) &&
+                 meta->crc == meta_crc(meta);
+    if (!valid) {
+        free(meta);
+        return NULL;
+    }
+    return meta;
+}
+
+static DB_Result write_meta(Shadow *shadow, uint64_t generation, page_num_t num_pages,
+                            const page_num_t *map_pages, uint32_t num_map_pages) {
+    ShadowMeta *meta = calloc(1, shadow->page_size);
+    if (!meta) return DB_MEMORY_ERROR;
+    meta->pager_header.page_size = shadow->page_size;
+    meta->magic = SHADOW_MAGIC;
+    meta->version = SHADOW_VERSION;
+    meta->generation = generation;
+    meta->num_pages = num_pages;
+    meta->num_map_pages = num_map_pages;
+    if (num_map_pages > 0) {
+        memcpy(meta->map_pages, map_pages, (size_t)num_map_pages * sizeof(page_num_t));
+    }
+    meta->crc = meta_crc(meta);
+
+    off_t offset = (off_t)(generation % SHADOW_META_SLOTS) * shadow->page_size;
+    DB_Result result = pwrite_full(shadow->fd, meta, shadow->page_size, offset);
+    free(meta);
+    if (result == DB_SUCCESS && fdatasync(shadow->fd) != 0) result = DB_IO_ERROR;
+    return result;
+}
+
+// ==================== PAGE ACCOUNTING ====================
+
+static DB_Result list_push(ShadowList *list, page_num_t page) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? 2 * list->capacity : 256;
+        page_num_t *grown = realloc(list->pages, (size_t)capacity * sizeof(page_num_t));
+        if (!grown) return DB_MEMORY_ERROR;
+        list->pages = grown;
+        list->capacity = capacity;
+    }
+    list->pages[list->count++] = page;
+    return DB_SUCCESS;
+}
+
+static bool is_used(Shadow *shadow, page_num_t page) {
+    return page < shadow->physical_pages && (shadow->used[page / 8] >> (page % 8)) & 1;
+}
+
+static void set_used(Shadow *shadow, page_num_t page, bool used) {
+    if (used) {
+        shadow->used[page / 8] |= (uint8_t)(1u << (page % 8));
+    } else {
+        shadow->used[page / 8] &= (uint8_t)~(1u << (page % 8));
+        if (page < shadow->next_free) shadow->next_free = page;
+    }
+}
+
+// Makes the bitmap cover `pages` physical pages
+static DB_Result grow_physical(Shadow *shadow, page_num_t pages) {
+    size_t old_bytes = ((size_t)shadow->physical_pages + 7) / 8;
+    size_t bytes = ((size_t)pages + 7) / 8;
+    if (bytes > old_bytes) {
+        uint8_t *grown = realloc(shadow->used, bytes);
+        if (!grown) return DB_MEMORY_ERROR;
+        memset(grown + old_bytes, 0, bytes - old_bytes);
+        shadow->used = grown;
+    }
+    if (pages > shadow->physical_pages) shadow->physical_pages = pages;
+    return DB_SUCCESS;
+}
+
+// Finds a free physical page, extending the file when none is left
+static page_num_t allocate_physical(Shadow *shadow) {
+    page_num_t page = shadow->next_free;
+    while (page < shadow->physical_pages && is_used(shadow, page)) page++;
+    if (page >= shadow->physical_pages) {
+        if (shadow->physical_pages == INVALID_PAGE - 1) return INVALID_PAGE;
+        if (grow_physical(shadow, shadow->physical_pages + 1) != DB_SUCCESS) return INVALID_PAGE;
+        page = shadow->physical_pages - 1;
+    }
+    if (list_push(&shadow->allocated, page) != DB_SUCCESS) return INVALID_PAGE;
+    set_used(shadow, page, true);
+    shadow->next_free = page + 1;
+    return page;
+}
+
+// Makes both maps hold at least `pages` entries
+static DB_Result grow_map(Shadow *shadow, page_num_t pages) {
+    if (pages <= shadow->map_capacity) return DB_SUCCESS;
+    page_num_t capacity = shadow->map_capacity ? shadow->map_capacity : 1024;
+    while (capacity < pages) capacity *= 2;
+
+    page_num_t *map = realloc(shadow->map, (size_t)capacity * sizeof(page_num_t));
+    if (!map) return DB_MEMORY_ERROR;
+    shadow->map = map;
+    page_num_t *committed = realloc(shadow->committed, (size_t)capacity * sizeof(page_num_t));
+    if (!committed) return DB_MEMORY_ERROR;
+    shadow->committed = committed;
+
+    for (page_num_t i = shadow->map_capacity; i < capacity; i++) {
+        shadow->map[i] = INVALID_PAGE;
+        shadow->committed[i] = INVALID_PAGE;
+    }
+    shadow->map_capacity = capacity;
+    return DB_SUCCESS;
+}
+
+// ==================== OPEN ====================
+
+static bool valid_page_size(uint32_t page_size) {
+    return page_size >= PAGE_SIZE_MIN && page_size <= PAGE_SIZE_MAX &&
+           (page_size & (page_size - 1)) == 0;
+}
+
+Shadow *shadow_open(int fd, uint32_t page_size, bool read_only) {
+    Shadow *shadow = calloc(1, sizeof(Shadow));
+    if (!shadow) return NULL;
+    shadow->fd = fd;
+    shadow->read_only = read_only;
+    pthread_mutex_init(&shadow->lock, NULL);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        shadow_close(shadow);
+        return NULL;
+    }
+
+    if (st.st_size == 0) {
+        // New file: commit 0 is empty
+        if (read_only || !valid_page_size(page_size)) {
+            shadow_close(shadow);
+            return NULL;
+        }
+        shadow->page_size = page_size;
+        shadow->max_map_pages = max_map_pages(page_size);
+        if (write_meta(shadow, 0, 0, NULL, 0) != DB_SUCCESS) {
+            shadow_close(shadow);
+            return NULL;
+        }
+        shadow->metas[0] = read_meta(fd, 0, page_size);
+        if (!shadow->metas[0]) {
+            shadow_close(shadow);
+            return NULL;
+        }
+        return shadow;
+    }
+
+    // Slot 0 names the page size; if it is torn, slot 1 is tried at every
+    // size it could have
+    PagerHeader header;
+    if (pread_full(fd, &header, sizeof(header), 0) == DB_SUCCESS && valid_page_size(header.page_size)) {
+        shadow->page_size = header.page_size;
+        shadow->metas[0] = read_meta(fd, 0, header.page_size);
+        shadow->metas[1] = read_meta(fd, 1, header.page_size);
+    }
+    for (uint32_t size = PAGE_SIZE_MIN; size <= PAGE_SIZE_MAX && !shadow->metas[0] && !shadow->metas[1];
+         size *= 2) {
+        shadow->metas[1] = read_meta(fd, 1, size);
+        if (shadow->metas[1]) shadow->page_size = size;
+    }
+    if (!shadow->metas[0] && !shadow->metas[1]) {
+        LOG_ERROR("File has no intact shadow meta page");
+        shadow_close(shadow);
+        return NULL;
+    }
+    shadow->max_map_pages = max_map_pages(shadow->page_size);
+    return shadow;
+}
+
+void shadow_close(Shadow *shadow) {
+    if (!shadow) return;
+    for (uint32_t i = 0; i < SHADOW_META_SLOTS; i++) free(shadow->metas[i]);
+    free(shadow->map);
+    free(shadow->committed);
+    free(shadow->map_pages);
+    free(shadow->next_map_pages);
+    free(shadow->used);
+    free(shadow->changed.pages);
+    free(shadow->allocated.pages);
+    free(shadow->freed.pages);
+    pthread_mutex_destroy(&shadow->lock);
+    free(shadow);
+}
+
+uint64_t shadow_newest(Shadow *shadow) {
+    uint64_t newest = 0;
+    for (uint32_t i = 0; i < SHADOW_META_SLOTS; i++) {
+        if (shadow->metas[i] && shadow->metas[i]->generation > newest) {
+            newest = shadow->metas[i]->generation;
+        }
+    }
+    return newest;
+}
+
+DB_Result shadow_load(Shadow *shadow, uint64_t generation) {
+    ShadowMeta *meta = shadow->metas[generation % SHADOW_META_SLOTS];
+    if (!meta || meta->generation != generation) {
+        LOG_ERROR("Shadow commit %llu is not in the file", (unsigned long long)generation);
+        return DB_ERROR;
+    }
+
+    struct stat st;
+    if (fstat(shadow->fd, &st) != 0) return DB_IO_ERROR;
+    page_num_t file_pages = (page_num_t)(st.st_size / shadow->page_size);
+    if (file_pages < SHADOW_META_SLOTS) file_pages = SHADOW_META_SLOTS;
+    if (grow_physical(shadow, file_pages) != DB_SUCCESS ||
+        grow_map(shadow, meta->num_pages) != DB_SUCCESS) {
+        return DB_MEMORY_ERROR;
+    }
+
+    shadow->map_pages = malloc((size_t)shadow->max_map_pages * sizeof(page_num_t));
+    shadow->next_map_pages = malloc((size_t)shadow->max_map_pages * sizeof(page_num_t));
+    if (!shadow->map_pages || !shadow->next_map_pages) return DB_MEMORY_ERROR;
+
+    for (uint32_t slot = 0; slot < SHADOW_META_SLOTS; slot++) set_used(shadow, slot, true);
+
+    // Every page the map reaches is in use; the rest of the file is free
+    uint32_t per_page = shadow->page_size / sizeof(page_num_t);
+    DB_Result result = DB_SUCCESS;
+    for (uint32_t i = 0; i < meta->num_map_pages && result == DB_SUCCESS; i++) {
+        page_num_t location = meta->map_pages[i];
+        page_num_t first = i * per_page;
+        page_num_t count = meta->num_pages - first < per_page ? meta->num_pages - first : per_page;
+        if (location >= shadow->physical_pages || first >= meta->num_pages) {
+            result = DB_ERROR;
+            break;
+        }
+        set_used(shadow, location, true);
+        shadow->map_pages[i] = location;
+        result = pread_full(shadow->fd, &shadow->map[first], (size_t)count * sizeof(page_num_t),
+                            (off_t)location * shadow->page_size);
+        for (page_num_t j = first; j < first + count && result == DB_SUCCESS; j++) {
+            if (shadow->map[j] == INVALID_PAGE) continue;
+            if (shadow->map[j] >= shadow->physical_pages) result = DB_ERROR;
+            else set_used(shadow, shadow->map[j], true);
+        }
+    }
+    if (result != DB_SUCCESS) {
+        LOG_ERROR("Shadow page map of commit %llu is damaged", (unsigned long long)generation);
+        return result;
+    }
+
+    // A new file has no pages and no map yet
+    if (meta->num_pages > 0) {
+        memcpy(shadow->committed, shadow->map, (size_t)meta->num_pages * sizeof(page_num_t));
+    }
+    shadow->num_map_pages = meta->num_map_pages;
+    shadow->committed_pages = meta->num_pages;
+    shadow->generation = generation;
+    shadow->next_free = SHADOW_META_SLOTS;
+    for (uint32_t i = 0; i < SHADOW_META_SLOTS; i++) {
+        free(shadow->metas[i]);
+        shadow->metas[i] = NULL;
+    }
+
+    LOG_INFO("Loaded shadow commit %llu, %u pages", (unsigned long long)generation,
+             shadow->committed_pages);
+    return DB_SUCCESS;
+}
+
+// ==================== PAGES ====================
+
+page_num_t shadow_lookup(Shadow *shadow, page_num_t page_num) {
+    pthread_mutex_lock(&shadow->lock);
+    page_num_t location = page_num < shadow->map_capacity ? shadow->map[page_num] : INVALID_PAGE;
+    pthread_mutex_unlock(&shadow->lock);
+    return location;
+}
+
+DB_Result shadow_write(Shadow *shadow, page_num_t page_num, const void *data) {
+    if (shadow->read_only) return DB_READONLY;
+    if (page_num >= shadow->max_map_pages * (shadow->page_size / sizeof(page_num_t))) {
+        return DB_FULL;
+    }
+
+    pthread_mutex_lock(&shadow->lock);
+    DB_Result result = grow_map(shadow, page_num + 1);
+    page_num_t location = INVALID_PAGE;
+    if (result == DB_SUCCESS) {
+        location = shadow->map[page_num];
+        page_num_t committed = shadow->committed[page_num];
+
+        // The committed image stays put until the commit that replaces it
+        if (location == INVALID_PAGE || location == committed) {
+            location = allocate_physical(shadow);
+            if (location == INVALID_PAGE) {
+                result = DB_MEMORY_ERROR;
+            } else {
+                if (committed != INVALID_PAGE) result = list_push(&shadow->freed, committed);
+                if (result == DB_SUCCESS) result = list_push(&shadow->changed, page_num);
+                if (result == DB_SUCCESS) shadow->map[page_num] = location;
+            }
+        }
+    }
+    pthread_mutex_unlock(&shadow->lock);
+
+    // No reader looks at a page of the open transaction by its location
+    if (result == DB_SUCCESS) {
+        result = pwrite_full(shadow->fd, data, shadow->page_size, (off_t)location * shadow->page_size);
+    }
+    return result;
+}
+
+bool shadow_changed(Shadow *shadow, page_num_t num_pages) {
+    return shadow->changed.count > 0 || num_pages != shadow->committed_pages;
+}
+
+// ==================== COMMIT ====================
+
+DB_Result shadow_prepare(Shadow *shadow, page_num_t num_pages) {
+    if (shadow->read_only) return DB_READONLY;
+
+    uint32_t per_page = shadow->page_size / sizeof(page_num_t);
+    uint32_t needed = (uint32_t)(((uint64_t)num_pages + per_page - 1) / per_page);
+    if (needed > shadow->max_map_pages) return DB_FULL;
+
+    pthread_mutex_lock(&shadow->lock);
+    DB_Result result = grow_map(shadow, (page_num_t)needed * per_page);
+
+    // Map pages holding a remapped entry, or new ones, are written afresh
+    bool *dirty = calloc(needed + 1, sizeof(bool));
+    if (!dirty) result = DB_MEMORY_ERROR;
+    for (uint32_t i = 0; result == DB_SUCCESS && i < shadow->changed.count; i++) {
+        page_num_t page = shadow->changed.pages[i];
+        if (page < num_pages) dirty[page / per_page] = true;
+    }
+
+    shadow->next_num_map_pages = needed;
+    shadow->next_num_pages = num_pages;
+    for (uint32_t i = 0; result == DB_SUCCESS && i < needed; i++) {
+        if (i < shadow->num_map_pages && !dirty[i]) {
+            shadow->next_map_pages[i] = shadow->map_pages[i];
+            continue;
+        }
+        page_num_t location = allocate_physical(shadow);
+        if (location == INVALID_PAGE) {
+            result = DB_MEMORY_ERROR;
+            break;
+        }
+        if (i < shadow->num_map_pages) result = list_push(&shadow->freed, shadow->map_pages[i]);
+        shadow->next_map_pages[i] = location;
+
+        // Entries past the end of the file read as never written
+        page_num_t first = i * per_page;
+        for (page_num_t j = num_pages; j < first + per_page; j++) {
+            if (j >= first) shadow->map[j] = INVALID_PAGE;
+        }
+        if (result == DB_SUCCESS) {
+            result = pwrite_full(shadow->fd, &shadow->map[first], shadow->page_size,
+                                 (off_t)location * shadow->page_size);
+        }
+    }
+    // Map pages past a shorter end are dropped
+    for (uint32_t i = needed; result == DB_SUCCESS && i < shadow->num_map_pages; i++) {
+        result = list_push(&shadow->freed, shadow->map_pages[i]);
+    }
+    free(dirty);
+    pthread_mutex_unlock(&shadow->lock);
+
+    // Everything the meta will point at must be durable before it is written
+    if (result == DB_SUCCESS && fdatasync(shadow->fd) != 0) result = DB_IO_ERROR;
+    return result;
+}
+
+DB_Result shadow_publish(Shadow *shadow, uint64_t generation) {
+    DB_Result result = write_meta(shadow, generation, shadow->next_num_pages,
+                                  shadow->next_map_pages, shadow->next_num_map_pages);
+    if (result != DB_SUCCESS) return result;
+
+    pthread_mutex_lock(&shadow->lock);
+    for (uint32_t i = 0; i < shadow->changed.count; i++) {
+        page_num_t page = shadow->changed.pages[i];
+        shadow->committed[page] = shadow->map[page];
+    }
+    for (page_num_t page = shadow->next_num_pages; page < shadow->committed_pages; page++) {
+        shadow->committed[page] = INVALID_PAGE;
+    }
+    memcpy(shadow->map_pages, shadow->next_map_pages,
+           (size_t)shadow->next_num_map_pages * sizeof(page_num_t));
+    shadow->num_map_pages = shadow->next_num_map_pages;
+    shadow->committed_pages = shadow->next_num_pages;
+    shadow->generation = generation;
+    shadow->changed.count = 0;
+    shadow->allocated.count = 0;
+    pthread_mutex_unlock(&shadow->lock);
+    return DB_SUCCESS;
+}
+
+void shadow_release(Shadow *shadow) {
+    // The previous commit is no longer needed by a crash recovery
+    pthread_mutex_lock(&shadow->lock);
+    for (uint32_t i = 0; i < shadow->freed.count; i++) {
+        set_used(shadow, shadow->freed.pages[i], false);
+    }
+    shadow->freed.count = 0;
+    pthread_mutex_unlock(&shadow->lock);
+}
+
+void shadow_rollback(Shadow *shadow) {
+    pthread_mutex_lock(&shadow->lock);
+    for (uint32_t i = 0; i < shadow->changed.count; i++) {
+        page_num_t page = shadow->changed.pages[i];
+        shadow->map[page] = shadow->committed[page];
+    }
+    for (uint32_t i = 0; i < shadow->allocated.count; i++) {
+        set_used(shadow, shadow->allocated.pages[i], false);
+    }
+    shadow->changed.count = 0;
+    shadow->allocated.count = 0;
+    shadow->freed.count = 0;
+    pthread_mutex_unlock(&shadow->lock);
+}
@@ -0,0 +1,103 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "constants.h"
+#include "pager.h"
+#include <pthread.h>
+
+// Shadow paging: the alternative to the write-ahead log, chosen when a
+// database is opened. Committed pages are never overwritten. The pager's
+// page numbers are logical; a page map gives the physical page holding
+// each one. A transaction writes changed pages to free physical pages, and
+// a commit writes the changed parts of the map the same way, then a new
+// meta into the slot that does not hold the last commit. Opening picks the
+// newest commit whose meta is intact, so a crash leaves nothing to replay.
+//
+// File layout:
+//   physical pages 0 and 1   ShadowMeta slots; commit n goes to slot n % 2
+//   other pages              page images and map pages, in any order
+// A map page holds the physical page of page_size / 4 consecutive logical
+// pages (INVALID_PAGE = never written, reads as zeros).
+#define SHADOW_MAGIC 0x48534B53         // "SKSH"
+#define SHADOW_VERSION 1
+#define SHADOW_META_SLOTS 2
+
+typedef struct {
+    PagerHeader pager_header;   // Only page_size is used, so pager_open can read it
+    uint32_t magic;
+    uint64_t generation;        // Commit number
+    uint32_t version;
+    page_num_t num_pages;       // Logical length of the file
+    uint32_t num_map_pages;
+    uint32_t crc;               // Over the meta with crc = 0, directory included
+    uint32_t reserved[2];
+    page_num_t map_pages[];     // Physical page of each map page
+} ShadowMeta;
+
+typedef struct {
+    page_num_t *pages;
+    uint32_t count;
+    uint32_t capacity;
+} ShadowList;
+
+typedef struct Shadow {
+    int fd;
+    uint32_t page_size;
+    bool read_only;
+    ShadowMeta *metas[SHADOW_META_SLOTS];   // Intact slots found at open, until loaded
+
+    uint64_t generation;        // Last commit
+    page_num_t *map;            // Logical -> physical, with the open transaction's writes
+    page_num_t *committed;      // The same as of the last commit
+    page_num_t map_capacity;    // Entries allocated in both
+    page_num_t committed_pages; // Logical length as of the last commit
+
+    // Map pages as of the last commit; a commit stages the next directory
+    page_num_t *map_pages;
+    uint32_t num_map_pages;
+    page_num_t *next_map_pages;
+    uint32_t next_num_map_pages;
+    page_num_t next_num_pages;
+    uint32_t max_map_pages;     // Directory entries that fit a meta slot
+
+    uint8_t *used;              // Bitmap of physical pages in use
+    page_num_t physical_pages;  // Pages the bitmap covers
+    page_num_t next_free;       // Allocation starts looking here
+
+    ShadowList changed;         // Logical pages the open transaction remapped
+    ShadowList allocated;       // Physical pages it took
+    ShadowList freed;           // Committed pages it replaced, freed once it commits
+
+    // Readers look pages up while a reader's eviction may write one back
+    pthread_mutex_t lock;
+} Shadow;
+
+// Reads the meta slots of a file, or writes the first one to an empty file.
+// page_size only applies to a new file. The map is loaded by shadow_load.
+Shadow *shadow_open(int fd, uint32_t page_size, bool read_only);
+void shadow_close(Shadow *shadow);
+// Newest commit with an intact meta
+uint64_t shadow_newest(Shadow *shadow);
+// Loads the page map of a commit; only the newest two are kept
+DB_Result shadow_load(Shadow *shadow, uint64_t generation);
+
+// Physical page holding a logical page, or INVALID_PAGE if never written
+page_num_t shadow_lookup(Shadow *shadow, page_num_t page_num);
+// Writes a page image for the open transaction. The first write of a page
+// since the last commit goes to a free physical page, later ones overwrite it.
+DB_Result shadow_write(Shadow *shadow, page_num_t page_num, const void *data);
+// True when the open transaction wrote a page or changed the length
+bool shadow_changed(Shadow *shadow, page_num_t num_pages);
+
+// Commits run in three steps over every file of the database, so that a
+// crash leaves all files at the same commit: shadow_prepare writes the
+// changed map pages and fsyncs; once all files are prepared, shadow_publish
+// writes and fsyncs the meta; once all are published, shadow_release frees
+// the pages the commit replaced.
+DB_Result shadow_prepare(Shadow *shadow, page_num_t num_pages);
+DB_Result shadow_publish(Shadow *shadow, uint64_t generation);
+void shadow_release(Shadow *shadow);
+// Forgets the open transaction, including a commit that did not publish
+void shadow_rollback(Shadow *shadow);
+
+#endif
@@ -1,120 +1,796 @@
 #include "storage.h"
+#include "log.h"
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct {
-    uint32_t size;
-    uint8_t data[];
-} StorageRecord;
+// Page geometry depends on the file's page size, so these take the Storage
+#define DATA_PAGE_CAPACITY(s) ((s)->page_end - sizeof(DataPageHeader))
+#define REUSE_MIN_FREE(s) ((s)->page_size / 4)  // Pages with less room are not worth revisiting
+#define MAX_RECORD_SIZE(s) (DATA_PAGE_CAPACITY(s) - sizeof(Slot))
+// Values larger than this are moved to an overflow extent
+#define INLINE_MAX(s) (MAX_RECORD_SIZE(s) < SLOT_LENGTH_MASK ? MAX_RECORD_SIZE(s) : SLOT_LENGTH_MASK)
+
+// ==================== FREE-SPACE MAP ====================
+
+// Each group is one FSM page followed by the page_size data pages it covers
+#define FSM_GROUP_PAGES(s) ((s)->page_size + 1)
+#define FSM_FIRST_PAGE 1
+
+static bool is_fsm_page(Storage *storage, page_num_t page) {
+    return page >= FSM_FIRST_PAGE && (page - FSM_FIRST_PAGE) % FSM_GROUP_PAGES(storage) == 0;
+}
+
+static page_num_t fsm_page_for(Storage *storage, page_num_t page, uint32_t *index) {
+    page_num_t group = (page - FSM_FIRST_PAGE) / FSM_GROUP_PAGES(storage);
+    page_num_t fsm_page = FSM_FIRST_PAGE + group * FSM_GROUP_PAGES(storage);
+    *index = page - fsm_page - 1;
+    return fsm_page;
+}
+
+// Free bytes are kept as a 0-255 class, rounded down so a class never overstates
+static uint8_t free_class(Storage *storage, uint32_t free_bytes) {
+    return (uint8_t)((uint64_t)free_bytes * 255 / DATA_PAGE_CAPACITY(storage));
+}
+
+static void fsm_update(Storage *storage, page_num_t page, uint32_t free_bytes) {
+    uint32_t index;
+    page_num_t fsm_page = fsm_page_for(storage, page, &index);
+
+    uint8_t *fsm = pager_get_page(storage->pager, fsm_page);
+    if (!fsm) return;
+    pager_mark_dirty(storage->pager, fsm_page);
+    fsm[index] = free_class(storage, free_bytes);
+    pager_unpin_page(storage->pager, fsm_page);
+}
+
+static void reuse_push(StorageHeader *header, page_num_t page) {
+    if (header->num_reuse >= STORAGE_REUSE_SLOTS) return;
+    for (uint32_t i = 0; i < header->num_reuse; i++) {
+        if (header->reuse[i] == page) return;
+    }
+    header->reuse[header->num_reuse++] = page;
+}
+
+// Scans one FSM page for pages with room; bounded work per call
+static void reuse_refill(Storage *storage, StorageHeader *header) {
+    page_num_t fsm_page = header->fsm_scan_page;
+    if (fsm_page >= storage->pager->num_pages) fsm_page = FSM_FIRST_PAGE;
+
+    uint8_t *fsm = pager_get_page(storage->pager, fsm_page);
+    if (!fsm) return;
+
+    uint8_t min_class = free_class(storage, REUSE_MIN_FREE(storage));
+    for (uint32_t i = 0; i < storage->page_size && header->num_reuse < STORAGE_REUSE_SLOTS; i++) {
+        page_num_t page = fsm_page + 1 + i;
+        if (page >= storage->pager->num_pages) break;
+        if (page != header->insert_page && fsm[i] >= min_class) {
+            reuse_push(header, page);
+        }
+    }
+    pager_unpin_page(storage->pager, fsm_page);
+
+    header->fsm_scan_page = fsm_page + FSM_GROUP_PAGES(storage);
+}
+
+// ==================== SLOTTED PAGES ====================
+
+static Slot *page_slots(void *page) {
+    return (Slot *)((char *)page + sizeof(DataPageHeader));
+}
+
+static void init_data_page(Storage *storage, DataPageHeader *page_header) {
+    page_header->num_slots = 0;
+    page_header->free_start = sizeof(DataPageHeader);
+    page_header->free_end = storage->page_end;
+    page_header->frag_bytes = 0;
+}
+
+// Room for a new record, counting bytes that compaction would recover
+static uint32_t page_free_bytes(const DataPageHeader *page_header) {
+    return page_header->free_end - page_header->free_start + page_header->frag_bytes;
+}
+
+static uint32_t slot_bytes(const Slot *slot) {
+    return slot->length & SLOT_LENGTH_MASK;
+}
+
+static bool slot_is_live(void *page, slot_num_t slot) {
+    DataPageHeader *page_header = (DataPageHeader *)page;
+    return slot < page_header->num_slots && page_slots(page)[slot].offset != 0;
+}
+
+// Moves all live records to the end of the page, squeezing out dead bytes
+static void compact_page(Storage *storage, void *page) {
+    DataPageHeader *page_header = (DataPageHeader *)page;
+    if (page_header->frag_bytes == 0) return;
+
+    char *copy = malloc(storage->page_size);
+    if (!copy) return;
+    memcpy(copy, page, storage->page_size);
+
+    Slot *slots = page_slots(page);
+    uint32_t end = storage->page_end;
+    for (uint32_t i = 0; i < page_header->num_slots; i++) {
+        if (slots[i].offset == 0) continue;
+        end -= slot_bytes(&slots[i]);
+        memmove((char *)page + end, copy + slots[i].offset, slot_bytes(&slots[i]));
+        slots[i].offset = end;
+    }
+
+    page_header->free_end = end;
+    page_header->frag_bytes = 0;
+    free(copy);
+}
+
+// Carves `size` bytes for `slot` out of the contiguous free area
+static DB_Result page_place_record(Storage *storage, void *page, slot_num_t slot,
+                                   const void *data, uint32_t size, uint16_t flags) {
+    DataPageHeader *page_header = (DataPageHeader *)page;
+
+    if (page_header->free_end - page_header->free_start < size) {
+        compact_page(storage, page);
+    }
+    if (page_header->free_end - page_header->free_start < size) {
+        return DB_FULL;
+    }
+
+    page_header->free_end -= size;
+    memcpy((char *)page + page_header->free_end, data, size);
+    page_slots(page)[slot].offset = page_header->free_end;
+    page_slots(page)[slot].length = size | flags;
+    return DB_SUCCESS;
+}
+
+static DB_Result page_insert(Storage *storage, void *page, const void *data, uint32_t size,
+                             uint16_t flags, slot_num_t *slot) {
+    DataPageHeader *page_header = (DataPageHeader *)page;
+    Slot *slots = page_slots(page);
+
+    // Reuse a dead slot before growing the directory
+    uint32_t index = 0;
+    while (index < page_header->num_slots && slots[index].offset != 0) {
+        index++;
+    }
+
+    uint32_t slot_cost = (index == page_header->num_slots) ? sizeof(Slot) : 0;
+    if (page_free_bytes(page_header) < size + slot_cost || index > UINT16_MAX) {
+        return DB_FULL;
+    }
+
+    if (slot_cost > 0) {
+        if (page_header->free_end - page_header->free_start < slot_cost) {
+            compact_page(storage, page);
+        }
+        page_header->num_slots++;
+        page_header->free_start += sizeof(Slot);
+        slots[index].offset = 0;
+        slots[index].length = 0;
+    }
+
+    *slot = (slot_num_t)index;
+    return page_place_record(storage, page, *slot, data, size, flags);
+}
+
+// Frees a record's bytes and trims unused slots off the end of the directory
+static uint32_t page_remove(void *page, slot_num_t slot) {
+    DataPageHeader *page_header = (DataPageHeader *)page;
+    Slot *slots = page_slots(page);
+
+    uint32_t length = slot_bytes(&slots[slot]);
+    page_header->frag_bytes += length;
+    slots[slot].offset = 0;
+    slots[slot].length = 0;
+
+    while (page_header->num_slots > 0 && slots[page_header->num_slots - 1].offset == 0) {
+        page_header->num_slots--;
+        page_header->free_start -= sizeof(Slot);
+    }
+    return length;
+}
+
+// ==================== PAGE ALLOCATION ====================
+
+static page_num_t allocate_data_page(Storage *storage) {
+    page_num_t page = pager_allocate_page(storage->pager);
+    if (page == INVALID_PAGE) return INVALID_PAGE;
+
+    // Keep FSM pages at their fixed positions; a fresh page reads as an empty map
+    if (is_fsm_page(storage, page)) {
+        page = pager_allocate_page(storage->pager);
+        if (page == INVALID_PAGE) return INVALID_PAGE;
+    }
+
+    DataPageHeader *page_header = pager_get_page(storage->pager, page);
+    if (!page_header) return INVALID_PAGE;
+    pager_mark_dirty(storage->pager, page);
+    init_data_page(storage, page_header);
+    pager_unpin_page(storage->pager, page);
+
+    fsm_update(storage, page, DATA_PAGE_CAPACITY(storage));
+    return page;
+}
+
+// Picks the page for a record of `needed` bytes in O(1): the cursor page,
+// then the most recent reuse candidate, then a freshly allocated page
+static page_num_t choose_insert_page(Storage *storage, StorageHeader *header, uint32_t needed) {
+    page_num_t cursor = header->insert_page;
+    uint32_t cursor_free = 0;
+
+    if (cursor != INVALID_PAGE) {
+        DataPageHeader *page_header = pager_get_page(storage->pager, cursor);
+        if (!page_header) return INVALID_PAGE;
+        cursor_free = page_free_bytes(page_header);
+        pager_unpin_page(storage->pager, cursor);
+        if (cursor_free >= needed) return cursor;
+    }
+
+    if (header->num_reuse == 0) {
+        reuse_refill(storage, header);
+    }
+
+    page_num_t target = INVALID_PAGE;
+    if (header->num_reuse > 0) {
+        page_num_t candidate = header->reuse[header->num_reuse - 1];
+        DataPageHeader *page_header = pager_get_page(storage->pager, candidate);
+        if (page_header) {
+            uint32_t candidate_free = page_free_bytes(page_header);
+            pager_unpin_page(storage->pager, candidate);
+            if (candidate_free >= needed) {
+                target = candidate;
+                header->num_reuse--;
+            } else if (candidate_free < REUSE_MIN_FREE(storage)) {
+                header->num_reuse--;  // Stale entry
+            }
+        }
+    }
+
+    if (target == INVALID_PAGE) {
+        target = allocate_data_page(storage);
+        if (target == INVALID_PAGE) return INVALID_PAGE;
+    }
+
+    // Remember the old cursor if it still has useful room
+    if (cursor != INVALID_PAGE && cursor_free >= REUSE_MIN_FREE(storage)) {
+        reuse_push(header, cursor);
+    }
+    header->insert_page = target;
+    return target;
+}
+
+// ==================== OVERFLOW EXTENTS ====================
+
+// Physical pages needed from `first` to cover `data_pages` pages, stepping over FSM pages
+static uint32_t extent_span(Storage *storage, page_num_t first, uint32_t data_pages) {
+    uint32_t span = 0;
+    for (uint32_t n = 0; n < data_pages; span++) {
+        if (!is_fsm_page(storage, first + span)) n++;
+    }
+    return span;
+}
+
+static uint32_t extent_data_pages(Storage *storage, const StorageExtent *extent) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < extent->span; i++) {
+        if (!is_fsm_page(storage, extent->first + i)) count++;
+    }
+    return count;
+}
+
+// First fit from the released extents, splitting off the unused tail;
+// otherwise grows the file
+static DB_Result extent_allocate(Storage *storage, StorageHeader *header,
+                                 uint32_t data_pages, StorageExtent *extent) {
+    for (uint32_t i = 0; i < header->num_free_extents; i++) {
+        StorageExtent *free_extent = &header->free_extents[i];
+        if (extent_data_pages(storage, free_extent) < data_pages) continue;
+
+        extent->first = free_extent->first;
+        extent->span = extent_span(storage, extent->first, data_pages);
+        free_extent->first += extent->span;
+        free_extent->span -= extent->span;
+        if (free_extent->span == 0) {
+            header->free_extents[i] = header->free_extents[--header->num_free_extents];
+        }
+        return DB_SUCCESS;
+    }
+
+    extent->first = storage->pager->num_pages;
+    extent->span = extent_span(storage, extent->first, data_pages);
+    // Storage never frees pages to the pager, so allocation always appends
+    for (uint32_t i = 0; i < extent->span; i++) {
+        page_num_t page = pager_allocate_page(storage->pager);
+        if (page == INVALID_PAGE) return DB_FULL;
+        if (page != extent->first + i) return DB_ERROR;
+    }
+    return DB_SUCCESS;
+}
+
+// Turns the pages of an extent into empty data pages; the FSM then offers
+// them to ordinary records
+static void extent_to_data_pages(Storage *storage, StorageExtent extent) {
+    for (uint32_t i = 0; i < extent.span; i++) {
+        page_num_t page = extent.first + i;
+        if (is_fsm_page(storage, page)) continue;
+
+        DataPageHeader *page_header = pager_get_page(storage->pager, page);
+        if (!page_header) {
+            LOG_WARN("Cannot reuse page %u of a released extent", page);
+            continue;
+        }
+        pager_mark_dirty(storage->pager, page);
+        init_data_page(storage, page_header);
+        pager_unpin_page(storage->pager, page);
+        fsm_update(storage, page, DATA_PAGE_CAPACITY(storage));
+    }
+}
+
+// Returns an extent to the free list, merging it with adjacent free extents.
+// When the list is full the smallest extent, listed or new, becomes data
+// pages, so the larger ones stay available for large values.
+static void extent_release(Storage *storage, StorageHeader *header, StorageExtent extent) {
+    uint32_t i = 0;
+    while (i < header->num_free_extents) {
+        StorageExtent *free_extent = &header->free_extents[i];
+        if (free_extent->first + free_extent->span == extent.first) {
+            extent.first = free_extent->first;
+            extent.span += free_extent->span;
+        } else if (extent.first + extent.span == free_extent->first) {
+            extent.span += free_extent->span;
+        } else {
+            i++;
+            continue;
+        }
+        header->free_extents[i] = header->free_extents[--header->num_free_extents];
+    }
+
+    if (header->num_free_extents >= STORAGE_FREE_EXTENTS) {
+        uint32_t smallest = 0;
+        for (uint32_t j = 1; j < header->num_free_extents; j++) {
+            if (header->free_extents[j].span < header->free_extents[smallest].span) smallest = j;
+        }
+        if (header->free_extents[smallest].span < extent.span) {
+            StorageExtent evicted = header->free_extents[smallest];
+            header->free_extents[smallest] = extent;
+            extent = evicted;
+        }
+        LOG_DEBUG("Free extent list full, reusing %u pages at %u as data pages",
+                  extent.span, extent.first);
+        extent_to_data_pages(storage, extent);
+        return;
+    }
+    header->free_extents[header->num_free_extents++] = extent;
+}
+
+// Moves `length` bytes between `buffer` and an extent, one vectored call per
+// run of consecutive data pages
+static DB_Result extent_io(Storage *storage, const StorageExtent *extent,
+                           void *buffer, uint64_t length, bool write) {
+    page_num_t page = extent->first;
+    page_num_t end = extent->first + extent->span;
+    uint64_t done = 0;
+
+    while (page < end && done < length) {
+        if (is_fsm_page(storage, page)) {
+            page++;
+            continue;
+        }
+        page_num_t run_end = page;
+        while (run_end < end && !is_fsm_page(storage, run_end)) run_end++;
+
+        uint64_t bytes = (uint64_t)(run_end - page) * storage->page_size;
+        if (bytes > length - done) bytes = length - done;
+        uint32_t count = (uint32_t)((bytes + storage->page_size - 1) / storage->page_size);
+
+        char *chunk = (char *)buffer + done;
+        DB_Result result = write
+            ? pager_write_run(storage->pager, page, count, chunk, bytes)
+            : pager_read_run(storage->pager, page, count, chunk, bytes);
+        if (result != DB_SUCCESS) return result;
+
+        done += bytes;
+        page = run_end;
+    }
+    return done == length ? DB_SUCCESS : DB_ERROR;
+}
+
+// Reads the OverflowRef stub of a live overflow record
+static bool read_overflow_ref(void *page_data, slot_num_t slot, OverflowRef *ref) {
+    Slot record = page_slots(page_data)[slot];
+    if (!(record.length & SLOT_OVERFLOW) || slot_bytes(&record) != sizeof(OverflowRef)) {
+        return false;
+    }
+    memcpy(ref, (char *)page_data + record.offset, sizeof(OverflowRef));
+    return true;
+}
+
+// ==================== STORAGE ====================
 
 Storage *storage_create(Pager *pager) {
     Storage *storage = malloc(sizeof(Storage));
     if (!storage) return NULL;
-    
+
     storage->pager = pager;
-    storage->next_offset = 0;
-    
+    storage->page_size = pager->page_size;
+    storage->page_end = pager->page_size <= UINT16_MAX ? pager->page_size : UINT16_MAX;
+
+    if (pager->num_pages == 0) {
+        // New data file: header page followed by the first FSM page
+        page_num_t header_page = pager_allocate_page(pager);
+        page_num_t fsm_page = pager_allocate_page(pager);
+        StorageHeader *header = pager_get_page(pager, STORAGE_HEADER_PAGE);
+        if (header_page != STORAGE_HEADER_PAGE || fsm_page != FSM_FIRST_PAGE || !header) {
+            free(storage);
+            return NULL;
+        }
+        pager_mark_dirty(pager, STORAGE_HEADER_PAGE);
+        header->magic = STORAGE_MAGIC;
+        header->version = STORAGE_VERSION;
+        header->insert_page = INVALID_PAGE;
+        header->fsm_scan_page = FSM_FIRST_PAGE;
+        header->data_size = 0;
+        header->num_reuse = 0;
+        header->num_free_extents = 0;
+        pager_unpin_page(pager, STORAGE_HEADER_PAGE);
+        return storage;
+    }
+
+    StorageHeader *header = pager_get_page(pager, STORAGE_HEADER_PAGE);
+    if (!header) {
+        free(storage);
+        return NULL;
+    }
+    bool valid = header->magic == STORAGE_MAGIC && header->version == STORAGE_VERSION;
+    pager_unpin_page(pager, STORAGE_HEADER_PAGE);
+
+    if (!valid) {
+        LOG_ERROR("Data file has no valid storage header");
+        free(storage);
+        return NULL;
+    }
+
     return storage;
 }
 
-DB_Result storage_write(Storage *storage, const void *data, size_t size, 
-                        page_num_t *page, offset_t *offset) {
-    // Use page 1 for data storage
-    *page = 1;
-    
-    void *page_data = pager_get_page(storage->pager, *page);
-    if (!page_data) return DB_ERROR;
-    
-    // Calculate sizes correctly
-    uint32_t data_with_null = size + 1;  // Size of data including null terminator
-    uint32_t total_size = sizeof(uint32_t) + data_with_null;  // Size prefix + data with null
-    
-    printf("Debug: size=%zu, data_with_null=%u, total_size=%u, next_offset=%u\n", 
-           size, data_with_null, total_size, storage->next_offset);
-    
-    // Check if we have space
-    if (storage->next_offset + total_size > PAGE_SIZE) {
-        printf("Debug: Storage full! Need %u bytes, have %u\n", 
-               total_size, PAGE_SIZE - storage->next_offset);
-        return DB_FULL;
+// Called after a page lost bytes: refresh its FSM entry and offer it for reuse
+static void page_space_freed(Storage *storage, page_num_t page, uint32_t free_bytes) {
+    fsm_update(storage, page, free_bytes);
+    if (free_bytes < REUSE_MIN_FREE(storage)) return;
+
+    StorageHeader *header = pager_get_page(storage->pager, STORAGE_HEADER_PAGE);
+    if (!header) return;
+    if (page != header->insert_page) {
+        pager_mark_dirty(storage->pager, STORAGE_HEADER_PAGE);
+        reuse_push(header, page);
     }
-    
-    // Write size prefix (this is the size INCLUDING null terminator)
-    memcpy((char *)page_data + storage->next_offset, &data_with_null, sizeof(uint32_t));
-    
-    // Write the data
-    memcpy((char *)page_data + storage->next_offset + sizeof(uint32_t), data, size);
-    
-    // Add null terminator
-    *((char *)page_data + storage->next_offset + sizeof(uint32_t) + size) = '\0';
-    
-    printf("Debug: Wrote size=%u at offset %u\n", data_with_null, storage->next_offset);
-    printf("Debug: Data starts at offset %u\n", storage->next_offset + sizeof(uint32_t));
-    
-    *offset = storage->next_offset;
-    storage->next_offset += total_size;
-    
-    return DB_SUCCESS;
+    pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+}
+
+static void adjust_data_size(Storage *storage, int64_t delta) {
+    StorageHeader *header = pager_get_page(storage->pager, STORAGE_HEADER_PAGE);
+    if (!header) return;
+    pager_mark_dirty(storage->pager, STORAGE_HEADER_PAGE);
+    header->data_size += delta;
+    pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
 }
 
-DB_Result storage_read(Storage *storage, page_num_t page, offset_t offset, 
+static bool is_data_page(Storage *storage, page_num_t page) {
+    return page != STORAGE_HEADER_PAGE && !is_fsm_page(storage, page) && page < storage->pager->num_pages;
+}
+
+DB_Result storage_write(Storage *storage, const void *data, size_t size,
+                        page_num_t *page, slot_num_t *slot) {
+    StorageHeader *header = pager_get_page(storage->pager, STORAGE_HEADER_PAGE);
+    if (!header) return DB_ERROR;
+    pager_mark_dirty(storage->pager, STORAGE_HEADER_PAGE);
+
+    // Large values live in their own extent; the record only holds a reference
+    const void *record_data = data;
+    uint32_t record_size = size;
+    uint16_t flags = 0;
+    OverflowRef ref;
+    if (size > INLINE_MAX(storage)) {
+        uint64_t data_pages = ((uint64_t)size + storage->page_size - 1) / storage->page_size;
+        DB_Result result = data_pages > UINT32_MAX / 2
+            ? DB_FULL
+            : extent_allocate(storage, header, (uint32_t)data_pages, &ref.extent);
+        if (result == DB_SUCCESS) {
+            result = extent_io(storage, &ref.extent, (void *)data, size, true);
+            if (result != DB_SUCCESS) extent_release(storage, header, ref.extent);
+        }
+        if (result != DB_SUCCESS) {
+            pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+            return result;
+        }
+        LOG_TRACE("Wrote %zu bytes to overflow extent at page %u (%u pages)",
+                  size, ref.extent.first, ref.extent.span);
+
+        ref.length = size;
+        record_data = &ref;
+        record_size = sizeof(ref);
+        flags = SLOT_OVERFLOW;
+    }
+    uint32_t needed = record_size + sizeof(Slot);
+
+    *page = choose_insert_page(storage, header, needed);
+    void *page_data = (*page == INVALID_PAGE) ? NULL : pager_get_page(storage->pager, *page);
+    if (!page_data) {
+        if (flags & SLOT_OVERFLOW) extent_release(storage, header, ref.extent);
+        pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+        return (*page == INVALID_PAGE) ? DB_FULL : DB_ERROR;
+    }
+
+    pager_mark_dirty(storage->pager, *page);
+    DB_Result result = page_insert(storage, page_data, record_data, record_size, flags, slot);
+    uint32_t free_bytes = page_free_bytes((DataPageHeader *)page_data);
+    pager_unpin_page(storage->pager, *page);
+
+    if (result == DB_SUCCESS) {
+        LOG_TRACE("Wrote %u bytes at page %u, slot %u", record_size, *page, *slot);
+        fsm_update(storage, *page, free_bytes);
+        header->data_size += size;
+    } else if (flags & SLOT_OVERFLOW) {
+        extent_release(storage, header, ref.extent);
+    }
+    pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+
+    return result;
+}
+
+DB_Result storage_write_batch(Storage *storage, uint32_t count, const void *const *data,
+                              const size_t *sizes, locator_t *locators) {
+    StorageHeader *header = pager_get_page(storage->pager, STORAGE_HEADER_PAGE);
+    if (!header) return DB_ERROR;
+    pager_mark_dirty(storage->pager, STORAGE_HEADER_PAGE);
+
+    // The insert page stays pinned while records keep fitting; its FSM entry
+    // is refreshed once when the batch moves on
+    page_num_t page = INVALID_PAGE;
+    void *page_data = NULL;
+    DB_Result result = DB_SUCCESS;
+    uint32_t written = 0;
+
+    while (written < count) {
+        size_t size = sizes[written];
+        uint32_t needed = (uint32_t)size + sizeof(Slot);
+        bool fits = page_data && size <= INLINE_MAX(storage) &&
+                    page_free_bytes((DataPageHeader *)page_data) >= needed;
+
+        if (!fits && page_data) {
+            fsm_update(storage, page, page_free_bytes((DataPageHeader *)page_data));
+            pager_unpin_page(storage->pager, page);
+            page_data = NULL;
+        }
+
+        if (size > INLINE_MAX(storage)) {
+            // Overflow values take the regular path
+            page_num_t record_page;
+            slot_num_t record_slot;
+            result = storage_write(storage, data[written], size, &record_page, &record_slot);
+            if (result != DB_SUCCESS) break;
+            locators[written++] = LOCATOR_MAKE(record_page, record_slot);
+            continue;
+        }
+
+        if (!page_data) {
+            page = choose_insert_page(storage, header, needed);
+            page_data = (page == INVALID_PAGE) ? NULL : pager_get_page(storage->pager, page);
+            if (!page_data) {
+                result = (page == INVALID_PAGE) ? DB_FULL : DB_ERROR;
+                break;
+            }
+            pager_mark_dirty(storage->pager, page);
+        }
+
+        slot_num_t slot;
+        result = page_insert(storage, page_data, data[written], (uint32_t)size, 0, &slot);
+        if (result != DB_SUCCESS) break;
+        locators[written++] = LOCATOR_MAKE(page, slot);
+        header->data_size += size;
+    }
+
+    if (page_data) {
+        fsm_update(storage, page, page_free_bytes((DataPageHeader *)page_data));
+        pager_unpin_page(storage->pager, page);
+    }
+    pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+    LOG_DEBUG("Batch wrote %u of %u records", written, count);
+
+    // All or nothing: drop the records already placed
+    if (result != DB_SUCCESS) {
+        for (uint32_t i = 0; i < written; i++) {
+            storage_delete(storage, LOCATOR_PAGE(locators[i]), LOCATOR_SLOT(locators[i]));
+        }
+    }
+    return result;
+}
+
+DB_Result storage_read(Storage *storage, page_num_t page, slot_num_t slot,
                        void *buffer, size_t *size) {
+    if (!is_data_page(storage, page)) return DB_ERROR;
+
     void *page_data = pager_get_page(storage->pager, page);
     if (!page_data) return DB_ERROR;
-    
-    // Read size prefix (this is the size INCLUDING null terminator)
-    uint32_t data_with_null;
-    memcpy(&data_with_null, (char *)page_data + offset, sizeof(uint32_t));
-    
-    printf("Debug: Read size prefix=%u at offset %u\n", data_with_null, offset);
-    
-    // Validate the size (should be reasonable)
-    if (data_with_null == 0 || data_with_null > PAGE_SIZE) {
-        printf("Debug: Invalid size %u read from offset %u\n", data_with_null, offset);
+
+    if (!slot_is_live(page_data, slot)) {
+        LOG_DEBUG("Slot %u on page %u is empty", slot, page);
+        pager_unpin_page(storage->pager, page);
+        return DB_ERROR;
+    }
+
+    Slot record = page_slots(page_data)[slot];
+    OverflowRef ref;
+    bool overflow = (record.length & SLOT_OVERFLOW) != 0;
+    if (overflow && !read_overflow_ref(page_data, slot, &ref)) {
+        LOG_ERROR("Slot %u on page %u has a damaged overflow reference", slot, page);
+        pager_unpin_page(storage->pager, page);
         return DB_ERROR;
     }
-    
-    // Calculate actual data size (without null terminator)
-    uint32_t data_size = data_with_null - 1;
-    
-    printf("Debug: Data size without null=%u\n", data_size);
-    
+    uint64_t data_size = overflow ? ref.length : slot_bytes(&record);
+
+    LOG_TRACE("Read slot %u on page %u: offset=%u, size=%llu",
+              slot, page, record.offset, (unsigned long long)data_size);
+
     // Check if buffer is large enough
     if (*size < data_size) {
         *size = data_size;
-        printf("Debug: Buffer too small, need %u bytes\n", data_size);
+        LOG_TRACE("Buffer too small, need %llu bytes", (unsigned long long)data_size);
+        pager_unpin_page(storage->pager, page);
         return DB_ERROR;
     }
-    
-    // Read the data (excluding null terminator for now)
-    memcpy(buffer, (char *)page_data + offset + sizeof(uint32_t), data_size);
-    
-    // Add null terminator
-    ((char *)buffer)[data_size] = '\0';
-    
+
+    if (overflow) {
+        // The stub is copied out, so the data page need not stay pinned
+        pager_unpin_page(storage->pager, page);
+        DB_Result result = extent_io(storage, &ref.extent, buffer, data_size, false);
+        if (result != DB_SUCCESS) return result;
+    } else {
+        memcpy(buffer, (char *)page_data + record.offset, data_size);
+        pager_unpin_page(storage->pager, page);
+    }
+
+    // Null-terminate when there is room, for callers storing strings
+    if (*size > data_size) {
+        ((char *)buffer)[data_size] = '\0';
+    }
+
     *size = data_size;
-    
-    printf("Debug: Successfully read %u bytes: '%s'\n", data_size, (char *)buffer);
-    
+
+    LOG_TRACE("Successfully read %llu bytes", (unsigned long long)data_size);
+
     return DB_SUCCESS;
 }
 
-// Add this function to storage.c
-DB_Result storage_delete(Storage *storage, page_num_t page, offset_t offset) {
+DB_Result storage_view(Storage *storage, page_num_t page, slot_num_t slot,
+                       const void **data, size_t *size) {
+    if (!is_data_page(storage, page)) return DB_ERROR;
+
+    void *page_data = pager_get_page(storage->pager, page);
+    if (!page_data) return DB_ERROR;
+
+    if (!slot_is_live(page_data, slot)) {
+        LOG_DEBUG("Slot %u on page %u is empty", slot, page);
+        pager_unpin_page(storage->pager, page);
+        return DB_ERROR;
+    }
+
+    Slot record = page_slots(page_data)[slot];
+    if (record.length & SLOT_OVERFLOW) {
+        OverflowRef ref;
+        bool valid = read_overflow_ref(page_data, slot, &ref);
+        pager_unpin_page(storage->pager, page);
+        if (!valid) {
+            LOG_ERROR("Slot %u on page %u has a damaged overflow reference", slot, page);
+            return DB_ERROR;
+        }
+        *data = NULL;
+        *size = ref.length;
+        return DB_SUCCESS;
+    }
+
+    // The page stays pinned for the caller
+    *data = (const char *)page_data + record.offset;
+    *size = slot_bytes(&record);
+    return DB_SUCCESS;
+}
+
+DB_Result storage_update(Storage *storage, page_num_t page, slot_num_t slot,
+                         const void *data, size_t size) {
+    if (!is_data_page(storage, page)) return DB_ERROR;
+    if (size > INLINE_MAX(storage)) return DB_FULL;
+
+    void *page_data = pager_get_page(storage->pager, page);
+    if (!page_data) return DB_ERROR;
+
+    if (!slot_is_live(page_data, slot)) {
+        pager_unpin_page(storage->pager, page);
+        return DB_ERROR;
+    }
+
+    DataPageHeader *page_header = (DataPageHeader *)page_data;
+    Slot *record = &page_slots(page_data)[slot];
+    uint32_t old_size = record->length;
+
+    // Overflow records are rewritten by the caller as a new record
+    if (record->length & SLOT_OVERFLOW) {
+        pager_unpin_page(storage->pager, page);
+        return DB_FULL;
+    }
+
+    if (size <= old_size) {
+        // Shrink in place; the tail becomes reclaimable
+        pager_mark_dirty(storage->pager, page);
+        memcpy((char *)page_data + record->offset, data, size);
+        record->length = size;
+        page_header->frag_bytes += old_size - size;
+    } else if (page_free_bytes(page_header) + old_size >= size) {
+        // Grow within the page: drop the old bytes, then place the new copy
+        pager_mark_dirty(storage->pager, page);
+        page_header->frag_bytes += old_size;
+        record->offset = 0;
+        record->length = 0;
+        if (page_place_record(storage, page_data, slot, data, size, 0) != DB_SUCCESS) {
+            pager_unpin_page(storage->pager, page);
+            return DB_ERROR;
+        }
+    } else {
+        pager_unpin_page(storage->pager, page);
+        return DB_FULL;
+    }
+
+    uint32_t free_bytes = page_free_bytes(page_header);
+    pager_unpin_page(storage->pager, page);
+
+    if (size < old_size) {
+        page_space_freed(storage, page, free_bytes);
+    } else {
+        fsm_update(storage, page, free_bytes);
+    }
+    adjust_data_size(storage, (int64_t)size - (int64_t)old_size);
+
+    return DB_SUCCESS;
+}
+
+DB_Result storage_delete(Storage *storage, page_num_t page, slot_num_t slot) {
     if (!storage || !storage->pager) return DB_ERROR;
-    
+    if (!is_data_page(storage, page)) return DB_ERROR;
+
     void *page_data = pager_get_page(storage->pager, page);
     if (!page_data) return DB_ERROR;
-    
-    // Read the size of the record (stored before the data)
-    uint32_t size;
-    memcpy(&size, (char *)page_data + offset, sizeof(uint32_t));
-    
-    // Add to free list (mark as available for reuse)
-    // For simplicity, we'll just zero out the first few bytes to mark as deleted
-    // A real implementation would maintain a proper free list
-    uint32_t deleted_marker = 0xDEADBEEF;
-    memcpy((char *)page_data + offset, &deleted_marker, sizeof(uint32_t));
-    
+
+    if (!slot_is_live(page_data, slot)) {
+        pager_unpin_page(storage->pager, page);
+        return DB_NOT_FOUND;
+    }
+
+    OverflowRef ref;
+    bool overflow = read_overflow_ref(page_data, slot, &ref);
+
+    pager_mark_dirty(storage->pager, page);
+    uint64_t size = page_remove(page_data, slot);
+    uint32_t free_bytes = page_free_bytes((DataPageHeader *)page_data);
+    pager_unpin_page(storage->pager, page);
+
+    if (overflow) {
+        StorageHeader *header = pager_get_page(storage->pager, STORAGE_HEADER_PAGE);
+        if (header) {
+            pager_mark_dirty(storage->pager, STORAGE_HEADER_PAGE);
+            extent_release(storage, header, ref.extent);
+            pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+        }
+        size = ref.length;
+    }
+
+    page_space_freed(storage, page, free_bytes);
+    adjust_data_size(storage, -(int64_t)size);
+
     return DB_SUCCESS;
-}
\ No newline at end of file
+}
+
+uint64_t storage_data_size(Storage *storage) {
+    StorageHeader *header = pager_get_page(storage->pager, STORAGE_HEADER_PAGE);
+    if (!header) return 0;
+
+    uint64_t data_size = header->data_size;
+    pager_unpin_page(storage->pager, STORAGE_HEADER_PAGE);
+    return data_size;
+}
@@ -4,14 +4,87 @@
 #include "constants.h"
 #include "pager.h"
 
+// Data file layout:
+//   page 0            StorageHeader
+//   page 1            free-space map (FSM) page for the next page_size pages
+//   pages 2..         data pages, with another FSM page every page_size + 1 pages
+// An FSM page holds one byte of free-space class per data page.
+#define STORAGE_MAGIC 0x444B5453        // "STKD"
+#define STORAGE_VERSION 5
+#define STORAGE_HEADER_PAGE 0
+#define STORAGE_REUSE_SLOTS 64
+#define STORAGE_FREE_EXTENTS 32
+
+// A run of pages holding one overflow value. FSM pages that fall inside the
+// run keep their role and are skipped, so span >= number of data pages.
+typedef struct {
+    page_num_t first;
+    uint32_t span;
+} StorageExtent;
+
+typedef struct {
+    PagerHeader pager_header;   // Unused: data pages are managed by the FSM and extents
+    uint32_t magic;
+    uint32_t version;
+    page_num_t insert_page;     // Allocation cursor: page that receives new records
+    page_num_t fsm_scan_page;   // Next FSM page to scan when refilling reuse[]
+    uint64_t data_size;         // Bytes of live record data
+    uint32_t num_reuse;
+    page_num_t reuse[STORAGE_REUSE_SLOTS];  // Stack of pages known to have room
+    uint32_t num_free_extents;
+    StorageExtent free_extents[STORAGE_FREE_EXTENTS];  // Released overflow extents; see extent_release
+} StorageHeader;
+
+// Data pages are slotted: the slot directory follows this header and
+// records are packed from the end of the page towards it
+typedef struct {
+    uint32_t num_slots;
+    uint32_t free_start;        // End of the slot directory
+    uint32_t free_end;          // Start of the record area
+    uint32_t frag_bytes;        // Dead record bytes inside the record area
+} DataPageHeader;
+
+#define SLOT_OVERFLOW 0x8000    // Slot length flag: the record is an OverflowRef
+#define SLOT_LENGTH_MASK 0x7FFF
+
+typedef struct {
+    uint16_t offset;            // 0 = unused slot
+    uint16_t length;            // Record bytes, plus SLOT_OVERFLOW for large values
+} Slot;
+
+// Inline stub left in the data page for a value stored in an overflow extent
+typedef struct {
+    uint64_t length;            // Value size in bytes
+    StorageExtent extent;
+} OverflowRef;
+
+// Locators pack a 48-bit data page number above a 16-bit slot
+#define LOCATOR_PAGE_BITS 48
+#define LOCATOR_MAKE(page, slot) (((locator_t)(page) << 16) | (slot_num_t)(slot))
+#define LOCATOR_PAGE(locator) ((page_num_t)((locator) >> 16))
+#define LOCATOR_SLOT(locator) ((slot_num_t)((locator) & 0xFFFF))
+
 typedef struct {
     Pager *pager;
-    offset_t next_offset;
+    uint32_t page_size;
+    uint32_t page_end;          // End of the record area; slot offsets are 16-bit
 } Storage;
 
 Storage *storage_create(Pager *pager);
-DB_Result storage_write(Storage *storage, const void *data, size_t size, page_num_t *page, offset_t *offset);
-DB_Result storage_read(Storage *storage, page_num_t page, offset_t offset, void *buffer, size_t *size);
-DB_Result storage_delete(Storage *storage, page_num_t page, offset_t offset);
+DB_Result storage_write(Storage *storage, const void *data, size_t size, page_num_t *page, slot_num_t *slot);
+// Writes count records, filling one data page before moving to the next.
+// Either every record is written or none is.
+DB_Result storage_write_batch(Storage *storage, uint32_t count, const void *const *data,
+                              const size_t *sizes, locator_t *locators);
+DB_Result storage_read(Storage *storage, page_num_t page, slot_num_t slot, void *buffer, size_t *size);
+// Points *data at a record inside its data page and leaves the page pinned
+// for the caller to unpin. A value in an overflow extent is not contiguous
+// in memory: *data is then NULL, *size its length, and nothing stays pinned.
+DB_Result storage_view(Storage *storage, page_num_t page, slot_num_t slot,
+                       const void **data, size_t *size);
+// Rewrites a record keeping its locator; DB_FULL if it no longer fits its page
+DB_Result storage_update(Storage *storage, page_num_t page, slot_num_t slot, const void *data, size_t size);
+DB_Result storage_delete(Storage *storage, page_num_t page, slot_num_t slot);
+uint64_t storage_data_size(Storage *storage);
 
-#endif
\ No newline at end of file
+#endif
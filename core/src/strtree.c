@@ -0,0 +1,846 @@
+#include "strtree.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A search key with its slot prefix worked out once
+typedef struct {
+    const uint8_t *data;
+    uint32_t size;
+    uint32_t prefix;
+} StrKey;
+
+// An internal node passed on the way down and the child taken there
+typedef struct {
+    page_num_t page;
+    uint32_t index;
+} PathEntry;
+
+static uint32_t key_prefix(const uint8_t *key, uint32_t size) {
+    uint32_t prefix = 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        prefix = (prefix << 8) | (i < size ? key[i] : 0);
+    }
+    return prefix;
+}
+
+static StrKey make_key(const void *data, uint32_t size) {
+    StrKey key = { data, size, key_prefix(data, size) };
+    return key;
+}
+
+static int compare_bytes(const uint8_t *a, uint32_t a_size, const uint8_t *b, uint32_t b_size) {
+    int order = memcmp(a, b, a_size < b_size ? a_size : b_size);
+    if (order != 0) return order;
+    return a_size < b_size ? -1 : (a_size > b_size);
+}
+
+static uint8_t *slot_cell(StrNode *node, const StrSlot *slot) {
+    return (uint8_t *)node + slot->offset;
+}
+
+static bool is_leaf(const StrNode *node) {
+    return node->header.type == NODE_LEAF;
+}
+
+static uint32_t payload_size(const StrNode *node) {
+    return is_leaf(node) ? sizeof(LeafValue) : sizeof(page_num_t);
+}
+
+static uint8_t *node_prefix(StrTree *tree, StrNode *node) {
+    return (uint8_t *)node + tree->pager->page_size - node->prefix_size;
+}
+
+// ==================== SEARCH ====================
+
+// Orders a slot's suffix against a search suffix. Equal prefixes settle it
+// when both fit in the prefix; only then is the cell read.
+static int compare_slot(StrNode *node, const StrSlot *slot, const StrKey *key) {
+    if (slot->prefix != key->prefix) return slot->prefix < key->prefix ? -1 : 1;
+    if (slot->suffix_size <= 4 && key->size <= 4) {
+        return slot->suffix_size < key->size ? -1 : (slot->suffix_size > key->size);
+    }
+    return compare_bytes(slot_cell(node, slot), slot->suffix_size, key->data, key->size);
+}
+
+// First slot whose key is >= key, or > key for the upper bound; *found is
+// set when the key itself is there. The key is checked against the node
+// prefix once, and the binary search then runs on suffixes alone.
+static uint32_t node_search(StrTree *tree, StrNode *node, const StrKey *key, bool upper, bool *found) {
+    *found = false;
+    StrKey suffix = *key;
+    uint32_t prefix_size = node->prefix_size;
+    if (prefix_size > 0) {
+        uint32_t common = key->size < prefix_size ? key->size : prefix_size;
+        int order = memcmp(key->data, node_prefix(tree, node), common);
+        // A key that is a proper prefix of the node prefix sorts before it
+        if (order < 0 || (order == 0 && key->size < prefix_size)) return 0;
+        if (order > 0) return node->num_cells;
+        suffix = make_key(key->data + prefix_size, key->size - prefix_size);
+    }
+
+    uint32_t low = 0;
+    uint32_t high = node->num_cells;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        int order = compare_slot(node, &node->slots[mid], &suffix);
+        if (order == 0) *found = true;
+        if (order < 0 || (upper && order == 0)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Child `index` of an internal node: first_child, then the child of each cell
+static page_num_t node_child(StrNode *node, uint32_t index) {
+    if (index == 0) return node->first_child;
+    const StrSlot *slot = &node->slots[index - 1];
+    page_num_t child;
+    memcpy(&child, slot_cell(node, slot) + slot->suffix_size, sizeof(child));
+    return child;
+}
+
+static LeafValue cell_value(StrNode *node, uint32_t index) {
+    const StrSlot *slot = &node->slots[index];
+    LeafValue value;
+    memcpy(&value, slot_cell(node, slot) + slot->suffix_size, sizeof(value));
+    return value;
+}
+
+// Decodes the full key of slot `index`: the node prefix, then the suffix
+static uint32_t read_key(StrTree *tree, StrNode *node, uint32_t index, uint8_t *key) {
+    const StrSlot *slot = &node->slots[index];
+    memcpy(key, node_prefix(tree, node), node->prefix_size);
+    memcpy(key + node->prefix_size, slot_cell(node, slot), slot->suffix_size);
+    return node->prefix_size + slot->suffix_size;
+}
+
+// ==================== CELLS ====================
+
+static uint32_t cell_key_size(const StrCell *cell) {
+    return cell->head_size + cell->tail_size;
+}
+
+static uint8_t cell_byte(const StrCell *cell, uint32_t index) {
+    return index < cell->head_size ? cell->head[index] : cell->tail[index - cell->head_size];
+}
+
+// Copies key bytes [from, from + size) of a cell
+static void cell_read(const StrCell *cell, uint32_t from, uint32_t size, uint8_t *dest) {
+    for (uint32_t end = from + size; from < end;) {
+        if (from < cell->head_size) {
+            uint32_t take = (end < cell->head_size ? end : cell->head_size) - from;
+            memcpy(dest, cell->head + from, take);
+            dest += take;
+            from += take;
+        } else {
+            memcpy(dest, cell->tail + (from - cell->head_size), end - from);
+            break;
+        }
+    }
+}
+
+// Length of the prefix two cells' keys share
+static uint32_t cells_common(const StrCell *a, const StrCell *b) {
+    uint32_t limit = cell_key_size(a) < cell_key_size(b) ? cell_key_size(a) : cell_key_size(b);
+    uint32_t common = 0;
+    while (common < limit && cell_byte(a, common) == cell_byte(b, common)) common++;
+    return common;
+}
+
+// The prefix a node holding these sorted cells stores once: what the first
+// and last keys share, which every key between them shares too
+static uint32_t cells_prefix(const StrCell *cells, uint32_t count) {
+    return count > 1 ? cells_common(&cells[0], &cells[count - 1]) : 0;
+}
+
+// Bytes of a node holding these cells, with key_bytes their total key size
+static uint32_t cells_size(const StrCell *cells, uint32_t count, uint32_t key_bytes, uint32_t payload) {
+    uint32_t prefix = cells_prefix(cells, count);
+    return prefix + count * (uint32_t)(sizeof(StrSlot) + payload) + key_bytes - count * prefix;
+}
+
+// Bytes of slots and cells in use, the node prefix included
+static uint32_t node_used(StrTree *tree, const StrNode *node) {
+    uint32_t cells = tree->pager->page_size - node->cell_start - node->garbage;
+    return node->num_cells * (uint32_t)sizeof(StrSlot) + cells;
+}
+
+static void initialize_node(StrTree *tree, void *page, NodeType type) {
+    StrNode *node = page;
+    node->header.format = STRTREE_FORMAT_VERSION;
+    node->header.type = type;
+    node->header.is_root = 0;
+    node->num_cells = 0;
+    node->cell_start = tree->pager->page_size;
+    node->garbage = 0;
+    node->prefix_size = 0;
+    node->prev_leaf = INVALID_PAGE;
+    node->next_leaf = INVALID_PAGE;
+    node->first_child = INVALID_PAGE;
+}
+
+// Writes a cell's suffix below the others and points slot `index` at it.
+// The caller has made room and checked the key starts with the node
+// prefix; the key must not point into this node.
+static void place_cell(StrNode *node, uint32_t index, const StrCell *cell) {
+    uint32_t payload = payload_size(node);
+    uint32_t suffix_size = cell_key_size(cell) - node->prefix_size;
+    node->cell_start -= suffix_size + payload;
+    uint8_t *dest = (uint8_t *)node + node->cell_start;
+    cell_read(cell, node->prefix_size, suffix_size, dest);
+    if (is_leaf(node)) {
+        memcpy(dest + suffix_size, &cell->value, payload);
+    } else {
+        memcpy(dest + suffix_size, &cell->child, payload);
+    }
+
+    StrSlot *slot = &node->slots[index];
+    slot->prefix = key_prefix(dest, suffix_size);
+    slot->offset = (uint16_t)node->cell_start;
+    slot->suffix_size = (uint16_t)suffix_size;
+}
+
+// Rewrites a node to hold exactly these cells, in order, under the longest
+// prefix they share
+static void fill_node(StrTree *tree, StrNode *node, const StrCell *cells, uint32_t count) {
+    uint32_t page_size = tree->pager->page_size;
+    node->prefix_size = cells_prefix(cells, count);
+    if (count > 0) cell_read(&cells[0], 0, node->prefix_size, node_prefix(tree, node));
+    node->cell_start = page_size - node->prefix_size;
+    node->garbage = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        place_cell(node, i, &cells[i]);
+    }
+    node->num_cells = count;
+}
+
+// Lists the cells of a node, with key_bytes their total key size; the keys
+// point into it
+static uint32_t collect_cells(StrTree *tree, StrNode *node, StrCell *cells, uint32_t *key_bytes) {
+    const uint8_t *prefix = node_prefix(tree, node);
+    for (uint32_t i = 0; i < node->num_cells; i++) {
+        const StrSlot *slot = &node->slots[i];
+        cells[i].head = prefix;
+        cells[i].head_size = node->prefix_size;
+        cells[i].tail = slot_cell(node, slot);
+        cells[i].tail_size = slot->suffix_size;
+        if (is_leaf(node)) {
+            cells[i].value = cell_value(node, i);
+        } else {
+            cells[i].child = node_child(node, i + 1);
+        }
+        if (key_bytes) *key_bytes += node->prefix_size + slot->suffix_size;
+    }
+    return node->num_cells;
+}
+
+static StrNode *scratch_node(StrTree *tree, int index) {
+    return (StrNode *)((char *)tree->scratch + (size_t)index * tree->pager->page_size);
+}
+
+// Packs the cells against the node prefix, reclaiming removed ones
+static void compact_node(StrTree *tree, StrNode *node) {
+    StrNode *copy = scratch_node(tree, 2);
+    memcpy(copy, node, tree->pager->page_size);
+
+    uint32_t payload = payload_size(node);
+    node->cell_start = tree->pager->page_size - node->prefix_size;
+    node->garbage = 0;
+    for (uint32_t i = 0; i < node->num_cells; i++) {
+        StrSlot *slot = &node->slots[i];
+        uint32_t size = slot->suffix_size + payload;
+        node->cell_start -= size;
+        memcpy((uint8_t *)node + node->cell_start, slot_cell(copy, &copy->slots[i]), size);
+        slot->offset = (uint16_t)node->cell_start;
+    }
+}
+
+// Adds a cell at slot `index`, compacting first if the free space is
+// scattered. A key without the node prefix rebuilds the node around the
+// prefix it does share. DB_FULL if the node cannot hold it.
+static DB_Result node_insert_cell(StrTree *tree, StrNode *node, uint32_t index, const StrCell *cell) {
+    uint32_t prefix_size = node->prefix_size;
+    uint32_t key_size = cell_key_size(cell);
+    bool shares_prefix = key_size >= prefix_size;
+    for (uint32_t i = 0; shares_prefix && i < prefix_size; i++) {
+        shares_prefix = cell_byte(cell, i) == node_prefix(tree, node)[i];
+    }
+
+    if (!shares_prefix) {
+        StrNode *copy = scratch_node(tree, 2);
+        memcpy(copy, node, tree->pager->page_size);
+        StrCell *cells = tree->cells;
+        uint32_t key_bytes = key_size;
+        uint32_t count = collect_cells(tree, copy, cells, &key_bytes);
+        memmove(&cells[index + 1], &cells[index], (count - index) * sizeof(StrCell));
+        cells[index] = *cell;
+        count++;
+        if (cells_size(cells, count, key_bytes, payload_size(node)) > tree->capacity) return DB_FULL;
+        fill_node(tree, node, cells, count);
+        return DB_SUCCESS;
+    }
+
+    uint32_t cost = sizeof(StrSlot) + key_size - prefix_size + payload_size(node);
+    if (node_used(tree, node) + cost > tree->capacity) return DB_FULL;
+
+    uint32_t slots_end = sizeof(StrNode) + node->num_cells * sizeof(StrSlot);
+    if (node->cell_start - slots_end < cost) compact_node(tree, node);
+
+    memmove(&node->slots[index + 1], &node->slots[index],
+            (node->num_cells - index) * sizeof(StrSlot));
+    place_cell(node, index, cell);
+    node->num_cells++;
+    return DB_SUCCESS;
+}
+
+// Drops slot `index`; its cell space is reclaimed by the next compaction
+static void node_remove_cell(StrTree *tree, StrNode *node, uint32_t index) {
+    node->garbage += node->slots[index].suffix_size + payload_size(node);
+    memmove(&node->slots[index], &node->slots[index + 1],
+            (node->num_cells - index - 1) * sizeof(StrSlot));
+    node->num_cells--;
+    if (node->num_cells == 0) {
+        node->prefix_size = 0;
+        node->cell_start = tree->pager->page_size;
+        node->garbage = 0;
+    }
+}
+
+// ==================== TREE ====================
+
+// Writes the cached root, height and key count back to the meta page
+static DB_Result write_meta(StrTree *tree) {
+    BTreeMeta *meta = pager_get_page(tree->pager, BTREE_META_PAGE);
+    if (!meta) return DB_ERROR;
+    pager_mark_dirty(tree->pager, BTREE_META_PAGE);
+    meta->string_root = tree->root_page_num == INVALID_PAGE ? 0 : tree->root_page_num;
+    meta->string_height = tree->height;
+    meta->string_keys = tree->num_keys;
+    pager_unpin_page(tree->pager, BTREE_META_PAGE);
+    return DB_SUCCESS;
+}
+
+static DB_Result load_meta(StrTree *tree) {
+    BTreeMeta *meta = pager_get_page(tree->pager, BTREE_META_PAGE);
+    if (!meta) return DB_ERROR;
+
+    // Page 0 is the meta page, so no root is ever there
+    bool valid = meta->string_root < tree->pager->num_pages;
+    if (valid) {
+        tree->root_page_num = meta->string_root == 0 ? INVALID_PAGE : meta->string_root;
+        tree->height = meta->string_height;
+        tree->num_keys = meta->string_keys;
+    } else {
+        LOG_ERROR("String index root %u is past the end of the file", meta->string_root);
+    }
+    pager_unpin_page(tree->pager, BTREE_META_PAGE);
+
+    if (valid && tree->root_page_num != INVALID_PAGE) {
+        StrNode *root = pager_get_page(tree->pager, tree->root_page_num);
+        if (!root) return DB_ERROR;
+        valid = root->header.format == STRTREE_FORMAT_VERSION;
+        if (!valid) {
+            LOG_ERROR("String index has format %u, expected %u",
+                      root->header.format, STRTREE_FORMAT_VERSION);
+        }
+        pager_unpin_page(tree->pager, tree->root_page_num);
+    }
+    return valid ? DB_SUCCESS : DB_ERROR;
+}
+
+StrTree *strtree_create(Pager *pager) {
+    StrTree *tree = calloc(1, sizeof(StrTree));
+    if (!tree) return NULL;
+
+    tree->pager = pager;
+    tree->capacity = pager->page_size - sizeof(StrNode);
+    tree->min_fill = tree->capacity / 2;
+
+    // Two nodes' cells at the smallest cell size, the separator between
+    // them and one cell being added
+    uint32_t max_cells = tree->capacity / (sizeof(StrSlot) + sizeof(page_num_t));
+    tree->cells = malloc((2 * (size_t)max_cells + 2) * sizeof(StrCell));
+    tree->scratch = malloc(3 * (size_t)pager->page_size);
+    if (!tree->cells || !tree->scratch || load_meta(tree) != DB_SUCCESS) {
+        strtree_destroy(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+DB_Result strtree_reload(StrTree *tree) {
+    tree->mod_count++;
+    return load_meta(tree);
+}
+
+void strtree_destroy(StrTree *tree) {
+    if (!tree) return;
+    free(tree->cells);
+    free(tree->scratch);
+    free(tree);
+}
+
+static DB_Result create_root(StrTree *tree) {
+    page_num_t root_page = pager_allocate_page(tree->pager);
+    if (root_page == INVALID_PAGE) return DB_FULL;
+    StrNode *root = pager_get_page(tree->pager, root_page);
+    if (!root) return DB_ERROR;
+    pager_mark_dirty(tree->pager, root_page);
+    initialize_node(tree, root, NODE_LEAF);
+    root->header.is_root = 1;
+    pager_unpin_page(tree->pager, root_page);
+
+    tree->root_page_num = root_page;
+    tree->height = 1;
+    tree->num_keys = 0;
+    return DB_SUCCESS;
+}
+
+// Walks from the root to the leaf covering key (the first leaf for NULL),
+// recording each internal node passed in path when one is given. Returns
+// the leaf pinned.
+static StrNode *descend(StrTree *tree, const StrKey *key, PathEntry *path, int *depth,
+                        page_num_t *leaf_page) {
+    page_num_t current = tree->root_page_num;
+    StrNode *node = pager_get_page(tree->pager, current);
+    if (depth) *depth = 0;
+
+    while (node && !is_leaf(node)) {
+        bool found;
+        uint32_t index = key ? node_search(tree, node, key, true, &found) : 0;
+        page_num_t child = node_child(node, index);
+        pager_unpin_page(tree->pager, current);
+        if (path) {
+            if (*depth == BTREE_MAX_DEPTH) return NULL;
+            path[*depth].page = current;
+            path[*depth].index = index;
+            (*depth)++;
+        }
+        current = child;
+        node = pager_get_page(tree->pager, current);
+    }
+    *leaf_page = current;
+    return node;
+}
+
+DB_Result strtree_find(StrTree *tree, const void *key, uint32_t key_size, LeafValue *value) {
+    if (key_size > STRTREE_MAX_KEY || tree->root_page_num == INVALID_PAGE) return DB_NOT_FOUND;
+
+    StrKey search = make_key(key, key_size);
+    page_num_t leaf_page;
+    StrNode *leaf = descend(tree, &search, NULL, NULL, &leaf_page);
+    if (!leaf) return DB_ERROR;
+
+    bool found;
+    uint32_t index = node_search(tree, leaf, &search, false, &found);
+    if (found) *value = cell_value(leaf, index);
+    pager_unpin_page(tree->pager, leaf_page);
+    return found ? DB_SUCCESS : DB_NOT_FOUND;
+}
+
+// ==================== INSERT ====================
+
+// Picks where a split divides cells: the point that balances the two
+// halves' bytes best among those where both fit a node. Internal nodes
+// move the cell at the split point up, so each half keeps at least one.
+// Every half is measured under its own prefix, since a key that broke the
+// node prefix may need a split that leaves it nearly alone.
+static uint32_t choose_split(StrTree *tree, const StrCell *cells, uint32_t count,
+                             uint32_t key_bytes, bool leaf) {
+    uint32_t payload = leaf ? sizeof(LeafValue) : sizeof(page_num_t);
+    uint32_t first = 1;
+    uint32_t last = leaf ? count - 1 : count - 2;
+    uint32_t best = count / 2;
+    uint32_t best_gap = UINT32_MAX;
+    uint32_t lower_bytes = 0;
+    for (uint32_t i = 0; i < first; i++) lower_bytes += cell_key_size(&cells[i]);
+
+    for (uint32_t split = first; split <= last; split++) {
+        uint32_t upper_start = leaf ? split : split + 1;
+        uint32_t upper_bytes = key_bytes - lower_bytes - (leaf ? 0 : cell_key_size(&cells[split]));
+        uint32_t lower = cells_size(cells, split, lower_bytes, payload);
+        uint32_t upper = cells_size(cells + upper_start, count - upper_start, upper_bytes, payload);
+        uint32_t gap = lower > upper ? lower - upper : upper - lower;
+        if (lower <= tree->capacity && upper <= tree->capacity && gap < best_gap) {
+            best = split;
+            best_gap = gap;
+        }
+        lower_bytes += cell_key_size(&cells[split]);
+    }
+    return best;
+}
+
+// Splits a node that has no room for `cell` at slot `index`. The lower
+// cells stay, the upper ones move to a new right sibling. The key dividing
+// them goes to separator, and its size to *separator_size. Leaves divide at
+// the shortest key above the lower half, since nothing between it and the
+// upper half's first key exists.
+static DB_Result split_node(StrTree *tree, page_num_t page_num, StrNode *node,
+                            uint32_t index, const StrCell *cell,
+                            uint8_t *separator, uint32_t *separator_size, page_num_t *sibling_page) {
+    *sibling_page = pager_allocate_page(tree->pager);
+    if (*sibling_page == INVALID_PAGE) return DB_FULL;
+    StrNode *sibling = pager_get_page(tree->pager, *sibling_page);
+    if (!sibling) return DB_ERROR;
+    pager_mark_dirty(tree->pager, *sibling_page);
+    initialize_node(tree, sibling, node->header.type);
+
+    StrNode *copy = scratch_node(tree, 0);
+    memcpy(copy, node, tree->pager->page_size);
+    StrCell *cells = tree->cells;
+    uint32_t key_bytes = cell_key_size(cell);
+    uint32_t count = collect_cells(tree, copy, cells, &key_bytes);
+    memmove(&cells[index + 1], &cells[index], (count - index) * sizeof(StrCell));
+    cells[index] = *cell;
+    count++;
+
+    uint32_t split = choose_split(tree, cells, count, key_bytes, is_leaf(node));
+    *separator_size = cell_key_size(&cells[split]);
+    if (is_leaf(node)) *separator_size = cells_common(&cells[split - 1], &cells[split]) + 1;
+    cell_read(&cells[split], 0, *separator_size, separator);
+
+    fill_node(tree, node, cells, split);
+    if (is_leaf(node)) {
+        fill_node(tree, sibling, cells + split, count - split);
+        sibling->prev_leaf = page_num;
+        sibling->next_leaf = node->next_leaf;
+        node->next_leaf = *sibling_page;
+        if (sibling->next_leaf != INVALID_PAGE) {
+            StrNode *after = pager_get_page(tree->pager, sibling->next_leaf);
+            if (!after) {
+                pager_unpin_page(tree->pager, *sibling_page);
+                return DB_ERROR;
+            }
+            pager_mark_dirty(tree->pager, sibling->next_leaf);
+            after->prev_leaf = *sibling_page;
+            pager_unpin_page(tree->pager, sibling->next_leaf);
+        }
+    } else {
+        sibling->first_child = cells[split].child;
+        fill_node(tree, sibling, cells + split + 1, count - split - 1);
+    }
+    pager_unpin_page(tree->pager, *sibling_page);
+
+    LOG_DEBUG("Split string index page %u, new sibling %u", page_num, *sibling_page);
+    return DB_SUCCESS;
+}
+
+// Replaces a split root: the old root becomes the left child of a new one
+static DB_Result grow_root(StrTree *tree, StrNode *old_root, const StrCell *separator) {
+    page_num_t root_page = pager_allocate_page(tree->pager);
+    if (root_page == INVALID_PAGE) return DB_FULL;
+    StrNode *root = pager_get_page(tree->pager, root_page);
+    if (!root) return DB_ERROR;
+    pager_mark_dirty(tree->pager, root_page);
+    initialize_node(tree, root, NODE_INTERNAL);
+    root->header.is_root = 1;
+    root->first_child = tree->root_page_num;
+    fill_node(tree, root, separator, 1);
+    pager_unpin_page(tree->pager, root_page);
+
+    old_root->header.is_root = 0;
+    tree->root_page_num = root_page;
+    tree->height++;
+    LOG_DEBUG("New string index root page %u, height %u", root_page, tree->height);
+    return DB_SUCCESS;
+}
+
+// Adds a cell to a pinned, dirty node, splitting it and the nodes above it
+// as needed. path[0..depth) holds the internal nodes above it.
+static DB_Result add_cell(StrTree *tree, const PathEntry *path, int depth,
+                          page_num_t page_num, StrNode *node, uint32_t index, const StrCell *cell) {
+    DB_Result result = node_insert_cell(tree, node, index, cell);
+    if (result != DB_FULL) return result;
+
+    uint8_t key[STRTREE_MAX_KEY];
+    StrCell separator = { key, 0, NULL, 0, { 0, 0 }, INVALID_PAGE };
+    result = split_node(tree, page_num, node, index, cell, key, &separator.head_size, &separator.child);
+    if (result != DB_SUCCESS) return result;
+    if (depth == 0) return grow_root(tree, node, &separator);
+
+    const PathEntry *up = &path[depth - 1];
+    StrNode *parent = pager_get_page(tree->pager, up->page);
+    if (!parent) return DB_ERROR;
+    pager_mark_dirty(tree->pager, up->page);
+    result = add_cell(tree, path, depth - 1, up->page, parent, up->index, &separator);
+    pager_unpin_page(tree->pager, up->page);
+    return result;
+}
+
+DB_Result strtree_insert(StrTree *tree, const void *key, uint32_t key_size, LeafValue value) {
+    if (key_size > STRTREE_MAX_KEY) return DB_ERROR;
+    if (tree->root_page_num == INVALID_PAGE) {
+        DB_Result result = create_root(tree);
+        if (result != DB_SUCCESS) return result;
+    }
+
+    StrKey search = make_key(key, key_size);
+    PathEntry path[BTREE_MAX_DEPTH];
+    int depth;
+    page_num_t leaf_page;
+    StrNode *leaf = descend(tree, &search, path, &depth, &leaf_page);
+    if (!leaf) return DB_ERROR;
+    pager_mark_dirty(tree->pager, leaf_page);
+
+    // Existing key: replace its value in place
+    bool found;
+    uint32_t index = node_search(tree, leaf, &search, false, &found);
+    if (found) {
+        const StrSlot *slot = &leaf->slots[index];
+        memcpy(slot_cell(leaf, slot) + slot->suffix_size, &value, sizeof(value));
+        pager_unpin_page(tree->pager, leaf_page);
+        return DB_SUCCESS;
+    }
+
+    StrCell cell = { search.data, key_size, NULL, 0, value, INVALID_PAGE };
+    DB_Result result = add_cell(tree, path, depth, leaf_page, leaf, index, &cell);
+    pager_unpin_page(tree->pager, leaf_page);
+
+    if (result == DB_SUCCESS) {
+        tree->num_keys++;
+        tree->mod_count++;
+        result = write_meta(tree);
+    }
+    return result;
+}
+
+// ==================== DELETE ====================
+
+// An internal root left with a single child hands the root to it
+static DB_Result shrink_root(StrTree *tree) {
+    page_num_t old_root = tree->root_page_num;
+    StrNode *root = pager_get_page(tree->pager, old_root);
+    if (!root) return DB_ERROR;
+    bool shrink = !is_leaf(root) && root->num_cells == 0;
+    page_num_t child = root->first_child;
+    pager_unpin_page(tree->pager, old_root);
+    if (!shrink) return DB_SUCCESS;
+
+    StrNode *new_root = pager_get_page(tree->pager, child);
+    if (!new_root) return DB_ERROR;
+    pager_mark_dirty(tree->pager, child);
+    new_root->header.is_root = 1;
+    pager_unpin_page(tree->pager, child);
+
+    pager_free_page(tree->pager, old_root);
+    tree->root_page_num = child;
+    tree->height--;
+    LOG_DEBUG("String index root moved to page %u, height %u", child, tree->height);
+    return DB_SUCCESS;
+}
+
+// Merges an underfull node with a sibling when the two fit in one page,
+// then looks at the parent, which lost a separator. Nodes whose siblings
+// are too full to take them stay as they are; redistributing could need a
+// longer separator than the parent has room for.
+static DB_Result rebalance(StrTree *tree, const PathEntry *path, int depth, page_num_t page_num) {
+    if (depth == 0) return shrink_root(tree);
+
+    StrNode *node = pager_get_page(tree->pager, page_num);
+    if (!node) return DB_ERROR;
+    bool underfull = node_used(tree, node) < tree->min_fill;
+    pager_unpin_page(tree->pager, page_num);
+    if (!underfull) return DB_SUCCESS;
+
+    const PathEntry *up = &path[depth - 1];
+    StrNode *parent = pager_get_page(tree->pager, up->page);
+    if (!parent) return DB_ERROR;
+    if (parent->num_cells == 0) {
+        pager_unpin_page(tree->pager, up->page);
+        return DB_SUCCESS;
+    }
+
+    // Merge the right node of the pair into the left one
+    uint32_t left_index = up->index < parent->num_cells ? up->index : up->index - 1;
+    page_num_t left_page = node_child(parent, left_index);
+    page_num_t right_page = node_child(parent, left_index + 1);
+    StrNode *left = pager_get_page(tree->pager, left_page);
+    StrNode *right = left ? pager_get_page(tree->pager, right_page) : NULL;
+    if (!right) {
+        if (left) pager_unpin_page(tree->pager, left_page);
+        pager_unpin_page(tree->pager, up->page);
+        return DB_ERROR;
+    }
+
+    StrNode *left_copy = scratch_node(tree, 0);
+    StrNode *right_copy = scratch_node(tree, 1);
+    memcpy(left_copy, left, tree->pager->page_size);
+    memcpy(right_copy, right, tree->pager->page_size);
+
+    // Internal nodes take the separator back down, with the right node's
+    // first child to its right. The merged node is measured under the
+    // prefix its cells share, which may be shorter than either node's.
+    StrCell *cells = tree->cells;
+    uint32_t key_bytes = 0;
+    uint32_t count = collect_cells(tree, left_copy, cells, &key_bytes);
+    if (!is_leaf(left)) {
+        const StrSlot *separator = &parent->slots[left_index];
+        StrCell *cell = &cells[count++];
+        cell->head = node_prefix(tree, parent);
+        cell->head_size = parent->prefix_size;
+        cell->tail = slot_cell(parent, separator);
+        cell->tail_size = separator->suffix_size;
+        cell->child = right_copy->first_child;
+        key_bytes += cell_key_size(cell);
+    }
+    count += collect_cells(tree, right_copy, cells + count, &key_bytes);
+    bool merge = cells_size(cells, count, key_bytes, payload_size(left)) <= tree->capacity;
+
+    if (merge) {
+        pager_mark_dirty(tree->pager, left_page);
+        fill_node(tree, left, cells, count);
+        if (is_leaf(left)) {
+            left->next_leaf = right_copy->next_leaf;
+            if (left->next_leaf != INVALID_PAGE) {
+                StrNode *after = pager_get_page(tree->pager, left->next_leaf);
+                if (after) {
+                    pager_mark_dirty(tree->pager, left->next_leaf);
+                    after->prev_leaf = left_page;
+                    pager_unpin_page(tree->pager, left->next_leaf);
+                }
+            }
+        }
+    }
+    pager_unpin_page(tree->pager, left_page);
+    pager_unpin_page(tree->pager, right_page);
+
+    if (merge) {
+        pager_mark_dirty(tree->pager, up->page);
+        node_remove_cell(tree, parent, left_index);
+        pager_free_page(tree->pager, right_page);
+        LOG_DEBUG("Merged string index page %u into %u", right_page, left_page);
+    }
+    pager_unpin_page(tree->pager, up->page);
+    return merge ? rebalance(tree, path, depth - 1, up->page) : DB_SUCCESS;
+}
+
+DB_Result strtree_delete(StrTree *tree, const void *key, uint32_t key_size) {
+    if (key_size > STRTREE_MAX_KEY || tree->root_page_num == INVALID_PAGE) return DB_NOT_FOUND;
+
+    StrKey search = make_key(key, key_size);
+    PathEntry path[BTREE_MAX_DEPTH];
+    int depth;
+    page_num_t leaf_page;
+    StrNode *leaf = descend(tree, &search, path, &depth, &leaf_page);
+    if (!leaf) return DB_ERROR;
+
+    bool found;
+    uint32_t index = node_search(tree, leaf, &search, false, &found);
+    if (!found) {
+        pager_unpin_page(tree->pager, leaf_page);
+        return DB_NOT_FOUND;
+    }
+    pager_mark_dirty(tree->pager, leaf_page);
+    node_remove_cell(tree, leaf, index);
+    pager_unpin_page(tree->pager, leaf_page);
+
+    tree->num_keys--;
+    tree->mod_count++;
+    DB_Result result = rebalance(tree, path, depth, leaf_page);
+    DB_Result meta_result = write_meta(tree);
+    return result != DB_SUCCESS ? result : meta_result;
+}
+
+// ==================== CURSOR ====================
+
+// Puts the cursor on cell `index` of `leaf`, or on the first cell after it
+static DB_Result cursor_settle(StrTreeCursor *cursor, page_num_t leaf, uint32_t index) {
+    StrTree *tree = cursor->tree;
+    cursor->valid = false;
+
+    while (leaf != INVALID_PAGE) {
+        StrNode *node = pager_get_page(tree->pager, leaf);
+        if (!node) return DB_ERROR;
+
+        if (index < node->num_cells) {
+            cursor->key_size = read_key(tree, node, index, cursor->key);
+            cursor->leaf = leaf;
+            cursor->index = index;
+            cursor->mod_count = tree->mod_count;
+            cursor->valid = true;
+            pager_unpin_page(tree->pager, leaf);
+            return DB_SUCCESS;
+        }
+
+        page_num_t next = node->next_leaf;
+        pager_unpin_page(tree->pager, leaf);
+        leaf = next;
+        index = 0;
+    }
+    return DB_NOT_FOUND;
+}
+
+// If the tree changed under the cursor, re-seeks to its key. *moved is set
+// when that key is gone and the cursor now sits on its successor.
+static DB_Result cursor_revalidate(StrTreeCursor *cursor, bool *moved) {
+    *moved = false;
+    if (!cursor->valid) return DB_NOT_FOUND;
+    if (cursor->mod_count == cursor->tree->mod_count) return DB_SUCCESS;
+
+    uint8_t key[STRTREE_MAX_KEY];
+    uint32_t key_size = cursor->key_size;
+    memcpy(key, cursor->key, key_size);
+    DB_Result result = strtree_cursor_seek(cursor, key, key_size);
+    if (result == DB_SUCCESS) {
+        *moved = compare_bytes(cursor->key, cursor->key_size, key, key_size) != 0;
+    }
+    return result;
+}
+
+void strtree_cursor_init(StrTreeCursor *cursor, StrTree *tree) {
+    cursor->tree = tree;
+    cursor->leaf = INVALID_PAGE;
+    cursor->index = 0;
+    cursor->key_size = 0;
+    cursor->mod_count = 0;
+    cursor->valid = false;
+}
+
+DB_Result strtree_cursor_first(StrTreeCursor *cursor) {
+    return strtree_cursor_seek(cursor, NULL, 0);
+}
+
+DB_Result strtree_cursor_seek(StrTreeCursor *cursor, const void *key, uint32_t key_size) {
+    StrTree *tree = cursor->tree;
+    cursor->valid = false;
+    if (tree->root_page_num == INVALID_PAGE) return DB_NOT_FOUND;
+
+    // Keys past the longest storable one still order correctly against it
+    StrKey search = make_key(key, key_size);
+    page_num_t leaf_page;
+    StrNode *leaf = descend(tree, key ? &search : NULL, NULL, NULL, &leaf_page);
+    if (!leaf) return DB_ERROR;
+    bool found;
+    uint32_t index = key ? node_search(tree, leaf, &search, false, &found) : 0;
+    pager_unpin_page(tree->pager, leaf_page);
+
+    // Past the leaf's last key: the answer starts the next leaf
+    return cursor_settle(cursor, leaf_page, index);
+}
+
+DB_Result strtree_cursor_next(StrTreeCursor *cursor) {
+    bool moved;
+    DB_Result result = cursor_revalidate(cursor, &moved);
+    if (result != DB_SUCCESS || moved) return result;
+    return cursor_settle(cursor, cursor->leaf, cursor->index + 1);
+}
+
+DB_Result strtree_cursor_get(StrTreeCursor *cursor, LeafValue *value) {
+    bool moved;
+    DB_Result result = cursor_revalidate(cursor, &moved);
+    if (result != DB_SUCCESS) return result;
+    // The cursor's own key was deleted
+    if (moved) return DB_NOT_FOUND;
+
+    if (value) {
+        StrNode *node = pager_get_page(cursor->tree->pager, cursor->leaf);
+        if (!node) return DB_ERROR;
+        *value = cell_value(node, cursor->index);
+        pager_unpin_page(cursor->tree->pager, cursor->leaf);
+    }
+    return DB_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#ifndef STRTREE_H
+#define STRTREE_H
+
+#include "constants.h"
+#include "pager.h"
+#include "btree.h"
+
+// B-tree over variable-length byte-string keys, ordered by memcmp with the
+// shorter of two equal prefixes first. It lives in the index file next to
+// the integer tree: the pages come from the same pager and the root is
+// recorded in BTreeMeta, so commits, rollbacks and recovery cover both.
+// A file written before string keys existed has no root; the first insert
+// creates one.
+#define STRTREE_FORMAT_VERSION 2
+#define STRTREE_MAX_KEY 512         // Longest key; at least four cells fit any node
+
+// A node keeps a slot array in key order growing up from the header and
+// the cells they point at growing down from the end of the page, in any
+// order. The bytes every key of the node starts with are stored once, in
+// the last prefix_size bytes of the page, and cells hold only the rest of
+// their key. Each slot caches the first bytes of that rest, so a search
+// checks the node prefix once and then rarely leaves the slot array.
+typedef struct {
+    uint32_t prefix;            // First four suffix bytes, big-endian and zero-padded
+    uint16_t offset;            // Cell position in the page
+    uint16_t suffix_size;       // Key bytes after the node prefix
+} StrSlot;
+
+// Leaf cells hold the key suffix followed by a LeafValue. Internal cells
+// hold the suffix followed by the child to its right; the child left of
+// the first key is first_child. Separators equal to a key route it to the
+// right. Separators made by leaf splits are cut to the shortest key that
+// still divides the two leaves.
+typedef struct {
+    NodeHeader header;          // format STRTREE_FORMAT_VERSION
+    uint32_t num_cells;
+    uint32_t cell_start;        // Lowest cell; free space lies between the slots and here
+    uint32_t garbage;           // Bytes of removed cells not yet reclaimed
+    uint32_t prefix_size;       // Shared key prefix at the end of the page
+    page_num_t prev_leaf;       // Leaves are chained in key order, INVALID_PAGE at the ends
+    page_num_t next_leaf;
+    page_num_t first_child;     // Internal nodes only
+    StrSlot slots[];
+} StrNode;
+
+// One cell while nodes are split, merged or rebuilt. The key is in two
+// pieces, usually a node prefix and a cell suffix, so it is never copied
+// out whole.
+typedef struct {
+    const uint8_t *head;
+    uint32_t head_size;
+    const uint8_t *tail;
+    uint32_t tail_size;
+    LeafValue value;            // Leaf cells
+    page_num_t child;           // Internal cells
+} StrCell;
+
+typedef struct {
+    Pager *pager;
+    page_num_t root_page_num;   // Cached from BTreeMeta; INVALID_PAGE while there is none
+    uint32_t height;
+    uint64_t num_keys;
+
+    // Bytes a node has for slots and cells. Nodes below min_fill are
+    // merged with a sibling when the two fit in one page.
+    uint32_t capacity;
+    uint32_t min_fill;
+    void *scratch;              // Copies of the nodes being rebuilt
+    StrCell *cells;             // Their cells, plus one being added
+    uint64_t mod_count;         // Bumped when keys are added or removed; invalidates cursor positions
+} StrTree;
+
+// Position on one leaf cell; like BTreeCursor it holds no pins between
+// calls and re-seeks to its key once the tree has changed
+typedef struct {
+    StrTree *tree;
+    page_num_t leaf;
+    uint32_t index;
+    uint8_t key[STRTREE_MAX_KEY];   // Key under the cursor
+    uint32_t key_size;
+    uint64_t mod_count;
+    bool valid;
+} StrTreeCursor;
+
+// Opens the string tree of an index file whose BTreeMeta exists
+StrTree *strtree_create(Pager *pager);
+// Re-reads the root from the meta page after a rollback
+DB_Result strtree_reload(StrTree *tree);
+void strtree_destroy(StrTree *tree);
+// Inserts key, or replaces the value if the key already exists. Keys longer
+// than STRTREE_MAX_KEY are rejected with DB_ERROR.
+DB_Result strtree_insert(StrTree *tree, const void *key, uint32_t key_size, LeafValue value);
+DB_Result strtree_find(StrTree *tree, const void *key, uint32_t key_size, LeafValue *value);
+DB_Result strtree_delete(StrTree *tree, const void *key, uint32_t key_size);
+
+// Cursor operations return DB_NOT_FOUND when they run off either end
+void strtree_cursor_init(StrTreeCursor *cursor, StrTree *tree);
+DB_Result strtree_cursor_first(StrTreeCursor *cursor);
+// Positions on the first key >= key
+DB_Result strtree_cursor_seek(StrTreeCursor *cursor, const void *key, uint32_t key_size);
+DB_Result strtree_cursor_next(StrTreeCursor *cursor);
+// The key is cursor->key; value may be NULL
+DB_Result strtree_cursor_get(StrTreeCursor *cursor, LeafValue *value);
+
+#endif
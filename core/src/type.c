@@ -1,5 +1,6 @@
 #include "type.h"
 #include "stark.h"
+#include "log.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -110,29 +111,22 @@ TypeDef* type_get(stark_db_t* db, const char* name) {
     char type_key[256];
     snprintf(type_key, sizeof(type_key), "type:%s", name);
     
-    // First, get the size needed
-    size_t size = 0;
-    stark_result_t result = stark_get_str(db, type_key, NULL, &size);
-    
-    // stark_get_str returns STARK_ERROR but sets size when data exists
-    if (size == 0) {
-        printf("❌ Type key '%s' not found\n", type_key);
+    // One lookup: the view gives the size and the bytes to copy
+    const void* data;
+    size_t size;
+    stark_pin_t pin;
+    stark_result_t result = stark_get_str_view(db, type_key, &data, &size, &pin);
+    if (result != STARK_OK) {
+        LOG_DEBUG("Type key '%s' not found: %d", type_key, result);
         return NULL;
     }
     
-    printf("✅ Type key found, size=%zu bytes\n", size);
+    LOG_DEBUG("Type key found, size=%zu bytes", size);
     
     // Allocate buffer for type
     TypeDef* type = (TypeDef*)malloc(size);
-    if (!type) return NULL;
-    
-    // Get the actual data
-    result = stark_get_str(db, type_key, type, &size);
-    if (result != STARK_OK) {
-        printf("❌ Failed to get type data: %d\n", result);
-        free(type);  // ← Make sure to free on error!
-        return NULL;
-    }
+    if (type) memcpy(type, data, size);
+    stark_release(&pin);
     
     return type;
 }
@@ -157,21 +151,43 @@ stark_result_t type_delete(stark_db_t* db, const char* name) {
 stark_result_t type_list(stark_db_t* db, char*** names, uint32_t* count) {
     if (!db || !names || !count) return STARK_INVALID_ARG;
     
-    // For now, we need a way to iterate over all keys
-    // This is a simplified approach - in a real DB you'd have a cursor
-    
-    // We'll use a temporary approach: try common type IDs
-    // In a real implementation, you'd maintain a separate index of type names
-    
     *names = NULL;
     *count = 0;
     
-    // Since we don't have iteration yet, we'll return a message
-    // For now, users can use 'desc <typename>' to check specific types
-    
-    printf("ℹ️  Type listing requires cursor iteration (to be implemented)\n");
-    printf("   For now, use 'desc <typename>' to check specific types\n");
+    stark_str_cursor_t* cursor = stark_str_cursor_create(db);
+    if (!cursor) return STARK_MEMORY_ERROR;
     
+    // String keys are ordered, so the definitions sit together from the prefix on
+    size_t prefix_length = strlen(TYPE_KEY_PREFIX);
+    char key[STARK_MAX_STR_KEY + 1];
+    stark_result_t result = stark_str_cursor_seek(cursor, TYPE_KEY_PREFIX);
+    while (result == STARK_OK) {
+        result = stark_str_cursor_get(cursor, key, sizeof(key), NULL, NULL);
+        if (result != STARK_OK || strncmp(key, TYPE_KEY_PREFIX, prefix_length) != 0) break;
+        
+        char** grown = realloc(*names, (*count + 1) * sizeof(char*));
+        if (!grown) {
+            result = STARK_MEMORY_ERROR;
+            break;
+        }
+        *names = grown;
+        (*names)[*count] = strdup(key + prefix_length);
+        if (!(*names)[*count]) {
+            result = STARK_MEMORY_ERROR;
+            break;
+        }
+        (*count)++;
+        result = stark_str_cursor_next(cursor);
+    }
+    stark_str_cursor_destroy(cursor);
+    
+    if (result != STARK_OK && result != STARK_NOT_FOUND) {
+        for (uint32_t i = 0; i < *count; i++) free((*names)[i]);
+        free(*names);
+        *names = NULL;
+        *count = 0;
+        return result;
+    }
     return STARK_OK;
 }
 
@@ -326,7 +342,7 @@ stark_result_t type_serialize(FieldDef* fields, uint32_t field_count,
                 }
             }
             if (!found) {
-                printf("Warning: Unknown field '%s' ignored\n", field_name);
+                LOG_WARN("Unknown field '%s' ignored", field_name);
             }
         }
         token = strtok(NULL, " \t");
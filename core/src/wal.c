@@ -0,0 +1,1039 @@
+#include "wal.h"
+#include "crc32.h"
+#include "log.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define WAL_BUFFER_SIZE (1024 * 1024)
+#define CHECKPOINT_RUN_PAGES 64
+
+// ==================== CHECKSUMS ====================
+
+static uint32_t frame_crc(const WalFrameHeader *header, const void *payload) {
+    WalFrameHeader copy = *header;
+    copy.crc = 0;
+    uint32_t crc = crc32_update(0, &copy, sizeof(copy));
+    return crc32_update(crc, payload, header->payload_size);
+}
+
+static uint32_t header_crc(const WalHeader *header) {
+    return crc32_update(0, header, offsetof(WalHeader, crc));
+}
+
+// ==================== FRAME INDEX ====================
+
+static uint32_t index_hash(uint32_t file, page_num_t page_num) {
+    return (page_num * 2654435761u) ^ (file * 0x9E3779B9u);
+}
+
+static DB_Result index_init(WalIndex *index, uint32_t capacity) {
+    index->entries = calloc(capacity, sizeof(WalIndexEntry));
+    if (!index->entries) return DB_MEMORY_ERROR;
+    index->mask = capacity - 1;
+    index->count = 0;
+    return DB_SUCCESS;
+}
+
+static WalIndexEntry *index_slot(WalIndex *index, uint32_t file, page_num_t page_num) {
+    uint32_t slot = index_hash(file, page_num) & index->mask;
+    while (index->entries[slot].offset != 0) {
+        WalIndexEntry *entry = &index->entries[slot];
+        if (entry->file == file && entry->page_num == page_num) return entry;
+        slot = (slot + 1) & index->mask;
+    }
+    return &index->entries[slot];
+}
+
+static uint64_t index_find(WalIndex *index, uint32_t file, page_num_t page_num) {
+    if (index->count == 0) return 0;
+    return index_slot(index, file, page_num)->offset;
+}
+
+static DB_Result index_put(WalIndex *index, uint32_t file, page_num_t page_num,
+                           uint64_t offset, uint64_t lsn) {
+    // Grow at 50% load
+    if (2 * (index->count + 1) > index->mask + 1) {
+        WalIndex grown;
+        if (index_init(&grown, 2 * (index->mask + 1)) != DB_SUCCESS) return DB_MEMORY_ERROR;
+        for (uint32_t i = 0; i <= index->mask; i++) {
+            WalIndexEntry *entry = &index->entries[i];
+            if (entry->offset != 0) *index_slot(&grown, entry->file, entry->page_num) = *entry;
+        }
+        grown.count = index->count;
+        free(index->entries);
+        *index = grown;
+    }
+
+    WalIndexEntry *entry = index_slot(index, file, page_num);
+    if (entry->offset == 0) {
+        entry->file = file;
+        entry->page_num = page_num;
+        entry->older = WAL_NO_VERSION;
+        index->count++;
+    }
+    entry->offset = offset;
+    entry->lsn = lsn;
+    return DB_SUCCESS;
+}
+
+static void index_clear(WalIndex *index) {
+    if (index->count == 0) return;
+    memset(index->entries, 0, (size_t)(index->mask + 1) * sizeof(WalIndexEntry));
+    index->count = 0;
+}
+
+static DB_Result push_version(Wal *wal, const WalIndexEntry *entry, uint32_t *index) {
+    if (wal->num_versions == wal->versions_capacity) {
+        uint32_t capacity = wal->versions_capacity ? 2 * wal->versions_capacity : 1024;
+        WalVersion *grown = realloc(wal->versions, (size_t)capacity * sizeof(WalVersion));
+        if (!grown) return DB_MEMORY_ERROR;
+        wal->versions = grown;
+        wal->versions_capacity = capacity;
+    }
+    WalVersion *version = &wal->versions[wal->num_versions];
+    version->offset = entry->offset;
+    version->lsn = entry->lsn;
+    version->older = entry->older;
+    *index = wal->num_versions++;
+    return DB_SUCCESS;
+}
+
+// Moves the open transaction's frames into the committed index. While
+// snapshots are open, the frames they replace stay reachable as versions.
+static DB_Result merge_pending(Wal *wal) {
+    WalIndex *from = &wal->pending;
+    for (uint32_t i = 0; i <= from->mask && from->count > 0; i++) {
+        WalIndexEntry *entry = &from->entries[i];
+        if (entry->offset == 0) continue;
+
+        uint32_t older = WAL_NO_VERSION;
+        WalIndexEntry *current = index_slot(&wal->committed, entry->file, entry->page_num);
+        if (wal->num_snapshots > 0 && current->offset != 0 &&
+            push_version(wal, current, &older) != DB_SUCCESS) {
+            return DB_MEMORY_ERROR;
+        }
+        if (index_put(&wal->committed, entry->file, entry->page_num,
+                      entry->offset, entry->lsn) != DB_SUCCESS) {
+            return DB_MEMORY_ERROR;
+        }
+        index_slot(&wal->committed, entry->file, entry->page_num)->older = older;
+    }
+    index_clear(from);
+    return DB_SUCCESS;
+}
+
+// The newest committed frame of a page that starts before `end`, or 0
+static uint64_t frame_before(Wal *wal, const WalIndexEntry *entry, uint64_t end) {
+    uint64_t offset = entry->offset;
+    uint32_t older = entry->older;
+    while (offset >= end) {
+        if (older == WAL_NO_VERSION) return 0;
+        offset = wal->versions[older].offset;
+        older = wal->versions[older].older;
+    }
+    return offset;
+}
+
+// ==================== FILE I/O ====================
+
+static DB_Result pwrite_full(int fd, const void *data, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t written = pwrite(fd, (const char *)data + done, size - done, offset + done);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (written == 0) return DB_IO_ERROR;
+        done += written;
+    }
+    return DB_SUCCESS;
+}
+
+static DB_Result pread_full(int fd, void *data, size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t bytes_read = pread(fd, (char *)data + done, size - done, offset + done);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            return DB_IO_ERROR;
+        }
+        if (bytes_read == 0) return DB_IO_ERROR;
+        done += bytes_read;
+    }
+    return DB_SUCCESS;
+}
+
+// ==================== SEGMENTS ====================
+
+static WalSegment *current_segment(Wal *wal) {
+    return &wal->segments[wal->current];
+}
+
+static WalSegment *other_segment(Wal *wal) {
+    return &wal->segments[1 - wal->current];
+}
+
+// False after a read-only open that found no log. The buffer only exists
+// once a segment file is open, and neither changes afterwards, so this is
+// safe to test without the lock.
+static bool has_log(Wal *wal) {
+    return wal->buffer != NULL;
+}
+
+// Where a log position lies in the current segment's file
+static off_t current_offset(Wal *wal, uint64_t position) {
+    return (off_t)(position - current_segment(wal)->start + sizeof(WalHeader));
+}
+
+// The segment holding the frame at a log position, and its offset there.
+// Called with the lock held.
+static WalSegment *segment_at(Wal *wal, uint64_t position, off_t *offset) {
+    WalSegment *segment = current_segment(wal);
+    if (position < segment->start) segment = other_segment(wal);
+    *offset = (off_t)(position - segment->start + sizeof(WalHeader));
+    return segment;
+}
+
+// True until the other segment's file has been emptied for good. Until
+// then a later recovery may still read it, so it cannot be reused, and the
+// current segment cannot start over without breaking the chain.
+static bool other_holds_frames(Wal *wal) {
+    return other_segment(wal)->start < current_segment(wal)->start;
+}
+
+// Empties the other segment once the checkpoint has copied all of it
+static DB_Result drop_other(Wal *wal) {
+    WalSegment *other = other_segment(wal);
+    if (!other_holds_frames(wal) || wal->backfilled < current_segment(wal)->start) return DB_SUCCESS;
+    if (ftruncate(other->fd, 0) != 0 || fdatasync(other->fd) != 0) return DB_IO_ERROR;
+    other->start = current_segment(wal)->start;
+    return DB_SUCCESS;
+}
+
+// Writes staged frames to the log file; they are not durable until synced.
+// Staged frames always belong to the current segment.
+static DB_Result flush_buffer(Wal *wal) {
+    if (wal->buffered == 0) return DB_SUCCESS;
+    DB_Result result = pwrite_full(current_segment(wal)->fd, wal->buffer, wal->buffered,
+                                   current_offset(wal, wal->end - wal->buffered));
+    if (result == DB_SUCCESS) wal->buffered = 0;
+    return result;
+}
+
+static DB_Result append_frame(Wal *wal, WalFrameHeader *header, const void *payload,
+                              uint64_t *offset) {
+    size_t frame_size = sizeof(WalFrameHeader) + header->payload_size;
+    if (wal->buffered + frame_size > wal->buffer_capacity) {
+        DB_Result result = flush_buffer(wal);
+        if (result != DB_SUCCESS) return result;
+    }
+
+    header->lsn = wal->next_lsn;
+    header->salt = current_segment(wal)->salt;
+    header->crc = frame_crc(header, payload);
+
+    char *dest = wal->buffer + wal->buffered;
+    memcpy(dest, header, sizeof(WalFrameHeader));
+    memcpy(dest + sizeof(WalFrameHeader), payload, header->payload_size);
+
+    *offset = wal->end;
+    wal->buffered += frame_size;
+    wal->end += frame_size;
+    wal->next_lsn++;
+    return DB_SUCCESS;
+}
+
+// Starts a new generation of a segment at the head of its file, taking log
+// positions from wal->end on. Frames of the old generation carry the old
+// salt, so recovery stops at them without erasing.
+static DB_Result start_segment(Wal *wal, WalSegment *segment, uint32_t page_size) {
+    uint32_t salt = (uint32_t)time(NULL) ^ (segment->salt * 2654435761u) ^ (uint32_t)getpid();
+    if (salt == segment->salt) salt++;
+    segment->salt = salt ? salt : 1;
+
+    WalHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = WAL_MAGIC;
+    header.version = WAL_VERSION;
+    header.page_size = page_size;
+    header.salt = segment->salt;
+    header.base_lsn = wal->next_lsn;
+    header.crc = header_crc(&header);
+    if (pwrite_full(segment->fd, &header, sizeof(header), 0) != DB_SUCCESS) return DB_IO_ERROR;
+    segment->start = wal->end;
+    return DB_SUCCESS;
+}
+
+// Starts the current segment over once everything logged has been copied
+// into the files
+static DB_Result restart_log(Wal *wal, uint32_t page_size) {
+    DB_Result result = start_segment(wal, current_segment(wal), page_size);
+    if (result != DB_SUCCESS) return result;
+
+    other_segment(wal)->start = wal->end;
+    // Readers check it without the lock; it only changes on an empty log
+    if (wal->page_size != page_size) wal->page_size = page_size;
+    wal->buffered = 0;
+    wal->commit_end = wal->end;
+    wal->synced_end = wal->end;
+    wal->backfilled = wal->end;
+    wal->commit_lsn = wal->next_lsn - 1;
+    index_clear(&wal->committed);
+    index_clear(&wal->pending);
+    wal->num_versions = 0;
+    return DB_SUCCESS;
+}
+
+// Restarts the log and trims the old generations from both files
+static DB_Result reset_log(Wal *wal, uint32_t page_size) {
+    DB_Result result = restart_log(wal, page_size);
+    if (result != DB_SUCCESS) return result;
+    int fd = current_segment(wal)->fd;
+    if (ftruncate(fd, sizeof(WalHeader)) != 0 || fdatasync(fd) != 0) return DB_IO_ERROR;
+    fd = other_segment(wal)->fd;
+    if (fd >= 0 && (ftruncate(fd, 0) != 0 || fdatasync(fd) != 0)) return DB_IO_ERROR;
+    return DB_SUCCESS;
+}
+
+// Moves appends to the other segment, which must hold nothing uncopied,
+// leaving the current one for the checkpointer to drain. Recovery only
+// chains the two if the current segment's commits are durable before any
+// frame of the other can be, and the other's new header before its frames.
+static DB_Result switch_segment(Wal *wal) {
+    WalSegment *next = other_segment(wal);
+    if (next->fd < 0) {
+        next->fd = open(wal->second_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (next->fd < 0) return DB_IO_ERROR;
+    }
+    if (wal->synced_end < wal->end) {
+        if (fdatasync(current_segment(wal)->fd) != 0) return DB_IO_ERROR;
+        wal->synced_end = wal->end;
+    }
+    if (start_segment(wal, next, wal->page_size) != DB_SUCCESS || fdatasync(next->fd) != 0) {
+        return DB_IO_ERROR;
+    }
+    LOG_DEBUG("WAL segment %u full at %llu bytes, continuing in segment %u", wal->current,
+              (unsigned long long)(wal->end - current_segment(wal)->start), 1 - wal->current);
+    wal->current = 1 - wal->current;
+    return DB_SUCCESS;
+}
+
+// Segment size that sends the next transaction to the other segment
+static uint64_t recycle_bytes(Wal *wal) {
+    uint64_t checkpoint_bytes = wal->checkpoint_bytes ? wal->checkpoint_bytes : WAL_CHECKPOINT_BYTES;
+    return WAL_RECYCLE_FACTOR * checkpoint_bytes;
+}
+
+// End of the newest commit a checkpoint may copy. Snapshots read whatever
+// the log does not hold for them from the files, so the files must not move
+// past the oldest one.
+static uint64_t checkpoint_limit(Wal *wal) {
+    uint64_t limit = wal->commit_end;
+    for (uint32_t i = 0; i < wal->num_snapshots; i++) {
+        const WalSnapshot *snapshot = &wal->snapshots[i];
+        if (snapshot->lsn >= wal->commit_lsn) continue;
+        if (snapshot->end < limit) limit = snapshot->end;
+    }
+    return limit;
+}
+
+// Committed bytes a checkpoint could copy now
+static uint64_t checkpoint_lag(Wal *wal) {
+    uint64_t limit = checkpoint_limit(wal);
+    return limit > wal->backfilled ? limit - wal->backfilled : 0;
+}
+
+// ==================== RECOVERY ====================
+
+// Replays a segment's frames up to its last intact commit, giving them log
+// positions from wal->end on. Frames after that commit never took effect.
+static DB_Result replay_segment(Wal *wal, WalSegment *segment, const WalHeader *header,
+                                void *payload, uint32_t *commits) {
+    segment->salt = header->salt;
+    segment->start = wal->end;
+    wal->next_lsn = header->base_lsn;
+    wal->commit_lsn = header->base_lsn - 1;
+    wal->commit_end = wal->end;
+
+    struct stat st;
+    if (fstat(segment->fd, &st) != 0) return DB_IO_ERROR;
+    uint64_t file_size = (uint64_t)st.st_size;
+
+    uint64_t offset = sizeof(WalHeader);
+    uint64_t commit_offset = offset;
+    while (offset + sizeof(WalFrameHeader) <= file_size) {
+        WalFrameHeader frame;
+        if (pread_full(segment->fd, &frame, sizeof(frame), (off_t)offset) != DB_SUCCESS) break;
+
+        bool valid = frame.salt == segment->salt && frame.lsn == wal->next_lsn &&
+                     frame.file < WAL_MAX_FILES &&
+                     ((frame.type == WAL_FRAME_PAGE && frame.payload_size == wal->page_size) ||
+                      (frame.type == WAL_FRAME_COMMIT && frame.payload_size == sizeof(WalCommit))) &&
+                     offset + sizeof(frame) + frame.payload_size <= file_size;
+        if (!valid) break;
+        if (pread_full(segment->fd, payload, frame.payload_size,
+                       (off_t)(offset + sizeof(frame))) != DB_SUCCESS ||
+            frame_crc(&frame, payload) != frame.crc) {
+            break;
+        }
+
+        uint64_t position = segment->start + (offset - sizeof(WalHeader));
+        offset += sizeof(frame) + frame.payload_size;
+        DB_Result result = DB_SUCCESS;
+        if (frame.type == WAL_FRAME_PAGE) {
+            result = index_put(&wal->pending, frame.file, frame.page_num, position, frame.lsn);
+        } else {
+            memcpy(wal->committed_pages, ((WalCommit *)payload)->num_pages,
+                   sizeof(wal->committed_pages));
+            wal->has_commit = true;
+            result = merge_pending(wal);
+            wal->commit_end = position + sizeof(frame) + frame.payload_size;
+            wal->commit_lsn = frame.lsn;
+            commit_offset = offset;
+            (*commits)++;
+        }
+        if (result != DB_SUCCESS) return result;
+        wal->next_lsn++;
+    }
+
+    index_clear(&wal->pending);
+    wal->next_lsn = wal->commit_lsn + 1;
+    wal->end = wal->commit_end;
+    if (!wal->read_only && file_size > commit_offset &&
+        ftruncate(segment->fd, (off_t)commit_offset) != 0) {
+        return DB_IO_ERROR;
+    }
+    return DB_SUCCESS;
+}
+
+// Replays the segments with a valid header: the one with the lower base
+// LSN, then the other if it continues it. One that does not follows a
+// damaged frame; it is emptied, so no later recovery chains it either.
+static DB_Result recover(Wal *wal, const WalHeader headers[WAL_SEGMENTS],
+                         const bool valid[WAL_SEGMENTS]) {
+    uint32_t first = valid[0] ? 0 : 1;
+    if (valid[0] && valid[1] && headers[1].base_lsn < headers[0].base_lsn) first = 1;
+    uint32_t second = 1 - first;
+    wal->page_size = headers[first].page_size;
+    wal->end = sizeof(WalHeader);
+    wal->backfilled = wal->end;
+
+    void *payload = malloc(wal->page_size);
+    if (!payload) return DB_MEMORY_ERROR;
+
+    uint32_t commits = 0;
+    wal->current = first;
+    DB_Result result = replay_segment(wal, &wal->segments[first], &headers[first], payload, &commits);
+    bool chained = valid[second] && headers[second].page_size == wal->page_size &&
+                   headers[second].base_lsn == wal->next_lsn;
+    if (result == DB_SUCCESS && chained) {
+        wal->current = second;
+        result = replay_segment(wal, &wal->segments[second], &headers[second], payload, &commits);
+    }
+    free(payload);
+    if (result != DB_SUCCESS) return result;
+
+    WalSegment *other = other_segment(wal);
+    if (!chained) {
+        other->start = current_segment(wal)->start;
+        if (!wal->read_only && other->fd >= 0 && ftruncate(other->fd, 0) != 0) return DB_IO_ERROR;
+    }
+    wal->synced_end = wal->commit_end;
+
+    if (commits > 0) {
+        LOG_INFO("WAL recovery found %u commits, %u pages", commits, wal->committed.count);
+    }
+    return DB_SUCCESS;
+}
+
+// Reads a segment's header; false if it has none that is intact
+static bool read_header(int fd, WalHeader *header) {
+    return fd >= 0 && pread_full(fd, header, sizeof(*header), 0) == DB_SUCCESS &&
+           header->magic == WAL_MAGIC && header->version == WAL_VERSION &&
+           header->crc == header_crc(header) &&
+           header->page_size >= PAGE_SIZE_MIN && header->page_size <= PAGE_SIZE_MAX;
+}
+
+// ==================== LOG ====================
+
+Wal *wal_open(const char *filename, uint32_t page_size, bool read_only) {
+    Wal *wal = calloc(1, sizeof(Wal));
+    if (!wal) return NULL;
+    wal->read_only = read_only;
+    wal->page_size = page_size ? page_size : PAGE_SIZE;
+    wal->next_lsn = 1;
+    wal->end = sizeof(WalHeader);
+    wal->commit_end = wal->end;
+    wal->synced_end = wal->end;
+    wal->backfilled = wal->end;
+    for (uint32_t i = 0; i < WAL_SEGMENTS; i++) {
+        wal->segments[i].fd = -1;
+        wal->segments[i].start = wal->end;
+    }
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->synced, NULL);
+    pthread_mutex_init(&wal->checkpoint_lock, NULL);
+    pthread_cond_init(&wal->wake, NULL);
+
+    size_t length = strlen(filename);
+    wal->second_path = malloc(length + 2);
+    if (!wal->second_path ||
+        index_init(&wal->committed, 1024) != DB_SUCCESS ||
+        index_init(&wal->pending, 1024) != DB_SUCCESS) {
+        wal_close(wal);
+        return NULL;
+    }
+    memcpy(wal->second_path, filename, length);
+    memcpy(wal->second_path + length, "2", 2);
+
+    // The second segment only exists once the log has needed it
+    int flags = read_only ? O_RDONLY | O_CLOEXEC : O_RDWR | O_CLOEXEC;
+    wal->segments[0].fd = open(filename, read_only ? flags : flags | O_CREAT, 0644);
+    bool failed = wal->segments[0].fd < 0 && (!read_only || errno != ENOENT);
+    wal->segments[1].fd = open(wal->second_path, flags);
+    if (failed || (wal->segments[1].fd < 0 && errno != ENOENT)) {
+        wal_close(wal);
+        return NULL;
+    }
+    // Nothing to recover, and nothing may be written
+    if (wal->segments[0].fd < 0 && wal->segments[1].fd < 0) return wal;
+
+    wal->buffer_capacity = WAL_BUFFER_SIZE;
+    wal->buffer = malloc(wal->buffer_capacity);
+    if (!wal->buffer) {
+        wal_close(wal);
+        return NULL;
+    }
+
+    WalHeader headers[WAL_SEGMENTS];
+    bool valid[WAL_SEGMENTS];
+    for (uint32_t i = 0; i < WAL_SEGMENTS; i++) {
+        valid[i] = read_header(wal->segments[i].fd, &headers[i]);
+    }
+
+    DB_Result result = DB_SUCCESS;
+    if (valid[0] || valid[1]) {
+        result = recover(wal, headers, valid);
+    } else if (!read_only) {
+        wal->current = 0;
+        result = reset_log(wal, wal->page_size);
+    }
+    if (result != DB_SUCCESS) {
+        wal_close(wal);
+        return NULL;
+    }
+    return wal;
+}
+
+void wal_close(Wal *wal) {
+    if (!wal) return;
+
+    wal_stop_checkpointer(wal);
+    // Drop the frames of a transaction that never committed
+    WalSegment *segment = current_segment(wal);
+    if (segment->fd >= 0 && !wal->read_only && wal->buffer && wal->end > wal->commit_end &&
+        wal->end - wal->buffered > wal->commit_end) {
+        (void)ftruncate(segment->fd, current_offset(wal, wal->commit_end));
+    }
+    for (uint32_t i = 0; i < WAL_SEGMENTS; i++) {
+        if (wal->segments[i].fd >= 0) close(wal->segments[i].fd);
+    }
+    pthread_mutex_destroy(&wal->lock);
+    pthread_cond_destroy(&wal->synced);
+    pthread_mutex_destroy(&wal->checkpoint_lock);
+    pthread_cond_destroy(&wal->wake);
+    free(wal->second_path);
+    free(wal->buffer);
+    free(wal->committed.entries);
+    free(wal->pending.entries);
+    free(wal->versions);
+    free(wal->snapshots);
+    free(wal);
+}
+
+bool wal_is_empty(Wal *wal) {
+    return wal->commit_end <= wal->backfilled;
+}
+
+void wal_set_pager(Wal *wal, uint32_t file, Pager *pager) {
+    wal->pagers[file] = pager;
+}
+
+DB_Result wal_reset(Wal *wal, uint32_t page_size) {
+    if (wal->read_only || !has_log(wal)) {
+        if (!wal_is_empty(wal)) return DB_READONLY;
+        wal->page_size = page_size;
+        return DB_SUCCESS;
+    }
+    pthread_mutex_lock(&wal->lock);
+    DB_Result result = reset_log(wal, page_size);
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+// Copies a frame's page image, from the buffer if it is not written yet.
+// Called with the lock held.
+static int copy_frame(Wal *wal, uint64_t position, void *dest, size_t bytes) {
+    if (position == 0) return 0;
+    uint64_t payload = position + sizeof(WalFrameHeader);
+    uint64_t buffer_start = wal->end - wal->buffered;
+    if (payload >= buffer_start) {
+        memcpy(dest, wal->buffer + (payload - buffer_start), bytes);
+        return 1;
+    }
+    off_t offset;
+    WalSegment *segment = segment_at(wal, position, &offset);
+    return pread_full(segment->fd, dest, bytes, offset + (off_t)sizeof(WalFrameHeader)) == DB_SUCCESS ?
+           1 : -1;
+}
+
+int wal_read_page(Wal *wal, uint32_t file, page_num_t page_num, void *dest, size_t bytes) {
+    if (bytes > wal->page_size) return -1;
+
+    // Held across the read so a checkpoint cannot recycle the frame meanwhile
+    pthread_mutex_lock(&wal->lock);
+    uint64_t offset = index_find(&wal->pending, file, page_num);
+    if (offset == 0) offset = index_find(&wal->committed, file, page_num);
+    int found = copy_frame(wal, offset, dest, bytes);
+    pthread_mutex_unlock(&wal->lock);
+    return found;
+}
+
+int wal_read_page_at(Wal *wal, uint32_t file, page_num_t page_num, uint64_t lsn,
+                     void *dest, size_t bytes) {
+    if (bytes > wal->page_size) return -1;
+
+    pthread_mutex_lock(&wal->lock);
+    uint64_t offset = 0;
+    if (wal->committed.count > 0) {
+        // Walk back past the frames committed after the snapshot
+        WalIndexEntry *entry = index_slot(&wal->committed, file, page_num);
+        offset = entry->offset;
+        uint64_t frame_lsn = entry->lsn;
+        uint32_t older = entry->older;
+        while (offset != 0 && frame_lsn > lsn) {
+            if (older == WAL_NO_VERSION) {
+                offset = 0;
+                break;
+            }
+            offset = wal->versions[older].offset;
+            frame_lsn = wal->versions[older].lsn;
+            older = wal->versions[older].older;
+        }
+    }
+    int found = copy_frame(wal, offset, dest, bytes);
+    pthread_mutex_unlock(&wal->lock);
+    return found;
+}
+
+DB_Result wal_append_page(Wal *wal, uint32_t file, page_num_t page_num, const void *data) {
+    if (wal->read_only || !has_log(wal)) return DB_READONLY;
+
+    WalFrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = WAL_FRAME_PAGE;
+    header.file = file;
+    header.page_num = page_num;
+    header.payload_size = wal->page_size;
+
+    pthread_mutex_lock(&wal->lock);
+    DB_Result result = DB_SUCCESS;
+
+    // A transaction starting on a fully checkpointed log reuses it from the
+    // top. Otherwise, once the segment is large, it moves to the other one
+    // and leaves this one to the checkpointer.
+    if (wal->pending.count == 0 && wal->end == wal->commit_end && !other_holds_frames(wal)) {
+        uint64_t used = wal->end - current_segment(wal)->start;
+        if (wal->backfilled == wal->commit_end && used > 0) {
+            result = restart_log(wal, wal->page_size);
+        } else if (used >= recycle_bytes(wal)) {
+            result = switch_segment(wal);
+        }
+    }
+
+    uint64_t offset;
+    if (result == DB_SUCCESS) result = append_frame(wal, &header, data, &offset);
+    if (result == DB_SUCCESS) result = index_put(&wal->pending, file, page_num, offset, header.lsn);
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+DB_Result wal_commit(Wal *wal, const page_num_t num_pages[WAL_MAX_FILES], uint64_t *commit_end) {
+    if (wal->read_only || !has_log(wal)) return DB_READONLY;
+
+    pthread_mutex_lock(&wal->lock);
+
+    // A transaction that changed nothing commits without touching the log
+    if (wal->pending.count == 0 &&
+        memcmp(num_pages, wal->committed_pages, sizeof(wal->committed_pages)) == 0) {
+        *commit_end = 0;
+        pthread_mutex_unlock(&wal->lock);
+        return DB_SUCCESS;
+    }
+
+    WalCommit commit;
+    memcpy(commit.num_pages, num_pages, sizeof(commit.num_pages));
+    WalFrameHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = WAL_FRAME_COMMIT;
+    header.payload_size = sizeof(WalCommit);
+
+    uint64_t offset;
+    uint64_t lsn = wal->next_lsn;
+    DB_Result result = append_frame(wal, &header, &commit, &offset);
+    if (result == DB_SUCCESS) result = flush_buffer(wal);
+    if (result == DB_SUCCESS) result = merge_pending(wal);
+    if (result == DB_SUCCESS) {
+        memcpy(wal->committed_pages, num_pages, sizeof(wal->committed_pages));
+        wal->has_commit = true;
+        wal->commit_end = wal->end;
+        wal->commit_lsn = lsn;
+        *commit_end = wal->end;
+        if (wal->checkpointer_running && checkpoint_lag(wal) >= wal->checkpoint_bytes) {
+            pthread_cond_signal(&wal->wake);
+        }
+    }
+
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+DB_Result wal_sync(Wal *wal, uint64_t end) {
+    if (!has_log(wal)) return DB_SUCCESS;
+
+    DB_Result result = DB_SUCCESS;
+    pthread_mutex_lock(&wal->lock);
+    // A log restarted since the commit had all of it checkpointed and fsynced
+    while (wal->synced_end < end && end <= wal->commit_end && result == DB_SUCCESS) {
+        if (wal->syncing) {
+            // Another committer's fsync is in flight; it may cover us too
+            pthread_cond_wait(&wal->synced, &wal->lock);
+            continue;
+        }
+
+        // Lead a sync covering every commit written so far. Earlier
+        // segments were synced when appends moved on from them.
+        uint64_t target = wal->commit_end;
+        int fd = current_segment(wal)->fd;
+        wal->syncing = true;
+        pthread_mutex_unlock(&wal->lock);
+        int status = fdatasync(fd);
+        pthread_mutex_lock(&wal->lock);
+        wal->syncing = false;
+        if (status == 0) {
+            if (target > wal->synced_end) wal->synced_end = target;
+        } else {
+            result = DB_IO_ERROR;
+        }
+        pthread_cond_broadcast(&wal->synced);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+DB_Result wal_rollback(Wal *wal) {
+    if (wal->read_only || !has_log(wal)) return DB_SUCCESS;
+
+    pthread_mutex_lock(&wal->lock);
+    WalSegment *segment = current_segment(wal);
+    bool written = wal->end - wal->buffered > wal->commit_end;
+    index_clear(&wal->pending);
+    wal->buffered = 0;
+    wal->end = wal->commit_end;
+    wal->next_lsn = wal->commit_lsn + 1;
+
+    // Overwritten later anyway, but a short tail could otherwise outlive a crash
+    DB_Result result = DB_SUCCESS;
+    if (written && ftruncate(segment->fd, current_offset(wal, wal->commit_end)) != 0) {
+        result = DB_IO_ERROR;
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return result;
+}
+
+// ==================== SNAPSHOTS ====================
+
+DB_Result wal_snapshot_open(Wal *wal, uint64_t *lsn, page_num_t num_pages[WAL_MAX_FILES]) {
+    pthread_mutex_lock(&wal->lock);
+    if (wal->num_snapshots == wal->snapshots_capacity) {
+        uint32_t capacity = wal->snapshots_capacity ? 2 * wal->snapshots_capacity : 8;
+        WalSnapshot *grown = realloc(wal->snapshots, (size_t)capacity * sizeof(WalSnapshot));
+        if (!grown) {
+            pthread_mutex_unlock(&wal->lock);
+            return DB_MEMORY_ERROR;
+        }
+        wal->snapshots = grown;
+        wal->snapshots_capacity = capacity;
+    }
+
+    WalSnapshot *snapshot = &wal->snapshots[wal->num_snapshots++];
+    snapshot->lsn = wal->commit_lsn;
+    snapshot->end = wal->commit_end;
+    *lsn = wal->commit_lsn;
+    memcpy(num_pages, wal->committed_pages, sizeof(wal->committed_pages));
+    pthread_mutex_unlock(&wal->lock);
+    return DB_SUCCESS;
+}
+
+void wal_snapshot_close(Wal *wal, uint64_t lsn) {
+    pthread_mutex_lock(&wal->lock);
+    for (uint32_t i = 0; i < wal->num_snapshots; i++) {
+        if (wal->snapshots[i].lsn == lsn) {
+            wal->snapshots[i] = wal->snapshots[--wal->num_snapshots];
+            break;
+        }
+    }
+
+    // The last snapshot is gone: nobody reads superseded frames any more
+    if (wal->num_snapshots == 0 && wal->num_versions > 0) {
+        for (uint32_t i = 0; i <= wal->committed.mask; i++) {
+            wal->committed.entries[i].older = WAL_NO_VERSION;
+        }
+        wal->num_versions = 0;
+    }
+
+    // Commits held back by this snapshot may be due for a checkpoint
+    if (wal->checkpointer_running && checkpoint_lag(wal) >= wal->checkpoint_bytes) {
+        pthread_cond_signal(&wal->wake);
+    }
+    pthread_mutex_unlock(&wal->lock);
+}
+
+// ==================== CHECKPOINT ====================
+
+static int compare_entries(const void *a, const void *b) {
+    const WalIndexEntry *x = a;
+    const WalIndexEntry *y = b;
+    if (x->file != y->file) return x->file < y->file ? -1 : 1;
+    return (x->page_num > y->page_num) - (x->page_num < y->page_num);
+}
+
+// Writes one run of consecutive pages of a file
+static DB_Result apply_run(Wal *wal, const WalIndexEntry *run, uint32_t count, char *staging) {
+    void *images[CHECKPOINT_RUN_PAGES];
+    int fds[CHECKPOINT_RUN_PAGES];
+    off_t offsets[CHECKPOINT_RUN_PAGES];
+    pthread_mutex_lock(&wal->lock);
+    for (uint32_t i = 0; i < count; i++) {
+        fds[i] = segment_at(wal, run[i].offset, &offsets[i])->fd;
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    for (uint32_t i = 0; i < count; i++) {
+        images[i] = staging + (size_t)i * wal->page_size;
+        DB_Result result = pread_full(fds[i], images[i], wal->page_size,
+                                      offsets[i] + (off_t)sizeof(WalFrameHeader));
+        if (result != DB_SUCCESS) return result;
+    }
+    return pager_write_pages(wal->pagers[run[0].file], run[0].page_num, count, images);
+}
+
+// Drops the frames that the checkpoint copied into the files, and with them
+// the entries of pages that have no newer frames
+static DB_Result prune_committed(Wal *wal, uint64_t target) {
+    WalIndex kept;
+    if (index_init(&kept, wal->committed.mask + 1) != DB_SUCCESS) return DB_MEMORY_ERROR;
+    WalVersion *versions = NULL;
+    if (wal->num_versions > 0) {
+        versions = malloc((size_t)wal->num_versions * sizeof(WalVersion));
+        if (!versions) {
+            free(kept.entries);
+            return DB_MEMORY_ERROR;
+        }
+    }
+
+    uint32_t num_versions = 0;
+    for (uint32_t i = 0; i <= wal->committed.mask; i++) {
+        WalIndexEntry *entry = &wal->committed.entries[i];
+        if (entry->offset < target) continue;
+        WalIndexEntry *slot = index_slot(&kept, entry->file, entry->page_num);
+        *slot = *entry;
+        kept.count++;
+
+        // Keep the versions a snapshot may still read
+        uint32_t *link = &slot->older;
+        for (uint32_t older = entry->older;
+             older != WAL_NO_VERSION && wal->versions[older].offset >= target;
+             older = wal->versions[older].older) {
+            versions[num_versions] = wal->versions[older];
+            *link = num_versions;
+            link = &versions[num_versions].older;
+            num_versions++;
+        }
+        *link = WAL_NO_VERSION;
+    }
+
+    free(wal->committed.entries);
+    wal->committed = kept;
+    free(wal->versions);
+    wal->versions = versions;
+    wal->versions_capacity = versions ? wal->num_versions : 0;
+    wal->num_versions = num_versions;
+    return DB_SUCCESS;
+}
+
+DB_Result wal_checkpoint(Wal *wal) {
+    if (wal->read_only || !has_log(wal)) return DB_READONLY;
+
+    pthread_mutex_lock(&wal->checkpoint_lock);
+    pthread_mutex_lock(&wal->lock);
+
+    // Take what is committed now, up to the oldest open snapshot. Those
+    // frames are never rewritten while the checkpoint runs, so they are
+    // copied without the lock.
+    uint64_t target = checkpoint_limit(wal);
+    uint32_t count = 0;
+    WalIndexEntry *entries = NULL;
+    page_num_t num_pages[WAL_MAX_FILES];
+    memcpy(num_pages, wal->committed_pages, sizeof(num_pages));
+    bool synced = wal->synced_end >= target;
+    int fd = current_segment(wal)->fd;
+    DB_Result result = DB_SUCCESS;
+    if (target > wal->backfilled) {
+        entries = malloc(((size_t)wal->committed.count + 1) * sizeof(WalIndexEntry));
+        if (!entries) result = DB_MEMORY_ERROR;
+        for (uint32_t i = 0; entries && i <= wal->committed.mask; i++) {
+            WalIndexEntry *entry = &wal->committed.entries[i];
+            if (entry->offset == 0) continue;
+            uint64_t offset = frame_before(wal, entry, target);
+            if (offset == 0) continue;
+            entries[count] = *entry;
+            entries[count++].offset = offset;
+        }
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    if (result == DB_SUCCESS && target > wal->backfilled) {
+        // The log must be durable before the files start to change
+        if (!synced) {
+            if (fdatasync(fd) != 0) result = DB_IO_ERROR;
+            pthread_mutex_lock(&wal->lock);
+            if (result == DB_SUCCESS && wal->synced_end < target) wal->synced_end = target;
+            pthread_mutex_unlock(&wal->lock);
+        }
+        qsort(entries, count, sizeof(WalIndexEntry), compare_entries);
+
+        // Sorted by file and page, so consecutive pages go out in one write
+        char *staging = malloc((size_t)CHECKPOINT_RUN_PAGES * wal->page_size);
+        if (!staging) result = DB_MEMORY_ERROR;
+        uint32_t start = 0;
+        while (result == DB_SUCCESS && start < count) {
+            uint32_t end = start + 1;
+            while (end < count && end - start < CHECKPOINT_RUN_PAGES &&
+                   entries[end].file == entries[start].file &&
+                   entries[end].page_num == entries[end - 1].page_num + 1) {
+                end++;
+            }
+            result = apply_run(wal, &entries[start], end - start, staging);
+            start = end;
+        }
+        free(staging);
+
+        for (uint32_t file = 0; file < WAL_MAX_FILES && result == DB_SUCCESS; file++) {
+            result = pager_sync_file(wal->pagers[file], num_pages[file]);
+        }
+    }
+
+    pthread_mutex_lock(&wal->lock);
+    if (result == DB_SUCCESS && target > wal->backfilled) {
+        // Readers find these pages in the files from now on
+        for (uint32_t i = 0; i < count; i++) {
+            Pager *pager = wal->pagers[entries[i].file];
+            if (entries[i].page_num >= pager->file_pages) {
+                __atomic_store_n(&pager->file_pages, entries[i].page_num + 1, __ATOMIC_RELAXED);
+            }
+        }
+        for (uint32_t file = 0; file < WAL_MAX_FILES; file++) {
+            if (num_pages[file] > wal->pagers[file]->file_pages) {
+                __atomic_store_n(&wal->pagers[file]->file_pages, num_pages[file], __ATOMIC_RELAXED);
+            }
+        }
+        result = prune_committed(wal, target);
+        if (result == DB_SUCCESS) {
+            wal->backfilled = target;
+            LOG_DEBUG("Checkpointed %u pages from %llu bytes of WAL", count,
+                      (unsigned long long)target);
+        }
+    }
+    // A segment left behind is emptied once all of it is copied, so the
+    // next switch can reuse it
+    if (result == DB_SUCCESS) result = drop_other(wal);
+    // An idle log is emptied now; a busy one restarts with its next transaction
+    if (result == DB_SUCCESS && wal->backfilled == wal->commit_end &&
+        wal->end == wal->commit_end && wal->end > current_segment(wal)->start) {
+        result = reset_log(wal, wal->page_size);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    pthread_mutex_unlock(&wal->checkpoint_lock);
+
+    free(entries);
+    return result;
+}
+
+static void *checkpointer_main(void *arg) {
+    Wal *wal = arg;
+
+    pthread_mutex_lock(&wal->lock);
+    while (!wal->stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += wal->checkpoint_interval_ms / 1000;
+        deadline.tv_nsec += (long)(wal->checkpoint_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        // Woken early by a commit that pushed the log past the size threshold
+        while (!wal->stopping && checkpoint_lag(wal) < wal->checkpoint_bytes) {
+            if (pthread_cond_timedwait(&wal->wake, &wal->lock, &deadline) == ETIMEDOUT) break;
+        }
+        // Run when there are commits to copy, or to truncate what is drained
+        bool drained = (wal->backfilled == wal->commit_end && wal->end == wal->commit_end &&
+                        wal->end > current_segment(wal)->start) ||
+                       (other_holds_frames(wal) && wal->backfilled >= current_segment(wal)->start);
+        if (wal->stopping) continue;
+        // Nothing new, or held back by a snapshot
+        if (checkpoint_lag(wal) == 0 && !drained) continue;
+
+        pthread_mutex_unlock(&wal->lock);
+        if (wal_checkpoint(wal) != DB_SUCCESS) {
+            LOG_WARN("Background checkpoint failed, retrying later");
+        }
+        pthread_mutex_lock(&wal->lock);
+    }
+    pthread_mutex_unlock(&wal->lock);
+    return NULL;
+}
+
+DB_Result wal_start_checkpointer(Wal *wal, uint64_t checkpoint_bytes, uint32_t interval_ms) {
+    if (wal->read_only || !has_log(wal)) return DB_READONLY;
+    if (wal->checkpointer_running) return DB_ERROR;
+
+    wal->checkpoint_bytes = checkpoint_bytes ? checkpoint_bytes : WAL_CHECKPOINT_BYTES;
+    wal->checkpoint_interval_ms = interval_ms ? interval_ms : WAL_CHECKPOINT_INTERVAL_MS;
+    wal->stopping = false;
+    if (pthread_create(&wal->checkpointer, NULL, checkpointer_main, wal) != 0) return DB_ERROR;
+    wal->checkpointer_running = true;
+    return DB_SUCCESS;
+}
+
+void wal_stop_checkpointer(Wal *wal) {
+    if (!wal->checkpointer_running) return;
+    pthread_mutex_lock(&wal->lock);
+    wal->stopping = true;
+    pthread_cond_signal(&wal->wake);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->checkpointer, NULL);
+
+    pthread_mutex_lock(&wal->lock);
+    wal->checkpointer_running = false;
+    pthread_mutex_unlock(&wal->lock);
+}
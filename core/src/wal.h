@@ -0,0 +1,207 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "constants.h"
+#include "pager.h"
+#include <pthread.h>
+
+// Write-ahead log: full page images for both files. A transaction appends
+// the pages it changed, then a commit frame; only the log is fsynced at
+// commit. A checkpoint later copies the latest committed image of each
+// page into .idx/.dat, normally from a background thread, and the log
+// starts over once everything in it has been copied.
+//
+// The log is kept in two segment files, <name>.wal and <name>.wal2, the
+// second created when first needed. Appends go to the current segment.
+// Once it has grown large, the next transaction moves to the other segment
+// if the checkpoint has copied everything there; the checkpointer then
+// drains the segment left behind, which no longer grows, while commits go
+// on. Writers never wait for it.
+//
+// Segment layout:
+//   WalHeader
+//   frames: WalFrameHeader + payload (a page image, or WalCommit)
+// Frames carry consecutive LSNs and the header's salt. Recovery replays
+// frames up to the last commit whose chain is intact; anything after it
+// belongs to a transaction that never committed. The segment with the
+// lower base_lsn goes first, and the other only if it continues the first.
+//
+// Frames are addressed by their position in the log, which counts bytes
+// of frames and only grows, across segments and restarts alike.
+//
+// Snapshots: a reader may pin the state of one commit. While snapshots are
+// open, a commit keeps the frames it supersedes as older versions of their
+// pages, and the checkpoint copies no commit newer than the oldest snapshot,
+// so whatever a snapshot does not find in the log is still in the files.
+#define WAL_MAGIC 0x574B5453            // "STKW"
+#define WAL_VERSION 1
+#define WAL_MAX_FILES 2
+#define WAL_FILE_INDEX 0
+#define WAL_FILE_DATA 1
+#define WAL_CHECKPOINT_BYTES (8u << 20)
+#define WAL_CHECKPOINT_INTERVAL_MS 1000
+#define WAL_SEGMENTS 2
+// A segment this many times the checkpoint size hands appends to the other
+// one. A busy writer would otherwise never find the log fully applied, and
+// it would never start over.
+#define WAL_RECYCLE_FACTOR 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t salt;              // New on every reset, so stale frames never match
+    uint64_t base_lsn;          // LSN of the first frame
+    uint32_t reserved;
+    uint32_t crc;               // Over the fields above
+} WalHeader;
+
+typedef enum {
+    WAL_FRAME_PAGE = 1,
+    WAL_FRAME_COMMIT = 2
+} WalFrameType;
+
+typedef struct {
+    uint32_t type;
+    uint32_t file;              // WAL_FILE_* the page belongs to
+    page_num_t page_num;
+    uint32_t payload_size;
+    uint64_t lsn;
+    uint32_t salt;
+    uint32_t crc;               // Over this header (crc = 0) and the payload
+} WalFrameHeader;
+
+// Payload of a commit frame: file lengths as of the commit
+typedef struct {
+    page_num_t num_pages[WAL_MAX_FILES];
+} WalCommit;
+
+#define WAL_NO_VERSION UINT32_MAX
+
+// (file, page) -> offset of the newest frame (open addressing, linear probing)
+typedef struct {
+    uint32_t file;
+    page_num_t page_num;
+    uint64_t offset;            // 0 = empty slot
+    uint64_t lsn;
+    uint32_t older;             // Superseded frame kept for snapshots (WalVersion index)
+} WalIndexEntry;
+
+// An older committed frame of a page, newest first along `older`
+typedef struct {
+    uint64_t offset;
+    uint64_t lsn;
+    uint32_t older;
+} WalVersion;
+
+// An open snapshot: the last commit it sees
+typedef struct {
+    uint64_t lsn;
+    uint64_t end;               // commit_end when it was opened
+} WalSnapshot;
+
+// One segment file. Its frames sit at log positions from `start` on; the
+// other segment's frames, if any, come before them.
+typedef struct {
+    int fd;                     // -1 until the file exists
+    uint32_t salt;              // New on every restart, so stale frames never match
+    uint64_t start;             // Log position of the first frame
+} WalSegment;
+
+typedef struct {
+    WalIndexEntry *entries;
+    uint32_t mask;
+    uint32_t count;
+} WalIndex;
+
+typedef struct Wal {
+    bool read_only;
+    uint32_t page_size;
+    uint64_t next_lsn;
+    uint64_t end;               // Position of the next frame, counting buffered bytes
+
+    // Frames before segments[current].start are in the other segment
+    WalSegment segments[WAL_SEGMENTS];
+    uint32_t current;
+    char *second_path;          // <name>.wal2
+
+    // Frames are staged here and written in one go
+    char *buffer;
+    size_t buffered;
+    size_t buffer_capacity;
+
+    uint64_t commit_end;        // End of the last commit frame
+    uint64_t commit_lsn;
+    page_num_t committed_pages[WAL_MAX_FILES];  // File lengths as of the last commit
+    bool has_commit;            // committed_pages came from a commit frame, not the files
+    WalIndex committed;         // Newest committed frame of each page not yet in the files
+    WalIndex pending;           // Frames of the open transaction
+    uint64_t backfilled;        // Log prefix already copied into the files
+
+    // Superseded frames that open snapshots may still read
+    WalVersion *versions;
+    uint32_t num_versions;
+    uint32_t versions_capacity;
+    WalSnapshot *snapshots;
+    uint32_t num_snapshots;
+    uint32_t snapshots_capacity;
+
+    // Group commit: one committer fsyncs on behalf of everyone waiting
+    pthread_mutex_t lock;
+    pthread_cond_t synced;
+    uint64_t synced_end;        // Bytes known to be durable
+    bool syncing;
+
+    // Checkpointing. The checkpointer thread wakes when the unapplied part
+    // of the log passes checkpoint_bytes, or every checkpoint_interval_ms.
+    Pager *pagers[WAL_MAX_FILES];
+    pthread_mutex_t checkpoint_lock;    // One checkpoint at a time
+    pthread_cond_t wake;
+    pthread_t checkpointer;
+    bool checkpointer_running;
+    bool stopping;
+    uint64_t checkpoint_bytes;
+    uint32_t checkpoint_interval_ms;
+} Wal;
+
+// Opens or creates the log named by the first segment's path and recovers
+// its committed frames. A read-only open of a missing log succeeds with an
+// empty log that cannot be written.
+Wal *wal_open(const char *filename, uint32_t page_size, bool read_only);
+void wal_close(Wal *wal);
+// True when no committed frames are waiting for a checkpoint
+bool wal_is_empty(Wal *wal);
+// Registers the pager holding a file's pages; the checkpoint writes to it
+void wal_set_pager(Wal *wal, uint32_t file, Pager *pager);
+// Starts the log over with a new page size; only for a log with no frames
+DB_Result wal_reset(Wal *wal, uint32_t page_size);
+
+// Copies the first bytes of the page's newest logged image, pending ones
+// first: 1 = read, 0 = not in the log, -1 = I/O error
+int wal_read_page(Wal *wal, uint32_t file, page_num_t page_num, void *dest, size_t bytes);
+// Same, but as a snapshot taken at `lsn` sees the page: the newest
+// committed frame no later than that commit, ignoring the open transaction
+int wal_read_page_at(Wal *wal, uint32_t file, page_num_t page_num, uint64_t lsn,
+                     void *dest, size_t bytes);
+// Adds a page image to the open transaction
+DB_Result wal_append_page(Wal *wal, uint32_t file, page_num_t page_num, const void *data);
+// Ends the open transaction with a commit frame and writes it out. The
+// caller then waits for durability with wal_sync(wal, *commit_end).
+DB_Result wal_commit(Wal *wal, const page_num_t num_pages[WAL_MAX_FILES], uint64_t *commit_end);
+DB_Result wal_sync(Wal *wal, uint64_t end);
+// Forgets the frames of the open transaction
+DB_Result wal_rollback(Wal *wal);
+// Pins the last commit for a snapshot: returns its LSN and the file lengths
+// as of that commit. Every open must be paired with wal_snapshot_close.
+DB_Result wal_snapshot_open(Wal *wal, uint64_t *lsn, page_num_t num_pages[WAL_MAX_FILES]);
+void wal_snapshot_close(Wal *wal, uint64_t lsn);
+// Copies every committed page into the files and fsyncs them, stopping at
+// the oldest open snapshot. Writers keep going meanwhile; the log is
+// emptied if it saw no new frames.
+DB_Result wal_checkpoint(Wal *wal);
+// Runs checkpoints on a background thread until wal_close.
+// 0 = WAL_CHECKPOINT_BYTES / WAL_CHECKPOINT_INTERVAL_MS.
+DB_Result wal_start_checkpointer(Wal *wal, uint64_t checkpoint_bytes, uint32_t interval_ms);
+void wal_stop_checkpointer(Wal *wal);
+
+#endif
@@ -0,0 +1,248 @@
+// Integer keys against a reference model. Random inserts and deletes grow
+// the tree and shrink it again, so leaves and internal nodes borrow from
+// their siblings, merge, and the root collapses level by level. After each
+// round point reads, a forward scan, a backward scan and the key count must
+// agree with the model, also after a reopen. Draining the tree and filling
+// it again must reuse the freed pages instead of growing the file.
+#include "test_util.h"
+#include <sys/stat.h>
+
+#define DB_NAME "test_btree_db"
+#define NUM_KEYS 100000
+#define OPS_PER_TRANSACTION 25000
+
+// The model: key i holds version[i] (0 = absent). Keys ascend with i.
+static uint32_t version[NUM_KEYS];
+static uint32_t next_version = 1;
+static uint64_t random_state = 42;
+static uint32_t key_bits;
+
+static uint32_t next_random(void) {
+    random_state = random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(random_state >> 33);
+}
+
+// Spread out, and above 32 bits in a 64-bit database
+static uint64_t key_at(uint32_t i) {
+    return key_bits == 64 ? ((uint64_t)1 << 40) + (uint64_t)i * 1000003 : (uint64_t)i * 7;
+}
+
+static size_t make_value(char *value, size_t size, uint32_t i, uint32_t v) {
+    return (size_t)snprintf(value, size, "%u:%u", i, v) + 1;
+}
+
+static void put(stark_db_t *db, uint32_t i) {
+    char value[32];
+    uint32_t v = next_version++;
+    size_t length = make_value(value, sizeof(value), i, v);
+    CHECK(stark_add64(db, key_at(i), value, length) == STARK_OK, "put %u failed", i);
+    version[i] = v;
+}
+
+static void del(stark_db_t *db, uint32_t i) {
+    stark_result_t result = stark_delete64(db, key_at(i));
+    CHECK(result == (version[i] ? STARK_OK : STARK_NOT_FOUND), "delete %u returned %d", i, result);
+    version[i] = 0;
+}
+
+// Applies `count` random operations, committing every OPS_PER_TRANSACTION;
+// puts happen insert_percent of the time and deletes otherwise
+static void random_ops(stark_db_t *db, uint32_t count, uint32_t insert_percent) {
+    stark_begin(db);
+    for (uint32_t op = 0; op < count; op++) {
+        uint32_t i = next_random() % NUM_KEYS;
+        if (next_random() % 100 < insert_percent) {
+            put(db, i);
+        } else {
+            del(db, i);
+        }
+        if ((op + 1) % OPS_PER_TRANSACTION == 0) {
+            stark_commit(db);
+            stark_begin(db);
+        }
+    }
+    stark_commit(db);
+}
+
+// Checks the cursor's entry against model key i
+static int check_entry(stark_cursor_t *cursor, uint32_t i, const char *what) {
+    char value[32], expected[32];
+    size_t size = sizeof(value);
+    uint64_t key;
+    if (stark_cursor_get64(cursor, &key, value, &size) != STARK_OK) {
+        CHECK(0, "%s: cursor read failed", what);
+        return 0;
+    }
+    if (key != key_at(i)) {
+        CHECK(0, "%s: scan found %llu where %llu belongs", what, (unsigned long long)key,
+              (unsigned long long)key_at(i));
+        return 0;
+    }
+    size_t length = make_value(expected, sizeof(expected), i, version[i]);
+    CHECK(size == length && memcmp(value, expected, length) == 0, "%s: wrong value for %u", what, i);
+    return 1;
+}
+
+static void verify(stark_db_t *db, const char *what) {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < NUM_KEYS; i++) live += version[i] != 0;
+
+    // Both scans must list exactly the live keys, in order
+    stark_cursor_t *cursor = stark_cursor_create(db);
+    CHECK(cursor != NULL, "%s: cannot create a cursor", what);
+    if (!cursor) return;
+    uint32_t seen = 0;
+    uint32_t i = 0;
+    for (stark_result_t result = stark_cursor_first(cursor); result == STARK_OK;
+         result = stark_cursor_next(cursor)) {
+        while (i < NUM_KEYS && version[i] == 0) i++;
+        if (i == NUM_KEYS) {
+            CHECK(0, "%s: forward scan found an extra key", what);
+            break;
+        }
+        if (!check_entry(cursor, i++, what)) break;
+        seen++;
+    }
+    CHECK(seen == live, "%s: forward scan found %u of %u keys", what, seen, live);
+
+    seen = 0;
+    i = NUM_KEYS;
+    for (stark_result_t result = stark_cursor_last(cursor); result == STARK_OK;
+         result = stark_cursor_prev(cursor)) {
+        while (i > 0 && version[i - 1] == 0) i--;
+        if (i == 0) {
+            CHECK(0, "%s: backward scan found an extra key", what);
+            break;
+        }
+        if (!check_entry(cursor, --i, what)) break;
+        seen++;
+    }
+    CHECK(seen == live, "%s: backward scan found %u of %u keys", what, seen, live);
+    stark_cursor_destroy(cursor);
+
+    // Point reads of live and deleted keys alike
+    char value[32], expected[32];
+    for (i = 0; i < NUM_KEYS; i += 3) {
+        size_t size = sizeof(value);
+        stark_result_t result = stark_get64(db, key_at(i), value, &size);
+        if (version[i]) {
+            size_t length = make_value(expected, sizeof(expected), i, version[i]);
+            CHECK(result == STARK_OK && size == length && memcmp(value, expected, length) == 0,
+                  "%s: key %u is missing or wrong", what, i);
+        } else {
+            CHECK(result == STARK_NOT_FOUND && !stark_exists64(db, key_at(i)),
+                  "%s: deleted key %u is still there", what, i);
+        }
+    }
+
+    stark_stats_t stats;
+    CHECK(stark_stats(db, &stats) == STARK_OK && stats.keys_count == live,
+          "%s: stats count %llu keys, expected %u", what, (unsigned long long)stats.keys_count, live);
+}
+
+static long index_size(void) {
+    struct stat st;
+    return stat(DB_NAME ".idx", &st) == 0 ? (long)st.st_size : -1;
+}
+
+static stark_db_t *open_database(uint32_t page_size) {
+    stark_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.page_size = page_size;
+    options.key_bits = key_bits;
+    return stark_open_ex(DB_NAME, 0, &options);
+}
+
+static void run(uint32_t bits, uint32_t page_size) {
+    char engine[32], what[96];
+    snprintf(engine, sizeof(engine), "%u-bit keys, %u-byte pages", bits, page_size);
+    key_bits = bits;
+    remove_database(DB_NAME);
+    memset(version, 0, sizeof(version));
+
+    stark_db_t *db = open_database(page_size);
+    CHECK(db != NULL, "%s: cannot create the database", engine);
+    if (!db) return;
+
+    // Grow the tree in a shuffled order, so splits happen all over it
+    uint32_t *shuffled = malloc(NUM_KEYS * sizeof(uint32_t));
+    for (uint32_t i = 0; i < NUM_KEYS; i++) shuffled[i] = i;
+    for (uint32_t i = NUM_KEYS - 1; i > 0; i--) {
+        uint32_t j = next_random() % (i + 1);
+        uint32_t swap = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = swap;
+    }
+    stark_begin(db);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) put(db, shuffled[i]);
+    stark_commit(db);
+    stark_stats_t stats;
+    stark_stats(db, &stats);
+    // Small pages reach a third level, so internal nodes rebalance too
+    CHECK(page_size > 4096 || stats.btree_height >= 3, "%s: the tree is only %u levels high",
+          engine, stats.btree_height);
+    snprintf(what, sizeof(what), "%s after inserts", engine);
+    verify(db, what);
+
+    for (int round = 0; round < 2; round++) {
+        random_ops(db, NUM_KEYS, 50);
+        snprintf(what, sizeof(what), "%s after mixed round %d", engine, round + 1);
+        verify(db, what);
+    }
+
+    // Shrink it again, so nodes borrow and merge back down
+    random_ops(db, NUM_KEYS * 3, 5);
+    snprintf(what, sizeof(what), "%s after deletes", engine);
+    verify(db, what);
+
+    stark_close(db);
+    db = open_database(page_size);
+    CHECK(db != NULL, "%s: cannot reopen the database", engine);
+    if (!db) {
+        free(shuffled);
+        return;
+    }
+    snprintf(what, sizeof(what), "%s after reopen", engine);
+    verify(db, what);
+
+    // Fill every key, then drain and refill in the same order: the refill
+    // builds the same tree, and every page it needs was freed by the drain
+    stark_begin(db);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) put(db, shuffled[i]);
+    stark_commit(db);
+    stark_close(db);
+    long full_size = index_size();
+
+    db = open_database(page_size);
+    stark_begin(db);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) del(db, shuffled[i]);
+    stark_commit(db);
+    stark_stats(db, &stats);
+    CHECK(stats.btree_height == 1, "%s: an empty tree is %u levels high", engine, stats.btree_height);
+    snprintf(what, sizeof(what), "%s when drained", engine);
+    verify(db, what);
+
+    // The free list outlives the close
+    stark_close(db);
+    db = open_database(page_size);
+    stark_begin(db);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) put(db, shuffled[i]);
+    stark_commit(db);
+    snprintf(what, sizeof(what), "%s after a refill", engine);
+    verify(db, what);
+    stark_close(db);
+    CHECK(index_size() == full_size, "%s: the index grew from %ld to %ld bytes on a refill",
+          engine, full_size, index_size());
+
+    free(shuffled);
+    remove_database(DB_NAME);
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    run(32, 4096);
+    run(64, 4096);
+    run(32, 16384);
+    run(64, 16384);
+    return test_result("Integer keys");
+}
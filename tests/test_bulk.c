@@ -0,0 +1,155 @@
+// Bulk load against a reference model. Unsorted input with repeated keys
+// is spilled across many small sort runs, so the merge has to pick the
+// last record of a key both within a run and across runs; presorted input
+// repeats keys too. The loaded database must hold exactly the last record
+// of every key.
+#include "test_util.h"
+
+#define DB_NAME "test_bulk_db"
+#define NUM_KEYS 20000
+#define NUM_RECORDS 60000
+#define MAX_VALUE 6000          // A few values need overflow pages
+
+// The model: the sequence number of the last record of each key (0 = none)
+static uint32_t last_record[NUM_KEYS];
+
+// Replays the input: record n (1-based) carries `keys[n - 1]`
+typedef struct {
+    const uint32_t *keys;
+    uint32_t count;
+    uint32_t next;
+    char value[MAX_VALUE];
+} Source;
+
+static size_t make_value(char *value, uint32_t key, uint32_t record) {
+    size_t length = record % 997 == 0 ? MAX_VALUE : 8 + (key * 31 + record) % 300;
+    memset(value, 'a' + record % 26, length);
+    snprintf(value, length, "%u#%u", key, record);
+    return length;
+}
+
+static int next_record(void *context, uint32_t *key, const void **data, size_t *size) {
+    Source *source = context;
+    if (source->next == source->count) return 0;
+    uint32_t record = ++source->next;
+    *key = source->keys[record - 1];
+    *size = make_value(source->value, *key, record);
+    *data = source->value;
+    return 1;
+}
+
+static void verify(stark_db_t *db, const char *what) {
+    static char value[MAX_VALUE], expected[MAX_VALUE];
+    uint32_t live = 0;
+    for (uint32_t key = 0; key < NUM_KEYS; key++) {
+        size_t size = sizeof(value);
+        stark_result_t result = stark_get(db, key, value, &size);
+        if (!last_record[key]) {
+            CHECK(result == STARK_NOT_FOUND, "%s: key %u was never loaded", what, key);
+            continue;
+        }
+        live++;
+        size_t length = make_value(expected, key, last_record[key]);
+        CHECK(result == STARK_OK && size == length && memcmp(value, expected, length) == 0,
+              "%s: key %u does not hold record %u", what, key, last_record[key]);
+    }
+
+    // Each key appears once, in order
+    stark_cursor_t *cursor = stark_cursor_create(db);
+    uint32_t count = 0;
+    uint32_t previous = 0;
+    for (stark_result_t result = stark_cursor_first(cursor); result == STARK_OK;
+         result = stark_cursor_next(cursor)) {
+        uint32_t key;
+        size_t size = sizeof(value);
+        if (stark_cursor_get(cursor, &key, value, &size) != STARK_OK) {
+            CHECK(0, "%s: cursor read failed", what);
+            break;
+        }
+        CHECK(count == 0 || key > previous, "%s: key %u follows %u", what, key, previous);
+        previous = key;
+        count++;
+    }
+    stark_cursor_destroy(cursor);
+    CHECK(count == live, "%s: scan found %u keys, expected %u", what, count, live);
+}
+
+static void load(const uint32_t *keys, uint32_t count, const stark_bulk_options_t *options,
+                 const char *what) {
+    remove_database(DB_NAME);
+    memset(last_record, 0, sizeof(last_record));
+    for (uint32_t n = 0; n < count; n++) last_record[keys[n]] = n + 1;
+
+    stark_db_t *db = stark_open(DB_NAME, 0);
+    CHECK(db != NULL, "%s: cannot create the database", what);
+    if (!db) return;
+    Source *source = calloc(1, sizeof(Source));
+    source->keys = keys;
+    source->count = count;
+    CHECK(stark_bulk_load(db, next_record, source, options) == STARK_OK, "%s: load failed", what);
+    verify(db, what);
+    free(source);
+
+    stark_close(db);
+    db = stark_open(DB_NAME, 0);
+    CHECK(db != NULL, "%s: cannot reopen the database", what);
+    if (db) {
+        verify(db, what);
+        stark_close(db);
+    }
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    uint32_t *keys = malloc(NUM_RECORDS * sizeof(uint32_t));
+    uint64_t state = 7;
+
+    // Random keys, about three records each
+    for (uint32_t n = 0; n < NUM_RECORDS; n++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        keys[n] = (uint32_t)(state >> 33) % NUM_KEYS;
+    }
+    stark_bulk_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.sort_memory = 64 << 10;
+    load(keys, NUM_RECORDS, &options, "spilled runs");
+
+    options.sort_memory = 0;
+    load(keys, NUM_RECORDS, &options, "in-memory sort");
+
+    // Ascending input in which some keys repeat back to back
+    uint32_t count = 0;
+    for (uint32_t key = 0; key < NUM_KEYS && count + 3 <= NUM_RECORDS; key += 2) {
+        keys[count++] = key;
+        if (key % 3 == 0) keys[count++] = key;
+        if (key % 9 == 0) keys[count++] = key;
+    }
+    memset(&options, 0, sizeof(options));
+    options.presorted = 1;
+    options.fill_percent = 100;
+    load(keys, count, &options, "presorted");
+
+    // Out of order presorted input, and a second load, are refused
+    stark_db_t *db = stark_open(DB_NAME, 0);
+    if (db) {
+        Source source = { keys, count, 0, { 0 } };
+        CHECK(stark_bulk_load(db, next_record, &source, NULL) == STARK_ERROR,
+              "loaded into a database that is not empty");
+        CHECK(source.next == 0, "read %u records for a database that is not empty", source.next);
+        stark_close(db);
+    }
+    remove_database(DB_NAME);
+    keys[0] = 5;
+    keys[1] = 3;
+    db = stark_open(DB_NAME, 0);
+    if (db) {
+        Source source = { keys, 2, 0, { 0 } };
+        CHECK(stark_bulk_load(db, next_record, &source, &options) == STARK_ERROR,
+              "accepted presorted input out of order");
+        stark_close(db);
+    }
+
+    free(keys);
+    remove_database(DB_NAME);
+    return test_result("Bulk load");
+}
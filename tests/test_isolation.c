@@ -0,0 +1,105 @@
+// Isolation of an open transaction. Its own thread reads its changes; other
+// threads wait until it ends and then see only what it committed, never the
+// changes of a transaction that rolls back. Snapshots read the last commit
+// without waiting.
+#include "test_util.h"
+#include <pthread.h>
+
+#define DB_NAME "test_isolation_db"
+#define NUM_KEYS 200
+
+static stark_db_t *db;
+
+static void make_value(char *value, size_t size, uint32_t key, const char *version) {
+    snprintf(value, size, "%s-%u", version, key);
+}
+
+// Writes every key with the given version
+static void write_all(const char *version) {
+    char value[32];
+    for (uint32_t key = 0; key < NUM_KEYS; key++) {
+        make_value(value, sizeof(value), key, version);
+        stark_add(db, key, value, strlen(value) + 1);
+    }
+}
+
+// Number of keys that do not hold `version`
+static uint32_t count_other(const char *version) {
+    char value[32], expected[32];
+    uint32_t other = 0;
+    for (uint32_t key = 0; key < NUM_KEYS; key++) {
+        size_t size = sizeof(value);
+        make_value(expected, sizeof(expected), key, version);
+        if (stark_get(db, key, value, &size) != STARK_OK || strcmp(value, expected) != 0) other++;
+    }
+    return other;
+}
+
+typedef struct {
+    const char *expected;
+    uint32_t wrong;
+    int done;
+} Reader;
+
+static void *reader_main(void *arg) {
+    Reader *reader = arg;
+    reader->wrong = count_other(reader->expected);
+    __atomic_store_n(&reader->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Starts a reader expecting `version` while this thread's transaction is
+// open, and checks that it is still waiting when the transaction ends
+static void read_across(const char *version, int commit, const char *what) {
+    Reader reader = { version, 0, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, reader_main, &reader);
+    usleep(100 * 1000);
+    CHECK(!__atomic_load_n(&reader.done, __ATOMIC_ACQUIRE),
+          "%s: a reader went ahead of the open transaction", what);
+    CHECK(count_other("new") == 0, "%s: the transaction does not read its own changes", what);
+
+    // A snapshot pins the last commit and does not wait
+    stark_snapshot_t *snapshot = stark_snapshot_open(db);
+    CHECK(snapshot != NULL, "%s: cannot open a snapshot", what);
+    if (snapshot) {
+        char value[32], expected[32];
+        size_t size = sizeof(value);
+        make_value(expected, sizeof(expected), 7, "old");
+        CHECK(stark_snapshot_get(snapshot, 7, value, &size) == STARK_OK && strcmp(value, expected) == 0,
+              "%s: the snapshot sees the open transaction", what);
+        stark_snapshot_close(snapshot);
+    }
+
+    if (commit) {
+        stark_commit(db);
+    } else {
+        stark_rollback(db);
+    }
+    pthread_join(thread, NULL);
+    CHECK(reader.wrong == 0, "%s: the reader found %u keys not from %s", what, reader.wrong, version);
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    remove_database(DB_NAME);
+    db = stark_open(DB_NAME, 0);
+    CHECK(db != NULL, "cannot create the database");
+    if (!db) return 1;
+
+    // A deadlock fails the test instead of hanging it
+    alarm(30);
+    write_all("old");
+
+    stark_begin(db);
+    write_all("new");
+    read_across("old", 0, "rolled back");
+
+    stark_begin(db);
+    write_all("new");
+    read_across("new", 1, "committed");
+
+    stark_close(db);
+    remove_database(DB_NAME);
+    return test_result("Transaction isolation");
+}
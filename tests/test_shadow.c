@@ -0,0 +1,148 @@
+// Meta slot fallback of the shadow-paging engine. A child process commits a
+// series of transactions and dies without closing; the newest meta of one
+// file is then damaged or lost, and each reopen must land both files on the
+// commit before it.
+#include "test_util.h"
+#include "shadow.h"
+#include <fcntl.h>
+#include <stddef.h>
+
+#define DB_NAME "test_shadow_db"
+#define SAVED "test_shadow_saved"       // Files as the writer crashed
+#define PREVIOUS "test_shadow_previous" // Files before its last commit
+#define COMMITS 8
+#define PAGE_SIZE 4096
+
+// The database must hold exactly the first `commits` commits
+static void verify_state(int commits, const char *what) {
+    stark_db_t *db = stark_open(DB_NAME, STARK_OPEN_SHADOW);
+    CHECK(db != NULL, "%s: reopen failed", what);
+    if (!db) return;
+
+    check_commits(db, commits, COMMITS, what);
+    stark_close(db);
+}
+
+// Slot holding the newest meta of a file, or -1 if neither is readable
+static int newest_slot(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    int newest = -1;
+    uint64_t generation = 0;
+    ShadowMeta meta;
+    for (int slot = 0; slot < SHADOW_META_SLOTS; slot++) {
+        if (pread(fd, &meta, sizeof(meta), (off_t)slot * PAGE_SIZE) == sizeof(meta) &&
+            meta.magic == SHADOW_MAGIC && (newest < 0 || meta.generation > generation)) {
+            newest = slot;
+            generation = meta.generation;
+        }
+    }
+    close(fd);
+    return newest;
+}
+
+// Overwrites `bytes` of a meta slot with `data`, at `offset` into the slot
+static void write_slot(const char *path, int slot, off_t offset, const void *data, size_t bytes) {
+    int fd = open(path, O_RDWR);
+    CHECK(fd >= 0 && pwrite(fd, data, bytes, (off_t)slot * PAGE_SIZE + offset) == (ssize_t)bytes,
+          "cannot write %s", path);
+    if (fd >= 0) close(fd);
+}
+
+// Flips one byte of the newest meta of DB_NAME + extension
+static void damage_newest(const char *extension, off_t offset) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", DB_NAME, extension);
+    int slot = newest_slot(path);
+    CHECK(slot >= 0, "%s has no meta", path);
+    if (slot < 0) return;
+
+    int fd = open(path, O_RDWR);
+    unsigned char byte = 0;
+    if (fd >= 0 && pread(fd, &byte, 1, (off_t)slot * PAGE_SIZE + offset) == 1) {
+        byte ^= 0x5A;
+        CHECK(pwrite(fd, &byte, 1, (off_t)slot * PAGE_SIZE + offset) == 1, "cannot write %s", path);
+    } else {
+        CHECK(0, "cannot read %s", path);
+    }
+    if (fd >= 0) close(fd);
+}
+
+// Puts back what the newest meta slot of DB_NAME + extension held before
+// the last commit, as if that meta write never reached the disk
+static void lose_newest(const char *extension) {
+    char path[256], previous[256];
+    snprintf(path, sizeof(path), "%s%s", DB_NAME, extension);
+    snprintf(previous, sizeof(previous), "%s%s", PREVIOUS, extension);
+    int slot = newest_slot(path);
+    CHECK(slot >= 0, "%s has no meta", path);
+    if (slot < 0) return;
+
+    char page[PAGE_SIZE];
+    int fd = open(previous, O_RDONLY);
+    if (fd >= 0 && pread(fd, page, sizeof(page), (off_t)slot * PAGE_SIZE) == sizeof(page)) {
+        write_slot(path, slot, 0, page, sizeof(page));
+    } else {
+        CHECK(0, "cannot read %s", previous);
+    }
+    if (fd >= 0) close(fd);
+}
+
+// Runs in a child that dies without closing
+static int write_commits(void *context) {
+    (void)context;
+    stark_db_t *db = stark_open(DB_NAME, STARK_OPEN_SHADOW);
+    if (!db) return 1;
+    for (int commit = 1; commit <= COMMITS; commit++) {
+        // Commits are fsynced, so the files on disk are those of the
+        // commit before this one
+        if (commit == COMMITS) copy_database(DB_NAME, PREVIOUS);
+        write_commit(db, commit);
+    }
+    return 0;
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    remove_database(DB_NAME);
+    remove_database(SAVED);
+    remove_database(PREVIOUS);
+
+    if (run_crashing(write_commits, NULL) != 0) {
+        CHECK(0, "writer process failed");
+    } else {
+        copy_database(DB_NAME, SAVED);
+        verify_state(COMMITS, "intact metas");
+
+        // Either file falling back takes the other with it
+        copy_database(SAVED, DB_NAME);
+        damage_newest(".idx", offsetof(ShadowMeta, num_pages));
+        verify_state(COMMITS - 1, "damaged index meta");
+
+        copy_database(SAVED, DB_NAME);
+        damage_newest(".dat", offsetof(ShadowMeta, map_pages));
+        verify_state(COMMITS - 1, "damaged data meta");
+
+        copy_database(SAVED, DB_NAME);
+        lose_newest(".idx");
+        verify_state(COMMITS - 1, "lost index meta");
+
+        copy_database(SAVED, DB_NAME);
+        lose_newest(".dat");
+        verify_state(COMMITS - 1, "lost data meta");
+
+        // With no intact meta at all the open must fail, not invent a state
+        copy_database(SAVED, DB_NAME);
+        char zeros[PAGE_SIZE] = { 0 };
+        write_slot(DB_NAME ".idx", 0, 0, zeros, sizeof(zeros));
+        write_slot(DB_NAME ".idx", 1, 0, zeros, sizeof(zeros));
+        stark_db_t *db = stark_open(DB_NAME, STARK_OPEN_SHADOW);
+        CHECK(db == NULL, "opened an index with no intact meta");
+        if (db) stark_close(db);
+    }
+
+    remove_database(DB_NAME);
+    remove_database(SAVED);
+    remove_database(PREVIOUS);
+    return test_result("Shadow metas");
+}
@@ -0,0 +1,251 @@
+// String keys against a reference model. The keys share long prefixes,
+// some are prefixes of others and some are near the length limit, so nodes
+// split and merge with node prefixes and truncated separators of every
+// size. After each round of random writes a full cursor scan, point reads
+// and prefix seeks must agree with the model, also after a reopen.
+#include "test_util.h"
+
+#define DB_NAME "test_strtree_db"
+#define NUM_KEYS 6000
+#define OPS_PER_TRANSACTION 500
+
+// The model: key i holds version[i] (0 = absent), and order[] lists the
+// keys in byte order
+static char *keys[NUM_KEYS];
+static uint32_t version[NUM_KEYS];
+static uint32_t order[NUM_KEYS];
+static uint32_t next_version = 1;
+static uint64_t random_state = 42;
+
+static uint32_t next_random(void) {
+    random_state = random_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(random_state >> 33);
+}
+
+// Five shapes: a namespaced key, the same key cut short so it is a prefix
+// of the first, long keys that differ only past a shared run of hundreds of
+// bytes, keys of up to 400 bytes of padding, and short numbers
+static char *make_key(uint32_t i) {
+    char key[STARK_MAX_STR_KEY + 1];
+    uint32_t n = i / 5;
+    switch (i % 5) {
+        case 0: snprintf(key, sizeof(key), "player:%06u:inventory", n); break;
+        case 1: snprintf(key, sizeof(key), "player:%06u", n); break;
+        case 2: {
+            int length = snprintf(key, sizeof(key), "type:item:%06u:", n);
+            uint32_t padding = (i * 37) % 400;
+            memset(key + length, 'x', padding);
+            key[length + padding] = '\0';
+            break;
+        }
+        case 3:
+            memset(key, 'q', 300);
+            snprintf(key + 300, sizeof(key) - 300, "%06u", n);
+            break;
+        default: snprintf(key, sizeof(key), "%u", n); break;
+    }
+    return strdup(key);
+}
+
+static int compare_keys(const void *a, const void *b) {
+    return strcmp(keys[*(const uint32_t *)a], keys[*(const uint32_t *)b]);
+}
+
+// Values vary in length with the version, so rewrites move records around
+static size_t make_value(char *value, uint32_t i, uint32_t v) {
+    size_t length = 16 + (i * 7 + v * 13) % 200;
+    memset(value, 'a' + v % 26, length);
+    snprintf(value, length, "%u/%u", i, v);
+    return length;
+}
+
+static void put(stark_db_t *db, uint32_t i) {
+    char value[256];
+    uint32_t v = next_version++;
+    size_t length = make_value(value, i, v);
+    CHECK(stark_put_str(db, keys[i], value, length) == STARK_OK, "put %s failed", keys[i]);
+    version[i] = v;
+}
+
+static void del(stark_db_t *db, uint32_t i) {
+    stark_result_t result = stark_del_str(db, keys[i]);
+    CHECK(result == (version[i] ? STARK_OK : STARK_NOT_FOUND), "delete %s returned %d", keys[i], result);
+    version[i] = 0;
+}
+
+// Applies `count` random operations, committing every OPS_PER_TRANSACTION;
+// puts happen insert_percent of the time and deletes otherwise
+static void random_ops(stark_db_t *db, uint32_t count, uint32_t insert_percent) {
+    stark_begin(db);
+    for (uint32_t op = 0; op < count; op++) {
+        uint32_t i = next_random() % NUM_KEYS;
+        if (next_random() % 100 < insert_percent) {
+            put(db, i);
+        } else {
+            del(db, i);
+        }
+        if ((op + 1) % OPS_PER_TRANSACTION == 0) {
+            stark_commit(db);
+            stark_begin(db);
+        }
+    }
+    stark_commit(db);
+}
+
+static void check_value(const char *what, uint32_t i, const char *value, size_t size) {
+    char expected[256];
+    size_t length = make_value(expected, i, version[i]);
+    CHECK(size == length && memcmp(value, expected, length) == 0,
+          "%s: wrong value for %s", what, keys[i]);
+}
+
+static void verify(stark_db_t *db, const char *what) {
+    char key[STARK_MAX_STR_KEY + 1];
+    char value[256];
+    size_t size;
+
+    // The scan must list exactly the live keys, in byte order
+    stark_str_cursor_t *cursor = stark_str_cursor_create(db);
+    CHECK(cursor != NULL, "%s: cannot create a cursor", what);
+    if (!cursor) return;
+    stark_result_t result = stark_str_cursor_seek(cursor, "");
+    uint32_t position = 0;
+    uint32_t live = 0;
+    while (result == STARK_OK) {
+        while (position < NUM_KEYS && version[order[position]] == 0) position++;
+        size = sizeof(value);
+        if (stark_str_cursor_get(cursor, key, sizeof(key), value, &size) != STARK_OK) {
+            CHECK(0, "%s: cursor read failed", what);
+            break;
+        }
+        if (position == NUM_KEYS) {
+            CHECK(0, "%s: scan found extra key %s", what, key);
+            break;
+        }
+        uint32_t i = order[position++];
+        if (strcmp(key, keys[i]) != 0) {
+            CHECK(0, "%s: scan found %.40s where %.40s belongs", what, key, keys[i]);
+            break;
+        }
+        check_value(what, i, value, size);
+        live++;
+        result = stark_str_cursor_next(cursor);
+    }
+    while (position < NUM_KEYS && version[order[position]] == 0) position++;
+    CHECK(position == NUM_KEYS, "%s: scan stopped early at %u live keys", what, live);
+
+    // Seeking a prefix lands on the first key that starts with it, or
+    // the next key above it
+    for (uint32_t probe = 0; probe < 200; probe++) {
+        uint32_t n = next_random() % (NUM_KEYS / 5);
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "player:%06u", n);
+        uint32_t first = 0;
+        while (first < NUM_KEYS &&
+               (version[order[first]] == 0 || strcmp(keys[order[first]], prefix) < 0)) {
+            first++;
+        }
+        result = stark_str_cursor_seek(cursor, prefix);
+        if (first == NUM_KEYS) {
+            CHECK(result == STARK_NOT_FOUND, "%s: seek past the last key found one", what);
+            continue;
+        }
+        CHECK(result == STARK_OK &&
+              stark_str_cursor_get(cursor, key, sizeof(key), NULL, NULL) == STARK_OK &&
+              strcmp(key, keys[order[first]]) == 0,
+              "%s: seek to %s did not land on %.40s", what, prefix, keys[order[first]]);
+    }
+
+    // A key buffer too small fails without writing the value
+    if (stark_str_cursor_seek(cursor, "") == STARK_OK) {
+        memset(value, '#', sizeof(value));
+        size = sizeof(value);
+        CHECK(stark_str_cursor_get(cursor, key, 1, value, &size) == STARK_ERROR &&
+              value[0] == '#' && size == sizeof(value),
+              "%s: a short key buffer still read the value", what);
+    }
+    stark_str_cursor_destroy(cursor);
+
+    // Point reads of live and deleted keys alike
+    for (uint32_t i = 0; i < NUM_KEYS; i += 7) {
+        size = sizeof(value);
+        result = stark_get_str(db, keys[i], value, &size);
+        if (version[i]) {
+            CHECK(result == STARK_OK, "%s: %s is missing", what, keys[i]);
+            if (result == STARK_OK) check_value(what, i, value, size);
+        } else {
+            CHECK(result == STARK_NOT_FOUND && !stark_exists_str(db, keys[i]),
+                  "%s: deleted key %s is still there", what, keys[i]);
+        }
+    }
+}
+
+static void run(unsigned flags, const char *engine) {
+    char what[64];
+    remove_database(DB_NAME);
+    memset(version, 0, sizeof(version));
+
+    stark_db_t *db = stark_open_ex(DB_NAME, flags, NULL);
+    CHECK(db != NULL, "%s: cannot create the database", engine);
+    if (!db) return;
+
+    // Grow the tree in a shuffled order, so splits happen all over it
+    uint32_t *shuffled = malloc(NUM_KEYS * sizeof(uint32_t));
+    for (uint32_t i = 0; i < NUM_KEYS; i++) shuffled[i] = i;
+    for (uint32_t i = NUM_KEYS - 1; i > 0; i--) {
+        uint32_t j = next_random() % (i + 1);
+        uint32_t swap = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = swap;
+    }
+    stark_begin(db);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) put(db, shuffled[i]);
+    stark_commit(db);
+    snprintf(what, sizeof(what), "%s after inserts", engine);
+    verify(db, what);
+
+    for (int round = 0; round < 3; round++) {
+        random_ops(db, NUM_KEYS, 50);
+        snprintf(what, sizeof(what), "%s after mixed round %d", engine, round + 1);
+        verify(db, what);
+    }
+
+    // Shrink it again, so nodes merge back down
+    random_ops(db, NUM_KEYS * 4, 5);
+    snprintf(what, sizeof(what), "%s after deletes", engine);
+    verify(db, what);
+
+    stark_close(db);
+    db = stark_open_ex(DB_NAME, flags, NULL);
+    CHECK(db != NULL, "%s: cannot reopen the database", engine);
+    if (db) {
+        snprintf(what, sizeof(what), "%s after reopen", engine);
+        verify(db, what);
+
+        stark_begin(db);
+        for (uint32_t i = 0; i < NUM_KEYS; i++) {
+            if (version[shuffled[i]]) del(db, shuffled[i]);
+        }
+        stark_commit(db);
+        snprintf(what, sizeof(what), "%s when empty", engine);
+        verify(db, what);
+        stark_close(db);
+    }
+    free(shuffled);
+    remove_database(DB_NAME);
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    for (uint32_t i = 0; i < NUM_KEYS; i++) {
+        keys[i] = make_key(i);
+        order[i] = i;
+    }
+    qsort(order, NUM_KEYS, sizeof(uint32_t), compare_keys);
+
+    run(0, "log");
+    run(STARK_OPEN_SHADOW, "shadow");
+
+    for (uint32_t i = 0; i < NUM_KEYS; i++) free(keys[i]);
+    return test_result("String keys");
+}
@@ -0,0 +1,137 @@
+// Shared by the test programs. Each test is a single translation unit, so
+// everything here is static; helpers a test does not use cost nothing.
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include "stark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+// Ends main: reports the checks and returns the exit status
+static inline int test_result(const char *name) {
+    if (failures) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", name);
+    return 0;
+}
+
+// ==================== DATABASE FILES ====================
+
+// Every file a database can have; the shadow engine uses only the first two
+#define NUM_EXTENSIONS 4
+
+static const char *const extensions[NUM_EXTENSIONS] = { ".idx", ".dat", ".wal", ".wal2" };
+
+static inline void remove_database(const char *name) {
+    char path[256];
+    for (int i = 0; i < NUM_EXTENSIONS; i++) {
+        snprintf(path, sizeof(path), "%s%s", name, extensions[i]);
+        unlink(path);
+    }
+}
+
+// Makes `to` a copy of `from`, without the files `from` does not have
+static inline void copy_database(const char *from, const char *to) {
+    char source[256], target[256], buffer[65536];
+    for (int i = 0; i < NUM_EXTENSIONS; i++) {
+        snprintf(source, sizeof(source), "%s%s", from, extensions[i]);
+        snprintf(target, sizeof(target), "%s%s", to, extensions[i]);
+        FILE *in = fopen(source, "rb");
+        if (!in) {
+            unlink(target);
+            continue;
+        }
+        FILE *out = fopen(target, "wb");
+        size_t n;
+        while (out && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+            fwrite(buffer, 1, n, out);
+        }
+        fclose(in);
+        if (out) fclose(out);
+    }
+}
+
+// ==================== COMMIT SERIES ====================
+
+// Crash tests write a series of commits, cut the writer off and check which
+// commits survive. Commit c (1-based) adds KEYS_PER_COMMIT new keys and
+// rewrites key 0.
+#define KEYS_PER_COMMIT 20
+#define VALUE_SIZE 200
+
+static inline void commit_value(char *value, uint32_t key, int commit) {
+    memset(value, 'a' + key % 26, VALUE_SIZE);
+    snprintf(value, VALUE_SIZE, "%u@%d", key, commit);
+}
+
+static inline void write_commit(stark_db_t *db, int commit) {
+    char value[VALUE_SIZE];
+    stark_begin(db);
+    for (uint32_t i = 0; i < KEYS_PER_COMMIT; i++) {
+        uint32_t key = commit * 100 + i;
+        commit_value(value, key, commit);
+        stark_add(db, key, value, sizeof(value));
+    }
+    commit_value(value, 0, commit);
+    stark_add(db, 0, value, sizeof(value));
+    stark_commit(db);
+}
+
+// The database must hold exactly the first `commits` of `total` commits
+static inline void check_commits(stark_db_t *db, int commits, int total, const char *what) {
+    char value[VALUE_SIZE], expected[VALUE_SIZE];
+    size_t size = sizeof(value);
+    stark_result_t result = stark_get(db, 0, value, &size);
+    commit_value(expected, 0, commits);
+    if (commits == 0) {
+        CHECK(result == STARK_NOT_FOUND, "%s: key 0 exists before any commit", what);
+    } else {
+        CHECK(result == STARK_OK && memcmp(value, expected, VALUE_SIZE) == 0,
+              "%s: key 0 is not from commit %d", what, commits);
+    }
+
+    for (int commit = 1; commit <= total; commit++) {
+        for (uint32_t i = 0; i < KEYS_PER_COMMIT; i++) {
+            uint32_t key = commit * 100 + i;
+            size = sizeof(value);
+            result = stark_get(db, key, value, &size);
+            if (commit <= commits) {
+                commit_value(expected, key, commit);
+                CHECK(result == STARK_OK && memcmp(value, expected, VALUE_SIZE) == 0,
+                      "%s: key %u of commit %d is missing or wrong", what, key, commit);
+            } else {
+                CHECK(result == STARK_NOT_FOUND,
+                      "%s: key %u of lost commit %d survived", what, key, commit);
+            }
+        }
+    }
+}
+
+// Runs body in a child process that exits without closing anything, as a
+// crash would. Returns 0 if the body returned 0.
+static inline int run_crashing(int (*body)(void *context), void *context) {
+    pid_t child = fork();
+    if (child < 0) return -1;
+    if (child == 0) _exit(body(context));
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,89 @@
+// Zero-copy views against writes. A thread holding a view cannot write,
+// begin, commit or roll back: it would wait for itself, so it gets an error
+// instead. Another thread's writes wait for the view. A view released on
+// another thread no longer counts against the thread that took it.
+#include "test_util.h"
+#include <pthread.h>
+
+#define DB_NAME "test_views_db"
+
+static stark_db_t *db;
+
+static int take_view(uint32_t key, stark_pin_t *pin) {
+    const void *value;
+    size_t size;
+    return stark_get_view(db, key, &value, &size, pin) == STARK_OK;
+}
+
+typedef struct {
+    stark_pin_t *pin;           // Released by the thread if set
+    stark_result_t result;      // Of a write otherwise
+    int done;
+} Helper;
+
+static void *helper_main(void *arg) {
+    Helper *helper = arg;
+    if (helper->pin) {
+        stark_release(helper->pin);
+    } else {
+        helper->result = stark_add(db, 2, "other", 6);
+    }
+    __atomic_store_n(&helper->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    remove_database(DB_NAME);
+    db = stark_open(DB_NAME, 0);
+    CHECK(db != NULL, "cannot create the database");
+    if (!db) return 1;
+
+    // A deadlock fails the test instead of hanging it
+    alarm(30);
+    CHECK(stark_add(db, 1, "first", 6) == STARK_OK, "setup write failed");
+
+    // The view's own thread is refused, not left waiting
+    stark_pin_t pin;
+    CHECK(take_view(1, &pin), "cannot take a view");
+    CHECK(stark_add(db, 1, "second", 7) == STARK_ERROR, "wrote while holding a view");
+    CHECK(stark_delete(db, 1) == STARK_ERROR, "deleted while holding a view");
+    CHECK(stark_begin(db) == STARK_ERROR, "began a transaction while holding a view");
+
+    // Another thread's write waits for the view instead
+    Helper helper = { NULL, STARK_ERROR, 0 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, helper_main, &helper);
+    usleep(100 * 1000);
+    CHECK(!__atomic_load_n(&helper.done, __ATOMIC_ACQUIRE), "a write went ahead of an open view");
+    stark_release(&pin);
+    pthread_join(thread, NULL);
+    CHECK(helper.result == STARK_OK, "the waiting write failed");
+    CHECK(stark_add(db, 1, "second", 7) == STARK_OK, "cannot write after releasing the view");
+
+    // A view taken inside a transaction holds off its end
+    CHECK(stark_begin(db) == STARK_OK, "cannot begin");
+    CHECK(stark_add(db, 3, "third", 6) == STARK_OK, "cannot write in the transaction");
+    CHECK(take_view(3, &pin), "cannot view the transaction's own write");
+    CHECK(stark_add(db, 4, "fourth", 7) == STARK_ERROR, "wrote in a transaction while holding a view");
+    CHECK(stark_commit(db) == STARK_ERROR, "committed while holding a view");
+    CHECK(stark_rollback(db) == STARK_ERROR, "rolled back while holding a view");
+    stark_release(&pin);
+    CHECK(stark_commit(db) == STARK_OK, "cannot commit after releasing the view");
+
+    // Released on another thread, the view stops counting against this one
+    CHECK(take_view(1, &pin), "cannot take a view");
+    Helper releaser = { &pin, STARK_OK, 0 };
+    pthread_create(&thread, NULL, helper_main, &releaser);
+    pthread_join(thread, NULL);
+    CHECK(stark_add(db, 1, "third", 6) == STARK_OK, "a view released elsewhere still counts here");
+
+    char value[16];
+    size_t size = sizeof(value);
+    CHECK(stark_get(db, 3, value, &size) == STARK_OK && strcmp(value, "third") == 0,
+          "the transaction's write is missing");
+
+    stark_close(db);
+    remove_database(DB_NAME);
+    return test_result("Views");
+}
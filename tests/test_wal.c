@@ -0,0 +1,247 @@
+// Crash recovery from the write-ahead log. A child process commits a series
+// of transactions and dies without closing; the log is then cut or damaged
+// at chosen points, and each reopen must show exactly the state of the last
+// commit that survived intact.
+#include "test_util.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#define DB_NAME "test_wal_db"
+#define SAVED "test_wal_saved"       // Files as the writer crashed
+#define BASE "test_wal_base"         // Files after its setup commit
+#define COMMITS 12
+
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+// Checkpoints only when asked, so every commit stays in the log
+static stark_options_t log_only_options(void) {
+    stark_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.checkpoint_bytes = 1ull << 40;
+    options.checkpoint_interval_ms = 3600 * 1000;
+    return options;
+}
+
+// The database must hold exactly the first `commits` commits
+static void verify_state(const char *name, int commits, const char *what) {
+    stark_options_t options = log_only_options();
+    stark_db_t *db = stark_open_ex(name, 0, &options);
+    CHECK(db != NULL, "%s: reopen failed", what);
+    if (!db) return;
+
+    check_commits(db, commits, COMMITS, what);
+    stark_close(db);
+}
+
+// Restores the crashed files, cuts a log segment to `length` bytes and
+// checks that recovery lands on commit `commits`
+static void check_cut(const char *segment, long length, int commits, const char *what) {
+    copy_database(SAVED, DB_NAME);
+    if (truncate(segment, length) != 0) {
+        CHECK(0, "%s: cannot truncate the log", what);
+        return;
+    }
+    verify_state(DB_NAME, commits, what);
+}
+
+// Flips one byte of a log segment at `offset`
+static void check_damage(const char *segment, long offset, int commits, const char *what) {
+    copy_database(SAVED, DB_NAME);
+    int fd = open(segment, O_RDWR);
+    unsigned char byte = 0;
+    if (fd < 0 || pread(fd, &byte, 1, offset) != 1) {
+        CHECK(0, "%s: cannot read the log", what);
+        if (fd >= 0) close(fd);
+        return;
+    }
+    byte ^= 0x5A;
+    CHECK(pwrite(fd, &byte, 1, offset) == 1, "%s: cannot write the log", what);
+    close(fd);
+    verify_state(DB_NAME, commits, what);
+}
+
+// What write_commits does in the child
+typedef struct {
+    int commits;
+    bool fresh;
+    int fd;                     // Receives the log length after each step
+} Writer;
+
+static int write_commits(void *context) {
+    Writer *writer = context;
+    stark_options_t options = log_only_options();
+    stark_db_t *db = stark_open_ex(DB_NAME, 0, &options);
+    if (!db) return 1;
+    if (writer->fresh) {
+        stark_add(db, 1, "setup", 5);
+        copy_database(DB_NAME, BASE);
+    }
+    stark_sync(db);
+    long size = file_size(DB_NAME ".wal");
+    if (write(writer->fd, &size, sizeof(size)) != sizeof(size)) return 1;
+    for (int commit = 1; commit <= writer->commits; commit++) {
+        write_commit(db, commit);
+        size = file_size(DB_NAME ".wal");
+        if (write(writer->fd, &size, sizeof(size)) != sizeof(size)) return 1;
+    }
+    return 0;
+}
+
+// Runs `commits` commits in a child that dies without closing; log_sizes[c]
+// is the log length once commit c is durable, and log_sizes[0] the length
+// before any. A fresh run first logs one setup commit and saves the files
+// under BASE; every run then checkpoints, which starts a log generation
+// with a salt of its own.
+static int crash_after_commits(int commits, long *log_sizes, bool fresh) {
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+
+    // The pipe holds every length, so they are read once the writer is gone
+    Writer writer = { commits, fresh, fds[1] };
+    int result = run_crashing(write_commits, &writer);
+    close(fds[1]);
+    int count = 0;
+    while (count <= commits && read(fds[0], &log_sizes[count], sizeof(long)) == sizeof(long)) {
+        count++;
+    }
+    close(fds[0]);
+    return (result == 0 && count == commits + 1) ? 0 : -1;
+}
+
+static void test_torn_log(long log_sizes[COMMITS + 1]) {
+    if (crash_after_commits(COMMITS, log_sizes, true) != 0) {
+        CHECK(0, "writer process failed");
+        return;
+    }
+    copy_database(DB_NAME, SAVED);
+    verify_state(DB_NAME, COMMITS, "intact log");
+
+    char what[64];
+    for (int commit = 0; commit < COMMITS; commit++) {
+        long start = log_sizes[commit];
+        long end = log_sizes[commit + 1];
+        CHECK(end > start, "commit %d did not grow the log", commit + 1);
+
+        snprintf(what, sizeof(what), "cut inside commit %d", commit + 1);
+        check_cut(DB_NAME ".wal", start + (end - start) / 2 + 7, commit, what);
+        snprintf(what, sizeof(what), "cut before the end of commit %d", commit + 1);
+        check_cut(DB_NAME ".wal", end - 1, commit, what);
+        snprintf(what, sizeof(what), "cut after commit %d", commit + 1);
+        check_cut(DB_NAME ".wal", end, commit + 1, what);
+    }
+
+    // A damaged frame ends replay at the commit before it
+    long last = log_sizes[COMMITS - 1];
+    check_damage(DB_NAME ".wal", last + (log_sizes[COMMITS] - last) / 2, COMMITS - 1,
+                 "damaged last commit");
+    check_damage(DB_NAME ".wal", log_sizes[0] + 40, 0, "damaged first commit");
+}
+
+// A busy log starts over in place under a new salt, leaving the frames of
+// the previous generation behind the new ones. Rebuild that layout from two
+// runs on the same files: the second run's one commit has the same shape
+// as the first run's first, so the older run's later commits follow it on
+// a frame boundary with the very LSNs replay expects next. Only the salt
+// keeps them out.
+static void test_stale_frames(const long old_sizes[COMMITS + 1]) {
+    copy_database(BASE, DB_NAME);
+    long log_sizes[2];
+    if (crash_after_commits(1, log_sizes, false) != 0) {
+        CHECK(0, "writer process failed");
+        return;
+    }
+    CHECK(log_sizes[1] == old_sizes[1], "the two generations do not line up");
+
+    FILE *in = fopen(SAVED ".wal", "rb");
+    FILE *out = fopen(DB_NAME ".wal", "r+b");
+    char buffer[65536];
+    size_t n;
+    if (in && out && fseek(in, log_sizes[1], SEEK_SET) == 0 && fseek(out, log_sizes[1], SEEK_SET) == 0) {
+        while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) fwrite(buffer, 1, n, out);
+    } else {
+        CHECK(0, "cannot splice the logs");
+    }
+    if (in) fclose(in);
+    if (out) fclose(out);
+
+    verify_state(DB_NAME, 1, "stale frames after a log restart");
+}
+
+// A snapshot opened before the first commit keeps the checkpointer from
+// copying any, so the first segment fills up and the log moves on to the
+// second while the first still holds commits. Recovery has to chain both;
+// damage in the first must also drop everything in the second.
+static int write_segments(void *context) {
+    int fd = *(int *)context;
+    stark_options_t options = log_only_options();
+    options.checkpoint_bytes = 16 << 10;
+    stark_db_t *db = stark_open_ex(DB_NAME, 0, &options);
+    if (!db || !stark_snapshot_open(db)) return 1;
+    for (int commit = 1; commit <= COMMITS; commit++) {
+        write_commit(db, commit);
+        long sizes[2] = { file_size(DB_NAME ".wal"), file_size(DB_NAME ".wal2") };
+        if (write(fd, sizes, sizeof(sizes)) != sizeof(sizes)) return 1;
+    }
+    return 0;
+}
+
+static void test_segments(void) {
+    remove_database(DB_NAME);
+    int fds[2];
+    if (pipe(fds) != 0) return;
+
+    // sizes[c] holds the lengths of both segments once commit c is durable
+    int result = run_crashing(write_segments, &fds[1]);
+    close(fds[1]);
+    long sizes[COMMITS + 1][2];
+    int count = 1;
+    while (count <= COMMITS && read(fds[0], sizes[count], sizeof(sizes[count])) == sizeof(sizes[count])) {
+        count++;
+    }
+    close(fds[0]);
+    if (result != 0 || count != COMMITS + 1) {
+        CHECK(0, "writer process failed");
+        return;
+    }
+
+    // The first commit that went to the second segment
+    int first = 1;
+    while (first <= COMMITS && sizes[first][1] <= 0) first++;
+    CHECK(first > 1 && first < COMMITS, "the log did not move to its second segment");
+    if (first <= 1 || first >= COMMITS) return;
+    CHECK(sizes[COMMITS][0] == sizes[first - 1][0], "the first segment changed after the switch");
+
+    copy_database(DB_NAME, SAVED);
+    verify_state(DB_NAME, COMMITS, "log across two segments");
+
+    char what[64];
+    for (int commit = first; commit < COMMITS; commit++) {
+        snprintf(what, sizeof(what), "second segment cut after commit %d", commit);
+        check_cut(DB_NAME ".wal2", sizes[commit][1], commit, what);
+        snprintf(what, sizeof(what), "second segment cut inside commit %d", commit + 1);
+        check_cut(DB_NAME ".wal2", sizes[commit][1] + 100, commit, what);
+    }
+    check_cut(DB_NAME ".wal2", 0, first - 1, "second segment lost");
+    check_damage(DB_NAME ".wal", sizes[first - 1][0] - 100, first - 2, "first segment damaged");
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    remove_database(DB_NAME);
+    remove_database(SAVED);
+    remove_database(BASE);
+
+    long log_sizes[COMMITS + 1];
+    test_torn_log(log_sizes);
+    test_stale_frames(log_sizes);
+    test_segments();
+
+    remove_database(DB_NAME);
+    remove_database(SAVED);
+    remove_database(BASE);
+    return test_result("WAL recovery");
+}
@@ -0,0 +1,150 @@
+// Batches, fetches, snapshot reads and bulk loads with 64-bit keys. Keys
+// are chosen so that pairs share their low 32 bits: a key cut to 32 bits
+// anywhere on the way, including the external sort, merges the pair and
+// loses a record.
+#include "test_util.h"
+
+#define DB_NAME "test_wide_keys_db"
+#define NUM_KEYS 4000
+#define BATCH_KEYS 100
+
+// Key n for n < NUM_KEYS; n and n + NUM_KEYS / 2 share their low 32 bits
+static uint64_t key_at(uint32_t n) {
+    uint32_t half = NUM_KEYS / 2;
+    return ((uint64_t)(1 + n / half) << 32) | (n % half);
+}
+
+static size_t make_value(char *value, size_t size, uint64_t key) {
+    return (size_t)snprintf(value, size, "v%llu", (unsigned long long)key) + 1;
+}
+
+// Hands out every key twice in a scrambled order; the second copy wins
+typedef struct {
+    uint32_t next;
+    char value[32];
+} Source;
+
+static int next_record(void *context, uint64_t *key, const void **data, size_t *size) {
+    Source *source = context;
+    if (source->next == 2 * NUM_KEYS) return 0;
+    uint32_t record = source->next++;
+    uint32_t n = record * 7919 % NUM_KEYS;
+    *key = key_at(n);
+    if (record < NUM_KEYS) {
+        *size = (size_t)snprintf(source->value, sizeof(source->value), "stale") + 1;
+    } else {
+        *size = make_value(source->value, sizeof(source->value), *key);
+    }
+    *data = source->value;
+    return 1;
+}
+
+static int holds(stark_db_t *db, uint64_t key) {
+    char value[32], expected[32];
+    size_t size = sizeof(value);
+    make_value(expected, sizeof(expected), key);
+    return stark_get64(db, key, value, &size) == STARK_OK && strcmp(value, expected) == 0;
+}
+
+int main(void) {
+    stark_set_log_level(STARK_LOG_NONE);
+    remove_database(DB_NAME);
+    stark_options_t options;
+    memset(&options, 0, sizeof(options));
+    options.key_bits = 64;
+    stark_db_t *db = stark_open_ex(DB_NAME, 0, &options);
+    CHECK(db != NULL, "cannot create the database");
+    if (!db) return 1;
+
+    // Small sort runs, so the wide keys go through run files too
+    stark_bulk_options_t bulk;
+    memset(&bulk, 0, sizeof(bulk));
+    bulk.sort_memory = 16 << 10;
+    Source source = { 0, { 0 } };
+    CHECK(stark_bulk_load64(db, next_record, &source, &bulk) == STARK_OK, "load failed");
+    uint32_t wrong = 0;
+    for (uint32_t n = 0; n < NUM_KEYS; n++) wrong += !holds(db, key_at(n));
+    CHECK(wrong == 0, "%u loaded keys do not hold their last record", wrong);
+
+    // A batch written and read back, with a missing key among the reads
+    stark_kv64_t items[BATCH_KEYS];
+    char values[BATCH_KEYS][32];
+    uint64_t keys[BATCH_KEYS + 1];
+    for (uint32_t i = 0; i < BATCH_KEYS; i++) {
+        keys[i] = ((uint64_t)7 << 32) | i;
+        items[i].key = keys[i];
+        items[i].value = values[i];
+        items[i].value_size = make_value(values[i], sizeof(values[i]), keys[i]);
+    }
+    keys[BATCH_KEYS] = (uint64_t)9 << 32;
+    CHECK(stark_put_batch64(db, items, BATCH_KEYS) == STARK_OK, "batch write failed");
+
+    static char buffer[BATCH_KEYS * 32];
+    stark_get_result_t results[BATCH_KEYS + 1];
+    CHECK(stark_get_batch64(db, keys, BATCH_KEYS + 1, buffer, sizeof(buffer), results) == STARK_OK,
+          "batch read failed");
+    wrong = 0;
+    for (uint32_t i = 0; i < BATCH_KEYS; i++) {
+        wrong += results[i].status != STARK_OK ||
+                 strcmp(buffer + results[i].value_offset, values[i]) != 0;
+    }
+    CHECK(wrong == 0, "%u batch keys read back wrong", wrong);
+    CHECK(results[BATCH_KEYS].status == STARK_NOT_FOUND, "found a key never written");
+
+    // The snapshot reads a wide key and not its 32-bit namesake
+    stark_snapshot_t *snapshot = stark_snapshot_open(db);
+    CHECK(snapshot != NULL, "cannot open a snapshot");
+    if (snapshot) {
+        char value[32], expected[32];
+        size_t size = sizeof(value);
+        make_value(expected, sizeof(expected), keys[5]);
+        CHECK(stark_snapshot_get64(snapshot, keys[5], value, &size) == STARK_OK &&
+              strcmp(value, expected) == 0, "the snapshot misses a wide key");
+        size = sizeof(value);
+        CHECK(stark_snapshot_get(snapshot, 5, value, &size) == STARK_NOT_FOUND,
+              "the snapshot found a wide key by its low bits");
+        stark_snapshot_close(snapshot);
+    }
+
+    // A 64-bit fetch walks every key; a 32-bit one stops at the first wide key
+    stark_cursor_t *cursor = stark_cursor_create(db);
+    stark_entry64_t entries[64];
+    uint32_t count = 0;
+    uint64_t previous = 0;
+    size_t fetched;
+    CHECK(stark_cursor_first(cursor) == STARK_OK, "cannot position the cursor");
+    while (stark_cursor_fetch64(cursor, entries, 64, NULL, 0, &fetched) == STARK_OK) {
+        for (size_t i = 0; i < fetched; i++) {
+            CHECK(count == 0 || entries[i].key > previous, "fetched %llu after %llu",
+                  (unsigned long long)entries[i].key, (unsigned long long)previous);
+            previous = entries[i].key;
+            count++;
+        }
+    }
+    CHECK(count == NUM_KEYS + BATCH_KEYS, "fetched %u keys, expected %u", count,
+          NUM_KEYS + BATCH_KEYS);
+    stark_entry_t narrow[4];
+    CHECK(stark_cursor_first(cursor) == STARK_OK, "cannot position the cursor");
+    CHECK(stark_cursor_fetch(cursor, narrow, 4, NULL, 0, &fetched) == STARK_ERROR,
+          "a 32-bit fetch returned a wide key");
+    stark_cursor_destroy(cursor);
+    stark_close(db);
+    remove_database(DB_NAME);
+
+    // A 32-bit database refuses wide keys without writing anything
+    db = stark_open(DB_NAME, 0);
+    CHECK(db != NULL, "cannot create the 32-bit database");
+    if (db) {
+        items[0].key = 3;
+        CHECK(stark_put_batch64(db, items, 2) == STARK_INVALID_ARG,
+              "a 32-bit database took a wide batch key");
+        CHECK(!stark_exists64(db, 3), "a refused batch was partly written");
+        source.next = 0;
+        CHECK(stark_bulk_load64(db, next_record, &source, NULL) == STARK_ERROR,
+              "a 32-bit database loaded wide keys");
+        stark_close(db);
+    }
+
+    remove_database(DB_NAME);
+    return test_result("Wide keys");
+}